@@ -0,0 +1,135 @@
+/*
+ * jbench - the parser context against the older parser
+ *
+ *  cc -O2 -I.. -o jbench jbench.c oldjparser.c files.c ../jparser.c ../json.c
+ *  ./jbench [-n iterations] [file]
+ *
+ * Without a file, a broadcast message and a configuration like document are
+ * made up. The documents are compact and the strings have no blanks.. the
+ * older parser does not take anything else.
+ *
+ *   old       old_init_parse() + old_parse_value() + free_value()
+ *   full      jparser_parse() + jparser_reset()
+ *   query     jparser_query() of one property + jparser_reset()
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "../jparser.h"
+#include "files.h"
+
+void old_init_parse(char *str);
+int old_parse_value();
+JSONValue *old_get_value();
+
+static double now()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static char *make_config(int n)
+{
+    char *buf = (char *)malloc(n * 200 + 64);
+    int i, len;
+
+    len = sprintf(buf, "{");
+    for (i = 0; i < n; i++)
+        len += sprintf(buf + len, "%s\"node%d\":{\"id\":%d,\"name\":\"device-%d\",\"rate\":%d.%d,"
+                       "\"on\":%s,\"tags\":[\"a%d\",\"b%d\",%d]}",
+                       i ? "," : "", i, i, i, i * 3, i % 10, i % 2 ? "true" : "false", i, i, i);
+    len += sprintf(buf + len, ",\"last\":\"done\"}");
+    return buf;
+}
+
+static void run(char *title, char *doc, int n, char *key)
+{
+    jparser_t *jp = jparser_new();
+    double t0, told, tfull, tquery = 0;
+    int i, len = strlen(doc);
+
+    t0 = now();
+    for (i = 0; i < n; i++)
+    {
+        old_init_parse(doc);
+        if (old_parse_value() == ERROR)
+        {
+            printf("ERROR! Old parser failed on %s\n", title);
+            break;
+        }
+        free_value(old_get_value(), 1);
+    }
+    told = now() - t0;
+
+    t0 = now();
+    for (i = 0; i < n; i++)
+    {
+        if (jparser_parse(jp, doc, len) == NULL)
+        {
+            printf("ERROR! Parser failed on %s at %d\n", title, jp->error);
+            break;
+        }
+        jparser_reset(jp);
+    }
+    tfull = now() - t0;
+
+    if (key != NULL)
+    {
+        t0 = now();
+        for (i = 0; i < n; i++)
+        {
+            if (jparser_query(jp, doc, len, "s", key) == NULL)
+            {
+                printf("ERROR! Query for %s failed on %s\n", key, title);
+                break;
+            }
+            jparser_reset(jp);
+        }
+        tquery = now() - t0;
+    }
+
+    printf("%-10s %7d bytes   old %9.2f us   full %9.2f us (%4.1fx)",
+           title, len, told / n, tfull / n, told / tfull);
+    if (key != NULL)
+        printf("   query(%s) %9.2f us (%4.1fx)", key, tquery / n, told / tquery);
+    printf("\n");
+
+    jparser_free(jp);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = 20000, i = 1, fsize;
+    char *doc;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0)
+    {
+        n = atoi(argv[2]);
+        i = 3;
+    }
+
+    if (i < argc)
+    {
+        if (read_file_to_buffer(argv[i], &doc, &fsize) < 0)
+            return 1;
+        run(argv[i], doc, n, NULL);
+        free(doc);
+        return 0;
+    }
+
+    run("bcast", "{\"counter\":1042,\"message\":\"temperature-22.5\",\"origin\":\"fog-3\"}", n * 10, "message");
+
+    doc = make_config(10);
+    run("config10", doc, n, "last");
+    free(doc);
+
+    doc = make_config(200);
+    run("config200", doc, n / 10, "last");
+    free(doc);
+
+    return 0;
+}
@@ -16,6 +16,7 @@
         "print.c",
         "qlock.c",
         "rendez.c",
+        "stack.c",
         "task.c"
       ]
     }
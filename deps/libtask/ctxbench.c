@@ -0,0 +1,65 @@
+/* Context switch benchmark: tasks ping-pong with taskyield */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <task.h>
+
+enum { STACK = 32768 };
+
+int nyield = 1000000;
+int ntask = 2;
+int done;
+int nyields;
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+void
+yieldtask(void *v)
+{
+	int i;
+
+	for(i=0; i<nyield; i++){
+		taskyield();
+		nyields++;
+	}
+	done++;
+}
+
+void
+taskmain(int argc, char **argv)
+{
+	int i, nsw;
+	double t0, t;
+
+	if(argc > 1)
+		nyield = atoi(argv[1]);
+	if(argc > 2)
+		ntask = atoi(argv[2]);
+	if(ntask < 1)
+		ntask = 1;
+
+	for(i=0; i<ntask; i++)
+		taskcreate(yieldtask, 0, STACK);
+
+	t0 = now();
+	while(done < ntask){
+		taskyield();
+		nyields++;
+	}
+	t = now() - t0;
+	nsw = 2*nyields;
+
+	/* every yield is two switches: into the scheduler and out */
+	printf("%d tasks, %d yields each: %.3f s, %d switches, %.1f ns/switch\n",
+		ntask, nyield, t, nsw, t*1e9/nsw);
+	taskexitall(0);
+}
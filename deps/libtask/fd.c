@@ -14,6 +14,8 @@ static int startedfdtask;
 static Tasklist sleeping;
 static int sleepingcounted;
 static uvlong nsec(void);
+static void unsleep(Task*);
+static void unpoll(Task*);
 
 
 void
@@ -56,7 +58,13 @@ fdtask(void *v)
 		/* wake up the guys who deserve it */
 		for(i=0; i<npollfd; i++){
 			while(i < npollfd && pollfd[i].revents){
-				taskready(polltask[i]);
+				t = polltask[i];
+				if(t->fdtimed){
+					/* ready before the alarm - take it off the sleeping list */
+					t->fdready = 1;
+					unsleep(t);
+				}
+				taskready(t);
 				--npollfd;
 				pollfd[i] = pollfd[npollfd];
 				polltask[i] = polltask[npollfd];
@@ -68,24 +76,18 @@ fdtask(void *v)
 			deltask(&sleeping, t);
 			if(!t->system && --sleepingcounted == 0)
 				taskcount--;
+			if(t->fdtimed)
+				unpoll(t);
 			taskready(t);
 		}
 	}
 }
 
-uint
-taskdelay(uint ms)
+static void
+addsleep(uvlong when)
 {
-	uvlong when, now;
 	Task *t;
 
-	if(!startedfdtask){
-		startedfdtask = 1;
-		taskcreate(fdtask, 0, 32768);
-	}
-
-	now = nsec();
-	when = now+(uvlong)ms*1000000;
 	for(t=sleeping.head; t!=nil && t->alarmtime < when; t=t->next)
 		;
 
@@ -110,13 +112,50 @@ taskdelay(uint ms)
 
 	if(!t->system && sleepingcounted++ == 0)
 		taskcount++;
+}
+
+static void
+unsleep(Task *t)
+{
+	deltask(&sleeping, t);
+	if(!t->system && --sleepingcounted == 0)
+		taskcount--;
+}
+
+static void
+unpoll(Task *t)
+{
+	int i;
+
+	for(i=0; i<npollfd; i++){
+		if(polltask[i] == t){
+			--npollfd;
+			pollfd[i] = pollfd[npollfd];
+			polltask[i] = polltask[npollfd];
+			return;
+		}
+	}
+}
+
+uint
+taskdelay(uint ms)
+{
+	uvlong now;
+
+	if(!startedfdtask){
+		startedfdtask = 1;
+		taskcreate(fdtask, 0, 32768);
+	}
+
+	now = nsec();
+	addsleep(now+(uvlong)ms*1000000);
 	taskswitch();
 
 	return (nsec() - now)/1000000;
 }
 
-void
-fdwait(int fd, int rw)
+static void
+addpoll(int fd, int rw)
 {
 	int bits;
 
@@ -146,9 +185,36 @@ fdwait(int fd, int rw)
 	pollfd[npollfd].events = bits;
 	pollfd[npollfd].revents = 0;
 	npollfd++;
+}
+
+void
+fdwait(int fd, int rw)
+{
+	addpoll(fd, rw);
 	taskswitch();
 }
 
+/*
+ * Like fdwait but gives up after ms milliseconds.
+ * Returns 1 if fd is ready and 0 if the time ran out.
+ */
+int
+fdtimedwait(int fd, int rw, uint ms)
+{
+	Task *t;
+
+	addpoll(fd, rw);
+	addsleep(nsec()+(uvlong)ms*1000000);
+
+	t = taskrunning;
+	t->fdtimed = 1;
+	t->fdready = 0;
+	taskswitch();
+	t->fdtimed = 0;
+
+	return t->fdready;
+}
+
 /* Like fdread but always calls fdwait before reading. */
 int
 fdread1(int fd, void *buf, int n)
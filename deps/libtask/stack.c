@@ -0,0 +1,141 @@
+#include "taskimpl.h"
+#include <sys/mman.h>
+
+/*
+ * Task stacks. Each task (the Task and its stack) is one mmap'd block
+ * with an inaccessible guard page at the bottom, so running off the
+ * stack faults instead of writing over the heap. Blocks come in power
+ * of two size classes; the block of an exited task is kept on the list
+ * of its class and given to the next task of that class. Blocks larger
+ * than the biggest class are unmapped when the task exits.
+ *
+ * Tasks are created and freed by the scheduler thread only.. there is
+ * no locking.
+ */
+
+enum
+{
+	STACKMINSHIFT = 14,		/* 16K */
+	STACKNCLASS = 7,		/* .. up to 1M */
+	STACKNCACHE = 64		/* blocks kept per class */
+};
+
+static Task	*stackfree[STACKNCLASS];
+static int	stacknfree[STACKNCLASS];
+static ulong	pagesize;
+
+static int
+stackclass(ulong n)
+{
+	int c;
+
+	for(c=0; c<STACKNCLASS; c++)
+		if(n <= (1UL<<(STACKMINSHIFT+c)))
+			return c;
+	return -1;
+}
+
+/* The Task sits at the top of the block, the stack grows down from it */
+static Task*
+stackinit(uchar *base, ulong size)
+{
+	Task *t;
+
+	t = (Task*)(((uintptr_t)(base+size-sizeof *t)) & ~(uintptr_t)15);
+	memset(t, 0, sizeof *t);
+	t->mapsize = size;
+	t->stk = base+pagesize;
+	t->stksize = (uchar*)t - t->stk;
+	return t;
+}
+
+Task*
+taskstackalloc(uint stack)
+{
+	Task *t;
+	uchar *base;
+	ulong size;
+	int c;
+
+	if(pagesize == 0)
+		pagesize = sysconf(_SC_PAGESIZE);
+
+	size = stack + sizeof *t + pagesize + 16;
+	c = stackclass(size);
+	if(c >= 0){
+		size = 1UL<<(STACKMINSHIFT+c);
+		if((t = stackfree[c]) != nil){
+			stackfree[c] = t->next;
+			stacknfree[c]--;
+			return stackinit(t->stk-pagesize, size);
+		}
+	}else
+		size = (size+pagesize-1) & ~(pagesize-1);
+
+	base = mmap(nil, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+	if(base == MAP_FAILED){
+		fprint(2, "taskalloc mmap: %r\n");
+		abort();
+	}
+	if(mprotect(base, pagesize, PROT_NONE) < 0){
+		fprint(2, "taskalloc mprotect: %r\n");
+		abort();
+	}
+	return stackinit(base, size);
+}
+
+void
+taskstackfree(Task *t)
+{
+	int c;
+
+	c = stackclass(t->mapsize);
+	if(c >= 0 && t->mapsize == (1UL<<(STACKMINSHIFT+c)) && stacknfree[c] < STACKNCACHE){
+		t->next = stackfree[c];
+		stackfree[c] = t;
+		stacknfree[c]++;
+		return;
+	}
+	munmap(t->stk-pagesize, t->mapsize);
+}
+
+/*
+ * A fault in the guard page of the running task is a stack overflow.
+ * The handler runs on its own stack (the task's is used up), says which
+ * task it was and lets the fault happen again with the default action.
+ */
+static void
+stackfault(int s, siginfo_t *si, void *v)
+{
+	Task *t;
+	uchar *a;
+
+	t = taskrunning;
+	a = si->si_addr;
+	if(t != nil && a >= t->stk-pagesize && a < t->stk)
+		fprint(2, "task stack overflow: task %d (%s) stack %d\n", t->id, t->name, t->stksize);
+}
+
+void
+taskstackguard(void)
+{
+	static uchar altstack[64*1024];
+	struct sigaction sa;
+	stack_t ss;
+
+	if(pagesize == 0)
+		pagesize = sysconf(_SC_PAGESIZE);
+
+	memset(&ss, 0, sizeof ss);
+	ss.ss_sp = altstack;
+	ss.ss_size = sizeof altstack;
+	if(sigaltstack(&ss, nil) < 0)
+		return;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_sigaction = stackfault;
+	sa.sa_flags = SA_SIGINFO|SA_ONSTACK|SA_RESETHAND;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGSEGV, &sa, nil);
+	sigaction(SIGBUS, &sa, nil);
+}
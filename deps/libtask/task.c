@@ -55,6 +55,14 @@ return;
 		fprint(fd, "%d._: %s\n", getpid(), buf);
 }
 
+#if USE_FASTCONTEXT
+static void
+taskstart(Task *t)
+{
+	t->startfn(t->startarg);
+	taskexit(0);
+}
+#else
 static void
 taskstart(uint y, uint x)
 {
@@ -72,6 +80,7 @@ taskstart(uint y, uint x)
 	taskexit(0);
 //print("not reacehd\n");
 }
+#endif
 
 static int taskidgen;
 
@@ -79,23 +88,44 @@ static Task*
 taskalloc(void (*fn)(void*), void *arg, uint stack)
 {
 	Task *t;
+#if USE_FASTCONTEXT
+	uintptr_t *sp;
+#else
 	sigset_t zero;
 	uint x, y;
 	ulong z;
+#endif
 
-	/* allocate the task and stack together */
-	t = malloc(sizeof *t+stack);
-	if(t == nil){
-		fprint(2, "taskalloc malloc: %r\n");
-		abort();
-	}
-	memset(t, 0, sizeof *t);
-	t->stk = (uchar*)(t+1);
-	t->stksize = stack;
+	/* the task and its stack come from the stack pool */
+	t = taskstackalloc(stack);
 	t->id = ++taskidgen;
 	t->startfn = fn;
 	t->startarg = arg;
 
+#if USE_FASTCONTEXT
+	/*
+	 * Build the frame taskswapctx pops: the first switch to the task
+	 * "returns" into taskstartctx, which calls taskstart(t).
+	 * Leave a few words open at the top, as below.
+	 */
+	sp = (uintptr_t*)(((uintptr_t)(t->stk+t->stksize-64)) & ~(uintptr_t)15);
+#if defined(__x86_64__)
+	sp -= 8;
+	memset(sp, 0, 8*sizeof sp[0]);
+	sp[0] = 0x1f80 | ((uintptr_t)0x037f<<32);	/* default mxcsr, x87 control word */
+	sp[4] = (uintptr_t)t;				/* %r12 */
+	sp[5] = (uintptr_t)taskstart;		/* %rbx */
+	sp[7] = (uintptr_t)taskstartctx;	/* return address */
+#elif defined(__aarch64__)
+	sp -= 22;
+	memset(sp, 0, 22*sizeof sp[0]);
+	sp[0] = (uintptr_t)taskstart;		/* x19 */
+	sp[1] = (uintptr_t)t;				/* x20 */
+	sp[11] = (uintptr_t)taskstartctx;	/* x30 */
+#endif
+	t->context.sp = sp;
+	return t;
+#else
 	/* do a reasonable initialization */
 	memset(&t->context.uc, 0, sizeof t->context.uc);
 	sigemptyset(&zero);
@@ -131,6 +161,7 @@ taskalloc(void (*fn)(void*), void *arg, uint stack)
 	makecontext(&t->context.uc, (void(*)())taskstart, 2, y, x);
 
 	return t;
+#endif
 }
 
 int
@@ -213,10 +244,14 @@ taskexit(int val)
 static void
 contextswitch(Context *from, Context *to)
 {
+#if USE_FASTCONTEXT
+	taskswapctx(&from->sp, to->sp);
+#else
 	if(swapcontext(&from->uc, &to->uc) < 0){
 		fprint(2, "swapcontext failed: %r\n");
 		assert(0);
 	}
+#endif
 }
 
 static void
@@ -248,7 +283,7 @@ taskscheduler(void)
 			i = t->alltaskslot;
 			alltask[i] = alltask[--nalltask];
 			alltask[i]->alltaskslot = i;
-			free(t);
+			taskstackfree(t);
 		}
 	}
 }
@@ -363,6 +398,8 @@ main(int argc, char **argv)
 	sigaction(SIGINFO, &sa, &osa);
 #endif
 
+	taskstackguard();
+
 	argv0 = argv[0];
 	taskargc = argc;
 	taskargv = argv;
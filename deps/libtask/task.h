@@ -156,6 +156,7 @@ int		fdread(int, void*, int);
 int		fdread1(int, void*, int);	/* always uses fdwait */
 int		fdwrite(int, void*, int);
 void		fdwait(int, int);
+int		fdtimedwait(int, int, unsigned int);	/* 1 if ready, 0 on timeout */
 int		fdnoblock(int);
 
 void		fdtask(void*);
@@ -16,6 +16,17 @@
 #define USE_UCONTEXT 0
 #endif
 
+/*
+ * Linux on x86_64 and aarch64 switches with taskswapctx (asm.S), which
+ * saves only the callee-saved registers on the task stack. swapcontext
+ * also saves and restores the signal mask.. a system call per switch.
+ */
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define USE_FASTCONTEXT 1
+#else
+#define USE_FASTCONTEXT 0
+#endif
+
 #if defined(__APPLE__)
 #include <AvailabilityMacros.h>
 #if defined(MAC_OS_X_VERSION_10_5)
@@ -147,9 +158,18 @@ enum
 
 struct Context
 {
+#if USE_FASTCONTEXT
+	void	*sp;	/* saved registers are on the stack below sp */
+#else
 	ucontext_t	uc;
+#endif
 };
 
+#if USE_FASTCONTEXT
+void taskswapctx(void **from, void *to);
+void taskstartctx(void);
+#endif
+
 struct Task
 {
 	char	name[256];	// offset known to acid
@@ -163,10 +183,13 @@ struct Task
 	uint	id;
 	uchar	*stk;
 	uint	stksize;
+	ulong	mapsize;	/* block holding the Task and stack (stack.c) */
 	int	exiting;
 	int	alltaskslot;
 	int	system;
 	int	ready;
+	int	fdtimed;	/* in both pollfd[] and sleeping (fdtimedwait) */
+	int	fdready;
 	void	(*startfn)(void*);
 	void	*startarg;
 	void	*udata;
@@ -178,5 +201,9 @@ void	taskswitch(void);
 void	addtask(Tasklist*, Task*);
 void	deltask(Tasklist*, Task*);
 
+Task*	taskstackalloc(uint);
+void	taskstackfree(Task*);
+void	taskstackguard(void);
+
 extern Task	*taskrunning;
 extern int	taskcount;
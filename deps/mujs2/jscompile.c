@@ -55,7 +55,7 @@ static js_Function *newfun(js_State *J, js_Ast *name, js_Ast *params, js_Ast *bo
 {
 	js_Function *F = js_malloc(J, sizeof *F);
 	memset(F, 0, sizeof *F);
-	F->gcmark = 0;
+	F->gcmark = J->gcmark;
 	F->gcnext = J->gcfun;
 	J->gcfun = F;
 	++J->gccounter;
@@ -5,7 +5,7 @@
 
 #include "regexp.h"
 
-static void jsG_markobject(js_State *J, int mark, js_Object *obj);
+#include <sys/time.h>
 
 static void jsG_freeenvironment(js_State *J, js_Environment *env)
 {
@@ -53,6 +53,32 @@ static void jsG_freeobject(js_State *J, js_Object *obj)
 	js_free(J, obj);
 }
 
+/*
+ * Marking is tri-color. An object is white if its gcmark is not the mark
+ * of the cycle, gray if it is marked and still on the gray stack, and black
+ * once its children are marked. Environments, functions and strings have
+ * no objects of their own to wait for, so they go straight to black.
+ *
+ * In incremental mode the mutator runs between mark steps. The roots are
+ * marked at the start of the cycle and the write barrier (jsG_barrier)
+ * marks a value before it is overwritten or deleted, so everything that
+ * was reachable at the start gets marked (snapshot at the beginning).
+ * Allocations take the mark of the cycle and are black.
+ */
+
+static void jsG_shade(js_State *J, int mark, js_Object *obj)
+{
+	if (obj->gcmark == mark)
+		return;
+	obj->gcmark = mark;
+	if (J->gcgraylen == J->gcgraycap) {
+		int cap = J->gcgraycap ? J->gcgraycap * 2 : 256;
+		J->gcgray = js_realloc(J, J->gcgray, cap * sizeof *J->gcgray);
+		J->gcgraycap = cap;
+	}
+	J->gcgray[J->gcgraylen++] = obj;
+}
+
 static void jsG_markfunction(js_State *J, int mark, js_Function *fun)
 {
 	int i;
@@ -66,36 +92,40 @@ static void jsG_markenvironment(js_State *J, int mark, js_Environment *env)
 {
 	do {
 		env->gcmark = mark;
-		if (env->variables->gcmark != mark)
-			jsG_markobject(J, mark, env->variables);
+		jsG_shade(J, mark, env->variables);
 		env = env->outer;
 	} while (env && env->gcmark != mark);
 }
 
+static void jsG_markvalue(js_State *J, int mark, js_Value *v)
+{
+	if (v->type == JS_TMEMSTR)
+		v->u.memstr->gcmark = mark;
+	if (v->type == JS_TOBJECT)
+		jsG_shade(J, mark, v->u.object);
+}
+
 static void jsG_markproperty(js_State *J, int mark, js_Property *node)
 {
 	if (node->left->level) jsG_markproperty(J, mark, node->left);
 	if (node->right->level) jsG_markproperty(J, mark, node->right);
 
-	if (node->value.type == JS_TMEMSTR && node->value.u.memstr->gcmark != mark)
-		node->value.u.memstr->gcmark = mark;
-	if (node->value.type == JS_TOBJECT && node->value.u.object->gcmark != mark)
-		jsG_markobject(J, mark, node->value.u.object);
-	if (node->getter && node->getter->gcmark != mark)
-		jsG_markobject(J, mark, node->getter);
-	if (node->setter && node->setter->gcmark != mark)
-		jsG_markobject(J, mark, node->setter);
+	jsG_markvalue(J, mark, &node->value);
+	if (node->getter)
+		jsG_shade(J, mark, node->getter);
+	if (node->setter)
+		jsG_shade(J, mark, node->setter);
 }
 
-static void jsG_markobject(js_State *J, int mark, js_Object *obj)
+/* Mark the children of a gray object */
+static void jsG_scanobject(js_State *J, int mark, js_Object *obj)
 {
-	obj->gcmark = mark;
 	if (obj->properties->level)
 		jsG_markproperty(J, mark, obj->properties);
-	if (obj->prototype && obj->prototype->gcmark != mark)
-		jsG_markobject(J, mark, obj->prototype);
+	if (obj->prototype)
+		jsG_shade(J, mark, obj->prototype);
 	if (obj->type == JS_CITERATOR) {
-		jsG_markobject(J, mark, obj->u.iter.target);
+		jsG_shade(J, mark, obj->u.iter.target);
 	}
 	if (obj->type == JS_CFUNCTION || obj->type == JS_CSCRIPT) {
 		if (obj->u.f.scope && obj->u.f.scope->gcmark != mark)
@@ -109,47 +139,56 @@ static void jsG_markstack(js_State *J, int mark)
 {
 	js_Value *v = J->stack;
 	int n = J->top;
-	while (n--) {
-		if (v->type == JS_TMEMSTR && v->u.memstr->gcmark != mark)
-			v->u.memstr->gcmark = mark;
-		if (v->type == JS_TOBJECT && v->u.object->gcmark != mark)
-			jsG_markobject(J, mark, v->u.object);
-		++v;
-	}
+	while (n--)
+		jsG_markvalue(J, mark, v++);
 }
 
-void js_gc(js_State *J, int report)
+void jsG_shadevalue(js_State *J, js_Value *v)
+{
+	jsG_markvalue(J, J->gcmark, v);
+}
+
+void jsG_shadeobject(js_State *J, js_Object *obj)
+{
+	if (obj)
+		jsG_shade(J, J->gcmark, obj);
+}
+
+static double jsG_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+/* Start a cycle: mark the roots gray */
+static void jsG_markroots(js_State *J)
 {
-	js_Function *fun, *nextfun, **prevnextfun;
-	js_Object *obj, *nextobj, **prevnextobj;
-	js_String *str, *nextstr, **prevnextstr;
-	js_Environment *env, *nextenv, **prevnextenv;
-	int nenv = 0, nfun = 0, nobj = 0, nstr = 0;
-	int genv = 0, gfun = 0, gobj = 0, gstr = 0;
 	int mark;
 	int i;
 
 	mark = J->gcmark = J->gcmark == 1 ? 2 : 1;
+	J->gcgraylen = 0;
+
+	jsG_shade(J, mark, J->Object_prototype);
+	jsG_shade(J, mark, J->Array_prototype);
+	jsG_shade(J, mark, J->Function_prototype);
+	jsG_shade(J, mark, J->Boolean_prototype);
+	jsG_shade(J, mark, J->Number_prototype);
+	jsG_shade(J, mark, J->String_prototype);
+	jsG_shade(J, mark, J->RegExp_prototype);
+	jsG_shade(J, mark, J->Date_prototype);
 
-	jsG_markobject(J, mark, J->Object_prototype);
-	jsG_markobject(J, mark, J->Array_prototype);
-	jsG_markobject(J, mark, J->Function_prototype);
-	jsG_markobject(J, mark, J->Boolean_prototype);
-	jsG_markobject(J, mark, J->Number_prototype);
-	jsG_markobject(J, mark, J->String_prototype);
-	jsG_markobject(J, mark, J->RegExp_prototype);
-	jsG_markobject(J, mark, J->Date_prototype);
-
-	jsG_markobject(J, mark, J->Error_prototype);
-	jsG_markobject(J, mark, J->EvalError_prototype);
-	jsG_markobject(J, mark, J->RangeError_prototype);
-	jsG_markobject(J, mark, J->ReferenceError_prototype);
-	jsG_markobject(J, mark, J->SyntaxError_prototype);
-	jsG_markobject(J, mark, J->TypeError_prototype);
-	jsG_markobject(J, mark, J->URIError_prototype);
-
-	jsG_markobject(J, mark, J->R);
-	jsG_markobject(J, mark, J->G);
+	jsG_shade(J, mark, J->Error_prototype);
+	jsG_shade(J, mark, J->EvalError_prototype);
+	jsG_shade(J, mark, J->RangeError_prototype);
+	jsG_shade(J, mark, J->ReferenceError_prototype);
+	jsG_shade(J, mark, J->SyntaxError_prototype);
+	jsG_shade(J, mark, J->TypeError_prototype);
+	jsG_shade(J, mark, J->URIError_prototype);
+
+	jsG_shade(J, mark, J->R);
+	jsG_shade(J, mark, J->G);
 
 	jsG_markstack(J, mark);
 
@@ -158,66 +197,203 @@ void js_gc(js_State *J, int report)
 	for (i = 0; i < J->envtop; ++i)
 		jsG_markenvironment(J, mark, J->envstack[i]);
 
-	prevnextenv = &J->gcenv;
-	for (env = J->gcenv; env; env = nextenv) {
-		nextenv = env->gcnext;
+	J->gcstate = JS_GCMARK;
+}
+
+static void jsG_startsweep(js_State *J)
+{
+	int i;
+
+	/* Whatever is white now is unreachable and stays so. New allocations
+	 * are black, so the sweep can be spread out too. */
+	J->gcstate = JS_GCSWEEP;
+	J->gcsweepenv = &J->gcenv;
+	J->gcsweepfun = &J->gcfun;
+	J->gcsweepobj = &J->gcobj;
+	J->gcsweepstr = &J->gcstr;
+	for (i = 0; i < 4; ++i)
+		J->gcseen[i] = J->gcfreed[i] = 0;
+}
+
+/* Budget check: every 64 units of work after the minimum, look at the
+ * clock. budget < 0 is no limit. */
+#define JSG_CHECKBUDGET() \
+	if (budget >= 0 && ++n >= minwork && (n & 63) == 0 && jsG_now() - start >= budget) \
+		return 0
+
+static int jsG_mark(js_State *J, int budget, int minwork, double start)
+{
+	int mark = J->gcmark;
+	int n = 0;
+
+	while (J->gcgraylen > 0) {
+		jsG_scanobject(J, mark, J->gcgray[--J->gcgraylen]);
+		JSG_CHECKBUDGET();
+	}
+	jsG_startsweep(J);
+	return 1;
+}
+
+/* Returns 1 when the cycle is complete */
+static int jsG_sweep(js_State *J, int budget, int minwork, double start)
+{
+	js_Environment *env;
+	js_Function *fun;
+	js_Object *obj;
+	js_String *str;
+	int mark = J->gcmark;
+	int n = 0;
+
+	while ((env = *J->gcsweepenv)) {
 		if (env->gcmark != mark) {
-			*prevnextenv = nextenv;
+			*J->gcsweepenv = env->gcnext;
 			jsG_freeenvironment(J, env);
-			++genv;
+			++J->gcfreed[0];
 		} else {
-			prevnextenv = &env->gcnext;
+			J->gcsweepenv = &env->gcnext;
 		}
-		++nenv;
+		++J->gcseen[0];
+		JSG_CHECKBUDGET();
 	}
 
-	prevnextfun = &J->gcfun;
-	for (fun = J->gcfun; fun; fun = nextfun) {
-		nextfun = fun->gcnext;
+	while ((fun = *J->gcsweepfun)) {
 		if (fun->gcmark != mark) {
-			*prevnextfun = nextfun;
+			*J->gcsweepfun = fun->gcnext;
 			jsG_freefunction(J, fun);
-			++gfun;
+			++J->gcfreed[1];
 		} else {
-			prevnextfun = &fun->gcnext;
+			J->gcsweepfun = &fun->gcnext;
 		}
-		++nfun;
+		++J->gcseen[1];
+		JSG_CHECKBUDGET();
 	}
 
-	prevnextobj = &J->gcobj;
-	for (obj = J->gcobj; obj; obj = nextobj) {
-		nextobj = obj->gcnext;
+	while ((obj = *J->gcsweepobj)) {
 		if (obj->gcmark != mark) {
-			*prevnextobj = nextobj;
+			*J->gcsweepobj = obj->gcnext;
 			jsG_freeobject(J, obj);
-			++gobj;
+			++J->gcfreed[2];
 		} else {
-			prevnextobj = &obj->gcnext;
+			J->gcsweepobj = &obj->gcnext;
 		}
-		++nobj;
+		++J->gcseen[2];
+		JSG_CHECKBUDGET();
 	}
 
-	prevnextstr = &J->gcstr;
-	for (str = J->gcstr; str; str = nextstr) {
-		nextstr = str->gcnext;
+	while ((str = *J->gcsweepstr)) {
 		if (str->gcmark != mark) {
-			*prevnextstr = nextstr;
+			*J->gcsweepstr = str->gcnext;
 			js_free(J, str);
-			++gstr;
+			++J->gcfreed[3];
 		} else {
-			prevnextstr = &str->gcnext;
+			J->gcsweepstr = &str->gcnext;
 		}
-		++nstr;
+		++J->gcseen[3];
+		JSG_CHECKBUDGET();
 	}
 
+	J->gcstate = JS_GCIDLE;
+	J->gcstats.collections++;
+	J->gcstats.freed += J->gcfreed[0] + J->gcfreed[1] + J->gcfreed[2] + J->gcfreed[3];
+	J->gcstats.envs = J->gcseen[0] - J->gcfreed[0];
+	J->gcstats.funs = J->gcseen[1] - J->gcfreed[1];
+	J->gcstats.objs = J->gcseen[2] - J->gcfreed[2];
+	J->gcstats.strs = J->gcseen[3] - J->gcfreed[3];
+	return 1;
+}
+
+#undef JSG_CHECKBUDGET
+
+/* Run the cycle in progress (or a new one) within the budget */
+static int jsG_run(js_State *J, int budget, int minwork, double start)
+{
+	if (J->gcstate == JS_GCIDLE)
+		jsG_markroots(J);
+	if (J->gcstate == JS_GCMARK)
+		if (!jsG_mark(J, budget, minwork, start))
+			return 0;
+	return jsG_sweep(J, budget, minwork, start);
+}
+
+static void jsG_pause(js_State *J, double start)
+{
+	double t = jsG_now() - start;
+	J->gcstats.steps++;
+	J->gcstats.lastpause = t;
+	J->gcstats.totaltime += t;
+	if (t > J->gcstats.maxpause)
+		J->gcstats.maxpause = t;
+}
+
+static void jsG_count(js_State *J)
+{
+	J->gcstats.allocations += J->gccounter;
+	J->gccounter = 0;
+}
+
+void js_gc(js_State *J, int report)
+{
+	double start = jsG_now();
+
+	jsG_count(J);
+
+	/* finish the cycle in progress before starting a new one */
+	if (J->gcstate != JS_GCIDLE)
+		jsG_run(J, -1, 0, start);
+	jsG_run(J, -1, 0, start);
+	jsG_pause(J, start);
+
 	if (report) {
 		char buf[256];
 		snprintf(buf, sizeof buf, "garbage collected: %d/%d envs, %d/%d funs, %d/%d objs, %d/%d strs",
-			genv, nenv, gfun, nfun, gobj, nobj, gstr, nstr);
+			J->gcfreed[0], J->gcseen[0], J->gcfreed[1], J->gcseen[1],
+			J->gcfreed[2], J->gcseen[2], J->gcfreed[3], J->gcseen[3]);
 		js_report(J, buf);
 	}
 }
 
+/* One step of an incremental cycle, about budget us long. Returns 1 when
+ * the cycle is complete. */
+int js_gcstep(js_State *J, int budget)
+{
+	double start = jsG_now();
+	int done;
+
+	/* At least twice the work of the allocations since the last step, so
+	 * the cycle keeps ahead of the program even when the budget is short.
+	 * The step that starts a cycle comes after JS_GCLIMIT allocations. */
+	int minwork = 2 * (J->gccounter < JS_GCSTEP ? J->gccounter : JS_GCSTEP);
+
+	jsG_count(J);
+	done = jsG_run(J, budget, minwork, start);
+	jsG_pause(J, start);
+	return done;
+}
+
+/* Called by the interpreter when the allocation counter trips */
+void jsG_collect(js_State *J)
+{
+	if (J->gcmode == JS_GCINCREMENTAL)
+		js_gcstep(J, J->gcbudget);
+	else
+		js_gc(J, 0);
+}
+
+void js_setgcmode(js_State *J, int mode, int budget)
+{
+	/* leaving incremental mode.. finish the cycle */
+	if (mode != JS_GCINCREMENTAL && J->gcstate != JS_GCIDLE)
+		jsG_run(J, -1, 0, 0);
+	J->gcmode = mode;
+	J->gcbudget = budget;
+}
+
+void js_gcstats(js_State *J, js_GCStats *stats)
+{
+	*stats = J->gcstats;
+	stats->allocations += J->gccounter;
+}
+
 void js_freestate(js_State *J)
 {
 	js_Function *fun, *nextfun;
@@ -239,6 +415,8 @@ void js_freestate(js_State *J)
 
 	jsS_freestrings(J);
 
+	js_free(J, J->gcgray);
+
 	js_free(J, J->lexbuf.text);
 	J->alloc(J->actx, J->stack, 0);
 	J->alloc(J->actx, J, 0);
@@ -73,6 +73,14 @@ typedef struct js_StackTrace js_StackTrace;
 #define JS_ENVLIMIT 64		/* environment stack size */
 #define JS_TRYLIMIT 64		/* exception stack size */
 #define JS_GCLIMIT 10000	/* run gc cycle every N allocations */
+#define JS_GCSTEP 1000		/* incremental step every N allocations */
+
+/* Collector states */
+enum {
+	JS_GCIDLE,
+	JS_GCMARK,
+	JS_GCSWEEP,
+};
 #define JS_ASTLIMIT 100		/* max nested expressions */
 
 /* instruction size -- change to int if you get integer overflow syntax errors */
@@ -85,6 +93,8 @@ const char *js_intern(js_State *J, const char *s);
 void jsS_dumpstrings(js_State *J);
 void jsS_freestrings(js_State *J);
 
+void jsG_collect(js_State *J);
+
 /* Portable strtod and printf float formatting */
 
 void js_fmtexp(char *p, int e);
@@ -221,6 +231,20 @@ struct js_State
 	js_Object *gcobj;
 	js_String *gcstr;
 
+	/* incremental collection (JS_GCINCREMENTAL): a cycle is spread over
+	 * steps; marking works off the gray stack, sweeping has a cursor in
+	 * each list */
+	int gcmode, gcbudget;
+	int gcstate;
+	js_Object **gcgray;
+	int gcgraylen, gcgraycap;
+	js_Environment **gcsweepenv;
+	js_Function **gcsweepfun;
+	js_Object **gcsweepobj;
+	js_String **gcsweepstr;
+	int gcseen[4], gcfreed[4];	/* envs, funs, objs, strs this cycle */
+	js_GCStats gcstats;
+
 	/* environments on the call stack but currently not in scope */
 	int envtop;
 	js_Environment *envstack[JS_ENVLIMIT];
@@ -150,7 +150,7 @@ js_Object *jsV_newobject(js_State *J, enum js_Class type, js_Object *prototype)
 {
 	js_Object *obj = js_malloc(J, sizeof *obj);
 	memset(obj, 0, sizeof *obj);
-	obj->gcmark = 0;
+	obj->gcmark = J->gcmark;
 	obj->gcnext = J->gcobj;
 	J->gcobj = obj;
 	++J->gccounter;
@@ -220,6 +220,14 @@ js_Property *jsV_setproperty(js_State *J, js_Object *obj, const char *name)
 
 void jsV_delproperty(js_State *J, js_Object *obj, const char *name)
 {
+	if (J->gcstate == JS_GCMARK) {
+		js_Property *ref = lookup(obj->properties, name);
+		if (ref) {
+			jsG_barrier(J, &ref->value);
+			jsG_barrierobject(J, ref->getter);
+			jsG_barrierobject(J, ref->setter);
+		}
+	}
 	obj->properties = delete(J, obj, obj->properties, name);
 }
 
@@ -63,7 +63,7 @@ js_String *jsV_newmemstring(js_State *J, const char *s, int n)
 	js_String *v = js_malloc(J, soffsetof(js_String, p) + n + 1);
 	memcpy(v->p, s, n);
 	v->p[n] = 0;
-	v->gcmark = 0;
+	v->gcmark = J->gcmark;
 	v->gcnext = J->gcstr;
 	J->gcstr = v;
 	++J->gccounter;
@@ -602,9 +602,10 @@ static void jsR_setproperty(js_State *J, js_Object *obj, const char *name)
 		ref = jsV_setproperty(J, obj, name);
 
 	if (ref) {
-		if (!(ref->atts & JS_READONLY))
+		if (!(ref->atts & JS_READONLY)) {
+			jsG_barrier(J, &ref->value);
 			ref->value = *value;
-		else
+		} else
 			goto readonly;
 	}
 
@@ -650,21 +651,24 @@ static void jsR_defproperty(js_State *J, js_Object *obj, const char *name,
 	ref = jsV_setproperty(J, obj, name);
 	if (ref) {
 		if (value) {
-			if (!(ref->atts & JS_READONLY))
+			if (!(ref->atts & JS_READONLY)) {
+				jsG_barrier(J, &ref->value);
 				ref->value = *value;
-			else if (J->strict)
+			} else if (J->strict)
 				js_typeerror(J, "'%s' is read-only", name);
 		}
 		if (getter) {
-			if (!(ref->atts & JS_DONTCONF))
+			if (!(ref->atts & JS_DONTCONF)) {
+				jsG_barrierobject(J, ref->getter);
 				ref->getter = getter;
-			else if (J->strict)
+			} else if (J->strict)
 				js_typeerror(J, "'%s' is non-configurable", name);
 		}
 		if (setter) {
-			if (!(ref->atts & JS_DONTCONF))
+			if (!(ref->atts & JS_DONTCONF)) {
+				jsG_barrierobject(J, ref->setter);
 				ref->setter = setter;
-			else if (J->strict)
+			} else if (J->strict)
 				js_typeerror(J, "'%s' is non-configurable", name);
 		}
 		ref->atts |= atts;
@@ -836,7 +840,7 @@ const char *js_nextiterator(js_State *J, int idx)
 js_Environment *jsR_newenvironment(js_State *J, js_Object *vars, js_Environment *outer)
 {
 	js_Environment *E = js_malloc(J, sizeof *E);
-	E->gcmark = 0;
+	E->gcmark = J->gcmark;
 	E->gcnext = J->gcenv;
 	J->gcenv = E;
 	++J->gccounter;
@@ -890,8 +894,10 @@ static void js_setvar(js_State *J, const char *name)
 				js_pop(J, 1);
 				return;
 			}
-			if (!(ref->atts & JS_READONLY))
+			if (!(ref->atts & JS_READONLY)) {
+				jsG_barrier(J, &ref->value);
 				ref->value = *stackidx(J, -1);
+			}
 			else if (J->strict)
 				js_typeerror(J, "'%s' is read-only", name);
 			return;
@@ -1297,10 +1303,8 @@ static void jsR_run(js_State *J, js_Function *F)
 	J->strict = F->strict;
 
 	while (1) {
-		if (J->gccounter > JS_GCLIMIT) {
-			J->gccounter = 0;
-			js_gc(J, 0);
-		}
+		if (J->gccounter > (J->gcstate != JS_GCIDLE ? JS_GCSTEP : JS_GCLIMIT))
+			jsG_collect(J);
 
 		opcode = *pc++;
 		switch (opcode) {
@@ -178,6 +178,17 @@ const char *jsV_nextiterator(js_State *J, js_Object *iter);
 
 void jsV_resizearray(js_State *J, js_Object *obj, int newlen);
 
+/* jsgc.c */
+void jsG_shadevalue(js_State *J, js_Value *v);
+void jsG_shadeobject(js_State *J, js_Object *obj);
+
+/* Write barrier: while an incremental mark is running, a value that is
+ * about to be overwritten or deleted is marked first. */
+#define jsG_barrier(J, v) \
+	do { if ((J)->gcstate == JS_GCMARK) jsG_shadevalue(J, v); } while (0)
+#define jsG_barrierobject(J, obj) \
+	do { if ((J)->gcstate == JS_GCMARK) jsG_shadeobject(J, obj); } while (0)
+
 /* jsdump.c */
 void js_dumpobject(js_State *J, js_Object *obj);
 void js_dumpvalue(js_State *J, js_Value v);
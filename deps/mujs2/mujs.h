@@ -41,6 +41,25 @@ typedef int (*js_Put)(js_State *J, void *p, const char *name);
 typedef int (*js_Delete)(js_State *J, void *p, const char *name);
 typedef void (*js_Report)(js_State *J, const char *message);
 
+/* Garbage collector modes (js_setgcmode) */
+enum {
+	JS_GCSTOPTHEWORLD = 0,	/* mark and sweep in one go (default) */
+	JS_GCINCREMENTAL = 1,	/* mark (with a write barrier) and sweep in steps of budget us */
+};
+
+typedef struct js_GCStats js_GCStats;
+struct js_GCStats
+{
+	unsigned long allocations;	/* environments, functions, objects and strings */
+	unsigned long freed;
+	unsigned int collections;	/* completed cycles */
+	unsigned int steps;		/* pauses, a cycle takes one or more */
+	int envs, funs, objs, strs;	/* live after the last completed cycle */
+	double lastpause;		/* us */
+	double maxpause;		/* us */
+	double totaltime;		/* us */
+};
+
 /* Basic functions */
 js_State *js_newstate(js_Alloc alloc, void *actx, int flags);
 void js_setcontext(js_State *J, void *uctx);
@@ -49,6 +68,9 @@ void js_setreport(js_State *J, js_Report report);
 js_Panic js_atpanic(js_State *J, js_Panic panic);
 void js_freestate(js_State *J);
 void js_gc(js_State *J, int report);
+void js_setgcmode(js_State *J, int mode, int budget);
+int js_gcstep(js_State *J, int budget);
+void js_gcstats(js_State *J, js_GCStats *stats);
 
 int js_dostring(js_State *J, const char *source);
 int js_dofile(js_State *J, const char *filename);
@@ -0,0 +1,182 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2016 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "actid.h"
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static uint64_t nodeid;
+static char *nodedev = NULL;
+static uint64_t counter;
+static pthread_once_t seeded = PTHREAD_ONCE_INIT;
+
+
+static uint64_t actid_fnv64(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+
+// Start the counter from the clock (microseconds shifted up) so that the IDs
+// are not reused after a restart
+static void actid_seed()
+{
+    struct timeval tv;
+    uint64_t seed;
+
+    gettimeofday(&tv, NULL);
+    seed = ((uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec) << 12;
+    __atomic_store_n(&counter, seed, __ATOMIC_SEQ_CST);
+}
+
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+    for (int i = 7; i >= 0; i--)
+    {
+        p[i] = v & 0xff;
+        v >>= 8;
+    }
+}
+
+
+// buf should be at least ACTID_LEN bytes
+//
+void actid_new(char *buf, char *device_id)
+{
+    unsigned char bytes[ACTID_BYTES];
+
+    // device_id is set once at startup.. the pointer check is enough
+    if (nodedev != device_id)
+    {
+        nodeid = actid_fnv64(device_id != NULL ? device_id : "");
+        nodedev = device_id;
+    }
+    pthread_once(&seeded, actid_seed);
+
+    put_u64(bytes, nodeid);
+    put_u64(bytes + 8, __atomic_add_fetch(&counter, 1, __ATOMIC_SEQ_CST));
+    actid_frombytes(bytes, buf);
+}
+
+
+bool actid_isbinary(const char *id)
+{
+    return id != NULL && id[0] == ACTID_MARK && strlen(id) == ACTID_STRLEN;
+}
+
+
+static int hexval(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+
+// False if the ID is not a binary ID.. send it as a string then
+//
+bool actid_tobytes(const char *id, unsigned char *bytes)
+{
+    if (!actid_isbinary(id))
+        return false;
+
+    for (int i = 0; i < ACTID_BYTES; i++)
+    {
+        int hi = hexval(id[1 + 2 * i]);
+        int lo = hexval(id[2 + 2 * i]);
+        if (hi < 0 || lo < 0)
+            return false;
+        bytes[i] = (hi << 4) | lo;
+    }
+    return true;
+}
+
+
+void actid_frombytes(const unsigned char *bytes, char *buf)
+{
+    buf[0] = ACTID_MARK;
+    for (int i = 0; i < ACTID_BYTES; i++)
+    {
+        buf[1 + 2 * i] = hexdigits[bytes[i] >> 4];
+        buf[2 + 2 * i] = hexdigits[bytes[i] & 0xf];
+    }
+    buf[ACTID_STRLEN] = '\0';
+}
+
+
+// FNV-1a over the ID.. used to skip most of the compares in the tables
+//
+uint32_t actid_hash(const char *id)
+{
+    uint32_t h = 2166136261U;
+
+    if (id == NULL)
+        return 0;
+    while (*id)
+    {
+        h ^= (unsigned char)*id++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+
+bool actid_equal(const char *a, const char *b)
+{
+    if (a == b)
+        return true;
+    if (a == NULL || b == NULL)
+        return false;
+
+    size_t alen = strlen(a);
+    if (alen != strlen(b))
+        return false;
+
+    // Counter digits are at the end
+    for (size_t i = alen; i > 0; i--)
+        if (a[i - 1] != b[i - 1])
+            return false;
+    return true;
+}
@@ -0,0 +1,63 @@
+/*
+The MIT License (MIT)
+Copyright (c) 2016 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __ACTID_H__
+#define __ACTID_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Activity IDs. A new ID is 128 bits: a 64-bit node ID (hash of the
+ * device_id) followed by a 64-bit counter that is seeded from the clock
+ * at startup. It goes over the wire as a CBOR byte string.
+ *
+ * Inside the runtime the ID is still a C string so that the older string
+ * IDs (from J nodes or C nodes that do not send byte strings) keep
+ * working: a binary ID is written as ACTID_MARK followed by 32 hex
+ * digits. The mark is not a character that a string ID can start with.
+ *
+ * The counter is in the last digits.. actid_equal() compares from the
+ * end so IDs from the same node differ on the first bytes looked at.
+ */
+
+#define ACTID_BYTES                 16
+#define ACTID_MARK                  '@'
+#define ACTID_STRLEN                (1 + 2 * ACTID_BYTES)
+#define ACTID_LEN                   (ACTID_STRLEN + 1)
+
+void actid_new(char *buf, char *device_id);
+bool actid_isbinary(const char *id);
+bool actid_tobytes(const char *id, unsigned char *bytes);
+void actid_frombytes(const unsigned char *bytes, char *buf);
+uint32_t actid_hash(const char *id);
+bool actid_equal(const char *a, const char *b);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
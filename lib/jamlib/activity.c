@@ -193,7 +193,7 @@ void activity_callbackreg_print(activity_callback_reg_t *areg)
 
 
 
-bool activity_regcallback(activity_table_t *at, char *name, int type, char *sig, activitycallback_f cback)
+bool activity_regcallback(activity_table_t *at, char *name, int type, char *sig, activitycallback_f cback, int stacksize)
 {
     int i;
 
@@ -213,6 +213,7 @@ bool activity_regcallback(activity_table_t *at, char *name, int type, char *sig,
     strcpy(creg->signature, sig);
     creg->type = type;
     creg->cback = cback;
+    creg->stacksize = stacksize;
 
     pthread_mutex_lock(&(at->lock));
     at->callbackregs[at->numcbackregs++] = creg;
@@ -245,6 +246,62 @@ activity_callback_reg_t *activity_findcallback(activity_table_t *at, char *name)
 }
 
 
+typedef struct _stackrun_t
+{
+    activity_callback_reg_t *creg;
+    jactivity_t *jact;
+    command_t *cmd;
+    bool done;
+    Rendez r;
+
+} stackrun_t;
+
+
+static void activity_stackrun(void *arg)
+{
+    stackrun_t *run = (stackrun_t *)arg;
+
+    taskname("%s", run->creg->name);
+    run->creg->cback(run->jact, run->cmd);
+    run->done = true;
+    taskwakeup(&(run->r));
+}
+
+
+// Run the callback of an activity on the calling activity thread, or on a
+// task with the stack the activity was declared with when that is bigger.
+// The thread takes the task's ID while it waits so that the calls that
+// look up their activity thread (athread_getmine) still find it.
+//
+void activity_callback(activity_table_t *at, jactivity_t *jact, command_t *cmd, activity_callback_reg_t *creg)
+{
+    if (creg->stacksize <= ACTIVITY_STACK_SIZE)
+    {
+        creg->cback(jact, cmd);
+        return;
+    }
+
+    activity_thread_t *athr = athread_getmine(at);
+    if (athr == NULL)
+    {
+        printf("WARNING! No activity thread for %s.. running on the caller's stack\n", creg->name);
+        creg->cback(jact, cmd);
+        return;
+    }
+
+    stackrun_t run;
+    memset(&run, 0, sizeof(stackrun_t));
+    run.creg = creg;
+    run.jact = jact;
+    run.cmd = cmd;
+
+    athr->taskid = taskcreate(activity_stackrun, &run, creg->stacksize);
+    while (!run.done)
+        tasksleep(&(run.r));
+    athr->taskid = taskid();
+}
+
+
 // This is the runner for the activity. Each activity is running this
 // on its task. It loads the newly arriving request and starts the corresponding
 // function
@@ -289,10 +346,10 @@ void run_activity(void *arg)
                 continue;
 
             // If the activity is local.. we check whether this is servicing JSYNC task processing
-            if ((!jact->remote) && (strcmp(cmd->cmd, "LEXEC-ASY") == 0))
+            if ((!jact->remote) && (cmd->opcode == CMD_LEXEC_ASY))
             {
                 activity_callback_reg_t *creg = activity_findcallback(js->atable, cmd->actname);
-                creg->cback(jact, cmd);
+                activity_callback(at, jact, cmd, creg);
                 activity_free(jact);
             }
             else
@@ -300,7 +357,7 @@ void run_activity(void *arg)
             {
                 jam_clear_timer(js, jact->actid);
                 // We got the ack for the SYNC request..
-                if ((strcmp(cmd->cmd, "TIMEOUT") != 0) && (strcmp(cmd->cmd, "REXEC-NAK") != 0))
+                if ((cmd->opcode != CMD_TIMEOUT) && (cmd->opcode != CMD_REXEC_NAK))
                 {
                     // We received the acknowledgement for the SYNC.. now proceed to the next stage.
                     int timeout = 900;
@@ -315,7 +372,7 @@ void run_activity(void *arg)
                         cmd = (command_t *)nv->data;
                         free(nv);
 
-                        if (strcmp(cmd->cmd, "REXEC-RES") == 0)
+                        if (cmd->opcode == CMD_REXEC_RES)
                         {
                             // We create a structure to hold the result returned by the root
                             repcode = (arg_t *)calloc(1, sizeof(arg_t));
@@ -343,7 +400,7 @@ void run_activity(void *arg)
                 bool ack_failed = false;
                 for (int i = 0; i < machine_height(js) -1; i++)
                 {
-                    if ((strcmp(cmd->cmd, "TIMEOUT") == 0) || (strcmp(cmd->cmd, "REXEC-NAK") == 0))
+                    if ((cmd->opcode == CMD_TIMEOUT) || (cmd->opcode == CMD_REXEC_NAK))
                         ack_failed = true;
 
                     if (i < machine_height(js) -2)
@@ -377,7 +434,7 @@ void run_activity(void *arg)
 
                 for (int i = 0; i < machine_height(js) -1 ; i++)
                 {
-                    if ((strcmp(cmd->cmd, "TIMEOUT") == 0) || (strcmp(cmd->cmd, "REXEC-NAK") == 0))
+                    if ((cmd->opcode == CMD_TIMEOUT) || (cmd->opcode == CMD_REXEC_NAK))
                         ack_failed = true;
 
                     if (i < machine_height(js) -2)
@@ -405,7 +462,7 @@ void run_activity(void *arg)
             }
             else
             {
-                if (strcmp(cmd->cmd, "REXEC-ASY") == 0) 
+                if (cmd->opcode == CMD_REXEC_ASY)
                 {
                     areg = activity_findcallback(at, cmd->actname);
                     if (areg == NULL)
@@ -419,13 +476,12 @@ void run_activity(void *arg)
                         #ifdef DEBUG_LVL1
                             printf(">>>>>>> After task create...cmd->actname %s\n", cmd->actname);
                         #endif
-                        // Delete the runtable entry..
-                        // TODO: Do we ever need a runtable entry (even the deleted one) at a later point in time?
-                        runtable_del(js->rtable, cmd->actid);
+                        // Done.. the entry is kept if there is a result to send again
+                        runtable_complete(js, cmd);
                     }
                 }
                 else
-                if (strcmp(cmd->cmd, "REXEC-SYN") == 0)
+                if (cmd->opcode == CMD_REXEC_SYN)
                 {
                     // TODO: There is no difference at this point.. what will be the difference?
                     areg = activity_findcallback(at, cmd->actname);
@@ -441,9 +497,8 @@ void run_activity(void *arg)
                         #ifdef DEBUG_LVL1
                             printf(">>>>>>> After task create...cmd->actname %s\n", cmd->actname);
                         #endif
-                        // Delete the runtable entry..
-                        // TODO: Do we ever need a runtable entry (even the deleted one) at a later point in time?
-                        runtable_del(js->rtable, cmd->actid);
+                        // Done.. the entry is kept if there is a result to send again
+                        runtable_complete(js, cmd);
                     }
                 }
             }
@@ -475,8 +530,8 @@ activity_thread_t *athread_init(activity_table_t *atbl)
     at->resultq = pqueue_new(true);
 
     comboptr_t *ct = create_combo3_ptr(atbl, at, NULL);
-    // TODO: What is the correct stack size? Remember this runs all user functions
-    taskcreate(run_activity, ct, 20000);
+    // Activities declared with a bigger stack get their own task (activity_callback)
+    taskcreate(run_activity, ct, ACTIVITY_STACK_SIZE);
 
     // return the pointer
     return at;
@@ -499,6 +554,7 @@ activity_thread_t *athread_getmine(activity_table_t *at)
             return at->athreads[i];
         }
     }
+    pthread_mutex_unlock(&(at->lock));
 
     return NULL;
 }
@@ -552,8 +608,6 @@ jactivity_t *activity_new(activity_table_t *at, char *actid, bool remote)
             count--;
             if (count <= 0)
             {
-                if (odcount > ODCOUNT_MIN)
-                    odcount -= ODCOUNT_DOWNVAL;
                 free(jact);
                 return NULL;
             }
@@ -591,8 +645,6 @@ jactivity_t *activity_renew(activity_table_t *at, jactivity_t *jact)
             count--;
             if (count <= 0)
             {
-                if (odcount > ODCOUNT_MIN)
-                    odcount -= ODCOUNT_DOWNVAL;
                 return NULL;
             }
         }
@@ -646,13 +698,26 @@ void activity_free(jactivity_t *jact)
     //     printf(".........Flusing activity jindx %d.. threadid %d \n", athr->jindx, athr->threadid);
     // }
 
-    if (odcount < ODCOUNT_MAX)
-        odcount += ODCOUNT_UPVAL;
     free(jact);
 }
 
 
 
+// Number of activity threads that are not held by an activity
+int athread_freecount(activity_table_t *at)
+{
+    int count = 0;
+
+    pthread_mutex_lock(&(at->lock));
+    for (int i = 0; i < MAX_ACT_THREADS; i++)
+        if (at->athreads[i]->jindx == 0)
+            count++;
+    pthread_mutex_unlock(&(at->lock));
+
+    return count;
+}
+
+
 activity_thread_t *athread_getbyindx(activity_table_t *at, int jindx)
 {
     // Only return non NULL if the activity has a thread
@@ -670,7 +735,7 @@ int match_actid(void *elem, void *arg)
     if (jact == NULL)
         return -1;
 
-    return strcmp(jact->actid, (char *)arg);
+    return actid_equal(jact->actid, (char *)arg) ? 0 : 1;
 }
 
 
@@ -762,6 +827,9 @@ void activity_complete(activity_table_t *at, char *opt, char *actid, char *fmt,
     runtableentry_t *re = runtable_find(js->rtable, actid);
 
     if (re != NULL)
+    {
+        runtable_store_results(js->rtable, actid, opt, qarg);
         jwork_send_results(js, opt, re->actname, re->actid, qarg);
+    }
 
 }
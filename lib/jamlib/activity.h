@@ -29,6 +29,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "simplequeue.h"
 #include "simplelist.h"
 #include "pushqueue.h"
+#include "actid.h"
 
 
 #include <stdbool.h>
@@ -39,6 +40,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define MAX_CALLBACKS           16 //32
 #define MAX_FIELD_LEN           64
 
+// Stack of the activity threads. An activity that declares a bigger
+// stack runs on a task of its own while its thread waits (activity_callback)
+#define ACTIVITY_STACK_SIZE     20000
+
 typedef void (*activitycallback_f)(void *ten, void *arg);
 
 enum activity_state_t
@@ -85,6 +90,7 @@ typedef struct _activity_callback_reg_t
     char name[MAX_NAME_LEN];
     char signature[MAX_NAME_LEN];
     activitycallback_f cback;
+    int stacksize;                          // 0 - ACTIVITY_STACK_SIZE
 
     enum activity_type_t type;
 
@@ -143,8 +149,9 @@ void activity_table_print(activity_table_t *at);
 void activity_callbackreg_print(activity_callback_reg_t *areg);
 void activity_printthread(activity_thread_t *ja);
 
-bool activity_regcallback(activity_table_t *at, char *name, int type, char *sig, activitycallback_f cback);
+bool activity_regcallback(activity_table_t *at, char *name, int type, char *sig, activitycallback_f cback, int stacksize);
 activity_callback_reg_t *activity_findcallback(activity_table_t *at, char *name);
+void activity_callback(activity_table_t *at, jactivity_t *jact, command_t *cmd, activity_callback_reg_t *creg);
 
 void run_activity(void *arg);
 
@@ -157,6 +164,7 @@ jactivity_t *activity_new(activity_table_t *at, char *actid, bool remote);
 jactivity_t *activity_renew(activity_table_t *at, jactivity_t *jact);
 
 void activity_free(jactivity_t *jact);
+int athread_freecount(activity_table_t *at);
 activity_thread_t *athread_getbyindx(activity_table_t *at, int jindx);
 activity_thread_t *athread_getbyid(activity_table_t *at, char *actid);
 jactivity_t *activity_getbyid(activity_table_t *at, char *actid);
@@ -0,0 +1,158 @@
+/*
+The MIT License (MIT)
+Copyright (c) 2016 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#include "admission.h"
+#include "timer.h"
+
+
+admission_t *admission_new()
+{
+    admission_t *adm = (admission_t *)calloc(1, sizeof(admission_t));
+    assert(adm != NULL);
+
+    pthread_mutex_init(&adm->lock, NULL);
+    adm->maxdepth = ADM_MAX_QDEPTH;
+    adm->target = ADM_TARGET;
+    adm->interval = ADM_INTERVAL;
+
+    return adm;
+}
+
+
+// The CoDel control law.. returns true if the request should be rejected.
+// Called with the lock held.
+//
+static bool admission_codel(admission_t *adm, double now)
+{
+    if (adm->sojourn < adm->target || adm->qdepth == 0)
+    {
+        // Good queue.. leave the dropping state
+        adm->first_above = 0;
+        adm->dropping = false;
+        return false;
+    }
+
+    if (adm->first_above == 0)
+    {
+        // Just went above the target.. it should stay there for an interval
+        adm->first_above = now + adm->interval;
+        return false;
+    }
+
+    if (!adm->dropping)
+    {
+        if (now < adm->first_above)
+            return false;
+
+        // Start dropping.. if we were dropping recently, start closer to
+        // the old rate instead of from the beginning
+        adm->dropping = true;
+        if (adm->count > 2 && now - adm->drop_next < 8 * adm->interval)
+            adm->count = adm->count - 2;
+        else
+            adm->count = 1;
+        adm->drop_next = now + adm->interval / sqrt(adm->count);
+        return true;
+    }
+
+    if (now >= adm->drop_next)
+    {
+        adm->count++;
+        adm->drop_next = adm->drop_next + adm->interval / sqrt(adm->count);
+        return true;
+    }
+
+    return false;
+}
+
+
+// Retry-after hint in milliseconds. The requests waiting now should be
+// cleared by then at the current sojourn time.
+// Called with the lock held.
+//
+static int admission_retry_after(admission_t *adm)
+{
+    double wait = adm->interval + adm->sojourn * (adm->qdepth + 1);
+
+    return (int)ceil(wait * 1000.0);
+}
+
+
+// Check whether a request can be admitted. Returns 0 if admitted or the
+// retry-after hint (milliseconds) if the request should be rejected.
+//
+int admission_check(admission_t *adm, int freethreads)
+{
+    double now = getcurtime();
+    int retry = 0;
+
+    pthread_mutex_lock(&adm->lock);
+
+    // Hard limits.. no point in queueing more than the activity threads
+    // could pick up soon
+    if (adm->qdepth >= adm->maxdepth ||
+        adm->qdepth >= freethreads + ADM_QUEUE_SLACK ||
+        admission_codel(adm, now))
+        retry = admission_retry_after(adm);
+
+    pthread_mutex_unlock(&adm->lock);
+
+    return retry;
+}
+
+
+// The request is put into the globalinq. We stamp the command so the
+// sojourn time can be measured at dispatch.
+//
+void admission_enqueued(admission_t *adm, command_t *cmd)
+{
+    cmd->qtime = getcurtime();
+
+    pthread_mutex_lock(&adm->lock);
+    adm->qdepth++;
+    pthread_mutex_unlock(&adm->lock);
+}
+
+
+// The request is taken out of the globalinq by the event loop.
+// Commands that did not go through admission have qtime == 0.
+//
+void admission_dispatched(admission_t *adm, command_t *cmd)
+{
+    if (cmd->qtime == 0)
+        return;
+
+    double now = getcurtime();
+
+    pthread_mutex_lock(&adm->lock);
+    adm->sojourn = now - cmd->qtime;
+    if (adm->qdepth > 0)
+        adm->qdepth--;
+    pthread_mutex_unlock(&adm->lock);
+
+    cmd->qtime = 0;
+}
@@ -0,0 +1,72 @@
+/*
+The MIT License (MIT)
+Copyright (c) 2016 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __ADMISSION_H__
+#define __ADMISSION_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "command.h"
+
+/*
+ * Admission control for the remote execution requests (REXEC-ASY).
+ * The decision is based on what is actually happening at the node:
+ *   - number of admitted requests still waiting in the globalinq
+ *   - number of free activity threads
+ *   - sojourn time (admission to dispatch) of the recently dispatched requests
+ *
+ * The sojourn time is controlled using CoDel: if it stays above the target
+ * for an interval we start rejecting, and the rejections get closer together
+ * (interval/sqrt(count)) until the sojourn time falls below the target.
+ * A rejected request gets a REXEC-NAK "OVERLOAD" with a retry-after hint.
+ */
+
+#define ADM_MAX_QDEPTH              64      // hard limit on waiting requests
+#define ADM_QUEUE_SLACK             8       // waiting requests allowed beyond free threads
+#define ADM_TARGET                  0.005   // target sojourn time (seconds)
+#define ADM_INTERVAL                0.100   // CoDel interval (seconds)
+
+typedef struct _admission_t
+{
+    pthread_mutex_t lock;
+
+    int qdepth;                             // admitted but not dispatched
+    int maxdepth;
+
+    double target;
+    double interval;
+    double sojourn;                         // sojourn of the last dispatched request
+    double first_above;                     // time sojourn was above target for an interval
+    double drop_next;                       // next rejection time in the dropping state
+    bool dropping;
+    int count;                              // rejections in the dropping state
+
+} admission_t;
+
+
+admission_t *admission_new();
+int admission_check(admission_t *adm, int freethreads);
+void admission_enqueued(admission_t *adm, command_t *cmd);
+void admission_dispatched(admission_t *adm, command_t *cmd);
+
+#endif
@@ -39,11 +39,122 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <cbor.h>
 
 #include "command.h"
+#include "actid.h"
 #include "cborutils.h"
 #include "free_list.h"
 
 static long id = 1;
 
+// Names of the commands indexed by the opcode.. see enum cmdopcode_t
+static const char *cmdnames[CMD_MAX_OPCODE] = {
+    [CMD_UNKNOWN]       = "",
+    [CMD_REGISTER]      = "REGISTER",
+    [CMD_REGISTER_ACK]  = "REGISTER-ACK",
+    [CMD_PING]          = "PING",
+    [CMD_KILL]          = "KILL",
+    [CMD_GET_CF_INFO]   = "GET-CF-INFO",
+    [CMD_PUT_CF_INFO]   = "PUT-CF-INFO",
+    [CMD_REF_CF_INFO]   = "REF-CF-INFO",
+    [CMD_REXEC_ASY]     = "REXEC-ASY",
+    [CMD_REXEC_SYN]     = "REXEC-SYN",
+    [CMD_REXEC_ACK]     = "REXEC-ACK",
+    [CMD_REXEC_NAK]     = "REXEC-NAK",
+    [CMD_REXEC_RES]     = "REXEC-RES",
+    [CMD_REXEC_ERR]     = "REXEC-ERR",
+    [CMD_REXEC_JDATA]   = "REXEC-JDATA",
+    [CMD_LEXEC_ASY]     = "LEXEC-ASY",
+    [CMD_READY]         = "READY",
+    [CMD_SYNCSTART]     = "SYNCSTART",
+    [CMD_TIMEOUT]       = "TIMEOUT",
+    [CMD_SYNC_TIMEOUT]  = "SYNC_TIMEOUT",
+    [CMD_CHUNK_ACK]     = "CHUNK-ACK"
+};
+
+
+// Intern the command string. We pick the candidate opcode by looking
+// at one or two characters and then confirm it with a single compare.
+// This runs once per command (at creation or decoding) and the dispatchers
+// just switch on the opcode after that.
+//
+enum cmdopcode_t command_opcode(const char *cmd)
+{
+    enum cmdopcode_t op = CMD_UNKNOWN;
+    size_t len;
+
+    // Shortest command names are 4 characters long (PING, KILL)
+    if (cmd == NULL || (len = strlen(cmd)) < 4)
+        return CMD_UNKNOWN;
+
+    switch (cmd[0])
+    {
+        case 'R':
+            if (len >= 9 && cmd[1] == 'E' && cmd[2] == 'X')
+            {
+                // REXEC-xxx family.. the 7th character tells them apart
+                // except for ASY/ACK that share the 'A'
+                switch (cmd[6])
+                {
+                    case 'A':
+                        op = (cmd[7] == 'S') ? CMD_REXEC_ASY : CMD_REXEC_ACK;
+                        break;
+                    case 'S': op = CMD_REXEC_SYN; break;
+                    case 'N': op = CMD_REXEC_NAK; break;
+                    case 'R': op = CMD_REXEC_RES; break;
+                    case 'E': op = CMD_REXEC_ERR; break;
+                    case 'J': op = CMD_REXEC_JDATA; break;
+                    default: break;
+                }
+            }
+            else
+            if (len >= 8 && cmd[2] == 'G')
+                op = (cmd[8] == '-') ? CMD_REGISTER_ACK : CMD_REGISTER;
+            else
+            if (cmd[2] == 'F')
+                op = CMD_REF_CF_INFO;
+            else
+            if (cmd[2] == 'A')
+                op = CMD_READY;
+            break;
+        case 'P':
+            op = (cmd[1] == 'I') ? CMD_PING : CMD_PUT_CF_INFO;
+            break;
+        case 'K':
+            op = CMD_KILL;
+            break;
+        case 'G':
+            op = CMD_GET_CF_INFO;
+            break;
+        case 'L':
+            op = CMD_LEXEC_ASY;
+            break;
+        case 'S':
+            op = (cmd[4] == 'S') ? CMD_SYNCSTART : CMD_SYNC_TIMEOUT;
+            break;
+        case 'T':
+            op = CMD_TIMEOUT;
+            break;
+        case 'C':
+            op = CMD_CHUNK_ACK;
+            break;
+        default:
+            break;
+    }
+
+    if (op != CMD_UNKNOWN && strcmp(cmd, cmdnames[op]) == 0)
+        return op;
+
+    return CMD_UNKNOWN;
+}
+
+
+const char *command_opname(enum cmdopcode_t opcode)
+{
+    if (opcode < CMD_UNKNOWN || opcode >= CMD_MAX_OPCODE)
+        return cmdnames[CMD_UNKNOWN];
+    return cmdnames[opcode];
+}
+
+
 //Copy the arguments pointed to by darg to sarg
 //@param *darg: a pointer to the destination argument
 //@param *sarg: a pointer to the source argument
@@ -62,6 +173,9 @@ void command_arg_copy(arg_t *darg, arg_t *sarg)
             darg->val.sval = strdup(sarg->val.sval);
             return;
         case NVOID_TYPE:
+        case INT_ARRAY_TYPE:
+        case FLOAT_ARRAY_TYPE:
+        case DOUBLE_ARRAY_TYPE:
             darg->val.nval = nvoid_new(sarg->val.nval->data, sarg->val.nval->len);
             return;
         default:
@@ -93,6 +207,9 @@ arg_t *command_arg_clone(arg_t *arg)
             val->val.sval = strdup(arg->val.sval);
             return val;
         case NVOID_TYPE:
+        case INT_ARRAY_TYPE:
+        case FLOAT_ARRAY_TYPE:
+        case DOUBLE_ARRAY_TYPE:
             val->val.nval = nvoid_new(arg->val.nval->data, arg->val.nval->len);
             return val;
         case NULL_TYPE:
@@ -116,6 +233,9 @@ void command_arg_free(arg_t *arg)
             free(arg->val.sval);
             break;
         case NVOID_TYPE:
+        case INT_ARRAY_TYPE:
+        case FLOAT_ARRAY_TYPE:
+        case DOUBLE_ARRAY_TYPE:
             nvoid_free(arg->val.nval);
             break;
         default:
@@ -139,12 +259,185 @@ void command_arg_print(arg_t *arg)
         case DOUBLE_TYPE:
             printf("Double: %f ", arg->val.dval);
             break;
+        case INT_ARRAY_TYPE:
+            printf("Int array: [%d] ", command_arg_count(arg));
+            break;
+        case FLOAT_ARRAY_TYPE:
+            printf("Float array: [%d] ", command_arg_count(arg));
+            break;
+        case DOUBLE_ARRAY_TYPE:
+            printf("Double array: [%d] ", command_arg_count(arg));
+            break;
         default:
             break;
     }
 }
 
 
+// Size of an element of an array type.. 0 for the other types
+static int command_elem_size(enum argtype_t type)
+{
+    switch (type)
+    {
+        case INT_ARRAY_TYPE:
+            return sizeof(int32_t);
+        case FLOAT_ARRAY_TYPE:
+            return sizeof(float);
+        case DOUBLE_ARRAY_TYPE:
+            return sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+
+// Number of elements in an array argument
+int command_arg_count(arg_t *arg)
+{
+    int size = command_elem_size(arg->type);
+
+    if (size == 0 || arg->val.nval == NULL)
+        return 0;
+    return arg->val.nval->len / size;
+}
+
+
+static enum argtype_t command_array_type(char code)
+{
+    switch (code)
+    {
+        case 'I':
+            return INT_ARRAY_TYPE;
+        case 'F':
+            return FLOAT_ARRAY_TYPE;
+        default:
+            return DOUBLE_ARRAY_TYPE;
+    }
+}
+
+
+// Tagged byte string holding the array.. the tag gives the element type
+// and the byte order of this host
+//
+static cbor_item_t *command_build_array(arg_t *arg)
+{
+    cbor_item_t *bytes, *tagged;
+    uint64_t tag;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    tag = arg->type == INT_ARRAY_TYPE ? CBOR_TAG_INT32_BE :
+          arg->type == FLOAT_ARRAY_TYPE ? CBOR_TAG_FLOAT32_BE : CBOR_TAG_FLOAT64_BE;
+#else
+    tag = arg->type == INT_ARRAY_TYPE ? CBOR_TAG_INT32_LE :
+          arg->type == FLOAT_ARRAY_TYPE ? CBOR_TAG_FLOAT32_LE : CBOR_TAG_FLOAT64_LE;
+#endif
+
+    bytes = cbor_build_bytestring(arg->val.nval->data, arg->val.nval->len);
+    tagged = cbor_build_tag(tag, bytes);
+    cbor_decref(&bytes);
+    return tagged;
+}
+
+
+// Array argument from a tagged byte string. The elements are swapped if
+// the sender has the other byte order. Returns -1 if it is not a typed array
+// we know.
+//
+static int command_get_array(cbor_item_t *item, arg_t *arg)
+{
+    cbor_item_t *bytes;
+    unsigned char *p, t;
+    int bigendian, size, len, i, j;
+
+    switch (cbor_tag_value(item))
+    {
+        case CBOR_TAG_INT32_BE:     arg->type = INT_ARRAY_TYPE; bigendian = 1; break;
+        case CBOR_TAG_INT32_LE:     arg->type = INT_ARRAY_TYPE; bigendian = 0; break;
+        case CBOR_TAG_FLOAT32_BE:   arg->type = FLOAT_ARRAY_TYPE; bigendian = 1; break;
+        case CBOR_TAG_FLOAT32_LE:   arg->type = FLOAT_ARRAY_TYPE; bigendian = 0; break;
+        case CBOR_TAG_FLOAT64_BE:   arg->type = DOUBLE_ARRAY_TYPE; bigendian = 1; break;
+        case CBOR_TAG_FLOAT64_LE:   arg->type = DOUBLE_ARRAY_TYPE; bigendian = 0; break;
+        default:
+            return -1;
+    }
+
+    bytes = cbor_tag_item(item);
+    size = command_elem_size(arg->type);
+    if (!cbor_isa_bytestring(bytes) || cbor_bytestring_length(bytes) % size != 0)
+    {
+        arg->type = NULL_TYPE;
+        cbor_decref(&bytes);
+        return -1;
+    }
+    len = cbor_bytestring_length(bytes);
+    arg->val.nval = nvoid_new(cbor_bytestring_handle(bytes), len);
+    cbor_decref(&bytes);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    if (!bigendian)
+#else
+    if (bigendian)
+#endif
+    {
+        p = (unsigned char *)arg->val.nval->data;
+        for (i = 0; i < len; i += size)
+            for (j = 0; j < size / 2; j++)
+            {
+                t = p[i + j];
+                p[i + j] = p[i + size - 1 - j];
+                p[i + size - 1 - j] = t;
+            }
+    }
+    return 0;
+}
+
+
+// A binary activity ID goes as a byte string (16 bytes).. any other
+// ID as a text string
+//
+static cbor_item_t *command_build_actid(char *actid)
+{
+    unsigned char bytes[ACTID_BYTES];
+
+    if (actid_tobytes(actid, bytes))
+        return cbor_build_bytestring(bytes, ACTID_BYTES);
+    return cbor_build_string(actid);
+}
+
+
+// Byte string argument of a remote request. A large one goes as a stream
+// descriptor and the bytes are not copied here.. they are sent from the
+// argument in fragments after the request (see jamstream.c)
+//
+static cbor_item_t *command_build_nvoid(nvoid_t *nv)
+{
+    if (nv->len <= JSTREAM_THRESHOLD)
+        return cbor_build_bytestring(nv->data, nv->len);
+
+    cbor_item_t *desc = cbor_new_definite_array(2);
+    assert(cbor_array_push(desc, cbor_move(cbor_build_uint32(nv->len))) == true);
+    assert(cbor_array_push(desc, cbor_move(cbor_build_uint32(JSTREAM_CHUNK))) == true);
+    cbor_item_t *tag = cbor_build_tag(CBOR_TAG_JAM_STREAM, desc);
+    cbor_decref(&desc);
+    return tag;
+}
+
+
+static char *command_get_actid(cbor_item_t *item)
+{
+    if (cbor_isa_bytestring(item))
+    {
+        char *buf = (char *)calloc(ACTID_LEN, sizeof(char));
+        if (cbor_bytestring_length(item) == ACTID_BYTES)
+            actid_frombytes(cbor_bytestring_handle(item), buf);
+        else
+            printf("WARNING! Activity ID of %d bytes ignored\n", (int)cbor_bytestring_length(item));
+        return buf;
+    }
+    return cbor_get_string(item);
+}
+
+
 // TODO: Check why we have two NVOID_TYPE in command_new.
 // This is in the while loop that converts the var args to cbor type
 //
@@ -179,11 +472,18 @@ command_t *command_rebuild(command_t *cmd)
             case DOUBLE_TYPE:
                 elem = cbor_build_float8(cmd->args[i].val.dval);
             break;
+
+            case INT_ARRAY_TYPE:
+            case FLOAT_ARRAY_TYPE:
+            case DOUBLE_ARRAY_TYPE:
+                elem = command_build_array(&cmd->args[i]);
+            break;
             default:
+                elem = NULL;
             break;
         }
         if (elem)
-            cbor_array_push(arr, elem);
+            cbor_array_push(arr, cbor_move(elem));
     }
 
     cbor_item_t *rmap = cbor_new_definite_map(8);
@@ -222,7 +522,7 @@ command_t *command_rebuild(command_t *cmd)
     // Add the actid field to the map
     cbor_map_add(rmap, (struct cbor_pair) {
         .key = cbor_move(cbor_build_string("actid")),
-        .value = cbor_move(cbor_build_string(cmd->actid))
+        .value = cbor_move(command_build_actid(cmd->actid))
     });
 
     // Add the actarg field to the map
@@ -260,6 +560,8 @@ command_t *command_rebuild(command_t *cmd)
  * At this time, they should all be primary types.
  *
  * format - s (string), i (integer) f,d for float/double - no % (e.g., "si")
+ *          I, F, D for int32, float and double arrays - each is a pointer
+ *          followed by the number of elements (e.g., "Di" takes 3 values)
  *
  */
 command_t *command_new_using_cbor(const char *cmd, char *opt, char *cond, int condvec, char *actname, char *actid, char *actarg,
@@ -272,6 +574,7 @@ command_t *command_new_using_cbor(const char *cmd, char *opt, char *cond, int co
 
     // hookup parameter such as cmd, opt, actname, etc
     cmdo->cmd = strdup(cmd);
+    cmdo->opcode = command_opcode(cmd);
     cmdo->opt = strdup(opt);
     cmdo->cond = strdup(cond);
     cmdo->condvec = condvec;
@@ -325,7 +628,7 @@ command_t *command_new_using_cbor(const char *cmd, char *opt, char *cond, int co
     // Add the actid field to the map
     cbor_map_add(rmap, (struct cbor_pair) {
         .key = cbor_move(cbor_build_string("actid")),
-        .value = cbor_move(cbor_build_string(actid))
+        .value = cbor_move(command_build_actid(actid))
     });
 
     // Add the actarg field to the map
@@ -381,6 +684,15 @@ command_t *command_new_using_arg(char *cmd, char *opt, char *cond, int condvec,
                 break;
             case NULL_TYPE:
                 elem = cbor_build_uint32(0);
+                break;
+
+            // The array owns the typed arrays.. they are not on the list
+            case INT_ARRAY_TYPE:
+            case FLOAT_ARRAY_TYPE:
+            case DOUBLE_ARRAY_TYPE:
+                cbor_array_push(arr, cbor_move(command_build_array(&args[i])));
+                elem = NULL;
+                break;
         }
 
         if (elem)
@@ -410,6 +722,7 @@ command_t *command_new_using_arg_only(const char *cmd, char *opt, char *cond, in
 
     // hookup parameter such as cmd, opt, actname, etc
     cmdo->cmd = strdup(cmd);
+    cmdo->opcode = command_opcode(cmd);
     cmdo->opt = strdup(opt);
     cmdo->cond = strdup(cond);
     cmdo->condvec = condvec;
@@ -438,7 +751,9 @@ command_t *command_new(const char *cmd, char *opt, char *cond, int condvec,
     va_list args;
     nvoid_t *nv;
     arg_t *qargs;
-    int i = 0;    
+    void *p;
+    int i = 0, n;
+    char code;
 
     if (strlen(fmt) > 0)
         qargs = (arg_t *)calloc(strlen(fmt), sizeof(arg_t));
@@ -452,7 +767,7 @@ command_t *command_new(const char *cmd, char *opt, char *cond, int condvec,
     struct alloc_memory_list * list = init_list_();
     while(*fmt)
     {
-        switch(*fmt++)
+        switch(code = *fmt++)
         {
             case 'n':
                 nv = va_arg(args, nvoid_t*);
@@ -483,6 +798,17 @@ command_t *command_new(const char *cmd, char *opt, char *cond, int condvec,
                 qargs[i].type = DOUBLE_TYPE;
                 elem = cbor_build_float8(qargs[i].val.dval);
                 break;
+            // pointer and element count.. the array owns the tagged item
+            case 'I':
+            case 'F':
+            case 'D':
+                p = va_arg(args, void *);
+                n = va_arg(args, int);
+                qargs[i].type = command_array_type(code);
+                qargs[i].val.nval = nvoid_new(p, n * command_elem_size(qargs[i].type));
+                assert(cbor_array_push(arr, cbor_move(command_build_array(&qargs[i]))) == true);
+                elem = NULL;
+                break;
             default:
                 break;
         }
@@ -504,8 +830,10 @@ command_t *command_new(const char *cmd, char *opt, char *cond, int condvec,
 rvalue_t *command_qargs_alloc(int remote, char *fmt, va_list args)
 {
     nvoid_t *nv;
-    int i = 0;
+    int i = 0, n;
     arg_t *qargs;
+    void *p;
+    char code;
 
     cbor_item_t *arr = NULL;
     cbor_item_t *elem = NULL;
@@ -526,12 +854,12 @@ rvalue_t *command_qargs_alloc(int remote, char *fmt, va_list args)
 
     while(*fmt)
     {
-        switch(*fmt++)
+        switch(code = *fmt++)
         {
             case 'n':
                 nv = va_arg(args, nvoid_t*);
                 if (remote)
-                    elem = cbor_build_bytestring(nv->data, nv->len);
+                    elem = command_build_nvoid(nv);
                 qargs[i].val.nval = nv;
                 qargs[i].type = NVOID_TYPE;
                 break;
@@ -555,7 +883,7 @@ rvalue_t *command_qargs_alloc(int remote, char *fmt, va_list args)
                 qargs[i].val.nval = va_arg(args, void *);
                 qargs[i].type = NVOID_TYPE;
                 if (remote)
-                    elem = cbor_build_bytestring(qargs[i].val.nval->data, qargs[i].val.nval->len);
+                    elem = command_build_nvoid(qargs[i].val.nval);
                 break;
             case 'd':
             case 'f':
@@ -564,6 +892,18 @@ rvalue_t *command_qargs_alloc(int remote, char *fmt, va_list args)
                 if (remote)
                     elem = cbor_build_float8(qargs[i].val.dval);
                 break;
+            // pointer and element count.. the array owns the tagged item
+            case 'I':
+            case 'F':
+            case 'D':
+                p = va_arg(args, void *);
+                n = va_arg(args, int);
+                qargs[i].type = command_array_type(code);
+                qargs[i].val.nval = nvoid_new(p, n * command_elem_size(qargs[i].type));
+                if (remote)
+                    assert(cbor_array_push(arr, cbor_move(command_build_array(&qargs[i]))) == true);
+                elem = NULL;
+                break;
             default:
                 break;
         }
@@ -587,6 +927,150 @@ rvalue_t *command_qargs_alloc(int remote, char *fmt, va_list args)
 
 
 
+/*
+ * Reply templates. The fixed fields are encoded once in the order used by
+ * command_new_using_cbor() (command_from_data() expects that order).
+ * Filling a template writes into the caller's buffer and returns the
+ * length of the command.. like snprintf(), nothing is written beyond size
+ * and the caller can fill again with a larger buffer.
+ */
+
+typedef struct _cmdwriter_t
+{
+    unsigned char *buf;
+    int size;
+    int len;
+
+} cmdwriter_t;
+
+
+static void cmdwriter_put(cmdwriter_t *w, const void *data, int len)
+{
+    if (w->len + len <= w->size)
+        memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+
+static void cmdwriter_string(cmdwriter_t *w, const char *str)
+{
+    unsigned char hdr[9];
+    int len = strlen(str);
+
+    cmdwriter_put(w, hdr, cbor_encode_string_start(len, hdr, sizeof(hdr)));
+    cmdwriter_put(w, str, len);
+}
+
+
+static void cmdwriter_int(cmdwriter_t *w, int val)
+{
+    unsigned char hdr[9];
+
+    if (val < 0)
+        cmdwriter_put(w, hdr, cbor_encode_negint(-1 - (int64_t)val, hdr, sizeof(hdr)));
+    else
+        cmdwriter_put(w, hdr, cbor_encode_uint(val, hdr, sizeof(hdr)));
+}
+
+
+cmdtemplate_t *command_template_new(const char *cmd, char *cond, int condvec, char *actarg)
+{
+    cmdtemplate_t *t = (cmdtemplate_t *)calloc(1, sizeof(cmdtemplate_t));
+    int size = strlen(cmd) + strlen(cond) + strlen(actarg) + 128;
+    cmdwriter_t w = {(unsigned char *)malloc(size), size, 0};
+    unsigned char hdr[9];
+    int i, start[5];
+
+    start[0] = w.len;
+    cmdwriter_put(&w, hdr, cbor_encode_map_start(8, hdr, sizeof(hdr)));
+    cmdwriter_string(&w, "cmd");
+    cmdwriter_string(&w, cmd);
+    cmdwriter_string(&w, "opt");
+
+    start[1] = w.len;
+    cmdwriter_string(&w, "cond");
+    cmdwriter_string(&w, cond);
+    cmdwriter_string(&w, "condvec");
+    cmdwriter_int(&w, condvec);
+    cmdwriter_string(&w, "actname");
+
+    start[2] = w.len;
+    cmdwriter_string(&w, "actid");
+
+    start[3] = w.len;
+    cmdwriter_string(&w, "actarg");
+    cmdwriter_string(&w, actarg);
+    cmdwriter_string(&w, "args");
+    start[4] = w.len;
+
+    assert(w.len <= w.size);
+    for (i = 0; i < 4; i++)
+    {
+        t->seglen[i] = start[i + 1] - start[i];
+        t->seg[i] = (unsigned char *)malloc(t->seglen[i]);
+        memcpy(t->seg[i], w.buf + start[i], t->seglen[i]);
+    }
+    free(w.buf);
+
+    return t;
+}
+
+
+// Only strings (s) and integers (i) go in the replies
+//
+int command_template_fill(cmdtemplate_t *t, unsigned char *buf, int size, char *opt, char *actname,
+                    char *actid, const char *fmt, va_list args)
+{
+    cmdwriter_t w = {buf, size, 0};
+    unsigned char bytes[ACTID_BYTES];
+    unsigned char hdr[9];
+
+    cmdwriter_put(&w, t->seg[0], t->seglen[0]);
+    cmdwriter_string(&w, opt);
+    cmdwriter_put(&w, t->seg[1], t->seglen[1]);
+    cmdwriter_string(&w, actname);
+    cmdwriter_put(&w, t->seg[2], t->seglen[2]);
+
+    // same as command_build_actid()
+    if (actid_tobytes(actid, bytes))
+    {
+        cmdwriter_put(&w, hdr, cbor_encode_bytestring_start(ACTID_BYTES, hdr, sizeof(hdr)));
+        cmdwriter_put(&w, bytes, ACTID_BYTES);
+    }
+    else
+        cmdwriter_string(&w, actid);
+
+    cmdwriter_put(&w, t->seg[3], t->seglen[3]);
+    cmdwriter_put(&w, hdr, cbor_encode_array_start(strlen(fmt), hdr, sizeof(hdr)));
+    while (*fmt)
+    {
+        switch (*fmt++)
+        {
+            case 's':
+                cmdwriter_string(&w, va_arg(args, char *));
+                break;
+            case 'i':
+                cmdwriter_int(&w, va_arg(args, int));
+                break;
+            default:
+                cmdwriter_put(&w, hdr, cbor_encode_null(hdr, sizeof(hdr)));
+                break;
+        }
+    }
+
+    return w.len;
+}
+
+
+void command_template_free(cmdtemplate_t *t)
+{
+    for (int i = 0; i < 4; i++)
+        free(t->seg[i]);
+    free(t);
+}
+
+
+
 /*
  * Command from CBOR data. If the fmt is non NULL, then we use
  * the specification in fmt to validate the parameter ordering.
@@ -622,6 +1106,7 @@ command_t *command_from_data(char *fmt, nvoid_t *data)
 
     cbor_assert_field_string(mitems[0].key, "cmd");
     cmd->cmd = cbor_get_string(mitems[0].value);
+    cmd->opcode = command_opcode(cmd->cmd);
 
     cbor_assert_field_string(mitems[1].key, "opt");
     cmd->opt = cbor_get_string(mitems[1].value);
@@ -636,7 +1121,7 @@ command_t *command_from_data(char *fmt, nvoid_t *data)
     cmd->actname = cbor_get_string(mitems[4].value);
 
     cbor_assert_field_string(mitems[5].key, "actid");
-    cmd->actid = cbor_get_string(mitems[5].value);
+    cmd->actid = command_get_actid(mitems[5].value);
 
     cbor_assert_field_string(mitems[6].key, "actarg");
     cmd->actarg = cbor_get_string(mitems[6].value);
@@ -693,6 +1178,16 @@ command_t *command_from_data(char *fmt, nvoid_t *data)
                 cmd->args[i].type = NVOID_TYPE;
                 cmd->args[i].val.nval = nvoid_new(cbor_bytestring_handle(arrl[i]), cbor_bytestring_length(arrl[i]));
                 break;
+            case CBOR_TYPE_TAG:
+                if (command_get_array(arrl[i], &cmd->args[i]) < 0) {
+                    printf("WARNING! Argument with CBOR tag %d ignored\n", (int)cbor_tag_value(arrl[i]));
+                    break;
+                }
+                if (fmt != NULL && command_array_type(fmt[i]) != cmd->args[i].type) {
+                    printf("ERROR! Message does not match the validation specification\n");
+                    return NULL;
+                }
+                break;
             default:
                 // Nothing to do for the CBOR types - at least for now
                 break;
@@ -752,9 +1247,14 @@ void command_free(command_t *cmd)
                 free(cmd->args[i].val.sval);
                 break;
             case NVOID_TYPE:
-                if(cmd->args[i].val.nval != NULL && strcmp(cmd->cmd, "REXEC-JDATA") != 0)
+                if(cmd->args[i].val.nval != NULL && cmd->opcode != CMD_REXEC_JDATA)
                     nvoid_free(cmd->args[i].val.nval);
                     break;
+            case INT_ARRAY_TYPE:
+            case FLOAT_ARRAY_TYPE:
+            case DOUBLE_ARRAY_TYPE:
+                nvoid_free(cmd->args[i].val.nval);
+                break;
             default: break;
         }
     }
@@ -860,7 +1360,7 @@ bool command_equal(command_t *f, command_t *s)
     if (string_equal(f->cmd, s->cmd) &&
         string_equal(f->opt, s->opt) &&
         string_equal(f->actname, s->actname) &&
-        string_equal(f->actid, s->actid) &&
+        actid_equal(f->actid, s->actid) &&
         string_equal(f->actarg, s->actarg) &&
         string_equal((char *)f->buffer, (char *)s->buffer))
         return true;
@@ -33,6 +33,7 @@ extern "C" {
 
 #include <cbor.h>
 #include <stdint.h>
+#include <stdarg.h>
 #include <pthread.h>
 #include "nvoid.h"
 
@@ -47,9 +48,33 @@ enum argtype_t {
     STRING_TYPE,
     INT_TYPE,
     DOUBLE_TYPE,
-    NVOID_TYPE
+    NVOID_TYPE,
+    INT_ARRAY_TYPE,                         // int32_t[] in val.nval
+    FLOAT_ARRAY_TYPE,                       // float[] in val.nval
+    DOUBLE_ARRAY_TYPE                       // double[] in val.nval
 };
 
+/*
+ * Typed arrays (format I, F and D - each takes a pointer and an element
+ * count) go on the wire as RFC 8746 tagged byte strings in the byte order
+ * of the sender. Both byte orders are taken when decoding.
+ */
+#define CBOR_TAG_INT32_BE           74
+#define CBOR_TAG_INT32_LE           78
+#define CBOR_TAG_FLOAT32_BE         81
+#define CBOR_TAG_FLOAT32_LE         85
+#define CBOR_TAG_FLOAT64_BE         82
+#define CBOR_TAG_FLOAT64_LE         86
+
+/*
+ * A byte string (format n or p) longer than JSTREAM_THRESHOLD in a remote
+ * request is sent as a descriptor: this tag over [length, fragment size].
+ * The bytes follow in fragments of JSTREAM_CHUNK bytes (see jamstream.h).
+ */
+#define CBOR_TAG_JAM_STREAM         19027           // "JS".. private use
+#define JSTREAM_THRESHOLD           (64 * 1024)
+#define JSTREAM_CHUNK               (16 * 1024)
+
 typedef struct _arg_t
 {
     enum argtype_t type;
@@ -63,6 +88,53 @@ typedef struct _arg_t
 } arg_t;
 
 
+/*
+ * Command opcodes. The command string is interned into one of these values
+ * when a command is created or decoded from the wire, so the dispatchers
+ * can switch on an integer instead of walking strcmp() chains.
+ * Keep this in sync with the name table in command.c.
+ */
+enum cmdopcode_t {
+    CMD_UNKNOWN,
+    CMD_REGISTER,
+    CMD_REGISTER_ACK,
+    CMD_PING,
+    CMD_KILL,
+    CMD_GET_CF_INFO,
+    CMD_PUT_CF_INFO,
+    CMD_REF_CF_INFO,
+    CMD_REXEC_ASY,
+    CMD_REXEC_SYN,
+    CMD_REXEC_ACK,
+    CMD_REXEC_NAK,
+    CMD_REXEC_RES,
+    CMD_REXEC_ERR,
+    CMD_REXEC_JDATA,
+    CMD_LEXEC_ASY,
+    CMD_READY,
+    CMD_SYNCSTART,
+    CMD_TIMEOUT,
+    CMD_SYNC_TIMEOUT,
+    CMD_CHUNK_ACK,
+    CMD_MAX_OPCODE
+};
+
+
+/*
+ * Pre-encoded command for the replies that go out for every request
+ * (REXEC-ACK, REXEC-NAK, ..). The CBOR of the fixed fields is built once
+ * and opt, actname, actid and args are written in between the segments:
+ *
+ *   seg[0] opt seg[1] actname seg[2] actid seg[3] args
+ */
+typedef struct _cmdtemplate_t
+{
+    unsigned char *seg[4];
+    int seglen[4];
+
+} cmdtemplate_t;
+
+
 typedef struct _rvalue_t
 {
     arg_t *qargs;
@@ -84,6 +156,7 @@ typedef struct _rvalue_t
 typedef struct _command_t
 {
     char *cmd;                              // Name of the command
+    enum cmdopcode_t opcode;                // Interned version of cmd
     char *opt;
     char *cond;
     int  condvec;
@@ -103,6 +176,8 @@ typedef struct _command_t
     pthread_mutex_t lock;
 
     long id;
+    double qtime;                           // time put into the globalinq (admission control)
+    int level;                              // level a remote command came from (0 - device)
 
 } command_t;
 
@@ -116,6 +191,13 @@ command_t *command_new_using_arg_only(const char *cmd, char *opt, char *cond, in
 command_t *command_new(const char *cmd, char *opt, char *cond, int condvec, char *actname, char *actid, char *actarg, const char *fmt, ...);
 rvalue_t *command_qargs_alloc(int remote, char *fmt, va_list args);
 command_t *command_from_data(char *fmt, nvoid_t *data);
+enum cmdopcode_t command_opcode(const char *cmd);
+const char *command_opname(enum cmdopcode_t opcode);
+
+cmdtemplate_t *command_template_new(const char *cmd, char *cond, int condvec, char *actarg);
+int command_template_fill(cmdtemplate_t *t, unsigned char *buf, int size, char *opt, char *actname,
+                    char *actid, const char *fmt, va_list args);
+void command_template_free(cmdtemplate_t *t);
 
 void command_hold(command_t *cmd);
 void command_free(command_t *cmd);
@@ -129,6 +211,7 @@ void command_arg_copy(arg_t *darg, arg_t *sarg);
 arg_t *command_arg_clone(arg_t *arg);
 void command_arg_free(arg_t *arg);
 void command_arg_print(arg_t *arg);
+int command_arg_count(arg_t *arg);
 
 #endif
 
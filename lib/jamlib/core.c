@@ -30,6 +30,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "core.h"
 #include "mqtt.h"
+#include "shmlink.h"
 #include "command.h"
 #include "comboptr.h"
 #include "uuid4.h"
@@ -162,6 +163,7 @@ corestate_t *core_init(int port, int serialnum)
     // device_id set inside the following function
     cs->cf_pending = true;
     cs->serial_num = serialnum;
+    cs->levelsem = threadsem_new();
 
     // redserver and redport are already initialized to NULL and 0, respectively
     //
@@ -193,6 +195,25 @@ void core_createserver(corestate_t *cs, int indx, char *url)
 //    cs->mqttenabled[indx] = false;
 }
 
+// The device level can use a shared memory link to the J node instead of
+// the MQTT broker. The link handle is kept in mqttserv[0].. mqtt_publish()
+// and mqtt_subscribe() know how to deal with it.
+//
+bool core_createshmlink(corestate_t *cs)
+{
+    shmlink_t *link = shmlink_open(cs->port, cs->serial_num);
+
+    if (link == NULL)
+        return false;
+
+    char name[64];
+    shmlink_name(name, cs->port);
+    cs->mqtthost[0] = strdup(name);
+    cs->mqttserv[0] = (MQTTAsync)link;
+
+    return true;
+}
+
 void core_reconnect_i(corestate_t *cs, int indx)
 {
     int rc;
@@ -268,6 +289,7 @@ bool core_disconnect(corestate_t *cs, int indx, char *hid)
 
     printf("Core.. disconnected... %s\n", cs->mqtthost[indx]);
     cs->mqttenabled[indx] = false;
+    thread_signal(cs->levelsem);
 
     return true;
 }
@@ -288,11 +310,11 @@ void core_set_subscription(corestate_t *cs, int level)
     if (!cs->mqttenabled[level])
         return;
 
-    mqtt_subscribe(cs->mqttserv[level], "/admin/announce/all");
-    mqtt_subscribe(cs->mqttserv[level], "/level/func/reply/#");
-    mqtt_subscribe(cs->mqttserv[level], "/mach/func/request");
+    mqtt_subscribe(cs->mqttserv[level], MQTT_ADMIN_ANNOUNCE);
+    mqtt_subscribe(cs->mqttserv[level], MQTT_LEVEL_REPLY_ALL);
+    mqtt_subscribe(cs->mqttserv[level], MQTT_MACH_REQUEST);
     // Subscribe to the "syncstart" topic for sync purpose.
-    mqtt_subscribe(cs->mqttserv[level], "/mach/func/syncstart");
+    mqtt_subscribe(cs->mqttserv[level], MQTT_MACH_SYNCSTART);
 }
 
 
@@ -29,6 +29,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "command.h"
 #include "comboptr.h"
+#include "threadsem.h"
 #include "MQTTAsync.h"
 
 #define MAX_SERVERS             3
@@ -47,6 +48,7 @@ typedef struct _corestate_t
     int pendingcount;
     char *mqtthost[3];
     char *hid[3];           // This points to the endpoint that is connected through MQTT broker
+    threadsem_t *levelsem;  // Signalled when a level goes up or down (see wait_for_machine)
 
     char *redserver;
     int redport;
@@ -66,6 +68,7 @@ corestate_t *core_init(int port, int serialnum);
 void core_setup(corestate_t *cs, int port);
 void core_set_redis(corestate_t *cs, char *server, int port);
 void core_createserver(corestate_t *cs, int indx, char *url);
+bool core_createshmlink(corestate_t *cs);
 void core_reconnect_i(corestate_t *cs, int indx);
 void core_connect(corestate_t *cs, int indx, void (*onconnect)(void *, MQTTAsync_successData *), char *hid);
 void core_sethost(corestate_t *cs, int indx, char *hid);
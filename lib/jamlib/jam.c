@@ -40,9 +40,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 int mheight = 1;
 
 int jamport;
-int odcount;
-list_elem_t *cache;
-int cachesize;
+int levelthreads = 0;
+int journaling = 0;
 
 extern jamstate_t *js;
 
@@ -66,12 +65,8 @@ jamstate_t *jam_init(int serialnum)
         exit(1);
     }
 
-    // Initialize the duplicate testing cache with 32 entries
-    cache = create_list();
-    cachesize = 32;
-
-    // Initialize the overflow detector
-    odcount = ODCOUNT_MAX;
+    // Initialize the admission controller for the remote requests
+    js->admctl = admission_new();
 
     // Initialize the jconditional
     jcond_init();
@@ -100,6 +95,15 @@ jamstate_t *jam_init(int serialnum)
     js->foginq = queue_new(false);
     js->cloudinq = queue_new(false);
 
+    // Worker state for each level.. the duplicate testing caches are in here
+    js->levels[0] = jwork_level_new(js, 0, "device", js->deviceinq);
+    js->levels[1] = jwork_level_new(js, 1, "fog", js->foginq);
+    js->levels[2] = jwork_level_new(js, 2, "cloud", js->cloudinq);
+
+    // Requests completed before a restart are not run again
+    if (journaling)
+        runtable_recover(js);
+
     // Output queue.. we write to this queue.
     // The jamdata event loop serves from there.
     js->dataoutq = semqueue_new(false);
@@ -176,8 +180,9 @@ void jam_event_loop(void *arg)
             free(nv);
 
             if (cmd != NULL) {
-                switch(cmd->cmd[6]) {
-                    case 'A': // 'REXEC-ASY' - checking 6th char of the string..
+                switch(cmd->opcode) {
+                    case CMD_REXEC_ASY:
+                        admission_dispatched(js->admctl, cmd);
                         // Remote requests go through here.. local requests don't go through here
                         jact = activity_new(js->atable, cmd->actid, true);
 
@@ -190,8 +195,11 @@ void jam_event_loop(void *arg)
                             activity_thread_t *athr = athread_getbyindx(js->atable, jact->jindx);
                             pqueue_enq(athr->inq, cmd, sizeof(command_t));
                         }
+                        else
+                            // No activity thread got free in time.. tell the J node to back off
+                            jwork_send_overload(js, cmd->level, cmd, ADM_INTERVAL * 1000);
                     break;
-                    case 'S': // 'REXEC-SYN' - checking 6th char of the string..
+                    case CMD_REXEC_SYN:
                         if (strcmp(cmd->opt, "cloud") == 0)
                             mcl = js->cstate->mqttserv[2];
                         else
@@ -203,7 +211,7 @@ void jam_event_loop(void *arg)
                         // Make a new command which signals to the J node that it's ready
                         // device ID is put in the cmd->actid because I don't know where else to put it.
                         command_t *readycmd = command_new("READY", "READY", "-", 0, "GLOBAL_INQUEUE", deviceid, "_", "");
-                        mqtt_publish(mcl, "/mach/func/syncrequest", readycmd);
+                        mqtt_publish(mcl, MQTT_MACH_SYNCREQUEST, readycmd);
                         double sTime = 0.0;
                         // Wait for the SYNCSTART signal from the J node.
                         nvoid_t *nv = p2queue_deq_high(js->atable->globalinq);
@@ -215,7 +223,7 @@ void jam_event_loop(void *arg)
                         else cmd_1 = NULL;
                         // printf("Waiting command TYPE: %s\n", cmd_1->cmd);
                         if (cmd_1 != NULL) {
-                            if (strcmp(cmd_1->cmd, "SYNCSTART") == 0)
+                            if (cmd_1->opcode == CMD_SYNCSTART)
                                 // Get the start time from the Go command.
                                 sTime = atof(cmd_1->opt);
                             else
@@ -251,10 +259,10 @@ void jam_event_loop(void *arg)
 
 jactivity_t *jam_create_activity(jamstate_t *js)
 {
-    char *t = activity_gettime(js->cstate->device_id);
-    jactivity_t *j = activity_new(js->atable, t, false);
-    free(t);
-    return j;
+    char t[ACTID_LEN];
+
+    actid_new(t, js->cstate->device_id);
+    return activity_new(js->atable, t, false);
 }
 
 bool have_fog_or_cloud(jamstate_t *js)
@@ -293,16 +301,22 @@ int requested_level(int cvec)
 }
 
 // maxtime is in milliseconds..
+// Only the calling task waits.. the levelsem is signalled by the MQTT
+// callbacks when a fog or cloud connects or goes away.
 int wait_for_machine(jamstate_t *js, int level, int maxtime)
 {
-    for (int i = 0; i < maxtime; i++)
+    double deadline = getcurtime() + maxtime / 1000.0;
+    int remaining;
+
+    while (machine_height(js) < level)
     {
-        if (machine_height(js) >= level)
-            return 1;
-        usleep(1000);
+        remaining = (int)((deadline - getcurtime()) * 1000.0);
+        if (remaining <= 0)
+            return -1;
+        task_timedwait(js->cstate->levelsem, remaining);
     }
 
-    return -1;
+    return 1;
 }
 
 
@@ -319,7 +333,7 @@ int jamargs(int argc, char **argv, char *appid, char *tag, int *num)
 
     opterr = 0;
 
-    while ((c = getopt (argc, argv, "p:a:n:t:h:")) != -1)
+    while ((c = getopt (argc, argv, "p:a:n:t:h:lj")) != -1)
         switch (c)
         {
             case 'a':
@@ -337,9 +351,17 @@ int jamargs(int argc, char **argv, char *appid, char *tag, int *num)
             case 'h':
                 mheight = atoi(optarg);
             break;
+            case 'l':
+                // Fog and cloud commands are processed in their own threads
+                levelthreads = 1;
+            break;
+            case 'j':
+                // Journal the remote requests for the recovery after a restart
+                journaling = 1;
+            break;
         default:
             printf("ERROR! Argument input error..\n");
-            printf("Usage: program -a app_id [-t tag] [-n num] [-p port] [-h height]\n");
+            printf("Usage: program -a app_id [-t tag] [-n num] [-p port] [-h height] [-l] [-j]\n");
             exit(1);
         }
 
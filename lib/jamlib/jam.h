@@ -44,31 +44,43 @@ extern "C" {
 #include "threadsem.h"
 #include "comboptr.h"
 #include "jamdata.h"
+#include "admission.h"
+#include "mqtt.h"
+#include "jamjournal.h"
 
 #include <event.h>
 #include <hiredis/async.h>
 
 
 #define STACKSIZE                   10000
+// Stack of the event loop and user main tasks (generated taskmain)
+#define JAM_TASK_STACK              50000
 
 // TODO: Max entries.. sufficient?
 #define MAX_RUN_ENTRIES             64
 #define MAX_FIELD_LEN               64
 
-#define ODCOUNT_MAX                 100
-#define ODCOUNT_MIN                 15
-#define ODCOUNT_DOWNVAL             20
-#define ODCOUNT_UPVAL               2
+// Levels: 0 - device, 1 - fog, 2 - cloud
+#define MAX_LEVELS                  3
+// Max number of messages taken from a level queue in one wakeup
+#define JWORK_DRAIN_MAX             16
+// Duplicate detection cache size (per level)
+#define JWORK_CACHE_SIZE            32
 
 
 typedef struct _runtableentry_t
 {
     char actid[MAX_FIELD_LEN];
+    uint32_t hash;                          // actid_hash(actid).. checked before the compare
     char actname[MAX_FIELD_LEN];
     int status;
     long long accesstime;
     enum activity_type_t type;
 
+    // Result of a COMPLETED remote request.. sent again if the request comes again
+    arg_t *result;
+    char opt[JOURNAL_OPTLEN];
+
 } runtableentry_t;
 
 
@@ -84,6 +96,33 @@ typedef struct _runtable_t
 
 
 
+/*
+ * Worker state for one level of the machine (device, fog, or cloud).
+ * The incoming commands from the J node at the level are processed
+ * using this state. The MQTT handle is not cached here because it is
+ * recreated when the level reconnects - use cstate->mqttserv[level]
+ * (the publisher keeps a pointer to that slot).
+ */
+typedef struct _jamlevel_t
+{
+    int level;
+    char *name;
+    simplequeue_t *inq;                     // commands from the J node at this level
+    char **cache;                           // duplicate detection cache (ring of actids)
+    uint32_t *cachehash;
+    int cachesize;
+    int cachepos;
+
+    publisher_t *pub;                       // replies to the J node at this level
+
+    bool ownthread;                         // processed by its own thread (not the bgthread)
+    pthread_t thread;
+
+    void *jarg;                             // back pointer to jamstate_t
+
+} jamlevel_t;
+
+
 typedef struct _jamstate_t
 {
     struct event_base *eloop;               // Loop used for logging
@@ -108,6 +147,14 @@ typedef struct _jamstate_t
     simplequeue_t *foginq;
     simplequeue_t *cloudinq;
 
+    jamlevel_t *levels[MAX_LEVELS];
+
+    // Admission control for the requests going into the globalinq
+    admission_t *admctl;
+
+    // Journal of the remote requests (-j).. NULL if not journaling
+    journal_t *journal;
+
     // We can still use the simplequeue_t
     // We wait on this queue.. and the wait would be blocking..
     // The pushqueue_t is used to wait without blocking the user-level threads...
@@ -134,7 +181,8 @@ typedef struct _jamstate_t
 
 
 // Globals defined in jam.c
-extern int odcount;
+extern int levelthreads;
+extern int journaling;
 
 // Global defined in the jamout.c (compiler generated)
 extern char dev_tag[32];
@@ -178,10 +226,13 @@ void send_register(corestate_t *cs, int level);
 void send_infoquery(corestate_t *cs);
 void jam_set_redis(jamstate_t *js, char *server, int port);
 void *jwork_bgthread(void *arg);
+void jwork_init_topics();
 void jwork_set_subscriptions(jamstate_t *js);
 
 void jwork_msg_delivered(void *ctx, MQTTAsync_deliveryComplete dt);
 int jwork_msg_arrived(void *ctx, char *topicname, int topiclen, MQTTAsync_message *msg);
+void jwork_shm_arrived(void *ctx, char *topicname, void *payload, int len);
+void jwork_msg_dispatch(void *ctx, char *topicname, int topiclen, void *payload, int payloadlen);
 void jwork_connect_lost(void *context, char *cause);
 
 void jwork_assemble_fds(jamstate_t *js);
@@ -190,19 +241,21 @@ void jwork_processor(jamstate_t *js);
 void jwork_process_globaloutq(jamstate_t *js);
 void jwork_process_actoutq(jamstate_t *js, int indx);
 
-void jwork_process_device(jamstate_t *js);
-void jwork_process_fog(jamstate_t *js);
-void jwork_process_cloud(jamstate_t *js);
+jamlevel_t *jwork_level_new(jamstate_t *js, int level, char *name, simplequeue_t *inq);
+void jwork_start_level_threads(jamstate_t *js);
+void *jwork_level_thread(void *arg);
+void jwork_process_level(jamstate_t *js, jamlevel_t *lvl);
+void jwork_process_command(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd);
+void jwork_process_cfinfo(jamstate_t *js, command_t *rcmd);
 
-bool duplicate_detect(command_t *rcmd);
-bool overflow_detect();
+bool duplicate_detect(jamlevel_t *lvl, command_t *rcmd);
+void duplicate_insert(jamlevel_t *lvl, char *actid);
 
 void jwork_send_error(jamstate_t *js, command_t *cmd, char *estr);
 void jwork_send_results(jamstate_t *js, char *opt, char *actname, char *actid, arg_t *args);
 void jwork_send_nak(jamstate_t *js, command_t *cmd, char *estr);
-void jwork_send_ack(jamstate_t *js, char *type, command_t *cmd);
-void jwork_send_ack_1(jamstate_t *js, char *type, command_t *cmd);
-void jwork_send_ack_2(jamstate_t *js, char *type, command_t *cmd);
+void jwork_send_overload(jamstate_t *js, int level, command_t *cmd, int retry);
+void jwork_send_ack(jamstate_t *js, int level, char *type, command_t *cmd);
 
 command_t *jwork_runid_status(jamstate_t *js, char *runid);
 command_t *jwork_device_status(jamstate_t *js);
@@ -221,7 +274,9 @@ runtableentry_t *runtable_find(runtable_t *table, char *actid);
 runtableentry_t *runtable_getfree(runtable_t *table);
 bool runtable_insert(jamstate_t * js, char *actid, command_t *cmd);
 bool runtable_del(runtable_t *tbl, char *actid);
-bool runtable_store_results(runtable_t *tbl, char *actid, arg_t *results);
+bool runtable_store_results(runtable_t *tbl, char *actid, char *opt, arg_t *results);
+void runtable_complete(jamstate_t *js, command_t *cmd);
+void runtable_recover(jamstate_t *js);
 void runtable_insert_synctask(jamstate_t *js, command_t *rcmd, int quorum);
 int runtable_synctask_count(runtable_t *rtbl);
 
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <pthread.h>
 #include "free_list.h"
+#include "jamstream.h"
 
 
 // Local execution handler
@@ -118,7 +119,10 @@ jactivity_t *jam_async_runner(jamstate_t *js, jactivity_t *jact, command_t *cmd)
     {
         // Send the command to the remote side
         // The send is executed via the worker thread..
-        queue_enq(athr->outq, cmd, sizeof(command_t));
+        // Not again while its arguments are still streaming.. the J node
+        // runs it (and acks) after the last fragment
+        if (!jstream_busy(cmd))
+            queue_enq(athr->outq, cmd, sizeof(command_t));
 
         jam_set_timer(js, jact->actid, timeout);
         nvoid_t *nv = pqueue_deq(athr->resultq);
@@ -139,6 +143,10 @@ jactivity_t *jam_async_runner(jamstate_t *js, jactivity_t *jact, command_t *cmd)
             nvoid_free(nv);
         } else 
             taskdelay(300);
+
+        // The streaming time does not count as a failed attempt
+        if (!valid_acks && jstream_busy(cmd))
+            i--;
     //    jact = activity_renew(js->atable, jact);
     }
     // Delete the runtable entry.
@@ -0,0 +1,123 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2017 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jamblock.h"
+
+// Worst case for a sample after the first: two 64-bit varints
+#define BLOCK_MAX_SAMPLE            20
+
+
+static int block_put_uvarint(unsigned char *p, unsigned long long val)
+{
+    int n = 0;
+    while (val >= 0x80)
+    {
+        p[n++] = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    p[n++] = val;
+    return n;
+}
+
+
+static int block_put_svarint(unsigned char *p, long long val)
+{
+    return block_put_uvarint(p, ((unsigned long long)val << 1) ^ (unsigned long long)(val >> 63));
+}
+
+
+static int block_put_xor(unsigned char *p, unsigned int x)
+{
+    int lead = 0, trail = 0, n = 1;
+
+    if (x == 0)
+    {
+        p[0] = 0;
+        return 1;
+    }
+    while ((x >> (24 - 8 * lead) & 0xff) == 0)
+        lead++;
+    while ((x >> (8 * trail) & 0xff) == 0)
+        trail++;
+
+    p[0] = 0x80 | (lead << 2) | trail;
+    for (int i = lead; i < 4 - trail; i++)
+        p[n++] = x >> (24 - 8 * i);
+    return n;
+}
+
+
+// The block has to be sent before the sample goes in: it could overflow
+// or it is maxage old
+//
+bool jamblock_full(jamblock_t *b, unsigned long long timestamp)
+{
+    return b->count > 0 && (b->len + BLOCK_MAX_SAMPLE > LOGGER_BLOCK_SIZE ||
+                            (b->maxage > 0 && timestamp - b->t0 >= (unsigned long long)b->maxage));
+}
+
+
+// Returns true when the block has maxcount samples (send it)
+//
+bool jamblock_add(jamblock_t *b, int type, unsigned int value, unsigned long long timestamp)
+{
+    if (b->count == 0)
+    {
+        b->data[0] = type;
+        b->len = 1 + block_put_uvarint(b->data + 1, timestamp);
+        if (type == LOGGER_BLOCK_INT)
+            b->len += block_put_svarint(b->data + b->len, (int)value);
+        else
+            for (int i = 0; i < 4; i++)
+                b->data[b->len++] = value >> (24 - 8 * i);
+        b->t0 = timestamp;
+        b->dprev = 0;
+    }
+    else
+    {
+        long long delta = (long long)(timestamp - b->tprev);
+        b->len += block_put_svarint(b->data + b->len, delta - b->dprev);
+        b->dprev = delta;
+        if (type == LOGGER_BLOCK_INT)
+            b->len += block_put_svarint(b->data + b->len, (long long)(int)value - (int)b->vprev);
+        else
+            b->len += block_put_xor(b->data + b->len, value ^ b->vprev);
+    }
+
+    b->tprev = timestamp;
+    b->vprev = value;
+    return ++b->count >= b->maxcount;
+}
+
+
+void jamblock_clear(jamblock_t *b)
+{
+    b->count = 0;
+    b->len = 0;
+}
@@ -0,0 +1,76 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2017 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __JAMBLOCK_H__
+#define __JAMBLOCK_H__
+
+#include <stdbool.h>
+
+#define LOGGER_BLOCK_SIZE           1024
+#define LOGGER_BLOCK_INT            1
+#define LOGGER_BLOCK_FLOAT          2
+
+// Compact block of samples for numeric loggers (declared with compact(..)).
+// Many samples go into one Redis member {"block": bytes, "timestamp": t0}.
+// The bytes are
+//
+//      type (1 int, 2 float), t0, v0, [dod, dv] * (count - 1)
+//
+// t0 is an unsigned varint and dod is the zigzag varint of the timestamp
+// delta-of-delta. An int dv is the zigzag varint of the value
+// delta. A float is XORed with the previous one: 0 if it is the same,
+// else 0x80 | leading zero bytes << 2 | trailing zero bytes followed by
+// the bytes in between. v0 is a zigzag varint (int) or 4 bytes (float).
+// JAMDatastream.expandBlock (lib/jamserver/jamdatastream.js) reads them.
+typedef struct _jamblock_t
+{
+    int maxcount;
+    int maxage;                     // ms after t0 before the block is sent (checked by the tick too)
+    int count;
+    int len;
+    unsigned long long t0;
+    unsigned long long tprev;
+    long long dprev;
+    unsigned int vprev;             // int value or float bits
+    unsigned char data[LOGGER_BLOCK_SIZE];
+
+} jamblock_t;
+
+
+// type is LOGGER_BLOCK_INT or LOGGER_BLOCK_FLOAT.. value is the int or the float bits
+bool jamblock_full(jamblock_t *b, unsigned long long timestamp);
+bool jamblock_add(jamblock_t *b, int type, unsigned int value, unsigned long long timestamp);
+void jamblock_clear(jamblock_t *b);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
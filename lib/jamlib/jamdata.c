@@ -39,7 +39,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "base64.h"
 #include "simplelist.h"
 #include "jparser.h"
-#include "json.h"
+
+#include <math.h>
 
 
 extern char app_id[64];
@@ -88,6 +89,127 @@ void jamdata_def_disconnect(const redisAsyncContext *c, int status)
 }
 
 
+/*
+ * Logger pipeline. Up to JAMDATA_MAX_INFLIGHT writes can wait for Redis.
+ * Records go to the disk spool (jamspool.h) when that window is full or
+ * when Redis is not connected, and the spool is replayed before new
+ * records are taken from the dataoutq. Redis orders the records by the
+ * timestamp (score) so a replayed record lands in the right place.
+ */
+static jamdata_inflight_t inflight[JAMDATA_MAX_INFLIGHT];
+static int ifhead = 0;
+static int ifcount = 0;
+static bool redis_up = false;
+static jamspool_t *spool = NULL;
+static unsigned long long next_connect = 0;
+static unsigned long long spool_lost = 0;
+
+// Exit: the jamdata thread spools what is left in the dataoutq
+static volatile bool stopping = false;
+static volatile bool stopped = false;
+
+// Windowed and compact loggers.. the tick closes them when they age
+static jamlogger_t *timed = NULL;
+static pthread_mutex_t timedlock = PTHREAD_MUTEX_INITIALIZER;
+
+static void jamdata_pump();
+static void jamdata_close_loggers(bool final);
+static void jamdata_release_item(nvoid_t *nv);
+static void jamdata_spool_record(char *key, void *value, int len, unsigned long long timestamp);
+
+
+static void jamdata_connect_cb(const redisAsyncContext *c, int status)
+{
+    jamdata_def_connect(c, status);
+
+    // hiredis frees the context after a failed connect
+    if (status != REDIS_OK)
+    {
+        js->redctx = NULL;
+        return;
+    }
+    redis_up = true;
+    jamdata_pump();
+}
+
+
+static void jamdata_disconnect_cb(const redisAsyncContext *c, int status)
+{
+    jamdata_def_disconnect(c, status);
+
+    printf("WARNING! Lost the Redis connection.. logger records are spooled\n");
+    redis_up = false;
+    js->redctx = NULL;
+}
+
+
+static void jamdata_connect()
+{
+    redisAsyncContext *c = redisAsyncConnect(js->cstate->redserver, js->cstate->redport);
+    if (c == NULL || c->err)
+    {
+        printf("WARNING! Unable to connect to the Redis server at %s:%d\n", js->cstate->redserver, js->cstate->redport);
+        if (c != NULL)
+            redisAsyncFree(c);
+        return;
+    }
+
+    redisLibeventAttach(c, js->eloop);
+    redisAsyncSetConnectCallback(c, jamdata_connect_cb);
+    redisAsyncSetDisconnectCallback(c, jamdata_disconnect_cb);
+    js->redctx = c;
+}
+
+
+// Retry the connection and drain the dataoutq while Redis is not there
+static void jamdata_tick(evutil_socket_t fd, short what, void *arg)
+{
+    nvoid_t *nv;
+
+    if (stopping)
+    {
+        // Redis may not answer before the exit.. keep the records for the next run.
+        // The in-flight ones taken from the spool (seq > 0) are still in it.
+        for (int i = 0; i < ifcount; i++)
+        {
+            jamdata_inflight_t *f = &inflight[(ifhead + i) % JAMDATA_MAX_INFLIGHT];
+            if (f->seq == 0)
+                jamdata_spool_record(f->key, f->value, f->len, f->timestamp);
+        }
+        while ((nv = semqueue_timeddeq(js->dataoutq, 0)) != NULL)
+        {
+            comboptr_t *cptr = (comboptr_t *)nv->data;
+            jamdata_spool_record(cptr->arg1, cptr->arg2, cptr->size, cptr->lluarg);
+            jamdata_release_item(nv);
+        }
+        stopped = true;
+        event_base_loopbreak(js->eloop);
+        return;
+    }
+
+    if (js->redctx == NULL && ms_time() >= next_connect)
+    {
+        next_connect = ms_time() + JAMDATA_RECONNECT_PERIOD;
+        jamdata_connect();
+    }
+    jamdata_close_loggers(false);
+    jamdata_pump();
+}
+
+
+// Partial blocks and windows are sent at exit. The jamdata thread spools
+// them (and anything else still queued) if it gets to it in time.
+//
+static void jamdata_exit()
+{
+    jamdata_close_loggers(true);
+
+    stopping = true;
+    for (int t = 0; t < JAMDATA_EXIT_WAIT && !stopped; t += 10)
+        usleep(10000);
+}
+
+
 /*
  * This initializes the JAM Data subsystem. It never returns so it should be run
  * in its own thread. This is using the event loop to do the actual sending.
@@ -120,23 +242,19 @@ void *jamdata_init(void *jsp)
     sem_post(js->jdsem);
 #endif
 
-    js->redctx = redisAsyncConnect(js->cstate->redserver, js->cstate->redport);
-    if (js->redctx->err)
-    {
-        printf("ERROR! Connecting to the Redis server at %s:%d\n", js->cstate->redserver, js->cstate->redport);
-        exit(1);
-    }
+    // Records left by an earlier run are replayed once Redis is connected
+    char spooldir[64];
+    sprintf(spooldir, "./%d/spool.%d", js->cstate->port, js->cstate->serial_num);
+    spool = jamspool_open(spooldir, JAMDATA_SPOOL_MAX);
+    atexit(jamdata_exit);
 
-    redisLibeventAttach(js->redctx, js->eloop);
-    redisAsyncSetConnectCallback(js->redctx, jamdata_def_connect);
-    redisAsyncSetDisconnectCallback(js->redctx, jamdata_def_disconnect);
+    // A failed connect is retried by the tick.. records are spooled meanwhile
+    next_connect = ms_time() + JAMDATA_RECONNECT_PERIOD;
+    jamdata_connect();
 
-    // Just send a test value to bootup the event loop..
-    // There is no significance to this data.
-    // The actual data transfer takes place in the callback entered afterwards
-
-    char *key = jamdata_makekey("test", "s");
-    __jamdata_logto_server(js->redctx, key, "dummy_value", 11, 0, jamdata_logger_cb);
+    struct timeval period = { 0, JAMDATA_PUMP_PERIOD * 1000 };
+    struct event *tick = event_new(js->eloop, -1, EV_PERSIST, jamdata_tick, NULL);
+    event_add(tick, &period);
 
     event_base_dispatch(js->eloop);
 
@@ -193,49 +311,128 @@ void time_operation() {
 }
 
 
-/*
- * This is the logger callback..
- */
-void jamdata_logger_cb(redisAsyncContext *c, void *r, void *privdata)
+static void jamdata_release_item(nvoid_t *nv)
 {
-    redisReply *reply = r;
+    comboptr_t *cptr = (comboptr_t *)nv->data;
+    jamlogger_t *jl = (jamlogger_t *)cptr->arg3;
 
-    // Do error processing on the redisReply...
-    if (reply == NULL)
-    {
+    // Logger records can be reused once they are written or spooled
+    if (jl != NULL)
+        jamlogger_release(jl, cptr->iarg, cptr->arg2);
+    nvoid_free(nv);
+}
+
+
+static void jamdata_spool_record(char *key, void *value, int len, unsigned long long timestamp)
+{
+    if (spool != NULL && jamspool_append(spool, key, value, len, timestamp))
+        return;
+
+    if (spool_lost++ % 1000 == 0)
+        printf("WARNING! No room for logger records.. %llu records lost\n", spool_lost);
+}
 
-    }
 
+// Write a record to Redis and keep a copy until the reply comes
+static void jamdata_send(char *key, void *value, int len, unsigned long long timestamp, unsigned long long seq)
+{
+    jamdata_inflight_t *f = &inflight[(ifhead + ifcount) % JAMDATA_MAX_INFLIGHT];
 
-    // If privdata is not NULL, release it.. it was previous data item
-    if (privdata != NULL)
+    if (f->cap < len)
     {
-        // TODO: Fix this memory freeing problem..
-    //    free(privdata);
+        f->value = (unsigned char *)realloc(f->value, len);
+        f->cap = len;
     }
-
-    // Wait on the dataoutq, if it has a data item (key, value) to send
-    // to the Redis.. we use the same callback..
-    while (1)
+    strncpy(f->key, key, sizeof(f->key) - 1);
+    memcpy(f->value, value, len);
+    f->len = len;
+    f->timestamp = timestamp;
+    f->seq = seq;
+
+    if (js->redctx != NULL &&
+        redisAsyncCommand(js->redctx, jamdata_logger_cb, f, "ZADD %s %llu %b", f->key, timestamp, f->value, (size_t)len) == REDIS_OK)
     {
-        nvoid_t *nv = semqueue_deq(js->dataoutq);
+        // The J node fetches the new members when it hears about them
+        char note[sizeof(f->key) + 24];
+        snprintf(note, sizeof(note), "%llu %s", timestamp, f->key);
+        redisAsyncCommand(js->redctx, NULL, NULL, "PUBLISH %s %s", JAMDATA_NOTIFY, note);
+        ifcount++;
+        return;
+    }
+
+    redis_up = false;
+    if (seq > 0)
+        jamspool_rewind(spool);
+    else
+        jamdata_spool_record(key, value, len, timestamp);
+}
 
-        if (nv != NULL)
+
+static void jamdata_pump()
+{
+    spoolrec_t rec;
+    nvoid_t *nv;
+
+    while (redis_up && ifcount < JAMDATA_MAX_INFLIGHT)
+    {
+        // Older records first
+        if (spool != NULL && jamspool_pending(spool))
         {
-            comboptr_t *cptr = (comboptr_t *)nv->data;
-            char *key = cptr->arg1;
-            char *value = cptr->arg2;
-            size_t size = cptr->size;
-            unsigned long long time_stamp = cptr->lluarg;
-            /* TODO */
-            // int iscbor = cptr->iarg;
-            // TODO: Free nv
-            // TODO: Free memory contained in nv
-
-            __jamdata_logto_server(js->redctx, key, value, size, time_stamp, jamdata_logger_cb);
-            break;
+            if (jamspool_next(spool, &rec))
+                jamdata_send(rec.key, rec.value, rec.len, rec.timestamp, rec.seq);
+            continue;
         }
+
+        // Wait a little for the next record if nothing is in flight
+        nv = semqueue_timeddeq(js->dataoutq, ifcount == 0 ? JAMDATA_PUMP_PERIOD : 0);
+        if (nv == NULL)
+            return;
+
+        comboptr_t *cptr = (comboptr_t *)nv->data;
+        jamdata_send(cptr->arg1, cptr->arg2, cptr->size, cptr->lluarg, 0);
+        jamdata_release_item(nv);
+    }
+
+    // Window is full or Redis is not there.. keep the dataoutq short
+    while ((nv = semqueue_timeddeq(js->dataoutq, 0)) != NULL)
+    {
+        comboptr_t *cptr = (comboptr_t *)nv->data;
+        jamdata_spool_record(cptr->arg1, cptr->arg2, cptr->size, cptr->lluarg);
+        jamdata_release_item(nv);
+    }
+}
+
+
+/*
+ * This is the logger callback.. privdata is the record in flight.
+ * Redis replies in order so it is always the oldest one.
+ */
+void jamdata_logger_cb(redisAsyncContext *c, void *r, void *privdata)
+{
+    redisReply *reply = r;
+    jamdata_inflight_t *f = (jamdata_inflight_t *)privdata;
+
+    if (f == NULL || ifcount == 0)
+        return;
+    ifhead = (ifhead + 1) % JAMDATA_MAX_INFLIGHT;
+    ifcount--;
+
+    if (reply == NULL)
+    {
+        // Connection is gone.. the record is replayed after the reconnect
+        if (f->seq > 0)
+            jamspool_rewind(spool);
+        else
+            jamdata_spool_record(f->key, f->value, f->len, f->timestamp);
+        return;
     }
+
+    if (reply->type == REDIS_REPLY_ERROR)
+        printf("WARNING! Redis rejected a logger record for %s: %s\n", f->key, reply->str);
+    else if (f->seq > 0)
+        jamspool_ack(spool, f->seq);
+
+    jamdata_pump();
 }
 
 
@@ -410,6 +607,752 @@ void jamdata_log_to_server(char *ns, char *lname, char *fmt, ...)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////////////
+//      JAM LOGGER handles
+//////////////////////////////////////////////////////////////////////////////////////
+
+// "timestamp" key followed by the head of a 64-bit unsigned integer
+static unsigned char logger_tskey[] = { 0x69, 't', 'i', 'm', 'e', 's', 't', 'a', 'm', 'p', 0x1b };
+
+
+jamlogger_t *jamlogger_init(char *ns, char *lname, int type)
+{
+    jamlogger_t *jl = (jamlogger_t *)calloc(1, sizeof(jamlogger_t));
+
+    // Same key as jamdata_makekey().. the device id is known after jam_init()
+    char format[] = "aps[%s].ns[%s].ds[%s].dts[%s]";
+    char *devid = js->cstate->device_id;
+    char key[strlen(app_id) + strlen(ns) + strlen(lname) + strlen(devid) + sizeof(format) - 8];
+    sprintf(key, format, app_id, ns, lname, devid);
+
+    jl->type = type;
+    jl->key = strdup(key);
+
+    // map(2) followed by the "value" key
+    jl->prefix[0] = 0xa2;
+    jl->prefix[1] = 0x65;
+    memcpy(jl->prefix + 2, "value", 5);
+    jl->prefixlen = 7;
+
+    pthread_mutex_init(&(jl->lock), NULL);
+
+    jl->slab = (unsigned char *)malloc(LOGGER_SLAB_RECORDS * LOGGER_RECORD_SIZE);
+    if (jl->slab == NULL)
+    {
+        printf("ERROR! Unable to allocate the record slab for logger %s\n", lname);
+        exit(1);
+    }
+
+    return jl;
+}
+
+
+static int logger_put_be(unsigned char *p, unsigned long long val, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        p[i] = val & 0xff;
+        val >>= 8;
+    }
+    return bytes;
+}
+
+// CBOR head (major type + length/value) using the shortest width
+static int logger_put_head(unsigned char *p, int major, unsigned long long val)
+{
+    major <<= 5;
+    if (val < 24)
+    {
+        p[0] = major | val;
+        return 1;
+    }
+    else if (val <= 0xff)
+    {
+        p[0] = major | 24;
+        return 1 + logger_put_be(p + 1, val, 1);
+    }
+    else if (val <= 0xffff)
+    {
+        p[0] = major | 25;
+        return 1 + logger_put_be(p + 1, val, 2);
+    }
+    else if (val <= 0xffffffffULL)
+    {
+        p[0] = major | 26;
+        return 1 + logger_put_be(p + 1, val, 4);
+    }
+    p[0] = major | 27;
+    return 1 + logger_put_be(p + 1, val, 8);
+}
+
+
+// Get a record of at least len bytes. It comes from the slab unless the
+// slab slot is still waiting to be sent (or len is too large) - then it
+// is allocated and freed by jamlogger_release().
+//
+static unsigned char *logger_get_record(jamlogger_t *jl, int len, int *indx)
+{
+    if (len <= LOGGER_RECORD_SIZE)
+    {
+        int i = __atomic_fetch_add(&jl->next, 1, __ATOMIC_RELAXED) % LOGGER_SLAB_RECORDS;
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&jl->busy[i], &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            *indx = i;
+            return jl->slab + i * LOGGER_RECORD_SIZE;
+        }
+    }
+
+    *indx = -1;
+    return (unsigned char *)malloc(len);
+}
+
+
+static void logger_send(jamlogger_t *jl, unsigned char *rec, int len, int indx, unsigned long long timestamp)
+{
+    // The queue copies the comboptr_t.. no need to allocate it
+    comboptr_t cptr = {0};
+    cptr.arg1 = jl->key;
+    cptr.arg2 = rec;
+    cptr.arg3 = jl;
+    cptr.iarg = indx;
+    cptr.size = len;
+    cptr.lluarg = timestamp;
+
+    semqueue_enq(js->dataoutq, &cptr, sizeof(comboptr_t));
+}
+
+
+// Fill in the record: prefix, value (already at rec + prefixlen), timestamp
+static int logger_finish(jamlogger_t *jl, unsigned char *rec, int vlen, unsigned long long timestamp)
+{
+    int len = jl->prefixlen + vlen;
+
+    memcpy(rec, jl->prefix, jl->prefixlen);
+    memcpy(rec + len, logger_tskey, sizeof(logger_tskey));
+    len += sizeof(logger_tskey);
+    len += logger_put_be(rec + len, timestamp, 8);
+
+    return len;
+}
+
+#define LOGGER_FIXED_SIZE(jl)       ((jl)->prefixlen + sizeof(logger_tskey) + 8)
+
+
+static void logger_add_timed(jamlogger_t *jl)
+{
+    pthread_mutex_lock(&timedlock);
+    jl->tnext = timed;
+    timed = jl;
+    pthread_mutex_unlock(&timedlock);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+//      Windowed aggregation
+//////////////////////////////////////////////////////////////////////////////////////
+
+void jamlogger_set_window(jamlogger_t *jl, int size, int slide)
+{
+    if (size <= 0)
+    {
+        printf("WARNING! Window size %d for logger %s is not valid.. ignored\n", size, jl->key);
+        return;
+    }
+    if (jl->window != NULL || jl->block != NULL)
+    {
+        printf("WARNING! Logger %s is already windowed or compact.. ignored\n", jl->key);
+        return;
+    }
+    // Tumbling window unless a smaller slide that divides the size is given
+    if (slide <= 0 || slide > size)
+        slide = size;
+    if (size % slide != 0 || size / slide > LOGGER_MAX_PANES)
+    {
+        printf("WARNING! Window slide %d does not divide size %d (max %d panes) for logger %s.. using a tumbling window\n",
+                slide, size, LOGGER_MAX_PANES, jl->key);
+        slide = size;
+    }
+
+    jamwindow_t *w = (jamwindow_t *)calloc(1, sizeof(jamwindow_t));
+    w->size = size;
+    w->slide = slide;
+    w->npanes = size / slide;
+    w->panes = (jampane_t *)calloc(w->npanes, sizeof(jampane_t));
+    if (w->panes == NULL)
+    {
+        printf("ERROR! Unable to allocate the window for logger %s\n", jl->key);
+        exit(1);
+    }
+    jl->window = w;
+    logger_add_timed(jl);
+}
+
+
+void jamlogger_set_histogram(jamlogger_t *jl, double min, double max, int bins)
+{
+    jamwindow_t *w = jl->window;
+
+    if (w == NULL || w->hbins > 0 || bins <= 0 || bins > LOGGER_MAX_BINS || max <= min)
+    {
+        printf("WARNING! Histogram (%g, %g, %d) for logger %s is not valid.. ignored\n", min, max, bins, jl->key);
+        return;
+    }
+
+    for (int i = 0; i < w->npanes; i++)
+    {
+        w->panes[i].hist = (unsigned int *)calloc(bins, sizeof(unsigned int));
+        if (w->panes[i].hist == NULL)
+        {
+            printf("ERROR! Unable to allocate the histogram for logger %s\n", jl->key);
+            exit(1);
+        }
+    }
+    w->hbins = bins;
+    w->hmin = min;
+    w->hmax = max;
+}
+
+
+static void window_reset_pane(jamwindow_t *w, jampane_t *p)
+{
+    p->count = 0;
+    p->sum = 0;
+    if (p->hist != NULL)
+        memset(p->hist, 0, w->hbins * sizeof(unsigned int));
+}
+
+
+static int logger_put_double(unsigned char *p, double value)
+{
+    unsigned long long bits;
+    memcpy(&bits, &value, sizeof(double));
+    p[0] = 0xfb;
+    return 1 + logger_put_be(p + 1, bits, 8);
+}
+
+
+static int logger_put_key(unsigned char *p, char *key)
+{
+    int len = strlen(key);
+    int n = logger_put_head(p, 3, len);
+    memcpy(p + n, key, len);
+    return n + len;
+}
+
+
+// Combine the panes of the window ending at end and send the record.
+// Nothing is sent for a window without samples.
+//
+static void window_emit(jamlogger_t *jl, unsigned long long end)
+{
+    jamwindow_t *w = jl->window;
+    unsigned int count = 0;
+    double min = 0, max = 0, sum = 0;
+    int i, indx, vlen;
+
+    for (i = 0; i < w->npanes; i++)
+    {
+        jampane_t *p = &(w->panes[i]);
+        if (p->count == 0)
+            continue;
+        if (count == 0 || p->min < min)
+            min = p->min;
+        if (count == 0 || p->max > max)
+            max = p->max;
+        count += p->count;
+        sum += p->sum;
+    }
+    if (count == 0)
+        return;
+
+    // Keys (at most 6 bytes each), 7 values and the histogram counts
+    int maxlen = 1 + 8 * 6 + 7 * 9 + (w->hbins > 0 ? 6 + 5 + w->hbins * 5 : 0);
+    unsigned char *rec = logger_get_record(jl, LOGGER_FIXED_SIZE(jl) + maxlen, &indx);
+    unsigned char *v = rec + jl->prefixlen;
+
+    vlen = logger_put_head(v, 5, w->hbins > 0 ? 8 : 7);
+    vlen += logger_put_key(v + vlen, "count");
+    vlen += logger_put_head(v + vlen, 0, count);
+    vlen += logger_put_key(v + vlen, "min");
+    vlen += logger_put_double(v + vlen, min);
+    vlen += logger_put_key(v + vlen, "max");
+    vlen += logger_put_double(v + vlen, max);
+    vlen += logger_put_key(v + vlen, "mean");
+    vlen += logger_put_double(v + vlen, sum / count);
+    vlen += logger_put_key(v + vlen, "last");
+    vlen += logger_put_double(v + vlen, w->last);
+    vlen += logger_put_key(v + vlen, "start");
+    vlen += logger_put_head(v + vlen, 0, end - w->size);
+    vlen += logger_put_key(v + vlen, "end");
+    vlen += logger_put_head(v + vlen, 0, end);
+
+    if (w->hbins > 0)
+    {
+        vlen += logger_put_key(v + vlen, "hist");
+        vlen += logger_put_head(v + vlen, 4, w->hbins);
+        for (int b = 0; b < w->hbins; b++)
+        {
+            unsigned int n = 0;
+            for (i = 0; i < w->npanes; i++)
+                n += w->panes[i].hist[b];
+            vlen += logger_put_head(v + vlen, 0, n);
+        }
+    }
+
+    logger_send(jl, rec, logger_finish(jl, rec, vlen, end), indx, end);
+}
+
+
+// Close the panes that ended before timestamp - each closing emits the
+// window that ends with it.
+//
+static void window_advance(jamlogger_t *jl, unsigned long long timestamp)
+{
+    jamwindow_t *w = jl->window;
+    int steps = 0;
+
+    while (timestamp >= w->curstart + w->slide)
+    {
+        if (steps++ == w->npanes)
+        {
+            // All panes are empty now.. skip the idle period
+            w->curstart = timestamp - timestamp % w->slide;
+            break;
+        }
+        window_emit(jl, w->curstart + w->slide);
+        w->cur = (w->cur + 1) % w->npanes;
+        window_reset_pane(w, &(w->panes[w->cur]));
+        w->curstart += w->slide;
+    }
+}
+
+
+// Fold a sample into the current pane
+//
+static void window_add(jamlogger_t *jl, double value, unsigned long long timestamp)
+{
+    jamwindow_t *w = jl->window;
+
+    if (w->curstart == 0)
+        w->curstart = timestamp - timestamp % w->slide;
+    window_advance(jl, timestamp);
+
+    jampane_t *p = &(w->panes[w->cur]);
+    if (p->count == 0 || value < p->min)
+        p->min = value;
+    if (p->count == 0 || value > p->max)
+        p->max = value;
+    p->count++;
+    p->sum += value;
+    w->last = value;
+
+    if (w->hbins > 0)
+    {
+        // Out of range values go into the first or last bin
+        int b = (int)((value - w->hmin) * w->hbins / (w->hmax - w->hmin));
+        if (b < 0)
+            b = 0;
+        else if (b >= w->hbins)
+            b = w->hbins - 1;
+        p->hist[b]++;
+    }
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////////////////
+//      Compact blocks
+//////////////////////////////////////////////////////////////////////////////////////
+
+void jamlogger_set_block(jamlogger_t *jl, int maxcount, int maxage)
+{
+    if ((jl->type != LOGGER_INT && jl->type != LOGGER_FLOAT) || jl->window != NULL || jl->block != NULL)
+    {
+        printf("WARNING! Logger %s cannot be compact.. ignored\n", jl->key);
+        return;
+    }
+
+    jamblock_t *b = (jamblock_t *)calloc(1, sizeof(jamblock_t));
+    if (b == NULL)
+    {
+        printf("ERROR! Unable to allocate the block for logger %s\n", jl->key);
+        exit(1);
+    }
+    // The block is also sent when it is full
+    b->maxcount = maxcount > 0 ? maxcount : LOGGER_BLOCK_SIZE;
+    b->maxage = maxage > 0 ? maxage : 0;
+    jl->block = b;
+    logger_add_timed(jl);
+}
+
+
+// Send the samples in the block (if any). The record is larger than the
+// slab records so it is allocated.
+//
+void jamlogger_flush(jamlogger_t *jl)
+{
+    jamblock_t *b = jl->block;
+    int indx, len = 0;
+
+    if (b == NULL || b->count == 0)
+        return;
+
+    unsigned char *rec = logger_get_record(jl, 1 + 6 + 3 + b->len + sizeof(logger_tskey) + 8, &indx);
+    rec[len++] = 0xa2;
+    len += logger_put_key(rec + len, "block");
+    len += logger_put_head(rec + len, 2, b->len);
+    memcpy(rec + len, b->data, b->len);
+    len += b->len;
+    memcpy(rec + len, logger_tskey, sizeof(logger_tskey));
+    len += sizeof(logger_tskey);
+    len += logger_put_be(rec + len, b->t0, 8);
+
+    logger_send(jl, rec, len, indx, b->t0);
+    jamblock_clear(b);
+}
+
+
+// value is the int or the float bits
+static void block_add(jamlogger_t *jl, unsigned int value, unsigned long long timestamp)
+{
+    int type = (jl->type == LOGGER_INT) ? LOGGER_BLOCK_INT : LOGGER_BLOCK_FLOAT;
+
+    if (jamblock_full(jl->block, timestamp))
+        jamlogger_flush(jl);
+    if (jamblock_add(jl->block, type, value, timestamp))
+        jamlogger_flush(jl);
+}
+
+
+// Close the windows and send the blocks that aged without a new sample.
+// final (at exit) also sends the partial ones.
+//
+static void jamdata_close_loggers(bool final)
+{
+    unsigned long long now = ms_time();
+    jamlogger_t *jl;
+
+    pthread_mutex_lock(&timedlock);
+    for (jl = timed; jl != NULL; jl = jl->tnext)
+    {
+        pthread_mutex_lock(&(jl->lock));
+        jamwindow_t *w = jl->window;
+        jamblock_t *b = jl->block;
+
+        if (w != NULL && w->curstart != 0)
+        {
+            window_advance(jl, now);
+            if (final)
+            {
+                window_emit(jl, w->curstart + w->slide);
+                window_reset_pane(w, &(w->panes[w->cur]));
+            }
+        }
+        if (b != NULL && b->count > 0 &&
+            (final || (b->maxage > 0 && now - b->t0 >= (unsigned long long)b->maxage)))
+            jamlogger_flush(jl);
+        pthread_mutex_unlock(&(jl->lock));
+    }
+    pthread_mutex_unlock(&timedlock);
+}
+
+
+void jamlogger_log_int(jamlogger_t *jl, int value)
+{
+    unsigned long long timestamp = ms_time();
+    int indx, vlen;
+
+    if (jl->window != NULL)
+    {
+        pthread_mutex_lock(&(jl->lock));
+        window_add(jl, value, timestamp);
+        pthread_mutex_unlock(&(jl->lock));
+        return;
+    }
+    if (jl->block != NULL)
+    {
+        pthread_mutex_lock(&(jl->lock));
+        block_add(jl, (unsigned int)value, timestamp);
+        pthread_mutex_unlock(&(jl->lock));
+        return;
+    }
+
+    unsigned char *rec = logger_get_record(jl, LOGGER_FIXED_SIZE(jl) + 9, &indx);
+
+    if (value < 0)
+        vlen = logger_put_head(rec + jl->prefixlen, 1, (unsigned long long)(-1LL - value));
+    else
+        vlen = logger_put_head(rec + jl->prefixlen, 0, value);
+
+    logger_send(jl, rec, logger_finish(jl, rec, vlen, timestamp), indx, timestamp);
+}
+
+
+void jamlogger_log_float(jamlogger_t *jl, float value)
+{
+    unsigned long long timestamp = ms_time();
+    int indx;
+
+    if (jl->window != NULL)
+    {
+        pthread_mutex_lock(&(jl->lock));
+        window_add(jl, value, timestamp);
+        pthread_mutex_unlock(&(jl->lock));
+        return;
+    }
+    if (jl->block != NULL)
+    {
+        unsigned int bits;
+        memcpy(&bits, &value, sizeof(float));
+        pthread_mutex_lock(&(jl->lock));
+        block_add(jl, bits, timestamp);
+        pthread_mutex_unlock(&(jl->lock));
+        return;
+    }
+
+    unsigned char *rec = logger_get_record(jl, LOGGER_FIXED_SIZE(jl) + 9, &indx);
+
+    // Sent as a double.. same as jamdata_log_to_server_float()
+    int vlen = logger_put_double(rec + jl->prefixlen, value);
+
+    logger_send(jl, rec, logger_finish(jl, rec, vlen, timestamp), indx, timestamp);
+}
+
+
+void jamlogger_log_string(jamlogger_t *jl, char *value)
+{
+    unsigned long long timestamp = ms_time();
+    int indx, vlen;
+    int slen = strlen(value);
+    unsigned char *rec = logger_get_record(jl, LOGGER_FIXED_SIZE(jl) + 9 + slen, &indx);
+
+    vlen = logger_put_head(rec + jl->prefixlen, 3, slen);
+    memcpy(rec + jl->prefixlen + vlen, value, slen);
+
+    logger_send(jl, rec, logger_finish(jl, rec, vlen + slen, timestamp), indx, timestamp);
+}
+
+
+/*
+ * Struct records. The compiler generates one encoder per struct type that
+ * calls these in the field order of the declaration.
+ * maxlen is the largest encoded size of the fields (strings included).
+ */
+void jamrecord_begin(jamrecord_t *r, jamlogger_t *jl, unsigned int schema, int nfields, int maxlen)
+{
+    r->jl = jl;
+    r->timestamp = ms_time();
+    r->buf = logger_get_record(jl, LOGGER_FIXED_SIZE(jl) + 18 + maxlen, &r->indx);
+
+    memcpy(r->buf, jl->prefix, jl->prefixlen);
+    r->len = jl->prefixlen;
+    r->len += logger_put_head(r->buf + r->len, 4, nfields + 1);
+    r->len += logger_put_head(r->buf + r->len, 0, schema);
+}
+
+void jamrecord_put_int(jamrecord_t *r, int value)
+{
+    if (value < 0)
+        r->len += logger_put_head(r->buf + r->len, 1, (unsigned long long)(-1LL - value));
+    else
+        r->len += logger_put_head(r->buf + r->len, 0, value);
+}
+
+void jamrecord_put_float(jamrecord_t *r, float value)
+{
+    double dval = value;
+    unsigned long long bits;
+
+    memcpy(&bits, &dval, sizeof(double));
+    r->buf[r->len++] = 0xfb;
+    r->len += logger_put_be(r->buf + r->len, bits, 8);
+}
+
+void jamrecord_put_string(jamrecord_t *r, char *value)
+{
+    int slen = strlen(value);
+
+    r->len += logger_put_head(r->buf + r->len, 3, slen);
+    memcpy(r->buf + r->len, value, slen);
+    r->len += slen;
+}
+
+void jamrecord_end(jamrecord_t *r)
+{
+    int len = logger_finish(r->jl, r->buf, r->len - r->jl->prefixlen, r->timestamp);
+    logger_send(r->jl, r->buf, len, r->indx, r->timestamp);
+}
+
+
+static bool reader_head(jamreader_t *r, int *major, unsigned long long *val)
+{
+    int ai, bytes;
+
+    if (r->p >= r->end)
+        return false;
+
+    *major = *(r->p) >> 5;
+    ai = *(r->p) & 0x1f;
+    r->p++;
+
+    if (ai < 24)
+    {
+        *val = ai;
+        return true;
+    }
+    else if (ai > 27)
+        return false;
+
+    bytes = 1 << (ai - 24);
+    if (r->p + bytes > r->end)
+        return false;
+
+    *val = 0;
+    for (int i = 0; i < bytes; i++)
+        *val = (*val << 8) | *(r->p++);
+
+    return true;
+}
+
+// CBOR float (half, single or double) from the raw bits
+static double reader_float(int ai, unsigned long long bits)
+{
+    if (ai == 25)
+    {
+        int exp = (bits >> 10) & 0x1f;
+        int mant = bits & 0x3ff;
+        double val;
+
+        if (exp == 0)
+            val = ldexp(mant, -24);
+        else if (exp != 31)
+            val = ldexp(mant + 1024, exp - 25);
+        else
+            val = mant == 0 ? INFINITY : NAN;
+        return (bits & 0x8000) ? -val : val;
+    }
+    else if (ai == 26)
+    {
+        uint32_t b = bits;
+        float f;
+        memcpy(&f, &b, sizeof(float));
+        return f;
+    }
+    else
+    {
+        double d;
+        memcpy(&d, &bits, sizeof(double));
+        return d;
+    }
+}
+
+// Decode the base64 payload into the reader buffer
+//
+bool jamreader_init(jamreader_t *r, char *data)
+{
+    int len;
+
+    r->buf = NULL;
+    if (data == NULL || data[0] == 0)
+        return false;
+
+    len = Base64decode_len(data);
+    r->buf = len <= JAMREADER_LOCAL_SIZE ? r->local : (unsigned char *)malloc(len);
+    len = Base64decode((char *)r->buf, data);
+    r->p = r->buf;
+    r->end = r->buf + len;
+
+    return true;
+}
+
+// Returns false if data is not a record of this schema.. the caller
+// should use the generic jamdata_decode() then.
+//
+bool jamreader_open(jamreader_t *r, char *data, unsigned int schema, int nfields)
+{
+    int major;
+    unsigned long long val;
+
+    if (!jamreader_init(r, data))
+        return false;
+
+    if (!reader_head(r, &major, &val) || major != 4 || val != nfields + 1 ||
+        !reader_head(r, &major, &val) || major != 0 || val != schema)
+    {
+        jamreader_close(r);
+        return false;
+    }
+
+    return true;
+}
+
+// Any CBOR number (or true/false) as a double
+static double reader_number(jamreader_t *r)
+{
+    int major, ai;
+    unsigned long long val;
+
+    if (r->p >= r->end)
+        return 0;
+    ai = *(r->p) & 0x1f;
+    if (!reader_head(r, &major, &val))
+        return 0;
+
+    if (major == 0)
+        return (double)val;
+    else if (major == 1)
+        return (double)(-1LL - (long long)val);
+    else if (major == 7 && ai >= 25)
+        return reader_float(ai, val);
+    else if (major == 7)
+        return (val == 21) ? 1 : 0;
+
+    return 0;
+}
+
+int jamreader_get_int(jamreader_t *r)
+{
+    return (int)reader_number(r);
+}
+
+float jamreader_get_float(jamreader_t *r)
+{
+    return (float)reader_number(r);
+}
+
+// The string is allocated.. same as jamdata_decode()
+char *jamreader_get_string(jamreader_t *r)
+{
+    int major;
+    unsigned long long val;
+
+    if (!reader_head(r, &major, &val) || (major != 3 && major != 2) || r->p + val > r->end)
+        return strdup("");
+
+    char *s = strndup((char *)r->p, val);
+    r->p += val;
+    return s;
+}
+
+void jamreader_close(jamreader_t *r)
+{
+    if (r->buf != NULL && r->buf != r->local)
+        free(r->buf);
+    r->buf = NULL;
+}
+
+
+// Called by the sender once the record is written to the Redis buffer
+void jamlogger_release(jamlogger_t *jl, int indx, void *record)
+{
+    if (indx < 0)
+        free(record);
+    else
+        __atomic_store_n(&jl->busy[indx], 0, __ATOMIC_RELEASE);
+}
+
+
 //////////////////////////////////////////////////////////////////////////////////////
 //      JAM BROADCASTER routines
 //////////////////////////////////////////////////////////////////////////////////////
@@ -458,6 +1401,7 @@ jambroadcaster_t *create_jambroadcaster(int mode, char *ns, char *varname)
     jval->data = create_list();
     jval->readysem = threadsem_new();
     jval->dataq = pqueue_new(true);
+    jval->waitsem = threadsem_new();
 
     // Start the runner
     pthread_create(&(jval->thread), NULL, jambcast_runner, jval);
@@ -468,43 +1412,156 @@ jambroadcaster_t *create_jambroadcaster(int mode, char *ns, char *varname)
 }
 
 
-// TODO: Fix the last vs next mode
+// Value for a read of the broadcaster in the program.. the first read in
+// BCAST_RETURNS_LAST waits for a value like BCAST_RETURNS_NEXT does
 char *get_bcast_value(jambroadcaster_t *bcast)
 {
+    if (bcast->mode == BCAST_RETURNS_LAST)
+    {
+        char *val = get_bcast_last_value(bcast);
+        if (val != NULL)
+            return val;
+        return get_bcast_newer_value(bcast, 0, NULL, -1);
+    }
+
     return get_bcast_next_value(bcast);
 }
 
 
+/*
+ * Broadcast values come in two forms. The J node sends the JSON envelope
+ * {"counter": .., "message": v} on the plain domain and a base64 encoded
+ * CBOR scalar on the ".cbor" domain (the compiler subscribes to the latter).
+ * Base64 never starts with '{', so the two are told apart by the first byte.
+ *
+ * Only the "message" value of the envelope is built (jparser_query()), in
+ * the arena of a parser that belongs to the calling thread. The functions
+ * release msg (it comes from get_bcast_next_value()).
+ */
+static __thread jparser_t *bcast_parser;
+
+// Value of the top level "message" key.. valid until the next call in this thread
+static JSONValue *bcast_json_message(char *msg)
+{
+    if (bcast_parser == NULL)
+        bcast_parser = jparser_new();
+    else
+        jparser_reset(bcast_parser);
+
+    return jparser_query(bcast_parser, msg, strlen(msg), "s", "message");
+}
+
+static double bcast_json_number(JSONValue *val)
+{
+    if (val == NULL)
+        return 0;
+
+    switch (val->type)
+    {
+        case INTEGER:
+            return val->val.ival;
+        case DOUBLE:
+            return val->val.dval;
+        case JTRUE:
+            return 1;
+        case STRING:
+            return strtod(val->val.sval, NULL);
+        default:
+            return 0;
+    }
+}
+
+static char *bcast_json_string(JSONValue *val)
+{
+    char buf[64];
+
+    if (val == NULL)
+        return strdup("");
+
+    switch (val->type)
+    {
+        case STRING:
+            return strdup(val->val.sval);
+        case INTEGER:
+            snprintf(buf, sizeof(buf), "%d", val->val.ival);
+            return strdup(buf);
+        case DOUBLE:
+            snprintf(buf, sizeof(buf), "%g", val->val.dval);
+            return strdup(buf);
+        case JTRUE:
+            return strdup("true");
+        case JFALSE:
+            return strdup("false");
+        case JNULL:
+            return strdup("null");
+        default:
+            return strdup("");
+    }
+}
+
+
 int get_bcast_int(char *msg)
 {
-    init_parse(msg);
-    parse_value();
-    JSONValue *jval = get_value();
-    JSONValue *jjval = query_value(jval, "s", "message");
+    jamreader_t r;
+    int ival = 0;
+
+    if (msg == NULL)
+        return 0;
 
-    return jjval->val.ival;
+    if (msg[0] == '{')
+        ival = (int)bcast_json_number(bcast_json_message(msg));
+    else if (jamreader_init(&r, msg))
+    {
+        ival = jamreader_get_int(&r);
+        jamreader_close(&r);
+    }
+
+    free(msg);
+    return ival;
 }
 
 
 float get_bcast_float(char *msg)
 {
-    init_parse(msg);
-    parse_value();
-    JSONValue *jval = get_value();
-    JSONValue *jjval = query_value(jval, "s", "message");
+    jamreader_t r;
+    float fval = 0;
 
-    return (float)jjval->val.dval;
+    if (msg == NULL)
+        return 0;
+
+    if (msg[0] == '{')
+        fval = (float)bcast_json_number(bcast_json_message(msg));
+    else if (jamreader_init(&r, msg))
+    {
+        fval = jamreader_get_float(&r);
+        jamreader_close(&r);
+    }
 
+    free(msg);
+    return fval;
 }
 
+// The returned string is allocated.. the caller owns it
 char *get_bcast_char(char *msg)
 {
-    init_parse(msg);
-    parse_value();
-    JSONValue *jval = get_value();
-    JSONValue *jjval = query_value(jval, "s", "message");
+    jamreader_t r;
+    char *sval;
+
+    if (msg == NULL)
+        return NULL;
+
+    if (msg[0] == '{')
+        sval = bcast_json_string(bcast_json_message(msg));
+    else if (jamreader_init(&r, msg))
+    {
+        sval = jamreader_get_string(&r);
+        jamreader_close(&r);
+    }
+    else
+        sval = strdup("");
 
-    return jjval->val.sval;
+    free(msg);
+    return sval;
 }
 
 
@@ -512,6 +1569,11 @@ char *get_bcast_next_value(jambroadcaster_t *bcast)
 {
     char *dval;
 
+    // Nothing is queued in this mode.. the next value is the one after
+    // the current one
+    if (bcast->mode == BCAST_RETURNS_LAST)
+        return get_bcast_newer_value(bcast, get_bcast_version(bcast), NULL, -1);
+
     nvoid_t *nv = pqueue_deq(bcast->dataq);
     if (nv != NULL)
     {
@@ -526,16 +1588,126 @@ char *get_bcast_next_value(jambroadcaster_t *bcast)
 
 
 
-// TODO: Reimplement this one with the new design
+// Store a value in the BCAST_RETURNS_LAST slot. Runs on the Redis thread,
+// the only writer of the slot.
 //
-// char *get_bcast_last_value(jambroadcaster_t *bcast)
-// {
-//     int count = get_bcast_count(bcast) -1;
-//     for (int i = 0; i < count; i++)
-//         get_bcast_next_value(bcast);
+static void bcast_store_last(jambroadcaster_t *bcast, char *val, int len)
+{
+    if (len >= BCAST_SLOT_SIZE)
+    {
+        printf("WARNING! Broadcast value of %d bytes on %s is too long.. dropped\n", len, bcast->key);
+        return;
+    }
+
+    unsigned int seq = bcast->seq;
+    __atomic_store_n(&bcast->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(bcast->last, val, len);
+    bcast->last[len] = 0;
+    __atomic_store_n(&bcast->version, bcast->version + 1, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&bcast->seq, seq + 2, __ATOMIC_RELEASE);
+
+    // One wakeup for each waiting reader
+    int n = __atomic_load_n(&bcast->nwaiters, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++)
+        thread_signal(bcast->waitsem);
+}
+
+
+// Copy the slot into buf.. returns the version of the copied value
 //
-//     return get_bcast_next_value(bcast);
-// }
+static unsigned long long bcast_load_last(jambroadcaster_t *bcast, char *buf)
+{
+    unsigned int s1, s2;
+    unsigned long long version;
+
+    do {
+        s1 = __atomic_load_n(&bcast->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1)
+            continue;
+        version = __atomic_load_n(&bcast->version, __ATOMIC_RELAXED);
+        memcpy(buf, bcast->last, BCAST_SLOT_SIZE);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&bcast->seq, __ATOMIC_RELAXED);
+    } while ((s1 & 1) || s1 != s2);
+
+    buf[BCAST_SLOT_SIZE - 1] = 0;
+    return version;
+}
+
+
+unsigned long long get_bcast_version(jambroadcaster_t *bcast)
+{
+    return __atomic_load_n(&bcast->version, __ATOMIC_ACQUIRE);
+}
+
+
+// Newest value (BCAST_RETURNS_LAST) or NULL if none came in yet. Does not
+// wait. The caller frees the value, as with get_bcast_next_value().
+//
+char *get_bcast_last_value(jambroadcaster_t *bcast)
+{
+    char buf[BCAST_SLOT_SIZE];
+
+    if (get_bcast_version(bcast) == 0)
+        return NULL;
+
+    bcast_load_last(bcast, buf);
+    return strdup(buf);
+}
+
+
+// Newest value once its version is above `version'. Waits at most ms
+// milliseconds (forever if ms < 0) and returns NULL on timeout. The
+// version of the returned value goes in newversion (if not NULL) so a
+// control loop can ask for the value after the one it has.
+//
+char *get_bcast_newer_value(jambroadcaster_t *bcast, unsigned long long version, unsigned long long *newversion, int ms)
+{
+    char buf[BCAST_SLOT_SIZE];
+    char c;
+    long long deadline = ms < 0 ? 0 : activity_getseconds() + ms * 1000LL;
+
+    while (1)
+    {
+        if (get_bcast_version(bcast) > version)
+        {
+            unsigned long long v = bcast_load_last(bcast, buf);
+            if (newversion != NULL)
+                *newversion = v;
+            return strdup(buf);
+        }
+
+        __atomic_add_fetch(&bcast->nwaiters, 1, __ATOMIC_ACQ_REL);
+        // The writer may have stored just before we registered
+        if (get_bcast_version(bcast) > version)
+        {
+            __atomic_sub_fetch(&bcast->nwaiters, 1, __ATOMIC_ACQ_REL);
+            continue;
+        }
+
+        bool ready = true;
+        if (ms < 0)
+            fdwait(bcast->waitsem->fildes[0], 'r');
+        else
+        {
+            long long left = deadline - activity_getseconds();
+            ready = left > 0 && fdtimedwait(bcast->waitsem->fildes[0], 'r', (left + 999) / 1000) != 0;
+        }
+        __atomic_sub_fetch(&bcast->nwaiters, 1, __ATOMIC_ACQ_REL);
+
+        if (ready)
+        {
+            // Take one wakeup.. another reader may have taken it already
+            if (read(bcast->waitsem->fildes[0], &c, 1) < 0)
+                continue;
+        }
+        else if (get_bcast_version(bcast) <= version)
+            return NULL;
+    }
+}
 
 
 // data          - encoded cbor data to be decoded
@@ -667,6 +1839,12 @@ void jambcast_recv_callback(redisAsyncContext *c, void *r, void *privdata)
         result = reply->element[2]->str;
 
         if ((result != NULL) && (strcmp(varname, jval->key) == 0))
-            pqueue_enq(jval->dataq, result, strlen(result));
+        {
+            if (jval->mode == BCAST_RETURNS_LAST)
+                bcast_store_last(jval, result, strlen(result));
+            else
+                // The copy keeps the NUL.. the readers treat it as a string
+                pqueue_enq(jval->dataq, result, strlen(result) + 1);
+        }
     }
 }
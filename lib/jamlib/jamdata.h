@@ -25,6 +25,9 @@
 #include "pushqueue.h"
 
 #include "cborutils.h"
+#include "jamspool.h"
+#include "jamblock.h"
+#include <pthread.h>
 
 #define DEFAULT_APP_NAME "APP"
 #define DEFAULT_SERV_IP "127.0.0.1"
@@ -33,6 +36,25 @@
 
 #define BCAST_RETURNS_NEXT          1
 #define BCAST_RETURNS_LAST          2
+#define BCAST_SLOT_SIZE             1024            // largest value kept in BCAST_RETURNS_LAST
+
+#define LOGGER_INT                  1
+#define LOGGER_FLOAT                2
+#define LOGGER_STRING               3
+#define LOGGER_STRUCT               4
+
+#define LOGGER_SLAB_RECORDS         128
+#define LOGGER_RECORD_SIZE          64
+#define LOGGER_MAX_PANES            64
+#define LOGGER_MAX_BINS             64
+#define JAMREADER_LOCAL_SIZE        256
+
+#define JAMDATA_MAX_INFLIGHT        32              // ZADDs waiting for Redis
+#define JAMDATA_PUMP_PERIOD         100             // ms
+#define JAMDATA_RECONNECT_PERIOD    2000            // ms
+#define JAMDATA_SPOOL_MAX           (64LL * 1024 * 1024)
+#define JAMDATA_EXIT_WAIT           500             // ms for the jamdata thread to spool at exit
+#define JAMDATA_NOTIFY              "jamdata.zadd"  // "<score> <key>" after each ZADD
 
 typedef void (*connection_callback_f)(const redisAsyncContext *c, int status);
 typedef void (*msg_rcv_callback_f)(redisAsyncContext *c, void *reply, void *privdata);
@@ -61,9 +83,116 @@ typedef struct _jambroadcaster_t
     pthread_t thread;
     redisAsyncContext *redctx;
 
+    // BCAST_RETURNS_LAST: only the newest value is kept. The Redis thread
+    // is the only writer; readers copy the slot and retry if seq moved
+    // (seqlock). version counts the values received.
+    unsigned int seq;
+    unsigned long long version;
+    char last[BCAST_SLOT_SIZE];
+    int nwaiters;                   // readers waiting for a newer value
+    threadsem_t *waitsem;
+
 } jambroadcaster_t;
 
 
+// A logger record written to Redis that is not acknowledged yet. The
+// record is copied so it can be spooled if the connection drops.
+typedef struct _jamdata_inflight_t
+{
+    char key[512];
+    unsigned char *value;
+    int len;
+    int cap;
+    unsigned long long timestamp;
+    unsigned long long seq;         // spool record or 0 for a new record
+
+} jamdata_inflight_t;
+
+
+// Windowed pre-aggregation for numeric loggers (declared with window(..)
+// in the program). Samples are folded into panes of slide ms; when a pane
+// closes the panes covering the last size ms are combined into a single
+// record {count, min, max, mean, last, start, end[, hist]}. A tumbling
+// window has one pane (slide == size). The window is closed by the first
+// sample written after its end or by the jamdata tick, whichever is first.
+typedef struct _jampane_t
+{
+    unsigned int count;
+    double min;
+    double max;
+    double sum;
+    unsigned int *hist;
+
+} jampane_t;
+
+typedef struct _jamwindow_t
+{
+    int size;                       // window length (ms)
+    int slide;                      // emit period (ms)
+    int npanes;
+    jampane_t *panes;
+    int cur;
+    unsigned long long curstart;    // start of the current pane
+    double last;                    // most recent sample
+
+    int hbins;                      // 0 if there is no histogram
+    double hmin;
+    double hmax;
+
+} jamwindow_t;
+
+
+// Handle for a logger declared in the program. The compiler creates one
+// in user_setup() so a write does not rebuild the key or the CBOR map.
+// Records are {"value": v, "timestamp": t} written into a slab that is
+// reused once the record is handed to Redis.
+typedef struct _jamlogger_t
+{
+    int type;
+    char *key;
+
+    unsigned char prefix[8];        // map(2) "value" - pre-encoded
+    int prefixlen;
+
+    unsigned char *slab;
+    volatile int busy[LOGGER_SLAB_RECORDS];
+    unsigned int next;
+
+    jamwindow_t *window;            // NULL unless the logger is windowed
+    jamblock_t *block;              // NULL unless the logger is compact
+
+    // Windowed and compact loggers are also closed by the jamdata thread
+    pthread_mutex_t lock;
+    struct _jamlogger_t *tnext;
+
+} jamlogger_t;
+
+
+// Struct records written by the encoders the compiler generates for each
+// struct type. The value is the array [schema id, field 1, .., field n] -
+// fields in declaration order, no field names.
+typedef struct _jamrecord_t
+{
+    jamlogger_t *jl;
+    unsigned char *buf;
+    int len;
+    int indx;
+    unsigned long long timestamp;
+
+} jamrecord_t;
+
+
+// Reader used by the generated struct decoders (broadcasters)
+typedef struct _jamreader_t
+{
+    unsigned char *buf;
+    unsigned char *p;
+    unsigned char *end;
+    unsigned char local[JAMREADER_LOCAL_SIZE];
+
+} jamreader_t;
+
+
 void jamdata_def_connect(const redisAsyncContext *c, int status);
 void jamdata_def_disconnect(const redisAsyncContext *c, int status);
 void *jamdata_init(void *jsp);
@@ -76,6 +205,26 @@ void jamdata_log_to_server(char *ns, char *lname, char *fmt, ...);
 void jamdata_log_to_server_int(char *ns, char *lname, int value);
 void jamdata_log_to_server_float(char *ns, char *lname, float value);
 void jamdata_log_to_server_string(char *ns, char *lname, char *value);
+jamlogger_t *jamlogger_init(char *ns, char *lname, int type);
+void jamlogger_log_int(jamlogger_t *jl, int value);
+void jamlogger_log_float(jamlogger_t *jl, float value);
+void jamlogger_log_string(jamlogger_t *jl, char *value);
+void jamlogger_release(jamlogger_t *jl, int indx, void *record);
+void jamlogger_set_window(jamlogger_t *jl, int size, int slide);
+void jamlogger_set_histogram(jamlogger_t *jl, double min, double max, int bins);
+void jamlogger_set_block(jamlogger_t *jl, int maxcount, int maxage);
+void jamlogger_flush(jamlogger_t *jl);
+void jamrecord_begin(jamrecord_t *r, jamlogger_t *jl, unsigned int schema, int nfields, int maxlen);
+void jamrecord_put_int(jamrecord_t *r, int value);
+void jamrecord_put_float(jamrecord_t *r, float value);
+void jamrecord_put_string(jamrecord_t *r, char *value);
+void jamrecord_end(jamrecord_t *r);
+bool jamreader_init(jamreader_t *r, char *data);
+bool jamreader_open(jamreader_t *r, char *data, unsigned int schema, int nfields);
+int jamreader_get_int(jamreader_t *r);
+float jamreader_get_float(jamreader_t *r);
+char *jamreader_get_string(jamreader_t *r);
+void jamreader_close(jamreader_t *r);
 comboptr_t *jamdata_simple_encode(char *redis_key, unsigned long long timestamp, cbor_item_t *value);
 unsigned long long ms_time();
 
@@ -85,6 +234,8 @@ jambroadcaster_t *create_jambroadcaster(int mode, char *ns, char *varname);
 char *get_bcast_value(jambroadcaster_t *bcast);
 char *get_bcast_next_value(jambroadcaster_t *bcast);
 char *get_bcast_last_value(jambroadcaster_t *bcast);
+char *get_bcast_newer_value(jambroadcaster_t *bcast, unsigned long long version, unsigned long long *newversion, int ms);
+unsigned long long get_bcast_version(jambroadcaster_t *bcast);
 int get_bcast_int(char *msg);
 float get_bcast_float(char *msg);
 char *get_bcast_char(char *msg);
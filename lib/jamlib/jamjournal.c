@@ -0,0 +1,234 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2017 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY O9F ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "jamjournal.h"
+
+
+// FNV-1a over the record after the magic and the check
+//
+static uint32_t journal_check(journalrec_t *r)
+{
+    unsigned char *p = (unsigned char *)&(r->seq);
+    unsigned char *end = (unsigned char *)(r + 1);
+    uint32_t h = 2166136261u;
+
+    while (p < end)
+        h = (h ^ *p++) * 16777619u;
+    return h;
+}
+
+
+static bool journal_valid(journalrec_t *r)
+{
+    return r->magic == JOURNAL_MAGIC && r->check == journal_check(r);
+}
+
+
+journal_t *journal_open(char *path)
+{
+    size_t size = JOURNAL_RECORDS * sizeof(journalrec_t);
+    int fd, i;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0)
+    {
+        printf("WARNING! Unable to open the journal %s.. running without it\n", path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        printf("WARNING! Unable to map the journal %s.. running without it\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    journal_t *j = (journal_t *)calloc(1, sizeof(journal_t));
+    j->fd = fd;
+    j->recs = (journalrec_t *)p;
+    pthread_mutex_init(&(j->lock), NULL);
+
+    // Carry on after the newest record
+    for (i = 0; i < JOURNAL_RECORDS; i++)
+        if (journal_valid(&(j->recs[i])) && j->recs[i].seq >= j->seq)
+            j->seq = j->recs[i].seq + 1;
+
+    return j;
+}
+
+
+// The slot is marked invalid while the record is written
+//
+static void journal_append(journal_t *j, journalrec_t *rec)
+{
+    pthread_mutex_lock(&(j->lock));
+    rec->seq = j->seq++;
+    journalrec_t *r = &(j->recs[rec->seq % JOURNAL_RECORDS]);
+
+    r->magic = 0;
+    __sync_synchronize();
+    memcpy(&(r->seq), &(rec->seq), sizeof(journalrec_t) - offsetof(journalrec_t, seq));
+    r->check = journal_check(r);
+    __sync_synchronize();
+    r->magic = JOURNAL_MAGIC;
+    pthread_mutex_unlock(&(j->lock));
+}
+
+
+void journal_started(journal_t *j, int level, command_t *cmd)
+{
+    journalrec_t rec;
+
+    if (j == NULL)
+        return;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.type = JOURNAL_STARTED;
+    rec.level = level;
+    rec.argtype = NULL_TYPE;
+    strncpy(rec.actid, cmd->actid, ACTID_LEN - 1);
+    strncpy(rec.actname, cmd->actname, JOURNAL_NAMELEN - 1);
+    journal_append(j, &rec);
+}
+
+
+// Only int, double and short string results are kept.. a request with any
+// other result is still taken as done, but it gets no results when it is resent
+//
+void journal_completed(journal_t *j, int level, char *actid, char *actname, char *opt, arg_t *result)
+{
+    journalrec_t rec;
+
+    if (j == NULL)
+        return;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.type = JOURNAL_COMPLETED;
+    rec.level = level;
+    rec.argtype = NULL_TYPE;
+    strncpy(rec.actid, actid, ACTID_LEN - 1);
+    strncpy(rec.actname, actname, JOURNAL_NAMELEN - 1);
+    if (opt != NULL)
+        strncpy(rec.opt, opt, JOURNAL_OPTLEN - 1);
+
+    if (result != NULL)
+    {
+        switch (result->type)
+        {
+            case INT_TYPE:
+                rec.result.ival = result->val.ival;
+                rec.argtype = INT_TYPE;
+                break;
+            case DOUBLE_TYPE:
+                rec.result.dval = result->val.dval;
+                rec.argtype = DOUBLE_TYPE;
+                break;
+            case STRING_TYPE:
+                if (strlen(result->val.sval) < JOURNAL_STRLEN)
+                {
+                    strcpy(rec.result.sval, result->val.sval);
+                    rec.argtype = STRING_TYPE;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    journal_append(j, &rec);
+}
+
+
+static int journal_cmpseq(const void *a, const void *b)
+{
+    uint64_t x = (*(journalrec_t **)a)->seq;
+    uint64_t y = (*(journalrec_t **)b)->seq;
+
+    return (x > y) - (x < y);
+}
+
+
+// Call fn on the valid records, oldest first. Returns the number of records.
+//
+int journal_replay(journal_t *j, journal_replay_f fn, void *arg)
+{
+    journalrec_t **recs;
+    int i, n = 0;
+
+    if (j == NULL)
+        return 0;
+
+    recs = (journalrec_t **)calloc(JOURNAL_RECORDS, sizeof(journalrec_t *));
+    for (i = 0; i < JOURNAL_RECORDS; i++)
+        if (journal_valid(&(j->recs[i])))
+            recs[n++] = &(j->recs[i]);
+
+    qsort(recs, n, sizeof(journalrec_t *), journal_cmpseq);
+    for (i = 0; i < n; i++)
+        fn(recs[i], arg);
+
+    free(recs);
+    return n;
+}
+
+
+// The result of a COMPLETED record as an argument (NULL if not kept)
+//
+arg_t *journal_result(journalrec_t *rec)
+{
+    if (rec->argtype == NULL_TYPE)
+        return NULL;
+
+    arg_t *arg = (arg_t *)calloc(1, sizeof(arg_t));
+    arg->type = rec->argtype;
+    switch (rec->argtype)
+    {
+        case INT_TYPE:
+            arg->val.ival = rec->result.ival;
+            break;
+        case DOUBLE_TYPE:
+            arg->val.dval = rec->result.dval;
+            break;
+        case STRING_TYPE:
+            arg->val.sval = strdup(rec->result.sval);
+            break;
+        default:
+            free(arg);
+            return NULL;
+    }
+    return arg;
+}
@@ -0,0 +1,109 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2017 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY O9F ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __JAMJOURNAL_H__
+#define __JAMJOURNAL_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "command.h"
+#include "actid.h"
+
+/*
+ * Journal of the remote requests run by this node (-j option). A request
+ * is written when it is accepted (STARTED) and when its activity is done
+ * (COMPLETED, with the result of a sync request). After a restart the
+ * completed requests go back into the duplicate detection caches and the
+ * results into the runtable, so a request the J node sends again is not
+ * run again. A request that was STARTED but not COMPLETED was cut by the
+ * restart.. it runs when it comes again.
+ *
+ * The journal is a file of fixed size records mmap'd in ./<port>/ and
+ * written as a ring: record seq goes to slot seq % JOURNAL_RECORDS. The
+ * magic is written last, so a record cut by a crash is skipped. The
+ * records are in the page cache as soon as they are written.. they
+ * survive a crash of the process (not of the machine).
+ */
+
+#define JOURNAL_RECORDS             4096
+#define JOURNAL_MAGIC               0x4a524e4c      // "JRNL"
+#define JOURNAL_NAMELEN             64
+#define JOURNAL_OPTLEN              8
+#define JOURNAL_STRLEN              112             // longer string results are not kept
+
+enum journal_rectype_t {
+    JOURNAL_STARTED = 1,
+    JOURNAL_COMPLETED
+};
+
+typedef struct _journalrec_t
+{
+    uint32_t magic;
+    uint32_t check;                         // hash of the rest of the record
+    uint64_t seq;
+    uint8_t type;                           // journal_rectype_t
+    uint8_t level;                          // level the request came from
+    uint8_t argtype;                        // argtype_t of the result (NULL_TYPE if none)
+    uint8_t pad;
+    char actid[ACTID_LEN];
+    char actname[JOURNAL_NAMELEN];
+    char opt[JOURNAL_OPTLEN];               // where the results go (see jwork_send_results)
+    union _journalval_t
+    {
+        int ival;
+        double dval;
+        char sval[JOURNAL_STRLEN];
+    } result;
+
+} journalrec_t;
+
+typedef struct _journal_t
+{
+    int fd;
+    journalrec_t *recs;
+    uint64_t seq;                           // of the next record
+    pthread_mutex_t lock;
+
+} journal_t;
+
+typedef void (*journal_replay_f)(journalrec_t *rec, void *arg);
+
+journal_t *journal_open(char *path);
+void journal_started(journal_t *j, int level, command_t *cmd);
+void journal_completed(journal_t *j, int level, char *actid, char *actname, char *opt, arg_t *result);
+int journal_replay(journal_t *j, journal_replay_f fn, void *arg);
+arg_t *journal_result(journalrec_t *rec);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
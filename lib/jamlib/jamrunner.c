@@ -70,17 +70,19 @@ runtable_t *runtable_new(void *jarg)
 runtableentry_t *runtable_find(runtable_t *table, char *actid)
 {
     int i, j = -1;
+    uint32_t hash;
 
     if (actid == NULL)
         return NULL;
 
+    hash = actid_hash(actid);
     pthread_mutex_lock(&(table->lock));
     for(i = 0; i < MAX_RUN_ENTRIES; i++)
     {
         // Search through PRESENT and DELETED entries in the table
         // If the table entry matches the actid, then we FOUND
-        if(table->entries[i].status != EMPTY)
-            if(strcmp(actid, table->entries[i].actid) == 0)
+        if(table->entries[i].status != EMPTY && table->entries[i].hash == hash)
+            if(actid_equal(actid, table->entries[i].actid))
             {
                 j = i;
                 break;
@@ -116,7 +118,8 @@ runtableentry_t *runtable_getfree(runtable_t *table)
         else
         {
             // otherwise.. find the oldest entry among the deleted using FIFO
-            if ((table->entries[i].status == DELETED) &&
+            // The completed ones are only kept to answer the resent requests
+            if ((table->entries[i].status == DELETED || table->entries[i].status == COMPLETED) &&
                 (minatime > table->entries[i].accesstime))
             {
                 minatime = table->entries[i].accesstime;
@@ -150,7 +153,10 @@ bool runtable_insert(jamstate_t * js, char *actid, command_t *cmd)
     }
 
     strcpy(re->actid, actid);
+    re->hash = actid_hash(actid);
     strcpy(re->actname, cmd->actname);
+    command_arg_free(re->result);
+    re->result = NULL;
 
     re->accesstime = activity_getseconds();
     re->status = STARTED;
@@ -186,6 +192,126 @@ bool runtable_del(runtable_t *tbl, char *actid)
 }
 
 
+// Keep the result of a remote request.. opt says where it was sent
+//
+bool runtable_store_results(runtable_t *tbl, char *actid, char *opt, arg_t *results)
+{
+    runtableentry_t *re = runtable_find(tbl, actid);
+    if (re == NULL)
+        return false;
+
+    arg_t *arg = command_arg_clone(results);
+
+    pthread_mutex_lock(&(tbl->lock));
+    command_arg_free(re->result);
+    re->result = arg;
+    strncpy(re->opt, opt, JOURNAL_OPTLEN - 1);
+    re->opt[JOURNAL_OPTLEN - 1] = 0;
+    pthread_mutex_unlock(&(tbl->lock));
+
+    return true;
+}
+
+
+// A remote request is done. The entry stays COMPLETED while it has a result
+// (a sync request).. the journal gets the request either way.
+//
+void runtable_complete(jamstate_t *js, command_t *cmd)
+{
+    runtable_t *tbl = js->rtable;
+    runtableentry_t *re = runtable_find(tbl, cmd->actid);
+    arg_t *result = NULL;
+    char *opt = NULL;
+
+    if (re != NULL)
+    {
+        pthread_mutex_lock(&(tbl->lock));
+        re->status = (re->result != NULL) ? COMPLETED : DELETED;
+        tbl->rcount--;
+        pthread_mutex_unlock(&(tbl->lock));
+        result = re->result;
+        opt = re->opt;
+    }
+
+    journal_completed(js->journal, cmd->level, cmd->actid, cmd->actname, opt, result);
+}
+
+
+static void runtable_restore(runtable_t *tbl, journalrec_t *rec)
+{
+    runtableentry_t *re = runtable_find(tbl, rec->actid);
+    if (re == NULL)
+        re = runtable_getfree(tbl);
+    if (re == NULL)
+        return;
+
+    pthread_mutex_lock(&(tbl->lock));
+    strcpy(re->actid, rec->actid);
+    re->hash = actid_hash(rec->actid);
+    strcpy(re->actname, rec->actname);
+    strcpy(re->opt, rec->opt);
+    command_arg_free(re->result);
+    re->result = journal_result(rec);
+    re->accesstime = activity_getseconds();
+    re->status = (re->result != NULL) ? COMPLETED : DELETED;
+    pthread_mutex_unlock(&(tbl->lock));
+}
+
+
+typedef struct _recovery_t
+{
+    jamstate_t *js;
+    int completed;
+    int interrupted;
+
+} recovery_t;
+
+
+// STARTED records are counted.. the COMPLETED one that follows cancels it
+//
+static void runtable_replay(journalrec_t *rec, void *arg)
+{
+    recovery_t *rc = (recovery_t *)arg;
+    jamstate_t *js = rc->js;
+
+    if (rec->type == JOURNAL_STARTED)
+    {
+        rc->interrupted++;
+        return;
+    }
+    if (rec->type != JOURNAL_COMPLETED || rec->level >= MAX_LEVELS)
+        return;
+
+    rc->completed++;
+    rc->interrupted--;
+    duplicate_insert(js->levels[rec->level], rec->actid);
+    if (rec->argtype != NULL_TYPE)
+        runtable_restore(js->rtable, rec);
+}
+
+
+// Open the journal and bring back the requests completed before a restart:
+// resending one of them gets the stored result instead of running it again
+//
+void runtable_recover(jamstate_t *js)
+{
+    char fname[256];
+    recovery_t rc = {js, 0, 0};
+
+    sprintf(fname, "./%d/journal.%d", js->cstate->port, js->cstate->serial_num);
+    js->journal = journal_open(fname);
+    if (js->journal == NULL)
+        return;
+
+    journal_replay(js->journal, runtable_replay, &rc);
+
+    #ifdef DEBUG_LVL1
+        printf("Journal: %d requests completed, %d cut by the restart\n", rc.completed,
+                rc.interrupted > 0 ? rc.interrupted : 0);
+    #endif
+}
+
+
 void jrun_arun_callback(jactivity_t *jact, command_t *cmd, activity_callback_reg_t *creg)
 {
     // Activity to run the callback is already created..
@@ -195,7 +321,7 @@ void jrun_arun_callback(jactivity_t *jact, command_t *cmd, activity_callback_reg
     #ifdef DEBUG_LVL1
     printf("========= >> Starting the function....................\n");
     #endif
-    creg->cback(jact, cmd);
+    activity_callback(jact->atable, jact, cmd, creg);
 
     // if the execution was done due to a remote request...
     if (jact->remote)
@@ -0,0 +1,450 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2016 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "jamspool.h"
+
+// Segment header: magic, version, read position (acknowledged up to), unused
+#define SEG_MAGIC(s)                (((uint32_t *)(s)->base)[0])
+#define SEG_VERSION(s)              (((uint32_t *)(s)->base)[1])
+#define SEG_RPOS(s)                 (((uint32_t *)(s)->base)[2])
+
+static uint32_t crctable[256];
+static bool crcready = false;
+
+
+static uint32_t spool_crc32(unsigned char *p, int len)
+{
+    uint32_t crc = 0xffffffff;
+
+    if (!crcready)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            crctable[i] = c;
+        }
+        crcready = true;
+    }
+
+    for (int i = 0; i < len; i++)
+        crc = crctable[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+
+static uint32_t get32(unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(uint32_t));
+    return v;
+}
+
+static uint64_t get64(unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(uint64_t));
+    return v;
+}
+
+
+static void spool_segname(jamspool_t *sp, unsigned long long id, char *buf)
+{
+    sprintf(buf, "%s/%016llx.seg", sp->dir, id);
+}
+
+
+// Length of a valid record at pos (0 if there is none)
+static int spool_reclen(spoolseg_t *seg, int pos)
+{
+    if (pos + SPOOL_REC_HDR > SPOOL_SEGMENT_SIZE)
+        return 0;
+
+    uint32_t len = get32(seg->base + pos);
+    if (len < SPOOL_REC_HDR - 8 || pos + 8 + len > SPOOL_SEGMENT_SIZE)
+        return 0;
+    if (spool_crc32(seg->base + pos + 8, len) != get32(seg->base + pos + 4))
+        return 0;
+
+    return 8 + len;
+}
+
+
+static spoolseg_t *spool_map(jamspool_t *sp, unsigned long long id, bool create)
+{
+    char fname[strlen(sp->dir) + 32];
+    struct stat st;
+
+    spool_segname(sp, id, fname);
+    int fd = open(fname, create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+    if (fd < 0)
+        return NULL;
+
+    if ((create && ftruncate(fd, SPOOL_SEGMENT_SIZE) != 0) ||
+        (!create && (fstat(fd, &st) != 0 || st.st_size != SPOOL_SEGMENT_SIZE)))
+    {
+        close(fd);
+        unlink(fname);
+        return NULL;
+    }
+
+    void *base = mmap(NULL, SPOOL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    spoolseg_t *seg = (spoolseg_t *)calloc(1, sizeof(spoolseg_t));
+    seg->id = id;
+    seg->base = (unsigned char *)base;
+
+    if (create)
+    {
+        SEG_MAGIC(seg) = SPOOL_MAGIC;
+        SEG_VERSION(seg) = SPOOL_VERSION;
+        SEG_RPOS(seg) = SPOOL_SEG_HDR;
+        seg->wpos = SPOOL_SEG_HDR;
+    }
+    return seg;
+}
+
+
+static void spool_unmap(jamspool_t *sp, spoolseg_t *seg, bool remove)
+{
+    char fname[strlen(sp->dir) + 32];
+
+    munmap(seg->base, SPOOL_SEGMENT_SIZE);
+    if (remove)
+    {
+        spool_segname(sp, seg->id, fname);
+        unlink(fname);
+    }
+    free(seg);
+}
+
+
+// Find the records in a segment left by an earlier run. Scanning stops at
+// the first record that is torn or fails the CRC.
+//
+static bool spool_scan(jamspool_t *sp, spoolseg_t *seg)
+{
+    int pos = SPOOL_SEG_HDR, n;
+
+    if (SEG_MAGIC(seg) != SPOOL_MAGIC || SEG_VERSION(seg) != SPOOL_VERSION)
+        return false;
+
+    while ((n = spool_reclen(seg, pos)) > 0)
+    {
+        unsigned long long seq = get64(seg->base + pos + 8);
+        if (seq >= sp->nextseq)
+            sp->nextseq = seq + 1;
+        if (pos >= SEG_RPOS(seg))
+            sp->count++;
+        pos += n;
+    }
+    seg->wpos = pos;
+
+    if (SEG_RPOS(seg) < SPOOL_SEG_HDR || SEG_RPOS(seg) > pos)
+        SEG_RPOS(seg) = SPOOL_SEG_HDR;
+    return SEG_RPOS(seg) < pos;
+}
+
+
+static int spool_idcmp(const void *a, const void *b)
+{
+    unsigned long long x = *(unsigned long long *)a;
+    unsigned long long y = *(unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+
+static void spool_link(jamspool_t *sp, spoolseg_t *seg)
+{
+    if (sp->tail == NULL)
+        sp->head = seg;
+    else
+        sp->tail->next = seg;
+    sp->tail = seg;
+    sp->nsegs++;
+}
+
+
+static void spool_drop_head(jamspool_t *sp)
+{
+    spoolseg_t *seg = sp->head;
+    long long n = 0;
+
+    for (int pos = SEG_RPOS(seg); pos < seg->wpos; pos += 8 + get32(seg->base + pos))
+        n++;
+    sp->count -= n;
+    sp->dropped += n;
+
+    if (sp->cseg == seg)
+        sp->cseg = NULL;
+    sp->head = seg->next;
+    if (sp->head == NULL)
+        sp->tail = NULL;
+    sp->nsegs--;
+    spool_unmap(sp, seg, true);
+
+    printf("WARNING! Logger spool is over %lld bytes.. dropped %lld records\n", sp->maxbytes, n);
+}
+
+
+jamspool_t *jamspool_open(char *dir, long long maxbytes)
+{
+    DIR *d;
+    struct dirent *ent;
+    unsigned long long *ids = NULL;
+    int nids = 0, maxids = 0;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+    {
+        printf("WARNING! Unable to create the logger spool at %s\n", dir);
+        return NULL;
+    }
+    if ((d = opendir(dir)) == NULL)
+    {
+        printf("WARNING! Unable to open the logger spool at %s\n", dir);
+        return NULL;
+    }
+
+    jamspool_t *sp = (jamspool_t *)calloc(1, sizeof(jamspool_t));
+    sp->dir = strdup(dir);
+    sp->maxbytes = maxbytes < SPOOL_SEGMENT_SIZE ? SPOOL_SEGMENT_SIZE : maxbytes;
+    sp->nextseq = 1;
+
+    while ((ent = readdir(d)) != NULL)
+    {
+        char *end;
+        unsigned long long id = strtoull(ent->d_name, &end, 16);
+        if (end == ent->d_name || strcmp(end, ".seg") != 0)
+            continue;
+        if (nids == maxids)
+        {
+            maxids = maxids ? maxids * 2 : 16;
+            ids = (unsigned long long *)realloc(ids, maxids * sizeof(unsigned long long));
+        }
+        ids[nids++] = id;
+    }
+    closedir(d);
+
+    // Replay the segments of the earlier run in order
+    qsort(ids, nids, sizeof(unsigned long long), spool_idcmp);
+    for (int i = 0; i < nids; i++)
+    {
+        spoolseg_t *seg = spool_map(sp, ids[i], false);
+        if (seg == NULL)
+            continue;
+        if (spool_scan(sp, seg))
+            spool_link(sp, seg);
+        else
+            spool_unmap(sp, seg, true);
+    }
+    free(ids);
+
+    while (sp->nsegs > 1 && (long long)sp->nsegs * SPOOL_SEGMENT_SIZE > sp->maxbytes)
+        spool_drop_head(sp);
+
+#ifdef DEBUG_LVL1
+    printf("Logger spool at %s: %d segments, %lld records\n", dir, sp->nsegs, sp->count);
+#endif
+    return sp;
+}
+
+
+bool jamspool_append(jamspool_t *sp, char *key, void *value, int len, unsigned long long timestamp)
+{
+    int keylen = strlen(key);
+    int need = SPOOL_REC_HDR + keylen + len;
+
+    if (keylen >= sizeof(((spoolrec_t *)0)->key) || SPOOL_SEG_HDR + need + 4 > SPOOL_SEGMENT_SIZE)
+    {
+        printf("WARNING! Record for %s is too large for the logger spool\n", key);
+        return false;
+    }
+
+    if (sp->tail == NULL || sp->tail->wpos + need + 4 > SPOOL_SEGMENT_SIZE)
+    {
+        spoolseg_t *seg = spool_map(sp, sp->tail ? sp->tail->id + 1 : 1, true);
+        if (seg == NULL)
+        {
+            printf("WARNING! Unable to add a segment to the logger spool at %s\n", sp->dir);
+            return false;
+        }
+        spool_link(sp, seg);
+        while (sp->nsegs > 1 && (long long)sp->nsegs * SPOOL_SEGMENT_SIZE > sp->maxbytes)
+            spool_drop_head(sp);
+    }
+
+    spoolseg_t *seg = sp->tail;
+    unsigned char *p = seg->base + seg->wpos;
+    uint32_t blen = need - 8;
+    uint64_t seq = sp->nextseq++;
+    uint16_t klen = keylen;
+    uint32_t zero = 0;
+
+    memcpy(p + 8, &seq, 8);
+    memcpy(p + 16, &timestamp, 8);
+    memcpy(p + 24, &klen, 2);
+    memcpy(p + 26, key, keylen);
+    memcpy(p + 26 + keylen, value, len);
+    uint32_t crc = spool_crc32(p + 8, blen);
+    memcpy(p + 4, &crc, 4);
+
+    // Terminate first so a reused segment does not show older records
+    memcpy(p + need, &zero, 4);
+    __atomic_store_n((uint32_t *)p, blen, __ATOMIC_RELEASE);
+
+    seg->wpos += need;
+    sp->count++;
+    return true;
+}
+
+
+// The next record to replay. The cursor moves past it but the record
+// stays in the spool until jamspool_ack() is called with its seq.
+//
+bool jamspool_next(jamspool_t *sp, spoolrec_t *rec)
+{
+    if (sp->cseg == NULL)
+    {
+        if (sp->head == NULL)
+            return false;
+        sp->cseg = sp->head;
+        sp->cpos = SEG_RPOS(sp->head);
+    }
+    while (sp->cpos >= sp->cseg->wpos)
+    {
+        if (sp->cseg->next == NULL)
+            return false;
+        sp->cseg = sp->cseg->next;
+        sp->cpos = SEG_RPOS(sp->cseg);
+    }
+
+    unsigned char *p = sp->cseg->base + sp->cpos;
+    uint32_t blen = get32(p);
+    uint16_t klen;
+
+    rec->seq = get64(p + 8);
+    rec->timestamp = get64(p + 16);
+    memcpy(&klen, p + 24, 2);
+    memcpy(rec->key, p + 26, klen);
+    rec->key[klen] = 0;
+    rec->value = p + 26 + klen;
+    rec->len = blen - (SPOOL_REC_HDR - 8) - klen;
+
+    sp->cpos += 8 + blen;
+    return true;
+}
+
+
+// Remove the records up to seq (Redis has them)
+void jamspool_ack(jamspool_t *sp, unsigned long long seq)
+{
+    while (sp->head != NULL)
+    {
+        spoolseg_t *seg = sp->head;
+        int pos = SEG_RPOS(seg);
+
+        while (pos < seg->wpos)
+        {
+            if (get64(seg->base + pos + 8) > seq)
+            {
+                SEG_RPOS(seg) = pos;
+                return;
+            }
+            pos += 8 + get32(seg->base + pos);
+            sp->count--;
+        }
+
+        if (seg == sp->tail)
+        {
+            // Reuse the last segment
+            uint32_t zero = 0;
+            memcpy(seg->base + SPOOL_SEG_HDR, &zero, 4);
+            SEG_RPOS(seg) = SPOOL_SEG_HDR;
+            seg->wpos = SPOOL_SEG_HDR;
+            if (sp->cseg == seg)
+                sp->cpos = SPOOL_SEG_HDR;
+            return;
+        }
+
+        if (sp->cseg == seg)
+            sp->cseg = NULL;
+        sp->head = seg->next;
+        sp->nsegs--;
+        spool_unmap(sp, seg, true);
+    }
+}
+
+
+// Replay again from the oldest record (the records in flight were lost)
+void jamspool_rewind(jamspool_t *sp)
+{
+    sp->cseg = NULL;
+}
+
+
+bool jamspool_empty(jamspool_t *sp)
+{
+    return sp->count == 0;
+}
+
+
+// There are records that are not replayed yet
+bool jamspool_pending(jamspool_t *sp)
+{
+    if (sp->count == 0)
+        return false;
+    if (sp->cseg == NULL)
+        return true;
+    return sp->cpos < sp->cseg->wpos || sp->cseg->next != NULL;
+}
+
+
+// The records that are left are replayed by the next run
+void jamspool_close(jamspool_t *sp)
+{
+    while (sp->head != NULL)
+    {
+        spoolseg_t *seg = sp->head;
+        sp->head = seg->next;
+        spool_unmap(sp, seg, false);
+    }
+    free(sp->dir);
+    free(sp);
+}
@@ -0,0 +1,108 @@
+/*
+The MIT License (MIT)
+Copyright (c) 2016 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __JAMSPOOL_H__
+#define __JAMSPOOL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Disk spool for the logger records that cannot go to Redis right away
+ * (connection down or too many writes in flight). The spool is a list of
+ * segment files (<dir>/<id>.seg) of SPOOL_SEGMENT_SIZE bytes that are
+ * mmap'd and appended to. A record is
+ *
+ *      [u32 len][u32 crc][u64 seq][u64 timestamp][u16 keylen][key][value]
+ *
+ * where len and crc cover everything after the crc. A zero len ends the
+ * segment. Records are replayed in order; a replayed record is removed
+ * only after Redis acknowledges it. When the spool grows past its byte
+ * cap the oldest segment is dropped.
+ *
+ * Only the jamdata thread uses the spool.. there is no locking.
+ */
+
+#define SPOOL_MAGIC                 0x4a53504c      // "JSPL"
+#define SPOOL_VERSION               1
+#define SPOOL_SEGMENT_SIZE          (1024 * 1024)
+#define SPOOL_SEG_HDR               16
+#define SPOOL_REC_HDR               (4 + 4 + 8 + 8 + 2)
+
+typedef struct _spoolseg_t
+{
+    unsigned long long id;
+    unsigned char *base;
+    int wpos;                               // end of the valid records
+    struct _spoolseg_t *next;
+
+} spoolseg_t;
+
+
+typedef struct _jamspool_t
+{
+    char *dir;
+    long long maxbytes;
+    int nsegs;
+
+    spoolseg_t *head;                       // oldest segment
+    spoolseg_t *tail;                       // segment being appended to
+    spoolseg_t *cseg;                       // replay cursor
+    int cpos;
+
+    unsigned long long nextseq;
+    unsigned long long dropped;             // records lost to the byte cap
+    long long count;                        // records in the spool
+
+} jamspool_t;
+
+
+// A record returned by jamspool_next().. points into the segment
+typedef struct _spoolrec_t
+{
+    unsigned long long seq;
+    unsigned long long timestamp;
+    char key[512];
+    unsigned char *value;
+    int len;
+
+} spoolrec_t;
+
+
+jamspool_t *jamspool_open(char *dir, long long maxbytes);
+bool jamspool_append(jamspool_t *sp, char *key, void *value, int len, unsigned long long timestamp);
+bool jamspool_next(jamspool_t *sp, spoolrec_t *rec);
+void jamspool_ack(jamspool_t *sp, unsigned long long seq);
+void jamspool_rewind(jamspool_t *sp);
+bool jamspool_empty(jamspool_t *sp);
+bool jamspool_pending(jamspool_t *sp);
+void jamspool_close(jamspool_t *sp);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
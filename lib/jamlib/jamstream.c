@@ -0,0 +1,267 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2017 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY O9F ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <cbor.h>
+
+#include "jamstream.h"
+#include "actid.h"
+#include "mqtt.h"
+#include "activity.h"
+
+// fragment header: array(4), actid (16 byte string or text), index, seq, bytes
+#define JSTREAM_HDR_MAX             (1 + 9 + ACTID_LEN + 9 + 9 + 9)
+
+typedef struct _jstream_t
+{
+    command_t *cmd;                         // held while the stream is there
+    int index;                              // argument of cmd being sent
+    nvoid_t *data;
+    int nchunks;
+
+    // array(4), actid and index.. the same in all the fragments
+    unsigned char hdr[JSTREAM_HDR_MAX];
+    int hdrlen;
+
+    int levels;                             // levels still receiving (bit mask)
+    int sent[MAX_SERVERS];                  // next fragment to send
+    int acked[MAX_SERVERS];                 // fragments received in order
+    long long acktime;                      // last ack or start (activity_getseconds, in us)
+
+    struct _jstream_t *next;
+
+} jstream_t;
+
+static jstream_t *streams = NULL;
+static pthread_mutex_t slock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char frame[JSTREAM_HDR_MAX + JSTREAM_CHUNK];
+
+
+static jstream_t *jstream_new(command_t *cmd, int index)
+{
+    jstream_t *s = (jstream_t *)calloc(1, sizeof(jstream_t));
+    unsigned char bytes[ACTID_BYTES];
+    size_t n, len;
+
+    s->cmd = cmd;
+    s->index = index;
+    s->data = cmd->args[index].val.nval;
+    s->nchunks = (s->data->len + JSTREAM_CHUNK - 1) / JSTREAM_CHUNK;
+
+    // The actid goes the same way as in the command (see command_build_actid)
+    n = cbor_encode_array_start(4, s->hdr, JSTREAM_HDR_MAX);
+    if (actid_tobytes(cmd->actid, bytes))
+    {
+        n += cbor_encode_bytestring_start(ACTID_BYTES, s->hdr + n, JSTREAM_HDR_MAX - n);
+        memcpy(s->hdr + n, bytes, ACTID_BYTES);
+        n += ACTID_BYTES;
+    }
+    else
+    {
+        len = strlen(cmd->actid);
+        n += cbor_encode_string_start(len, s->hdr + n, JSTREAM_HDR_MAX - n);
+        memcpy(s->hdr + n, cmd->actid, len);
+        n += len;
+    }
+    n += cbor_encode_uint(index, s->hdr + n, JSTREAM_HDR_MAX - n);
+    s->hdrlen = n;
+
+    s->acktime = activity_getseconds();
+    command_hold(cmd);
+
+    s->next = streams;
+    streams = s;
+    return s;
+}
+
+
+static void jstream_remove(jstream_t *s)
+{
+    jstream_t **p;
+
+    for (p = &streams; *p != NULL; p = &((*p)->next))
+        if (*p == s)
+        {
+            *p = s->next;
+            break;
+        }
+    command_free(s->cmd);
+    free(s);
+}
+
+
+// Keep up to JSTREAM_WINDOW fragments beyond the last ack in flight
+// The publish copies the frame.. so one buffer does for all the streams
+//
+static void jstream_send(corestate_t *cs, jstream_t *s, int level)
+{
+    size_t n;
+    int len;
+
+    while (s->sent[level] < s->nchunks && s->sent[level] < s->acked[level] + JSTREAM_WINDOW)
+    {
+        int seq = s->sent[level]++;
+        len = s->data->len - seq * JSTREAM_CHUNK;
+        if (len > JSTREAM_CHUNK)
+            len = JSTREAM_CHUNK;
+
+        memcpy(frame, s->hdr, s->hdrlen);
+        n = s->hdrlen;
+        n += cbor_encode_uint(seq, frame + n, sizeof(frame) - n);
+        n += cbor_encode_bytestring_start(len, frame + n, sizeof(frame) - n);
+        memcpy(frame + n, (unsigned char *)s->data->data + seq * JSTREAM_CHUNK, len);
+
+        mqtt_publish_data(cs->mqttserv[level], MQTT_LEVEL_STREAM, frame, n + len);
+    }
+}
+
+
+// A stream for each descriptor in the request. Called after the request
+// is published.. a resend of the request does not restart the streams.
+//
+void jstream_start(corestate_t *cs, command_t *cmd, int levels)
+{
+    cbor_item_t *arr;
+    jstream_t *s;
+    int i, j;
+
+    if (cmd->cdata == NULL || cmd->args == NULL || cbor_map_size(cmd->cdata) != 8)
+        return;
+
+    arr = cbor_map_handle(cmd->cdata)[7].value;
+    if (cbor_array_size(arr) != (size_t)cmd->nargs)
+        return;
+
+    pthread_mutex_lock(&slock);
+    for (i = 0; i < cmd->nargs; i++)
+    {
+        cbor_item_t *item = cbor_array_handle(arr)[i];
+        if (!cbor_isa_tag(item) || cbor_tag_value(item) != CBOR_TAG_JAM_STREAM)
+            continue;
+
+        for (s = streams; s != NULL; s = s->next)
+            if (s->cmd == cmd && s->index == i)
+                break;
+        if (s != NULL)
+            continue;
+
+        s = jstream_new(cmd, i);
+        s->levels = levels;
+        for (j = 0; j < MAX_SERVERS; j++)
+            if (levels & (1 << j))
+                jstream_send(cs, s, j);
+    }
+    pthread_mutex_unlock(&slock);
+}
+
+
+// Some level is still receiving an argument of the command
+//
+bool jstream_busy(command_t *cmd)
+{
+    jstream_t *s;
+
+    pthread_mutex_lock(&slock);
+    for (s = streams; s != NULL; s = s->next)
+        if (s->cmd == cmd)
+            break;
+    pthread_mutex_unlock(&slock);
+
+    return s != NULL;
+}
+
+
+// CHUNK-ACK from the J node at the level: [index, fragments received in order]
+//
+void jstream_ack(corestate_t *cs, int level, command_t *ack)
+{
+    jstream_t *s;
+    int index, count;
+
+    if (ack->nargs < 2 || ack->args[0].type != INT_TYPE || ack->args[1].type != INT_TYPE)
+        return;
+    index = ack->args[0].val.ival;
+    count = ack->args[1].val.ival;
+
+    pthread_mutex_lock(&slock);
+    for (s = streams; s != NULL; s = s->next)
+        if (s->index == index && actid_equal(s->cmd->actid, ack->actid))
+            break;
+
+    // Not ours (acks to all the C nodes come on the same topic) or done
+    if (s == NULL || !(s->levels & (1 << level)) || count <= s->acked[level] || count > s->nchunks)
+    {
+        pthread_mutex_unlock(&slock);
+        return;
+    }
+
+    s->acked[level] = count;
+    if (s->sent[level] < count)
+        s->sent[level] = count;
+    s->acktime = activity_getseconds();
+
+    if (count == s->nchunks)
+    {
+        s->levels &= ~(1 << level);
+        if (s->levels == 0)
+            jstream_remove(s);
+    }
+    else
+        jstream_send(cs, s, level);
+
+    pthread_mutex_unlock(&slock);
+}
+
+
+// Drop the streams that have not seen an ack for JSTREAM_TIMEOUT seconds..
+// the J node gives up on its side the same way
+//
+void jstream_sweep()
+{
+    static long long lastsweep = 0;
+    long long now = activity_getseconds();
+    jstream_t *s, *nxt;
+
+    // activity_getseconds() is in microseconds
+    if (now - lastsweep < 1000000LL)
+        return;
+
+    pthread_mutex_lock(&slock);
+    lastsweep = now;
+    for (s = streams; s != NULL; s = nxt)
+    {
+        nxt = s->next;
+        if (now - s->acktime > JSTREAM_TIMEOUT * 1000000LL)
+        {
+            printf("WARNING! Stream of argument %d of %s timed out\n", s->index, s->cmd->actname);
+            jstream_remove(s);
+        }
+    }
+    pthread_mutex_unlock(&slock);
+}
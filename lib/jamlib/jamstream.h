@@ -0,0 +1,70 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2017 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY O9F ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __JAMSTREAM_H__
+#define __JAMSTREAM_H__
+
+#include <stdbool.h>
+#include "command.h"
+#include "core.h"
+
+/*
+ * Chunked transfer of the large byte string (NVOID) arguments of a remote
+ * execution request. The request carries a descriptor in place of the
+ * bytes (see CBOR_TAG_JAM_STREAM in command.h) and the bytes follow on
+ * /level/func/stream as fragments of JSTREAM_CHUNK bytes:
+ *
+ *      [actid, argument index, sequence number, bytes]
+ *
+ * The J node copies the fragments into one buffer of the size given by
+ * the descriptor and runs the request when all its arguments are there.
+ * It acks (CHUNK-ACK, args: [index, fragments received in order]) as
+ * it goes. At most JSTREAM_WINDOW fragments beyond the last ack are in
+ * flight at a level.. the rest are sent as the acks come in.
+ *
+ * The fragments are sent straight out of the argument. The command is
+ * held until every level has acked the last fragment or the stream
+ * times out.
+ */
+
+#define JSTREAM_WINDOW              4       // fragments in flight per level
+#define JSTREAM_TIMEOUT             10      // seconds without an ack
+
+// levels is a bit mask of (1 << level).. the request is already published there
+void jstream_start(corestate_t *cs, command_t *cmd, int levels);
+bool jstream_busy(command_t *cmd);
+void jstream_ack(corestate_t *cs, int level, command_t *ack);
+void jstream_sweep();
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
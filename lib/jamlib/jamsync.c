@@ -59,12 +59,10 @@ arg_t *jam_rexec_sync(jamstate_t *js, char *condstr, int condvec, char *aname, c
         list2 = init_list_();
     }
 
-    // Get the activity ID.. based on time and device_id - so this should be unique
-    // because the same device is not generating multiple activities at the same time with
-    // high resolution timer!
-    char *t = activity_gettime(js->cstate->device_id);
+    // Get the activity ID.. node ID (from device_id) and a counter - see actid.h
+    char t[ACTID_LEN];
+    actid_new(t, js->cstate->device_id);
     jactivity_t *jact = activity_new(js->atable, t, false);
-    free(t);
 
     if (jact != NULL)
     {
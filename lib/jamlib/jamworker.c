@@ -29,15 +29,16 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <task.h>
 #include <string.h>
+#include <assert.h>
 #include "threadsem.h"
 #include "jamdata.h"
 #include "nvoid.h"
 #include "mqtt.h"
+#include "shmlink.h"
 #include "activity.h"
 #include "simplelist.h"
+#include "jamstream.h"
 
-extern list_elem_t *cache;
-extern int cachesize;
 extern char app_id[64];
 
 
@@ -52,7 +53,7 @@ void send_register(corestate_t *cs, int level)
     #endif
 
     cmd = command_new("REGISTER", "DEVICE", "-", 0, "-", "-", cs->device_id, "");
-    mqtt_publish(cs->mqttserv[level], "/admin/request/all", cmd);
+    mqtt_publish(cs->mqttserv[level], MQTT_ADMIN_REQUEST, cmd);
 }
 
 void send_infoquery(corestate_t *cs)
@@ -64,7 +65,7 @@ void send_infoquery(corestate_t *cs)
     #endif
 
     cmd = command_new("REF-CF-INFO", "-", "-", 0, "-", "-", cs->device_id, "");
-    mqtt_publish(cs->mqttserv[0], "/admin/request/all", cmd);
+    mqtt_publish(cs->mqttserv[0], MQTT_ADMIN_REQUEST, cmd);
 }
 
 
@@ -110,6 +111,8 @@ void on_fog_connect(void* context, MQTTAsync_successData* response)
     // Set the subscriptions
     core_set_subscription(cs, 1);
     send_register(cs, 1);
+    // Wake up the activities waiting for this level
+    thread_signal(cs->levelsem);
 
     // NOTE: For now, I am putting the mqttenabled flag setting here.
     // This is for the fog.
@@ -129,6 +132,8 @@ void on_cloud_connect(void* context, MQTTAsync_successData* response)
     // Set the subscriptions
     core_set_subscription(cs, 2);
     send_register(cs, 2);
+    // Wake up the activities waiting for this level
+    thread_signal(cs->levelsem);
 
     // NOTE: For now, I am putting the mqttenabled flag setting here.
     // This is for the cloud.
@@ -163,17 +168,33 @@ void *jwork_bgthread(void *arg)
 
     char localhost[64];
     sprintf(localhost, "tcp://localhost:%d", js->cstate->port);
-    core_createserver(js->cstate, 0, localhost);
+    // Topics should be ready before any message could arrive
+    jwork_init_topics();
     comboptr_t *ctx = create_combo3i_ptr(js, js->deviceinq, NULL, 0);
-    // Set the callback handlers .. this is necessary befor the actual connection
-    core_setcallbacks(js->cstate, ctx, jwork_connect_lost, jwork_msg_arrived, NULL);
 
-    // Now do the connection to the local server
-    core_connect(js->cstate, 0, on_dev_connect, NULL);
+    // Use the shared memory link if the J node is serving one.. otherwise
+    // go through the local MQTT broker
+    if (core_createshmlink(js->cstate))
+    {
+        shmlink_start(js->cstate->mqttserv[0], jwork_shm_arrived, ctx);
+        on_dev_connect(js->cstate, NULL);
+    }
+    else
+    {
+        core_createserver(js->cstate, 0, localhost);
+        // Set the callback handlers .. this is necessary befor the actual connection
+        core_setcallbacks(js->cstate, ctx, jwork_connect_lost, jwork_msg_arrived, NULL);
+
+        // Now do the connection to the local server
+        core_connect(js->cstate, 0, on_dev_connect, NULL);
+    }
 
     // assemble the poller.. insert the FDs that should go into the poller
     jwork_assemble_fds(js);
 
+    // Levels that are processed in their own threads (-l option)
+    jwork_start_level_threads(js);
+
     // NOTE: signalling on bgsem happens in a callback now
     // We need to signal the main thread to proceed only after the local J
     // responds to the registration
@@ -188,6 +209,9 @@ void *jwork_bgthread(void *arg)
     {
         int nfds = jwork_wait_fds(js);
 
+        // at most once a second
+        jstream_sweep();
+
         if (nfds == 0)
             continue;
         else if(nfds < 0)
@@ -204,6 +228,93 @@ void *jwork_bgthread(void *arg)
 }
 
 
+// Topics the worker listens on. The full topic strings are built once
+// (they depend on the app_id) and the incoming topic is interned into one
+// of these values before the message is handled.
+//
+enum topicid_t {
+    TOPIC_UNKNOWN,
+    TOPIC_ADMIN_ANNOUNCE,
+    TOPIC_LEVEL_REPLY,
+    TOPIC_MACH_REQUEST,
+    TOPIC_MACH_SYNCSTART,
+    TOPIC_MAX
+};
+
+typedef struct _topicentry_t
+{
+    char name[128];
+    int len;
+    bool prefix;                            // match on prefix (topic has sub levels)
+} topicentry_t;
+
+static topicentry_t topictable[TOPIC_MAX];
+static int apptopiclen;
+
+
+static void jwork_set_topic(enum topicid_t id, char *suffix, bool prefix)
+{
+    sprintf(topictable[id].name, "/%s%s", app_id, suffix);
+    topictable[id].len = strlen(topictable[id].name);
+    topictable[id].prefix = prefix;
+}
+
+
+void jwork_init_topics()
+{
+    apptopiclen = strlen(app_id) + 1;
+
+    jwork_set_topic(TOPIC_ADMIN_ANNOUNCE, "/admin/announce/all", false);
+    jwork_set_topic(TOPIC_LEVEL_REPLY, "/level/func/reply", true);
+    jwork_set_topic(TOPIC_MACH_REQUEST, "/mach/func/request", true);
+    jwork_set_topic(TOPIC_MACH_SYNCSTART, "/mach/func/syncstart", true);
+}
+
+
+// Find the topic id of the incoming topic. All topics start with /<app_id>
+// and the first character after that selects the candidate. The candidate
+// is confirmed with a single compare against the prebuilt topic string.
+//
+static enum topicid_t jwork_topic_id(char *topicname, int topiclen)
+{
+    enum topicid_t id = TOPIC_UNKNOWN;
+
+    // Paho sets topiclen to 0 when the topic is NULL terminated
+    if (topiclen == 0)
+        topiclen = strlen(topicname);
+
+    if (topiclen <= apptopiclen + 1)
+        return TOPIC_UNKNOWN;
+
+    switch (topicname[apptopiclen + 1])
+    {
+        case 'a':
+            id = TOPIC_ADMIN_ANNOUNCE;
+            break;
+        case 'l':
+            id = TOPIC_LEVEL_REPLY;
+            break;
+        case 'm':
+            // /mach/func/request vs /mach/func/syncstart
+            if (topiclen > apptopiclen + 11)
+                id = (topicname[apptopiclen + 11] == 'r') ? TOPIC_MACH_REQUEST : TOPIC_MACH_SYNCSTART;
+            break;
+        default:
+            break;
+    }
+
+    if (id == TOPIC_UNKNOWN)
+        return TOPIC_UNKNOWN;
+
+    if (topiclen < topictable[id].len ||
+        (!topictable[id].prefix && topiclen != topictable[id].len) ||
+        strncmp(topicname, topictable[id].name, topictable[id].len) != 0)
+        return TOPIC_UNKNOWN;
+
+    return id;
+}
+
+
 /*
  * The most important callback handler. This is executed in another anonymous thread
  * by the MQTT (Paho) Client library. We are not explicitly spawning the thread.
@@ -212,64 +323,63 @@ void *jwork_bgthread(void *arg)
 
 int jwork_msg_arrived(void *ctx, char *topicname, int topiclen, MQTTAsync_message *msg)
 {
-    char adminannouce[64];
-    char levelreply[64];
-    char machrequest[64];
-    char admingo[64];
+    jwork_msg_dispatch(ctx, topicname, topiclen, msg->payload, msg->payloadlen);
+
+    MQTTAsync_freeMessage(&msg);
+    MQTTAsync_free(topicname);
+    return 1;
+}
+
+
+// Messages coming through the shared memory link (see shmlink.h). Run by
+// the link reader thread. The frame carries the same topic and payload.
+//
+void jwork_shm_arrived(void *ctx, char *topicname, void *payload, int len)
+{
+    jwork_msg_dispatch(ctx, topicname, strlen(topicname), payload, len);
+}
+
+
+void jwork_msg_dispatch(void *ctx, char *topicname, int topiclen, void *payload, int payloadlen)
+{
+    nvoid_t *nv;
+    command_t *cmd;
 
     #ifdef DEBUG_LVL1
         printf("JWork message arrived on topic %s\n", topicname);
     #endif
 
-    sprintf(adminannouce, "/%s/admin/announce/all", app_id);
-    sprintf(levelreply, "/%s/level/func/reply", app_id);
-    sprintf(machrequest, "/%s/mach/func/request", app_id);
-    sprintf(admingo, "/%s/mach/func/syncstart", app_id);
-
     // the ctx pointer is used to recover original context.
     comboptr_t *cptr = (comboptr_t *)ctx;
     simplequeue_t *queue = (simplequeue_t *)(cptr->arg2);
 
     // We need handle the message based on the topic..
-    if (strcmp(topicname, adminannouce) == 0)
+    switch (jwork_topic_id(topicname, topiclen))
     {
-        nvoid_t *nv = nvoid_new(msg->payload, msg->payloadlen);
-        command_t *cmd = command_from_data(NULL, nv);
+        case TOPIC_ADMIN_ANNOUNCE:
+        case TOPIC_LEVEL_REPLY:
+        case TOPIC_MACH_REQUEST:
+            nv = nvoid_new(payload, payloadlen);
+            cmd = command_from_data(NULL, nv);
+            nvoid_free(nv);
+            queue_enq(queue, cmd, sizeof(command_t));
+            // Don't free the command structure.. the queue is still carrying it
+            break;
+
+        case TOPIC_MACH_SYNCSTART:
+        {
+            char *stime = (char *)malloc(payloadlen + 2);
+            strncpy(stime, payload, payloadlen);
+            stime[payloadlen] = 0;
+            cmd = command_new("SYNCSTART", stime, "-", 0, "GLOBAL_INQUEUE", "__", "__", "");
+            queue_enq(queue, cmd, sizeof(command_t));
+            free(stime);
+            break;
+        }
 
-        nvoid_free(nv);
-        queue_enq(queue, cmd, sizeof(command_t));
-    }
-    else
-    if (strncmp(topicname, levelreply, strlen(levelreply) -1) == 0)
-    {
-        nvoid_t *nv = nvoid_new(msg->payload, msg->payloadlen);
-        command_t *cmd = command_from_data(NULL, nv);
-        nvoid_free(nv);
-        queue_enq(queue, cmd, sizeof(command_t));
-        // Don't free the command structure.. the queue is still carrying it
-    }
-    else
-    if (strncmp(topicname, machrequest, strlen(machrequest) -1) == 0)
-    {
-        nvoid_t *nv = nvoid_new(msg->payload, msg->payloadlen);
-        command_t *cmd = command_from_data(NULL, nv);
-        nvoid_free(nv);
-        queue_enq(queue, cmd, sizeof(command_t));
-        // Don't free the command structure.. the queue is still carrying it
-    }
-    else
-    if (strncmp(topicname, admingo, strlen(admingo) -1) == 0) {
-        char *stime = (char *)malloc(msg->payloadlen + 2);
-        strncpy(stime, msg->payload, msg->payloadlen);
-        stime[msg->payloadlen] = 0;
-        command_t *cmd = command_new("SYNCSTART", stime, "-", 0, "GLOBAL_INQUEUE", "__", "__", "");
-        queue_enq(queue, cmd, sizeof(command_t));
-        free(stime);
+        default:
+            break;
     }
-
-    MQTTAsync_freeMessage(&msg);
-    MQTTAsync_free(topicname);
-    return 1;
 }
 
 
@@ -287,6 +397,7 @@ void jwork_connect_lost(void *ctx, char *cause)
     else
     {
         js->cstate->mqttenabled[indx] = false;
+        thread_signal(js->cstate->levelsem);
         printf("Connection lost at %d.. reconnecting.. \n", indx);
         core_reconnect_i(js->cstate, indx);
     }
@@ -312,9 +423,12 @@ void jwork_assemble_fds(jamstate_t *js)
 
     js->pollfds[0].fd = js->atable->globaloutq->pullsock;
 
-    js->pollfds[1].fd = js->deviceinq->pullsock;
-    js->pollfds[2].fd = js->foginq->pullsock;
-    js->pollfds[3].fd = js->cloudinq->pullsock;
+    for (i = 0; i < MAX_LEVELS; i++)
+    {
+        js->pollfds[1 + i].fd = js->levels[i]->inq->pullsock;
+        if (js->levels[i]->ownthread)
+            js->pollfds[1 + i].events = 0;
+    }
 
     for (i = 0; i < MAX_ACT_THREADS; i++)
         js->pollfds[4 + i].fd = js->atable->athreads[i]->outq->pullsock;
@@ -344,27 +458,17 @@ void jwork_processor(jamstate_t *js)
         #endif
         jwork_process_globaloutq(js);
     }
-    if (js->pollfds[1].revents & NN_POLLIN)
-    {
-        #ifdef DEBUG_LVL1
-            printf("DEVICE_IN_SOCK has message\n");
-        #endif
-        jwork_process_device(js);
-    }
-
-    if (js->pollfds[2].revents & NN_POLLIN)
+    // Levels that run in their own threads are not watched by the poller
+    // (their events are 0) so revents would never be set for them
+    for (int i = 0; i < MAX_LEVELS; i++)
     {
-        #ifdef DEBUG_LVL1
-            printf("FOG_IN_SOCK has message\n");
-        #endif
-        jwork_process_fog(js);
-    }
-    if (js->pollfds[3].revents & NN_POLLIN)
-    {
-        #ifdef DEBUG_LVL1
-            printf("CLOUD_IN_SOCK has message\n");
-        #endif
-        jwork_process_cloud(js);
+        if (js->pollfds[i + 1].revents & NN_POLLIN)
+        {
+            #ifdef DEBUG_LVL1
+                printf("%s input queue has message\n", js->levels[i]->name);
+            #endif
+            jwork_process_level(js, js->levels[i]);
+        }
     }
     for (int i = 0; i < MAX_ACT_THREADS; i++)
     {
@@ -374,14 +478,37 @@ void jwork_processor(jamstate_t *js)
 }
 
 
+// Relay a request to all the connected levels. The large byte string
+// arguments (sent as stream descriptors) follow the request in fragments.
+// We hold rcmd for each publish.. the extra hold (the queue's) is kept
+// until the streams are started and released at the end.
+//
+static void jwork_publish_request(jamstate_t *js, command_t *rcmd)
+{
+    int i, levels = 0;
+
+    for (i = 0; i < 3; i++)
+        if (js->cstate->mqttenabled[i] == true)
+        {
+            levels |= (1 << i);
+            command_hold(rcmd);
+        }
+
+    for (i = 0; i < 3; i++)
+        if (levels & (1 << i))
+            mqtt_publish(js->cstate->mqttserv[i], MQTT_LEVEL_REQUEST, rcmd);
+
+    jstream_start(js->cstate, rcmd, levels);
+    command_free(rcmd);
+}
+
+
 // The global Output Q has all the commands the main thread wants to
 // get executed: LOCAL and non LOCAL. If the "opt" field of the message
 // is "LOCAL" we execute the command locally. Otherwise, it is sent to the
 // remote node for
 void jwork_process_globaloutq(jamstate_t *js)
 {
-    int i;
-
     nvoid_t *nv = queue_deq(js->atable->globaloutq);
     if (nv == NULL) return;
 
@@ -395,14 +522,7 @@ void jwork_process_globaloutq(jamstate_t *js)
             printf("Processing cmd: from GlobalOutQ.. ..\n");
             printf("====================================== In global processing.. cmd: %s, opt: %s\n", rcmd->cmd, rcmd->opt);
         #endif
-        // increment the reference count..
-        for (i = 1; i < 3; i++)
-            if (js->cstate->mqttenabled[i] == true)
-                command_hold(rcmd);
-
-        for (i = 0; i < 3; i++)
-            if (js->cstate->mqttenabled[i] == true)
-                mqtt_publish(js->cstate->mqttserv[i], "/level/func/request", rcmd);
+        jwork_publish_request(js, rcmd);
     }
 }
 
@@ -420,7 +540,6 @@ void jwork_process_globaloutq(jamstate_t *js)
 
 void jwork_process_actoutq(jamstate_t *js, int indx)
 {
-    int i;
     nvoid_t *nv = queue_deq(js->atable->athreads[indx]->outq);
     if (nv == NULL) return;
 
@@ -435,477 +554,458 @@ void jwork_process_actoutq(jamstate_t *js, int indx)
     {
         // TODO: What else goes here..???
         // TODO: Revise this part...
-        // Increment the hold on rcmd.. so that memory deallocation happens after all use
-        for (i = 1; i < 3; i++)
-            if (js->cstate->mqttenabled[i] == true)
-                command_hold(rcmd);
-
-        // relay the command to the remote servers..
-        for (int i = 0; i < 3; i++)
-            if (js->cstate->mqttenabled[i] == true)
-                mqtt_publish(js->cstate->mqttserv[i], "/level/func/request", rcmd);
+        jwork_publish_request(js, rcmd);
     }
 }
 
 
-// We have an incoming message from the J at device
-// We need to process it here..
+// Create the worker state for a level. The state is created at initialization
+// (before the bgthread starts) for all the levels - even the ones that
+// are not connected yet.
 //
-void jwork_process_device(jamstate_t *js)
+jamlevel_t *jwork_level_new(jamstate_t *js, int level, char *name, simplequeue_t *inq)
 {
-    // Get the message from the device to process
-    //
-    nvoid_t *nv = queue_deq(js->deviceinq);
-    if (nv == NULL) return;
+    jamlevel_t *lvl = (jamlevel_t *)calloc(1, sizeof(jamlevel_t));
+    assert(lvl != NULL);
+
+    lvl->level = level;
+    lvl->name = strdup(name);
+    lvl->inq = inq;
+    lvl->cachesize = JWORK_CACHE_SIZE;
+    lvl->cache = (char **)calloc(lvl->cachesize, sizeof(char *));
+    lvl->cachehash = (uint32_t *)calloc(lvl->cachesize, sizeof(uint32_t));
+    lvl->jarg = js;
+    lvl->pub = publisher_new(&(js->cstate->mqttserv[level]), js->cstate->device_id);
+
+    // The device level always goes through the bgthread. It carries the
+    // registration and configuration traffic.
+    lvl->ownthread = (levelthreads && level > 0);
+
+    return lvl;
+}
 
-    command_t *rcmd = (command_t *)nv->data;
-    free(nv);
-    #ifdef DEBUG_LVL1
-        printf("Command from Device cmd: %s, opt: %s actarg: %s actid: %s\n", rcmd->cmd, rcmd->opt, rcmd->actarg, rcmd->actid);
-    #endif
-    // Don't use nvoid_free() .. it is not deep enough
 
-    if (rcmd != NULL)
+void jwork_start_level_threads(jamstate_t *js)
+{
+    for (int i = 0; i < MAX_LEVELS; i++)
     {
-        if (strcmp(rcmd->cmd, "KILL") == 0)
-        {
-            printf("ERROR! Kill message received from the J node.\n");
-            printf("Exiting.\n");
-            exit(1);
-        }
-        else
-        if (strcmp(rcmd->cmd, "REGISTER-ACK") == 0)
+        jamlevel_t *lvl = js->levels[i];
+        if (lvl->ownthread)
         {
-            js->registered = true;
-            command_t *scmd = command_new("GET-CF-INFO", "-", "-", 0, "-", "-", js->cstate->device_id, "");
-            mqtt_publish(js->cstate->mqttserv[0], "/admin/request/all", scmd);
-
-            // We know the host actid - in this case the device J. save it.
-            core_sethost(js->cstate, 0, rcmd->actid);
-            // We are done with registration...
-            thread_signal(js->bgsem);
-            command_free(rcmd);
-        }
-        else
-        if (strcmp(rcmd->cmd, "PING") == 0)
-        {
-            // If registration is still not complete.. send another registration
-            // Although this could be a very rare event.. (missing REGISTER message)
-            if (!js->registered)
-                send_register(js->cstate, 0);
-
-            // If CF information is still pending.. send a REFRESH to get the
-            // latest information... the callback is already there..
-            if (js->cstate->cf_pending)
-                send_infoquery(js->cstate);
-
-            // Handle mqttpending[] - decrement the counter. if the counter hits
-            // zero, turn off mqttpending[].. this should be done only if mqttpending[] is true
-            if (js->cstate->mqttpending[1])
+            int rval = pthread_create(&(lvl->thread), NULL, jwork_level_thread, (void *)lvl);
+            if (rval != 0)
             {
-                if (js->cstate->pendingcount-- < 0)
-                {
-                    js->cstate->pendingcount = 0;
-                    js->cstate->mqttpending[1] = false;
-                }
+                perror("ERROR! Unable to start the level thread");
+                exit(1);
             }
-            command_free(rcmd);
-        }
-        else
-        if (strcmp(rcmd->cmd, "PUT-CF-INFO") == 0)
-        {
-            if (strcmp(rcmd->actarg, "redis") == 0)
-            {
-                if (rcmd->nargs == 2)
-                {
-                    char *host = rcmd->args[0].val.sval;
-                    int port;
-                    if (rcmd->args[1].type == INT_TYPE)
-                        port = rcmd->args[1].val.ival;
-                    else
-                        port = atoi(rcmd->args[1].val.sval);
-                    jam_set_redis(js, host, port);
-                }
-            }
-            else
-            if (strcmp(rcmd->actarg, "fog") == 0)
-            {
-                printf("Information about a fog %s, %s, %d %d\n", rcmd->opt, rcmd->args[0].val.sval, js->cstate->mqttenabled[1], js->cstate->mqttpending[1]);
-
-                if  (strcmp(rcmd->opt, "ADD") == 0)
-                {
-                    if (!js->cstate->mqttenabled[1] && !js->cstate->mqttpending[1])
-                    {
-                        js->cstate->mqttpending[1] = true;
-                        js->cstate->pendingcount = MAX_PENDING_CNT;
-                        core_createserver(js->cstate, 1, rcmd->args[0].val.sval);
-                        comboptr_t *ctx = create_combo3i_ptr(js, js->foginq, NULL, 1);
-                        core_setcallbacks(js->cstate, ctx, jwork_connect_lost, jwork_msg_arrived, NULL);
-                        core_connect(js->cstate, 1, on_fog_connect, rcmd->actid);
-            //            printf("Machine height %d\n", machine_height(js));
-                    }
-                }
-                else
-                if (strcmp(rcmd->opt, "DEL") == 0)
-                {
-                    if (core_disconnect(js->cstate, 1, rcmd->actid))
-                    {
-                        printf("==>>>>>>>>>>=== FOG deleted ----------------->>>>>>>>>\n");
-                        js->cstate->mqttpending[1] = false;
-                    }
-                    else
-                        printf("==>>>>>>>>>>=== FOG delete  IGNORED ----------------->>>>>>>>>\n");
-                }
-            }
-            else
-            if (strcmp(rcmd->actarg, "cloud") == 0)
-            {
-                if  (strcmp(rcmd->opt, "ADD") == 0)
-                {
-                    if (!js->cstate->mqttenabled[2] && !js->cstate->mqttpending[2])
-                    {
-                        js->cstate->mqttpending[2] = true;
-                        js->cstate->pendingcount = MAX_PENDING_CNT;
-                        printf("================ Cloud connection...... at %s\n", rcmd->args[0].val.sval);
-                        core_createserver(js->cstate, 2, rcmd->args[0].val.sval);
-                        comboptr_t *ctx = create_combo3i_ptr(js, js->cloudinq, NULL, 2);
-                        core_setcallbacks(js->cstate, ctx, jwork_connect_lost, jwork_msg_arrived, NULL);
-                        core_connect(js->cstate, 2, on_cloud_connect, rcmd->actid);
-                    }
-                }
-                else
-                if (strcmp(rcmd->opt, "DEL") == 0)
-                {
-                    if (core_disconnect(js->cstate, 2, rcmd->actid))
-                        printf("==>>>>>>>>>>=== CLOUD deleted ----------------->>>>>>>>>\n");
-                    else
-                        printf("==>>>>>>>>>>=== CLOUD delete IGNORED ----------------->>>>>>>>>\n");
-                }
-            }
-            command_free(rcmd);
-            core_check_pending(js->cstate);
-        }
-        else
-        if (strcmp(rcmd->cmd, "REXEC-ASY") == 0)
-        {
-            if (overflow_detect())
-            {
-                command_free(rcmd);
-                return;
-            }
-
-            if (duplicate_detect(rcmd))
-                return;
-
-            if (jwork_evaluate_cond(rcmd->cond))
-            {
-                p2queue_enq_low(js->atable->globalinq, rcmd, sizeof(command_t));
-            }
-            else
-                jwork_send_nak(js, rcmd, "CONDITION FALSE");
-        }
-        else
-        if (strcmp(rcmd->cmd, "REXEC-SYN") == 0)
-        {
-            if (duplicate_detect(rcmd))
-                return;
-
-            if (jwork_evaluate_cond(rcmd->cond))
-            {
-                jwork_send_ack(js, "SYN", rcmd);
-                p2queue_enq_low(js->atable->globalinq, rcmd, sizeof(command_t));
-            }
-            else
-                jwork_send_nak(js, rcmd, "CONDITION FALSE");
-        }
-        else
-        if ((strcmp(rcmd->cmd, "REXEC-ACK") == 0) ||
-            (strcmp(rcmd->cmd, "REXEC-NAK") == 0) ||
-            (strcmp(rcmd->cmd, "REXEC-RES") == 0))
-        {
-           // resolve the activity id to index
-            activity_thread_t *athr = athread_getbyid(js->atable, rcmd->actid);
-            if (athr != NULL)
-                pqueue_enq(athr->inq, rcmd, sizeof(command_t));
-        }
-        else
-        if (strcmp(rcmd->cmd, "SYNCSTART") == 0) {
-			// Received the "go" from J nodes, we put the go command into the high queue
-            p2queue_enq_high(js->atable->globalinq, rcmd, sizeof(command_t));
-        }
-        else
-        {
-            command_free(rcmd);
         }
     }
 }
 
 
-bool overflow_detect()
+// A level thread just blocks on the input queue of the level.
+// So the fog or cloud traffic does not wait behind the device traffic
+// in the bgthread.
+//
+void *jwork_level_thread(void *arg)
 {
-    if (arc4random_uniform(100) <= odcount)
-        return false;
-    else
-        return true;
+    jamlevel_t *lvl = (jamlevel_t *)arg;
+    jamstate_t *js = (jamstate_t *)lvl->jarg;
+
+    #ifdef DEBUG_LVL1
+        printf("Level thread started for %s\n", lvl->name);
+    #endif
+
+    while (1)
+        jwork_process_level(js, lvl);
+
+    return NULL;
 }
 
-bool duplicate_detect(command_t *rcmd)
+
+// We have incoming messages from the J node at the level.
+// The first message is known to be there (or we block for it). After that
+// we take the messages that are already sitting in the queue - up to
+// JWORK_DRAIN_MAX - without going back to the poller.
+//
+void jwork_process_level(jamstate_t *js, jamlevel_t *lvl)
 {
-    if (find_list_item(cache, rcmd->actid))
-    {
-        command_free(rcmd);
-        return true;
-    }
-    else
+    int count = 0;
+    nvoid_t *nv;
+
+    for (nv = queue_deq(lvl->inq); nv != NULL; nv = queue_deq_nowait(lvl->inq))
     {
-        put_list_tail(cache, strdup(rcmd->actid), strlen(rcmd->actid));
-        if (list_length(cache) > cachesize)
-            del_list_tail(cache);
-    }
+        command_t *rcmd = (command_t *)nv->data;
+        free(nv);
+        // Don't use nvoid_free() .. it is not deep enough
 
-    return false;
+        if (rcmd != NULL)
+        {
+            #ifdef DEBUG_LVL1
+                printf("Command from %s cmd: %s, opt: %s actarg: %s actid: %s\n", lvl->name, rcmd->cmd, rcmd->opt, rcmd->actarg, rcmd->actid);
+            #endif
+            jwork_process_command(js, lvl, rcmd);
+        }
+
+        if (++count >= JWORK_DRAIN_MAX)
+            break;
+    }
 }
 
 
-void jwork_send_error(jamstate_t *js, command_t *cmd, char *estr)
+/*
+ * Handlers for the commands coming from the J nodes. The handler table
+ * is indexed by the command opcode and says which levels are allowed to
+ * send the command. Anything not in the table is dropped.
+ * The handler owns the command (frees it or passes it on).
+ */
+
+#define LEVELS_DEVICE               0x1
+#define LEVELS_ALL                  0x7
+
+typedef void (*jwork_handler_f)(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd);
+
+typedef struct _jwork_handler_t
 {
-    MQTTAsync mcl = js->cstate->mqttserv[0];
-    char *deviceid = js->cstate->device_id;
+    jwork_handler_f handler;
+    int levels;                             // bit mask of (1 << level)
 
-    // Create a new command to send as error..
-    command_t *scmd = command_new("REXEC-ERR", "ERR", "-", 0, cmd->actname, cmd->actid, deviceid, "s", estr);
+} jwork_handler_t;
 
-    // send the command over
-    mqtt_publish(mcl, "/mach/func/reply", scmd);
 
-    // deallocate the command string..
-    command_free(cmd);
+static void jwork_handle_kill(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
+{
+    printf("ERROR! Kill message received from the J node.\n");
+    printf("Exiting.\n");
+    exit(1);
 }
 
 
-void jwork_send_nak(jamstate_t *js, command_t *cmd, char *estr)
+static void jwork_handle_register_ack(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
 {
-    MQTTAsync mcl = js->cstate->mqttserv[0];
-    char *deviceid = js->cstate->device_id;
+    js->registered = true;
+    command_t *scmd = command_new("GET-CF-INFO", "-", "-", 0, "-", "-", js->cstate->device_id, "");
+    mqtt_publish(js->cstate->mqttserv[0], MQTT_ADMIN_REQUEST, scmd);
+
+    // We know the host actid - in this case the device J. save it.
+    core_sethost(js->cstate, 0, rcmd->actid);
+    // We are done with registration...
+    thread_signal(js->bgsem);
+    command_free(rcmd);
+}
 
-    // Create a new command to send as error..
-    command_t *scmd = command_new("REXEC-NAK", "NAK", "-", 0, cmd->actname, cmd->actid, deviceid, "s", estr);
 
-    // send the command over
-    mqtt_publish(mcl, "/mach/func/reply", scmd);
+static void jwork_handle_ping(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
+{
+    // If registration is still not complete.. send another registration
+    // Although this could be a very rare event.. (missing REGISTER message)
+    if (!js->registered)
+        send_register(js->cstate, 0);
+
+    // If CF information is still pending.. send a REFRESH to get the
+    // latest information... the callback is already there..
+    if (js->cstate->cf_pending)
+        send_infoquery(js->cstate);
+
+    // Handle mqttpending[] - decrement the counter. if the counter hits
+    // zero, turn off mqttpending[].. this should be done only if mqttpending[] is true
+    if (js->cstate->mqttpending[1])
+    {
+        if (js->cstate->pendingcount-- < 0)
+        {
+            js->cstate->pendingcount = 0;
+            js->cstate->mqttpending[1] = false;
+        }
+    }
+    command_free(rcmd);
+}
 
-    // deallocate the command string..
-    command_free(cmd);
+
+static void jwork_handle_cfinfo(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
+{
+    jwork_process_cfinfo(js, rcmd);
+    command_free(rcmd);
+    core_check_pending(js->cstate);
 }
 
 
-void jwork_send_ack(jamstate_t *js, char *opt, command_t *cmd)
+static void jwork_handle_rexec_asy(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
 {
-    MQTTAsync mcl = js->cstate->mqttserv[0];
-    char *deviceid = js->cstate->device_id;
+    // Admission control comes before the duplicate detection, so the
+    // retry of a rejected request is not taken as a duplicate
+    int retry = admission_check(js->admctl, athread_freecount(js->atable));
+    if (retry > 0)
+    {
+        jwork_send_overload(js, lvl->level, rcmd, retry);
+        return;
+    }
 
-    // Create a new command to send as error..
-    command_t *scmd = command_new("REXEC-ACK", opt, "-", 0, cmd->actname, cmd->actid, deviceid, "");    
+    if (duplicate_detect(lvl, rcmd))
+        return;
 
-    // send the command over
-    mqtt_publish(mcl, "/mach/func/reply", scmd);
+    if (jwork_evaluate_cond(rcmd->cond))
+    {
+        journal_started(js->journal, lvl->level, rcmd);
+        admission_enqueued(js->admctl, rcmd);
+        p2queue_enq_low(js->atable->globalinq, rcmd, sizeof(command_t));
+    }
+    else
+        jwork_send_nak(js, rcmd, "CONDITION FALSE");
 }
 
 
-void jwork_send_ack_1(jamstate_t *js, char *opt, command_t *cmd)
+static void jwork_handle_rexec_syn(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
 {
-    MQTTAsync mcl = js->cstate->mqttserv[1];
-    char *deviceid = js->cstate->device_id;
+    // Already run (maybe before a restart).. send the result again
+    runtableentry_t *re = runtable_find(js->rtable, rcmd->actid);
+    if (re != NULL && re->status == COMPLETED && re->result != NULL)
+    {
+        jwork_send_ack(js, lvl->level, "SYN", rcmd);
+        jwork_send_results(js, re->opt, re->actname, re->actid, command_arg_clone(re->result));
+        command_free(rcmd);
+        return;
+    }
 
-    // Create a new command to send as error..
-    command_t *scmd = command_new("REXEC-ACK", opt, "-", 0, cmd->actname, cmd->actid, deviceid, "");    
+    if (duplicate_detect(lvl, rcmd))
+        return;
 
-    // send the command over
-    mqtt_publish(mcl, "/mach/func/reply", scmd);
+    if (jwork_evaluate_cond(rcmd->cond))
+    {
+        journal_started(js->journal, lvl->level, rcmd);
+        jwork_send_ack(js, lvl->level, "SYN", rcmd);
+        p2queue_enq_low(js->atable->globalinq, rcmd, sizeof(command_t));
+    }
+    else
+        jwork_send_nak(js, rcmd, "CONDITION FALSE");
 }
 
 
-void jwork_send_ack_2(jamstate_t *js, char *opt, command_t *cmd)
+static void jwork_handle_reply(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
 {
-    MQTTAsync mcl = js->cstate->mqttserv[2];
-    char *deviceid = js->cstate->device_id;
+    // resolve the activity id to index
+    activity_thread_t *athr = athread_getbyid(js->atable, rcmd->actid);
+    if (athr != NULL)
+        pqueue_enq(athr->inq, rcmd, sizeof(command_t));
+}
 
-    // Create a new command to send as error..
-    command_t *scmd = command_new("REXEC-ACK", opt, "-", 0, cmd->actname, cmd->actid, deviceid, "");    
 
-    // send the command over
-    mqtt_publish(mcl, "/mach/func/reply", scmd);
+static void jwork_handle_chunk_ack(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
+{
+    jstream_ack(js->cstate, lvl->level, rcmd);
+    command_free(rcmd);
 }
 
 
-void jwork_send_results(jamstate_t *js, char *opt, char *actname, char *actid, arg_t *args)
+static void jwork_handle_syncstart(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
 {
-    MQTTAsync mcl;
+    // Received the "go" from J nodes, we put the go command into the high queue
+    p2queue_enq_high(js->atable->globalinq, rcmd, sizeof(command_t));
+}
 
-    printf("Sending the results... %s\n", opt);
 
-    if (strcmp(opt, "cloud") == 0)
-        mcl = js->cstate->mqttserv[2];
-    else
-    if (strcmp(opt, "fog") == 0)
-        mcl = js->cstate->mqttserv[1];
-    else
-        mcl = js->cstate->mqttserv[0];
-    char *deviceid = js->cstate->device_id;
+static jwork_handler_t jwork_handlers[CMD_MAX_OPCODE] = {
+    [CMD_KILL]          = {jwork_handle_kill, LEVELS_DEVICE},
+    [CMD_REGISTER_ACK]  = {jwork_handle_register_ack, LEVELS_DEVICE},
+    [CMD_PING]          = {jwork_handle_ping, LEVELS_DEVICE},
+    [CMD_PUT_CF_INFO]   = {jwork_handle_cfinfo, LEVELS_DEVICE},
+    [CMD_REXEC_ASY]     = {jwork_handle_rexec_asy, LEVELS_ALL},
+    [CMD_REXEC_SYN]     = {jwork_handle_rexec_syn, LEVELS_ALL},
+    [CMD_REXEC_ACK]     = {jwork_handle_reply, LEVELS_ALL},
+    [CMD_REXEC_NAK]     = {jwork_handle_reply, LEVELS_ALL},
+    [CMD_REXEC_RES]     = {jwork_handle_reply, LEVELS_ALL},
+    [CMD_SYNCSTART]     = {jwork_handle_syncstart, LEVELS_ALL},
+    [CMD_CHUNK_ACK]     = {jwork_handle_chunk_ack, LEVELS_ALL}
+};
 
-    // Create a new command to send as error..
-    command_t *scmd = command_new_using_arg("REXEC-RES", "SYN", "-", 0, actname, actid, deviceid, args, 1);
 
-    // send the command over
-    mqtt_publish(mcl, "/mach/func/reply", scmd);
+void jwork_process_command(jamstate_t *js, jamlevel_t *lvl, command_t *rcmd)
+{
+    jwork_handler_t *h = &jwork_handlers[rcmd->opcode];
 
+    rcmd->level = lvl->level;
+    if (h->handler != NULL && (h->levels & (1 << lvl->level)))
+        h->handler(js, lvl, rcmd);
+    else
+        command_free(rcmd);
 }
 
 
-// We have an incoming message from the J at fog
-// We need to process it here..
+// Configuration information (PUT-CF-INFO) from the device J. It tells us
+// about the redis server and the fog and cloud brokers that come and go.
 //
-void jwork_process_fog(jamstate_t *js)
+void jwork_process_cfinfo(jamstate_t *js, command_t *rcmd)
 {
-    // Get the message from the fog to process
-    //
-    nvoid_t *nv = queue_deq(js->foginq);
-    if (nv == NULL) return;
-
-    command_t *rcmd = (command_t *)nv->data;
-    free(nv);
-    #ifdef DEBUG_LVL1
-        printf("\n\nFOG-INQ %s, opt: %s actarg: %s actid: %s\n\n\n", rcmd->cmd, rcmd->opt, rcmd->actarg, rcmd->actid);
-    #endif
-    // Don't use nvoid_free() .. it is not deep enough
-
-    if (rcmd != NULL)
+    if (strcmp(rcmd->actarg, "redis") == 0)
     {
-        // We are getting replies from the fog level for requests that
-        // were sent from the C. There is no unsolicited replies.
-        if (strcmp(rcmd->cmd, "REXEC-ASY") == 0)
+        if (rcmd->nargs == 2)
         {
-            if (duplicate_detect(rcmd))
-                return;
+            char *host = rcmd->args[0].val.sval;
+            int port;
+            if (rcmd->args[1].type == INT_TYPE)
+                port = rcmd->args[1].val.ival;
+            else
+                port = atoi(rcmd->args[1].val.sval);
+            jam_set_redis(js, host, port);
+        }
+    }
+    else
+    if (strcmp(rcmd->actarg, "fog") == 0)
+    {
+        printf("Information about a fog %s, %s, %d %d\n", rcmd->opt, rcmd->args[0].val.sval, js->cstate->mqttenabled[1], js->cstate->mqttpending[1]);
 
-            if (jwork_evaluate_cond(rcmd->cond))
+        if  (strcmp(rcmd->opt, "ADD") == 0)
+        {
+            if (!js->cstate->mqttenabled[1] && !js->cstate->mqttpending[1])
             {
-            //    printf("Machine height ----- %d\n", machine_height(js));
-                p2queue_enq_low(js->atable->globalinq, rcmd, sizeof(command_t));
+                js->cstate->mqttpending[1] = true;
+                js->cstate->pendingcount = MAX_PENDING_CNT;
+                core_createserver(js->cstate, 1, rcmd->args[0].val.sval);
+                comboptr_t *ctx = create_combo3i_ptr(js, js->foginq, NULL, 1);
+                core_setcallbacks(js->cstate, ctx, jwork_connect_lost, jwork_msg_arrived, NULL);
+                core_connect(js->cstate, 1, on_fog_connect, rcmd->actid);
+    //            printf("Machine height %d\n", machine_height(js));
             }
-            else
-                jwork_send_nak(js, rcmd, "CONDITION FALSE");
-        } 
-        else 
-        if (strcmp(rcmd->cmd, "REXEC-SYN") == 0)
+        }
+        else
+        if (strcmp(rcmd->opt, "DEL") == 0)
         {
-            if (duplicate_detect(rcmd))
-                return;
-
-            if (jwork_evaluate_cond(rcmd->cond))
+            if (core_disconnect(js->cstate, 1, rcmd->actid))
             {
-           //     printf("SYN..Machine height ----- %d\n", machine_height(js));
-                jwork_send_ack_1(js, "SYN", rcmd);
-                p2queue_enq_low(js->atable->globalinq, rcmd, sizeof(command_t));
+                printf("==>>>>>>>>>>=== FOG deleted ----------------->>>>>>>>>\n");
+                js->cstate->mqttpending[1] = false;
             }
             else
-                jwork_send_nak(js, rcmd, "CONDITION FALSE");
+                printf("==>>>>>>>>>>=== FOG delete  IGNORED ----------------->>>>>>>>>\n");
         }
-        else
-        if ((strcmp(rcmd->cmd, "REXEC-ACK") == 0) ||
-            (strcmp(rcmd->cmd, "REXEC-NAK") == 0) ||
-            (strcmp(rcmd->cmd, "REXEC-RES") == 0))
+    }
+    else
+    if (strcmp(rcmd->actarg, "cloud") == 0)
+    {
+        if  (strcmp(rcmd->opt, "ADD") == 0)
         {
-           // resolve the activity id to index
-            activity_thread_t *athr = athread_getbyid(js->atable, rcmd->actid);
-            if (athr != NULL)
-                pqueue_enq(athr->inq, rcmd, sizeof(command_t));
+            if (!js->cstate->mqttenabled[2] && !js->cstate->mqttpending[2])
+            {
+                js->cstate->mqttpending[2] = true;
+                js->cstate->pendingcount = MAX_PENDING_CNT;
+                printf("================ Cloud connection...... at %s\n", rcmd->args[0].val.sval);
+                core_createserver(js->cstate, 2, rcmd->args[0].val.sval);
+                comboptr_t *ctx = create_combo3i_ptr(js, js->cloudinq, NULL, 2);
+                core_setcallbacks(js->cstate, ctx, jwork_connect_lost, jwork_msg_arrived, NULL);
+                core_connect(js->cstate, 2, on_cloud_connect, rcmd->actid);
+            }
         }
         else
-        if (strcmp(rcmd->cmd, "SYNCSTART") == 0) {
-			// Received the "go" from J nodes, we put the go command into the high queue
-            p2queue_enq_high(js->atable->globalinq, rcmd, sizeof(command_t));
+        if (strcmp(rcmd->opt, "DEL") == 0)
+        {
+            if (core_disconnect(js->cstate, 2, rcmd->actid))
+                printf("==>>>>>>>>>>=== CLOUD deleted ----------------->>>>>>>>>\n");
+            else
+                printf("==>>>>>>>>>>=== CLOUD delete IGNORED ----------------->>>>>>>>>\n");
         }
-        else
+    }
+}
+
+
+bool duplicate_detect(jamlevel_t *lvl, command_t *rcmd)
+{
+    uint32_t hash = actid_hash(rcmd->actid);
+
+    for (int i = 0; i < lvl->cachesize; i++)
+    {
+        if (lvl->cache[i] != NULL && lvl->cachehash[i] == hash &&
+            actid_equal(lvl->cache[i], rcmd->actid))
         {
             command_free(rcmd);
+            return true;
         }
     }
+
+    duplicate_insert(lvl, rcmd->actid);
+    return false;
 }
 
 
-// We have an incoming message from the J at cloud
-// We need to process it here..
+// Ring.. the oldest entry goes
 //
-void jwork_process_cloud(jamstate_t *js)
+void duplicate_insert(jamlevel_t *lvl, char *actid)
 {
-    // Get the message from the cloud to process
-    //
-    nvoid_t *nv = queue_deq(js->cloudinq);
-    if (nv == NULL) return;
+    if (lvl->cache[lvl->cachepos] != NULL)
+        free(lvl->cache[lvl->cachepos]);
+    lvl->cache[lvl->cachepos] = strdup(actid);
+    lvl->cachehash[lvl->cachepos] = actid_hash(actid);
+    lvl->cachepos = (lvl->cachepos + 1) % lvl->cachesize;
+}
 
-    command_t *rcmd = (command_t *)nv->data;
-    free(nv);
-    #ifdef DEBUG_LVL1
-        printf("\n\nCLOUD-INQ %s, opt: %s actarg: %s actid: %s\n\n\n", rcmd->cmd, rcmd->opt, rcmd->actarg, rcmd->actid);
-    #endif
-    // Don't use nvoid_free() .. it is not deep enough
 
-    if (rcmd != NULL)
-    {
-        // We are getting replies from the cloud level for requests that
-        // were sent from the C. There is no unsolicited replies.
+void jwork_send_error(jamstate_t *js, command_t *cmd, char *estr)
+{
+    publisher_t *pub = js->levels[0]->pub;
 
-        // TODO: Can we detect unsolicited replies and discard them?
-        if (strcmp(rcmd->cmd, "REXEC-ASY") == 0) 
-        {
-            if (duplicate_detect(rcmd))
-                return;
+    publisher_reply(pub, MQTT_MACH_REPLY, pub->err, "ERR", cmd->actname, cmd->actid, "s", estr);
 
-            if (jwork_evaluate_cond(rcmd->cond))
-            {
-                p2queue_enq_low(js->atable->globalinq, rcmd, sizeof(command_t));
-            }
-            else
-                jwork_send_nak(js, rcmd, "CONDITION FALSE");
-        } 
-        else 
-        if (strcmp(rcmd->cmd, "REXEC-SYN") == 0)
-        {
-            if (duplicate_detect(rcmd))
-                return;
+    // deallocate the command string..
+    command_free(cmd);
+}
+
+
+void jwork_send_nak(jamstate_t *js, command_t *cmd, char *estr)
+{
+    publisher_t *pub = js->levels[0]->pub;
+
+    publisher_reply(pub, MQTT_MACH_REPLY, pub->nak, "NAK", cmd->actname, cmd->actid, "s", estr);
+
+    // deallocate the command string..
+    command_free(cmd);
+}
+
+
+// Reject a request because the node is overloaded. The J node should
+// resend the request after retry milliseconds. The NAK goes to the J node
+// at the level where the request came from.
+void jwork_send_overload(jamstate_t *js, int level, command_t *cmd, int retry)
+{
+    publisher_t *pub = js->levels[level]->pub;
+
+    publisher_reply(pub, MQTT_MACH_REPLY, pub->nak, "NAK", cmd->actname, cmd->actid, "si", "OVERLOAD", retry);
+
+    // deallocate the command string..
+    command_free(cmd);
+}
+
+
+// Send the ACK to the J node at the level where the request came from
+void jwork_send_ack(jamstate_t *js, int level, char *opt, command_t *cmd)
+{
+    publisher_t *pub = js->levels[level]->pub;
+
+    publisher_reply(pub, MQTT_MACH_REPLY, pub->ack, opt, cmd->actname, cmd->actid, "");
+}
+
+
+void jwork_send_results(jamstate_t *js, char *opt, char *actname, char *actid, arg_t *args)
+{
+    MQTTAsync mcl;
+
+    printf("Sending the results... %s\n", opt);
+
+    if (strcmp(opt, "cloud") == 0)
+        mcl = js->cstate->mqttserv[2];
+    else
+    if (strcmp(opt, "fog") == 0)
+        mcl = js->cstate->mqttserv[1];
+    else
+        mcl = js->cstate->mqttserv[0];
+    char *deviceid = js->cstate->device_id;
+
+    // Create a new command to send as error..
+    command_t *scmd = command_new_using_arg("REXEC-RES", "SYN", "-", 0, actname, actid, deviceid, args, 1);
+
+    // send the command over
+    mqtt_publish(mcl, MQTT_MACH_REPLY, scmd);
 
-            if (jwork_evaluate_cond(rcmd->cond))
-            {
-                jwork_send_ack_2(js, "SYN", rcmd);
-                p2queue_enq_low(js->atable->globalinq, rcmd, sizeof(command_t));                
-            }
-            else
-                jwork_send_nak(js, rcmd, "CONDITION FALSE");
-        }        
-        else
-        if ((strcmp(rcmd->cmd, "REXEC-ACK") == 0) ||
-            (strcmp(rcmd->cmd, "REXEC-NAK") == 0) ||
-            (strcmp(rcmd->cmd, "REXEC-RES") == 0))
-        {
-           // resolve the activity id to index
-            activity_thread_t *athr = athread_getbyid(js->atable, rcmd->actid);
-            if (athr != NULL)
-                pqueue_enq(athr->inq, rcmd, sizeof(command_t));
-        }
-        else
-        if (strcmp(rcmd->cmd, "SYNCSTART") == 0) {
-            // Received the "go" from J nodes, we put the go command into the high queue
-            p2queue_enq_high(js->atable->globalinq, rcmd, sizeof(command_t));
-        }
-        else
-        {
-            command_free(rcmd);
-        }
-        // Send the command (rcmd) to the activity given the above pointer is non NULL
-    }
 }
 
+
 bool jwork_evaluate_cond(char *cnd)
 {
     if (strlen(cnd) == 0)
@@ -2,9 +2,14 @@
 #include <mujs.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 js_State *J = NULL;
 
+// The conditions could be evaluated from more than one worker thread
+// (level threads) and the mujs state is not thread safe.
+static pthread_mutex_t jcondlock = PTHREAD_MUTEX_INITIALIZER;
+
 void print(js_State *J)
 {
     const char *name = js_tostring(J, 1);
@@ -16,6 +21,7 @@ void print(js_State *J)
 void jcond_init()
 {
     J = js_newstate(NULL, NULL, JS_STRICT);
+    js_setgcmode(J, JS_GCINCREMENTAL, JCOND_GC_BUDGET);
 
     js_newcfunction(J, print, "console_log", 1);
     js_setglobal(J, "console_log");
@@ -25,7 +31,9 @@ void jcond_init()
 
 void jcond_eval_str(char *s)
 {
+    pthread_mutex_lock(&jcondlock);
     js_dostring(J, s);
+    pthread_mutex_unlock(&jcondlock);
 }
 
 
@@ -37,10 +45,12 @@ char *jcond_eval_str_str(char *s)
 
     char buf[strlen(s) + 32];
     sprintf(buf, "var __jrval = eval(%s)", s);
+    pthread_mutex_lock(&jcondlock);
     js_dostring(J, buf);
     js_getglobal(J, "__jrval");
     res = strdup((char *)js_tostring(J, -1));
     js_pop(J, 1);
+    pthread_mutex_unlock(&jcondlock);
 
     return res;
 }
@@ -50,10 +60,12 @@ int jcond_eval_bool(char *s)
     int res;
     char buf[strlen(s) + 32];
     sprintf(buf, "var __jrval = eval(%s)", s);
+    pthread_mutex_lock(&jcondlock);
     js_dostring(J, buf);
     js_getglobal(J, "__jrval");
     res = js_toboolean(J, -1);
     js_pop(J, 1);
+    pthread_mutex_unlock(&jcondlock);
 
     return res;
 }
@@ -64,10 +76,12 @@ int jcond_eval_int(char *s)
 
     char buf[strlen(s) + 32];
     sprintf(buf, "var __jrval = eval(%s)", s);
+    pthread_mutex_lock(&jcondlock);
     js_dostring(J, buf);
     js_getglobal(J, "__jrval");
     res = js_toint32(J, -1);
     js_pop(J, 1);
+    pthread_mutex_unlock(&jcondlock);
 
     return res;
 }
@@ -78,15 +92,26 @@ double jcond_eval_double(char *s)
 
     char buf[strlen(s) + 32];
     sprintf(buf, "var __jrval = eval(%s)", s);
+    pthread_mutex_lock(&jcondlock);
     js_dostring(J, buf);
     js_getglobal(J, "__jrval");
     res = js_tonumber(J, -1);
     js_pop(J, 1);
+    pthread_mutex_unlock(&jcondlock);
 
     return res;
 }
 
 
+// Allocation and collection counts of the condition interpreter
+void jcond_gcstats(js_GCStats *stats)
+{
+    pthread_mutex_lock(&jcondlock);
+    js_gcstats(J, stats);
+    pthread_mutex_unlock(&jcondlock);
+}
+
+
 void jcond_free()
 {
     js_freestate(J);
@@ -13,6 +13,9 @@
 #define JCOND_SYNC_REQUESTED          0b00000000000000000000000000001000
 #define JCOND_JDATA_COND              0b00000000000000000000000000010000
 
+// Longest GC pause (us) in a condition check.. marking and sweeping both run in steps
+#define JCOND_GC_BUDGET               200
+
 
 // In any case, we will read it into memory lazily when first needed ...
 void print(js_State *J);
@@ -23,6 +26,7 @@ char *jcond_eval_str_str(char *s);
 int jcond_eval_bool(char *s);
 int jcond_eval_int(char *s);
 double jcond_eval_double(char *s);
+void jcond_gcstats(js_GCStats *stats);
 void jcond_free();
 
 #endif
@@ -30,448 +30,681 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 
-static char *_parse_str;
-static int _loc;
-static int _len;
-/* parsed value is passed using the parameter.. */
-static JSONValue *rval;
-
-int _peek_value();
-void _consume_char();
-void _parse_white();
-void _parse_nextline();
-int _char_in_string();
-int _parse_colon();
-int _parse_quote();
-int _parse_comma();
-int _parse_eobj();
-int _parse_bobj();
-int _parse_earr();
-int _parse_barr();
-char *_get_char();
-
-
-/* TODO: Lots of memory leak here.. Nothing is properly deallocated as it should
- * TODO: Check and balance the allocs and deallocs
- * TODO: Some deallocs should be delayed until the value is not needed
- */
+struct jarena_t
+{
+    struct jarena_t *next;
+    int size;
+    int used;
+    double data[];                  /* aligned start of the storage */
+};
+
+static JSONValue *jp_value(jparser_t *jp);
+static int jp_skip(jparser_t *jp);
+
+/* the parser used by init_parse() and friends.. one per thread */
+static __thread jparser_t *tparser;
 
-int parse_undefined(){
-    JSONValue *val = create_value();
-    _parse_white();
-    if(strncmp("undefined", (_parse_str + _loc), 9) == 0){ //equal{
-        val->type = UNDEFINED;
-        rval = val;
-        _loc += 9;
-        return UNDEFINED_VALUE;
-    } else {
-        free(val);
-        return ERROR;
-    }
-}
 
 /*
- * Setup the parse process...
+ * Arena.. allocation moves a pointer in the first block. A request that
+ * does not fit gets a new block in front of the list (a block of its own
+ * if it is bigger than JPARSER_BLOCK).
  */
-void init_parse(char *str)
+void *jparser_alloc(jparser_t *jp, int size)
 {
-    _parse_str = str;
-    _loc = 0;
-    _len = strlen(str);
+    jarena_t *a = jp->arena;
+    int bsize;
+    void *p;
+
+    size = (size + 7) & ~7;
+    if (a == NULL || a->used + size > a->size)
+    {
+        bsize = size > JPARSER_BLOCK ? size : JPARSER_BLOCK;
+        a = (jarena_t *)malloc(sizeof(jarena_t) + bsize);
+        if (a == NULL)
+        {
+            perror("Unable to Allocate Memory");
+            return NULL;
+        }
+        a->size = bsize;
+        a->used = 0;
+        a->next = jp->arena;
+        jp->arena = a;
+    }
+    p = (char *)a->data + a->used;
+    a->used += size;
+    return p;
 }
 
 
-/*
- * Return a pointer to the global variable holding the parsed JSON value..
- */
-JSONValue *get_value()
+jparser_t *jparser_new()
 {
-    return rval;
+    jparser_t *jp = (jparser_t *)calloc(1, sizeof(jparser_t));
+
+    jp->error = -1;
+    jp->maxtop = JPARSER_STACK;
+    jp->stack = (JSONValue *)calloc(jp->maxtop, sizeof(JSONValue));
+
+    return jp;
 }
 
 
 /*
- * Global variable rval is set by the 'parse_' functions called here.
- * There is no need to manipulate that variable here.. we just need to pass
- * along to the next iteration..
+ * Releases every document parsed so far. One standard block is kept for
+ * the next document so that a reused parser stops calling malloc().
  */
-int parse_value()
+void jparser_reset(jparser_t *jp)
 {
-
-    _parse_white();
-    int nextchar = _peek_value();
-
-    switch(nextchar)
-	{
-	case ' ':
-	    _consume_char();
-	    break;
-	case 't':
-	    return (parse_true() == ERROR) ? ERROR : VALID_VALUE;
-	case 'f':
-	    return (parse_false() == ERROR) ? ERROR : VALID_VALUE;
-	case 'n':
-	    return (parse_null() == ERROR) ? ERROR : VALID_VALUE;
-	case '[':
-	    return (parse_array() == ERROR) ? ERROR : VALID_VALUE;
-	case '{':
-	    return (parse_object() == ERROR) ? ERROR : VALID_VALUE;
-	case '"':
-	    return (parse_string() == ERROR) ? ERROR : VALID_VALUE;
-	case '-':
-	    return (parse_number() == ERROR) ? ERROR : VALID_VALUE;
-    case 'u':
-        return (parse_undefined() == ERROR) ? ERROR : VALID_VALUE;
-	default:
-	    if ((nextchar >= '0') && (nextchar <= '9'))
-		return (parse_number() == ERROR) ? ERROR : VALID_VALUE;
-	}
-    return ERROR;
+    jarena_t *a, *keep = NULL;
+
+    while ((a = jp->arena) != NULL)
+    {
+        jp->arena = a->next;
+        if (keep == NULL && a->size == JPARSER_BLOCK)
+            keep = a;
+        else
+            free(a);
+    }
+    if (keep != NULL)
+    {
+        keep->used = 0;
+        keep->next = NULL;
+        jp->arena = keep;
+    }
+    jp->top = 0;
+    jp->depth = 0;
+    jp->error = -1;
+    jp->rval = NULL;
 }
 
 
-void print_string()
+void jparser_free(jparser_t *jp)
 {
-    printf("Parse string %s\n", &_parse_str[_loc]);
-}
+    jarena_t *a;
 
-int parse_true()
-{
-    int sloc = _loc;
-    JSONValue *val = create_value();
-
-    _parse_white();
-    if ((_parse_str[_loc++] == 't') && (_parse_str[_loc++] == 'r') &&
-        (_parse_str[_loc++] == 'u') && (_parse_str[_loc++] == 'e')) {
-        set_true(val);
-        rval = val;
-        return TRUE_VALUE;
-    } else {
-        free(val);
-        _loc = sloc;
-        return ERROR;
+    while ((a = jp->arena) != NULL)
+    {
+        jp->arena = a->next;
+        free(a);
     }
+    free(jp->stack);
+    free(jp);
 }
 
 
-int parse_false()
+static void jp_start(jparser_t *jp, char *str, int len)
 {
-    int sloc = _loc;
-    JSONValue *val = create_value();
-
-    _parse_white();
-    if ((_parse_str[_loc++] == 'f') &&
-	(_parse_str[_loc++] == 'a') &&
-	(_parse_str[_loc++] == 'l') &&
-	(_parse_str[_loc++] == 's') &&
-	(_parse_str[_loc++] == 'e')) {
-	set_false(val);
-	rval = val;
-	return FALSE_VALUE;
-    } else {
-	free(val);
-	_loc = sloc;
-	return ERROR;
-    }
+    jp->str = str;
+    jp->loc = 0;
+    jp->len = len;
+    jp->top = 0;
+    jp->depth = 0;
+    jp->error = -1;
+    jp->rval = NULL;
 }
 
 
-int parse_null()
+JSONValue *jparser_parse(jparser_t *jp, char *str, int len)
 {
-    int sloc = _loc;
-    JSONValue *val = create_value();
-
-    _parse_white();
-    if ((_parse_str[_loc++] == 'n') &&
-	(_parse_str[_loc++] == 'u') &&
-	(_parse_str[_loc++] == 'l') &&
-	(_parse_str[_loc++] == 'l')) {
-	set_null(val);
-	rval = val;
-	return NULL_VALUE;
-    } else {
-	free(val);
-	_loc = sloc;
-	return ERROR;
-    }
+    jp_start(jp, str, len);
+    return jp->rval = jp_value(jp);
 }
 
 
-int parse_array()
+/*
+ * Private functions...
+ */
+
+static JSONValue *jp_fail(jparser_t *jp)
 {
-    JSONValue *val = create_value();
-    JSONArray *arr = create_array();
-    set_array(val, arr);
+    if (jp->error < 0)
+        jp->error = jp->loc;
+    return NULL;
+}
 
+static inline int jp_peek(jparser_t *jp)
+{
+    return jp->loc < jp->len ? (unsigned char)jp->str[jp->loc] : 0;
+}
 
-    if (_parse_barr() == BEGIN_ARRAY) {
+static inline void jp_white(jparser_t *jp)
+{
+    while (jp->loc < jp->len &&
+           (jp->str[jp->loc] == ' ' || jp->str[jp->loc] == '\t' ||
+            jp->str[jp->loc] == '\n' || jp->str[jp->loc] == '\r'))
+        jp->loc++;
+}
 
-        while (_peek_value() != ']') {
+static int jp_match(jparser_t *jp, char *word)
+{
+    int n = strlen(word);
 
-            if (parse_value() == ERROR) return ERROR;
-    	    add_element(arr, rval);
-            if (_peek_value() == ',')
-                _parse_comma();
-        }
-        finalize_array(arr);
-        rval = val;
-        return _parse_earr() == END_ARRAY ? ARRAY_VALUE : ERROR;
-    }
-    return ERROR;
+    if (jp->len - jp->loc < n || strncmp(jp->str + jp->loc, word, n) != 0)
+        return 0;
+    jp->loc += n;
+    return 1;
 }
 
-
-int parse_object()
+static JSONValue *jp_push(jparser_t *jp)
 {
-    JSONValue *savedval;
-    JSONValue *val = create_value();
-    JSONObject *obj = create_object();
-    set_object(val, obj);
-
-    if (_parse_bobj() == BEGIN_OBJECT) {
-	do {
-	    if (parse_string() == ERROR) {
-            printf("String Error\n");
-            return ERROR;
-        }
-	    savedval = rval;
-	    if (_parse_colon() == ERROR) {
-            printf("Colon Error\n");
-            return ERROR;
-        }
-	    if (parse_value() == ERROR) {
-            printf("Value Error\n");
-            return ERROR;
-        }
-	    if (savedval->type != STRING) {
-            printf("Second String Error\n");
-            return ERROR;
+    JSONValue *s;
+
+    if (jp->top >= jp->maxtop)
+    {
+        s = (JSONValue *)realloc(jp->stack, 2 * jp->maxtop * sizeof(JSONValue));
+        if (s == NULL)
+        {
+            perror("Unable to Reallocate Memory");
+            return NULL;
         }
-	    add_property(obj, savedval->val.sval, rval);
-	    free(savedval); /* we need to free this.. the string is freed later */
-	} while (_parse_comma() == COMMA_VALUE);
-	finalize_object(obj);
-	rval = val;
-    _parse_white();
-    _parse_nextline();
-	return _parse_eobj() == END_OBJECT ? OBJECT_VALUE : ERROR;
+        jp->stack = s;
+        jp->maxtop *= 2;
     }
-    return ERROR;
+    return &(jp->stack[jp->top++]);
 }
 
-
-int parse_string()
+static int jp_hex(char *p)
 {
-    JSONValue *val = create_value();
-    char buf[128];
-    int j = 0;
-
-    _parse_white();
-    _parse_nextline();
-    //if(_parse_str[_loc] == ' ')
-        //printf("Testing %d\n",_parse_str[_loc]);
-
-    if (_parse_quote() == QUOTE_VALUE) {
-	while (_char_in_string())
-	    buf[j++] = *_get_char();
-
-	buf[j] = '\0';
-    //printf("%s\n", buf);
-	val->val.sval = strdup(buf);
-	val->type = STRING;
-	rval = val;
-	return (_parse_quote() == QUOTE_VALUE) ? STRING_VALUE : ERROR;
+    int i, c, v = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v |= c - 'A' + 10;
+        else
+            return -1;
     }
-    return ERROR;
+    return v;
 }
 
+static char *jp_utf8(char *q, int c)
+{
+    if (c < 0x80)
+        *q++ = c;
+    else if (c < 0x800)
+    {
+        *q++ = 0xc0 | (c >> 6);
+        *q++ = 0x80 | (c & 0x3f);
+    }
+    else if (c < 0x10000)
+    {
+        *q++ = 0xe0 | (c >> 12);
+        *q++ = 0x80 | ((c >> 6) & 0x3f);
+        *q++ = 0x80 | (c & 0x3f);
+    }
+    else
+    {
+        *q++ = 0xf0 | (c >> 18);
+        *q++ = 0x80 | ((c >> 12) & 0x3f);
+        *q++ = 0x80 | ((c >> 6) & 0x3f);
+        *q++ = 0x80 | (c & 0x3f);
+    }
+    return q;
+}
 
 /*
- * This needs to expanded and tested for all possible number formats..
- * particularly fixed and floating pointing formats are not handled properly
- * or correctly...
+ * String at the quote. The unescaped string is never longer than the
+ * escaped one, so the raw length is allocated and the escapes are decoded
+ * straight into it. Strings without escapes are a single memcpy.
  */
+static char *jp_string(jparser_t *jp)
+{
+    char *s = jp->str;
+    int start = ++jp->loc, end, escaped = 0;
+    char *buf, *q;
+    int c, lo;
+
+    for (end = start; end < jp->len && s[end] != '"'; end++)
+        if (s[end] == '\\')
+        {
+            escaped = 1;
+            if (++end >= jp->len)
+                break;
+        }
+    if (end >= jp->len)
+        return (char *)jp_fail(jp);
+
+    buf = (char *)jparser_alloc(jp, end - start + 1);
+    if (buf == NULL)
+        return NULL;
+    jp->loc = end + 1;
+
+    if (!escaped)
+    {
+        memcpy(buf, s + start, end - start);
+        buf[end - start] = '\0';
+        return buf;
+    }
+
+    for (q = buf; start < end; start++)
+    {
+        if (s[start] != '\\')
+        {
+            *q++ = s[start];
+            continue;
+        }
+        switch (s[++start])
+        {
+            case 'n':   *q++ = '\n'; break;
+            case 't':   *q++ = '\t'; break;
+            case 'r':   *q++ = '\r'; break;
+            case 'b':   *q++ = '\b'; break;
+            case 'f':   *q++ = '\f'; break;
+            case 'u':
+                if (end - start < 5 || (c = jp_hex(s + start + 1)) < 0)
+                {
+                    jp->loc = start;
+                    return (char *)jp_fail(jp);
+                }
+                start += 4;
+                // surrogate pair
+                if (c >= 0xd800 && c < 0xdc00 && end - start >= 7 &&
+                    s[start + 1] == '\\' && s[start + 2] == 'u' &&
+                    (lo = jp_hex(s + start + 3)) >= 0xdc00 && lo < 0xe000)
+                {
+                    c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+                    start += 6;
+                }
+                q = jp_utf8(q, c);
+                break;
+            default:    *q++ = s[start]; break;
+        }
+    }
+    *q = '\0';
+    return buf;
+}
+
 /*
- *  Negative Parse Added
- *  Can now detect overflow and throw error
- *  May lead to rounding error, when surpassing the notation's ability to represent
- *  
+ * Numbers without a fraction or an exponent that fit in an int are
+ * INTEGER.. everything else is DOUBLE.
  */
-int parse_number()
+static int jp_number(jparser_t *jp, JSONValue *val)
 {
-    JSONValue *val = create_value();
-    char buf[64];
-    int j = 0; 
-    int negative = 1;
-
-    _parse_white();
-    if(_parse_str[_loc] == '-'){
-        negative = -1;
-        _loc++;
-    } //So the number is negative
-    _parse_white();
-
-    while (isdigit(_parse_str[_loc]))
-        buf[j++] = *(_get_char());
-
-    if (_parse_str[_loc] == '.') { //If double overflows/underflow it will be detected...
-        buf[j++] = *(_get_char());
-        while (isdigit(_parse_str[_loc]))
-            buf[j++] = *(_get_char());
-        buf[j] = '\0';
-        errno = 0;
-        val->val.dval = strtod(buf, NULL) * negative;
-        if(errno == ERANGE || errno == EINVAL){
-            printf("\n------DOUBLE OVERFLOW-------\n");
-            return ERROR;
+    char buf[64], *end;
+    int start = jp->loc, isint = 1, n;
+    long lval;
+    int c;
+
+    while ((c = jp_peek(jp)) != 0 &&
+           (isdigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+    {
+        if (c == '.' || c == 'e' || c == 'E')
+            isint = 0;
+        jp->loc++;
+    }
+    n = jp->loc - start;
+    if (n == 0 || n >= (int)sizeof(buf))
+        return -1;
+    memcpy(buf, jp->str + start, n);
+    buf[n] = '\0';
+
+    errno = 0;
+    if (isint)
+    {
+        lval = strtol(buf, &end, 10);
+        if (*end == '\0' && errno == 0 && lval >= INT_MIN && lval <= INT_MAX)
+        {
+            val->type = INTEGER;
+            val->val.ival = (int)lval;
+            return 0;
         }
-        val->type = DOUBLE;
-        rval = val;
-        return NUMBER_VALUE;
-    } else {  //We try integer otherwise, if it doesn't work will return an error
-        buf[j] = '\0';
         errno = 0;
-        val->val.ival = strtol(buf, NULL, 10) * negative;
-        if(errno == ERANGE || errno == EINVAL){
-            printf("\n------INTEGER OVERFLOW-------\n");
-                return ERROR;
-        }
-        val->type = INTEGER;
-        rval = val;
-        return NUMBER_VALUE;
     }
+    val->val.dval = strtod(buf, &end);
+    if (*end != '\0' || errno == ERANGE)
+        return -1;
+    val->type = DOUBLE;
+    return 0;
 }
 
-
 /*
- * Private functions...
+ * Parses one value into 'val'. Arrays and objects put their members on the
+ * stack while they are open and copy them into the arena when they close.
+ * Members of an object are pushed as pairs: the name (a STRING) and the value.
  */
-
-int _peek_value()
+static int jp_fill(jparser_t *jp, JSONValue *val)
 {
-    return _parse_str[_loc];
+    int base, count, i, c;
+    JSONArray *arr;
+    JSONObject *obj;
+    JSONValue elem, *vals, *slot;
+    char *name;
+
+    jp_white(jp);
+    c = jp_peek(jp);
+    memset(val, 0, sizeof(JSONValue));
+
+    switch (c)
+    {
+        case '"':
+            if ((val->val.sval = jp_string(jp)) == NULL)
+                return -1;
+            val->type = STRING;
+            return 0;
+
+        case 't':
+            val->type = JTRUE;
+            return jp_match(jp, "true") ? 0 : -1;
+        case 'f':
+            val->type = JFALSE;
+            return jp_match(jp, "false") ? 0 : -1;
+        case 'n':
+            val->type = JNULL;
+            return jp_match(jp, "null") ? 0 : -1;
+        case 'u':
+            val->type = UNDEFINED;
+            return jp_match(jp, "undefined") ? 0 : -1;
+
+        case '[':
+            if (++jp->depth > JPARSER_MAXDEPTH)
+                return -1;
+            jp->loc++;
+            base = jp->top;
+            jp_white(jp);
+            while (jp_peek(jp) != ']')
+            {
+                // fill a local and push it after.. the push may move the stack
+                if (jp_fill(jp, &elem) < 0 || (slot = jp_push(jp)) == NULL)
+                    return -1;
+                *slot = elem;
+                jp_white(jp);
+                if (jp_peek(jp) == ',')
+                    jp->loc++;
+                else if (jp_peek(jp) != ']')
+                    return -1;
+            }
+            jp->loc++;
+
+            count = jp->top - base;
+            arr = (JSONArray *)jparser_alloc(jp, sizeof(JSONArray) + count * sizeof(JSONValue));
+            if (arr == NULL)
+                return -1;
+            arr->elems = (JSONValue *)(arr + 1);
+            memcpy(arr->elems, jp->stack + base, count * sizeof(JSONValue));
+            arr->allocednum = arr->length = count;
+            jp->top = base;
+            jp->depth--;
+            set_array(val, arr);
+            return 0;
+
+        case '{':
+            if (++jp->depth > JPARSER_MAXDEPTH)
+                return -1;
+            jp->loc++;
+            base = jp->top;
+            jp_white(jp);
+            while (jp_peek(jp) != '}')
+            {
+                if (jp_peek(jp) != '"' || (name = jp_string(jp)) == NULL)
+                    return -1;
+                jp_white(jp);
+                if (jp_peek(jp) != ':')
+                    return -1;
+                jp->loc++;
+                if (jp_fill(jp, &elem) < 0 || (slot = jp_push(jp)) == NULL)
+                    return -1;
+                slot->type = STRING;
+                slot->val.sval = name;
+                if ((slot = jp_push(jp)) == NULL)
+                    return -1;
+                *slot = elem;
+                jp_white(jp);
+                if (jp_peek(jp) == ',')
+                {
+                    jp->loc++;
+                    jp_white(jp);
+                }
+                else if (jp_peek(jp) != '}')
+                    return -1;
+            }
+            jp->loc++;
+
+            count = (jp->top - base) / 2;
+            obj = (JSONObject *)jparser_alloc(jp, sizeof(JSONObject) +
+                                              count * (sizeof(JSONProperty) + sizeof(JSONValue)));
+            if (obj == NULL)
+                return -1;
+            obj->properties = (JSONProperty *)(obj + 1);
+            vals = (JSONValue *)(obj->properties + count);
+            for (i = 0; i < count; i++)
+            {
+                obj->properties[i].name = jp->stack[base + 2 * i].val.sval;
+                vals[i] = jp->stack[base + 2 * i + 1];
+                obj->properties[i].value = &vals[i];
+            }
+            obj->allocednum = obj->count = count;
+            jp->top = base;
+            jp->depth--;
+            set_object(val, obj);
+            return 0;
+
+        default:
+            if (c == '-' || isdigit(c))
+                return jp_number(jp, val);
+            return -1;
+    }
 }
 
-
-void _consume_char()
+static JSONValue *jp_value(jparser_t *jp)
 {
-    _loc++;
-}
+    JSONValue *val = (JSONValue *)jparser_alloc(jp, sizeof(JSONValue));
 
+    if (val == NULL || jp_fill(jp, val) < 0)
+        return jp_fail(jp);
+    return val;
+}
 
-/* White spaces here does not include TABs and NEWLINEs..
- * TODO: Should this be fixed?
+/*
+ * Skips one value without building it.. only strings and nesting are
+ * looked at, so this is a lot cheaper than parsing.
  */
-void _parse_white()
+static int jp_skip_string(jparser_t *jp)
 {
-    while (_loc < _len && (_parse_str[_loc] == ' ' ))
-        _loc++;
+    char *s = jp->str;
+
+    for (jp->loc++; jp->loc < jp->len && s[jp->loc] != '"'; jp->loc++)
+        if (s[jp->loc] == '\\')
+            jp->loc++;
+    if (jp->loc >= jp->len)
+        return -1;
+    jp->loc++;
+    return 0;
 }
 
-void _parse_nextline(){
-    while (_loc < _len && (_parse_str[_loc] == '\n' ))
-        _loc++;
-}
-
-
-int _parse_colon()
+static int jp_skip(jparser_t *jp)
 {
-    _parse_white();
-    if (_parse_str[_loc++] == ':')
-        return COLON_VALUE;
-    else {
-        _loc--;
-        return ERROR;
+    char *s = jp->str;
+    int depth = 0, start;
+
+    jp_white(jp);
+    switch (jp_peek(jp))
+    {
+        case '"':
+            return jp_skip_string(jp);
+
+        case '[':
+        case '{':
+            while (jp->loc < jp->len)
+            {
+                switch (s[jp->loc])
+                {
+                    case '"':
+                        if (jp_skip_string(jp) < 0)
+                            return -1;
+                        continue;
+                    case '[':
+                    case '{':
+                        depth++;
+                        break;
+                    case ']':
+                    case '}':
+                        if (--depth == 0)
+                        {
+                            jp->loc++;
+                            return 0;
+                        }
+                        break;
+                }
+                jp->loc++;
+            }
+            return -1;
+
+        default:
+            start = jp->loc;
+            while (jp->loc < jp->len && strchr(",]} \t\n\r", s[jp->loc]) == NULL)
+                jp->loc++;
+            return jp->loc > start ? 0 : -1;
     }
 }
 
-
-int _parse_comma()
+/* Compares the property name at the quote with 'name' and moves past it */
+static int jp_name_is(jparser_t *jp, char *name)
 {
-    _parse_white();
-    if (_parse_str[_loc++] == ',')
-        return COMMA_VALUE;
-    else {
-        _loc--;
-        return ERROR;
+    char *s = jp->str;
+    int start = jp->loc + 1, end, escaped = 0;
+    char *str;
+
+    for (end = start; end < jp->len && s[end] != '"'; end++)
+        if (s[end] == '\\')
+        {
+            escaped = 1;
+            end++;
+        }
+    if (end >= jp->len)
+        return -1;
+
+    // escaped names are decoded before they are compared
+    if (escaped)
+    {
+        if ((str = jp_string(jp)) == NULL)
+            return -1;
+        return strcmp(str, name) == 0;
     }
-}
 
+    jp->loc = end + 1;
+    return (int)strlen(name) == end - start && memcmp(s + start, name, end - start) == 0;
+}
 
-int _parse_barr()
+/* Moves to the value of property 'name' of the object at loc */
+static int jp_find_property(jparser_t *jp, char *name)
 {
-    _parse_white();
-    if (_parse_str[_loc++] == '[')
-        return BEGIN_ARRAY;
-    else {
-        _loc--;
-        return ERROR;
+    int r;
+
+    jp_white(jp);
+    if (jp_peek(jp) != '{')
+        return -1;
+    jp->loc++;
+    jp_white(jp);
+    while (jp_peek(jp) == '"')
+    {
+        if ((r = jp_name_is(jp, name)) < 0)
+            return -1;
+        jp_white(jp);
+        if (jp_peek(jp) != ':')
+            return -1;
+        jp->loc++;
+        if (r)
+            return 0;
+        if (jp_skip(jp) < 0)
+            return -1;
+        jp_white(jp);
+        if (jp_peek(jp) != ',')
+            return -1;
+        jp->loc++;
+        jp_white(jp);
     }
+    return -1;
 }
 
-
-int _parse_earr()
+/* Moves to element 'index' of the array at loc */
+static int jp_find_element(jparser_t *jp, int index)
 {
-    _parse_white();
-    if (_parse_str[_loc++] == ']')
-        return END_ARRAY;
-    else {
-        _loc--;
-        return ERROR;
+    int i;
+
+    jp_white(jp);
+    if (jp_peek(jp) != '[' || index < 0)
+        return -1;
+    jp->loc++;
+    for (i = 0; i < index; i++)
+    {
+        jp_white(jp);
+        if (jp_peek(jp) == ']' || jp_skip(jp) < 0)
+            return -1;
+        jp_white(jp);
+        if (jp_peek(jp) != ',')
+            return -1;
+        jp->loc++;
     }
+    jp_white(jp);
+    return jp_peek(jp) == ']' ? -1 : 0;
 }
 
 
-int _parse_bobj()
+JSONValue *jparser_query(jparser_t *jp, char *str, int len, char *fmt, ...)
 {
-    _parse_white();
-    if (_parse_str[_loc++] == '{')
-        return BEGIN_OBJECT;
-    else {
-        _loc--;
-        return ERROR;
+    va_list args;
+    int r = 0;
+
+    jp_start(jp, str, len);
+    va_start(args, fmt);
+    while (*fmt && r == 0)
+    {
+        switch (*fmt++)
+        {
+            case 's':
+                r = jp_find_property(jp, va_arg(args, char *));
+                break;
+            case 'd':
+                r = jp_find_element(jp, va_arg(args, int));
+                break;
+        }
     }
+    va_end(args);
+
+    if (r < 0)
+        return NULL;
+    return jp->rval = jp_value(jp);
 }
 
 
-int _parse_eobj()
+/*
+ * Older interface.. same calls as before on a per thread parser.
+ */
+void init_parse(char *str)
 {
-    _parse_white();
-    if (_parse_str[_loc++] == '}')
-        return END_OBJECT;
-    else {
-        _loc--;
-        return ERROR;
-    }
+    if (tparser == NULL)
+        tparser = jparser_new();
+    else
+        jparser_reset(tparser);
+    jp_start(tparser, str, strlen(str));
 }
 
-int _parse_quote()
+
+JSONValue *get_value()
 {
-    _parse_white();
-    if (_parse_str[_loc++] == '"')
-        return QUOTE_VALUE;
-    else {
-        _loc--;
-        return ERROR;
-    }
+    return tparser->rval;
 }
 
 
-int _char_in_string()
+int parse_value()
 {
-    int curchar = _parse_str[_loc];
-
-    if (isalnum(curchar) || (curchar >= '#' && curchar <= ('#' + 91)) || curchar == '!')
-        return 1;
-    else
-        return 0;
+    tparser->rval = jp_value(tparser);
+    return tparser->rval == NULL ? ERROR : VALID_VALUE;
 }
 
 
-char *_get_char()
+void print_string()
 {
-    return &(_parse_str[_loc++]);
+    printf("Parse string %s\n", &tparser->str[tparser->loc]);
 }
@@ -35,6 +35,9 @@ extern "C" {
 
 #include "json.h"
 
+#define JPARSER_BLOCK                    4096
+#define JPARSER_STACK                    64
+#define JPARSER_MAXDEPTH                 64
 
 typedef enum
 {
@@ -57,22 +60,61 @@ typedef enum
     UNDEFINED_VALUE
 } ReturnTypes;
 
-/* Primary parser interface functions.. */
+typedef struct jarena_t jarena_t;
+
+/*
+ * Parser context. All the state of a parse is in here, so any number of
+ * threads can parse at the same time with their own contexts.
+ *
+ * Every node of a parsed document (values, arrays, objects, strings) is
+ * allocated from the arena of the context. The nodes are released all
+ * at once by jparser_reset() or jparser_free().. never call free_value()
+ * on them.
+ */
+typedef struct jparser_t
+{
+    char *str;
+    int loc;
+    int len;
+    int depth;
+    int error;                      /* offset of the first error or -1 */
+    JSONValue *rval;
+
+    jarena_t *arena;
+
+    /* Members of the arrays and objects being parsed. They are moved into
+     * the arena (in one piece) when the array or object is closed.
+     */
+    JSONValue *stack;
+    int top;
+    int maxtop;
+} jparser_t;
+
+jparser_t *jparser_new();
+void jparser_reset(jparser_t *jp);
+void jparser_free(jparser_t *jp);
+void *jparser_alloc(jparser_t *jp, int size);
+
+/* Parses the whole document.. NULL on a syntax error */
+JSONValue *jparser_parse(jparser_t *jp, char *str, int len);
+
+/*
+ * jparser_query(jp, str, len, "sd", name, index) - same format as query_value()
+ * The document is scanned without building it. Only the value at the end of
+ * the path is built. NULL if the path is not in the document.
+ */
+JSONValue *jparser_query(jparser_t *jp, char *str, int len, char *fmt, ...);
+
+/*
+ * The older interface. It uses a parser that belongs to the calling thread..
+ * the value returned by get_value() is released by the next init_parse()
+ * in the same thread.
+ */
 void init_parse(char *str);
 JSONValue *get_value();
 int parse_value();
 void print_string();
 
-/* Secondary parser interface functions.. could be rarely used */
-int parse_true();
-int parse_false();
-int parse_null();
-int parse_array();
-int parse_object();
-int parse_string();
-int parse_number();
-int parse_undefined();
-
 #endif /* _JPARSER_H */
 
 #ifdef __cplusplus
@@ -57,7 +57,7 @@ union DataValueType {
     char *sval;
     JSONArray *aval;
     JSONObject *oval;
-} val;
+};
 
 typedef struct JSONValue
 {
@@ -1,13 +1,32 @@
-
 #include <unistd.h>
+#include <stdio.h>
 #include <MQTTAsync.h>
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include "mqtt.h"
 #include "command.h"
+#include "shmlink.h"
 
 extern char app_id[64];
 
+static const char *topicsuffix[MQTT_TOPIC_MAX] = {
+    [MQTT_ADMIN_REQUEST]    = "/admin/request/all",
+    [MQTT_ADMIN_ANNOUNCE]   = "/admin/announce/all",
+    [MQTT_LEVEL_REQUEST]    = "/level/func/request",
+    [MQTT_LEVEL_STREAM]     = "/level/func/stream",
+    [MQTT_LEVEL_REPLY_ALL]  = "/level/func/reply/#",
+    [MQTT_MACH_REQUEST]     = "/mach/func/request",
+    [MQTT_MACH_REPLY]       = "/mach/func/reply",
+    [MQTT_MACH_SYNCREQUEST] = "/mach/func/syncrequest",
+    [MQTT_MACH_SYNCSTART]   = "/mach/func/syncstart"
+};
+
+static char *topicnames[MQTT_TOPIC_MAX];
+static pthread_once_t topiconce = PTHREAD_ONCE_INIT;
+
+
 MQTTAsync mqtt_create(char *mhost, int i, char *devid)
 {
     MQTTAsync mcl;
@@ -22,15 +41,34 @@ MQTTAsync mqtt_create(char *mhost, int i, char *devid)
 }
 
 
+// The app_id is set (jamargs) before anything is published
+//
+static void mqtt_init_topics()
+{
+    for (int i = 0; i < MQTT_TOPIC_MAX; i++)
+    {
+        topicnames[i] = (char *)malloc(strlen(app_id) + strlen(topicsuffix[i]) + 2);
+        sprintf(topicnames[i], "/%s%s", app_id, topicsuffix[i]);
+    }
+}
+
+
+const char *mqtt_topic(enum mqtt_topic_t topic)
+{
+    pthread_once(&topiconce, mqtt_init_topics);
+    return topicnames[topic];
+}
+
+
 // Subscribe using QoS level 1
 //
-void mqtt_subscribe(MQTTAsync mcl, char *topic)
+void mqtt_subscribe(MQTTAsync mcl, enum mqtt_topic_t topic)
 {
-    char fulltopic[128];
-    sprintf(fulltopic, "/%s%s", app_id, topic);
+    // The J node sends everything down the shared memory link.. nothing to subscribe
+    if (shmlink_ishandle(mcl))
+        return;
 
-    if (topic != NULL)
-        MQTTAsync_subscribe(mcl, fulltopic, 1, NULL);
+    MQTTAsync_subscribe(mcl, mqtt_topic(topic), 1, NULL);
 }
 
 void mqtt_onpublish(void* context, MQTTAsync_successData* response)
@@ -42,13 +80,20 @@ void mqtt_onpublish(void* context, MQTTAsync_successData* response)
 
 // Publish without retain..QoS level 1
 //
-void mqtt_publish(MQTTAsync mcl, char *topic, command_t *cmd)
+void mqtt_publish(MQTTAsync mcl, enum mqtt_topic_t topic, command_t *cmd)
 {
 //    if (MQTTAsync_isConnected(mcl) == false)
 //        printf("WARNING! The handle.. is offline..\n");
 
-    char fulltopic[128];
-    sprintf(fulltopic, "/%s%s", app_id, topic);
+    const char *fulltopic = mqtt_topic(topic);
+
+    // Shared memory link to the J node.. the write is done when the call returns
+    if (shmlink_ishandle(mcl))
+    {
+        shmlink_publish((shmlink_t *)mcl, (char *)fulltopic, cmd->buffer, cmd->length);
+        command_free(cmd);
+        return;
+    }
 
     MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
     opts.onSuccess = mqtt_onpublish;
@@ -56,5 +101,65 @@ void mqtt_publish(MQTTAsync mcl, char *topic, command_t *cmd)
 
     int rc = MQTTAsync_send(mcl, fulltopic, cmd->length, cmd->buffer, 1, 0, &opts);
     if (rc != MQTTASYNC_SUCCESS)
-        printf("WARNING!! Unable to publish message (error %d) to MQTT broker - topic: %s, cmdr %s\n", rc, topic, cmd->cmd);
+        printf("WARNING!! Unable to publish message (error %d) to MQTT broker - topic: %s, cmdr %s\n", rc, fulltopic, cmd->cmd);
+}
+
+
+// Publish bytes that are not a command (stream fragments, filled templates).
+// The payload is copied by the time the call returns.. the caller keeps the buffer.
+//
+void mqtt_publish_data(MQTTAsync mcl, enum mqtt_topic_t topic, void *data, int len)
+{
+    const char *fulltopic = mqtt_topic(topic);
+
+    if (shmlink_ishandle(mcl))
+    {
+        shmlink_publish((shmlink_t *)mcl, (char *)fulltopic, data, len);
+        return;
+    }
+
+    int rc = MQTTAsync_send(mcl, fulltopic, len, data, 1, 0, NULL);
+    if (rc != MQTTASYNC_SUCCESS)
+        printf("WARNING!! Unable to publish data (error %d) to MQTT broker - topic: %s\n", rc, fulltopic);
+}
+
+
+publisher_t *publisher_new(MQTTAsync *mcl, char *devid)
+{
+    publisher_t *p = (publisher_t *)calloc(1, sizeof(publisher_t));
+
+    p->mcl = mcl;
+    p->ack = command_template_new("REXEC-ACK", "-", 0, devid);
+    p->nak = command_template_new("REXEC-NAK", "-", 0, devid);
+    p->err = command_template_new("REXEC-ERR", "-", 0, devid);
+
+    return p;
+}
+
+
+// Fill the template and publish it.. no command is built
+//
+void publisher_reply(publisher_t *p, enum mqtt_topic_t topic, cmdtemplate_t *t, char *opt,
+                    char *actname, char *actid, const char *fmt, ...)
+{
+    unsigned char frame[PUBLISHER_FRAME];
+    unsigned char *buf = frame;
+    va_list args, args2;
+    int len;
+
+    va_start(args, fmt);
+    va_copy(args2, args);
+    len = command_template_fill(t, frame, sizeof(frame), opt, actname, actid, fmt, args);
+    if (len > (int)sizeof(frame))
+    {
+        buf = (unsigned char *)malloc(len);
+        command_template_fill(t, buf, len, opt, actname, actid, fmt, args2);
+    }
+    va_end(args2);
+    va_end(args);
+
+    mqtt_publish_data(*(p->mcl), topic, buf, len);
+
+    if (buf != frame)
+        free(buf);
 }
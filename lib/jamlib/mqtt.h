@@ -1,14 +1,53 @@
-
 #ifndef __MQTT_H__
 #define __MQTT_H__
 
 #include <MQTTAsync.h>
 #include "command.h"
 
+/*
+ * Topics used by the C node. The full topic strings (/<app_id>/...) are
+ * built once.. publish and subscribe just pick them up.
+ */
+enum mqtt_topic_t {
+    MQTT_ADMIN_REQUEST,                     // /admin/request/all
+    MQTT_ADMIN_ANNOUNCE,                    // /admin/announce/all
+    MQTT_LEVEL_REQUEST,                     // /level/func/request
+    MQTT_LEVEL_STREAM,                      // /level/func/stream
+    MQTT_LEVEL_REPLY_ALL,                   // /level/func/reply/#
+    MQTT_MACH_REQUEST,                      // /mach/func/request
+    MQTT_MACH_REPLY,                        // /mach/func/reply
+    MQTT_MACH_SYNCREQUEST,                  // /mach/func/syncrequest
+    MQTT_MACH_SYNCSTART,                    // /mach/func/syncstart
+    MQTT_TOPIC_MAX
+};
+
+// Replies that fit are built on the stack
+#define PUBLISHER_FRAME             256
+
+/*
+ * Publisher for one level. It holds the slot of the level's handle
+ * (the handle is replaced when the level reconnects) and the templates
+ * of the replies this node sends for the requests from the level.
+ */
+typedef struct _publisher_t
+{
+    MQTTAsync *mcl;
+    cmdtemplate_t *ack;                     // REXEC-ACK
+    cmdtemplate_t *nak;                     // REXEC-NAK
+    cmdtemplate_t *err;                     // REXEC-ERR
+
+} publisher_t;
+
 
 MQTTAsync mqtt_create(char *mhost, int i, char *devid);
-void mqtt_subscribe(MQTTAsync mcl, char *topic);
-void mqtt_publish(MQTTAsync mcl, char *topic, command_t *cmd);
+const char *mqtt_topic(enum mqtt_topic_t topic);
+void mqtt_subscribe(MQTTAsync mcl, enum mqtt_topic_t topic);
+void mqtt_publish(MQTTAsync mcl, enum mqtt_topic_t topic, command_t *cmd);
+void mqtt_publish_data(MQTTAsync mcl, enum mqtt_topic_t topic, void *data, int len);
+
+publisher_t *publisher_new(MQTTAsync *mcl, char *devid);
+void publisher_reply(publisher_t *p, enum mqtt_topic_t topic, cmdtemplate_t *t, char *opt,
+                    char *actname, char *actid, const char *fmt, ...);
 
 
 #endif
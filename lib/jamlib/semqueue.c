@@ -22,6 +22,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "semqueue.h"
 
@@ -66,3 +67,32 @@ nvoid_t *semqueue_deq(semqueue_t *queue)
 
     return queue_deq(queue->queue);
 }
+
+
+// Returns NULL if nothing came in ms milliseconds (0 does not wait)
+nvoid_t *semqueue_timeddeq(semqueue_t *queue, int ms)
+{
+#ifdef linux
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    if (sem_timedwait(&queue->lock, &ts) != 0)
+        return NULL;
+#elif __APPLE__
+    // No sem_timedwait() for the named semaphores
+    while (sem_trywait(queue->lock) != 0)
+    {
+        if (ms-- <= 0)
+            return NULL;
+        usleep(1000);
+    }
+#endif
+
+    return queue_deq(queue->queue);
+}
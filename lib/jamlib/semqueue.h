@@ -54,5 +54,6 @@ typedef struct _semqueue_t
 semqueue_t *semqueue_new(bool ownedbyq);
 bool semqueue_enq(semqueue_t *queue, void *data, int len);
 nvoid_t *semqueue_deq(semqueue_t *queue);
+nvoid_t *semqueue_timeddeq(semqueue_t *queue, int ms);
 
 #endif
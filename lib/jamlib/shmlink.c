@@ -0,0 +1,469 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2016 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef linux
+#include <limits.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "shmlink.h"
+
+#define SHM_RING_MASK               (SHM_RING_SIZE - 1)
+
+// Only one link per C node.. used to tell the link apart from an MQTT handle
+static shmlink_t *activelink = NULL;
+
+
+void shmlink_name(char *buf, int port)
+{
+    sprintf(buf, "/jamshm-%d", port);
+}
+
+
+bool shmlink_pid_alive(int32_t pid)
+{
+    if (pid <= 0)
+        return false;
+
+    return (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+
+// The J node creates the segment. Any segment left behind by an
+// earlier J node on the same port is removed first.
+//
+shmseg_t *shmseg_create(char *name, int nslots)
+{
+    int fd;
+    shmseg_t *seg;
+
+    if (nslots <= 0 || nslots > SHM_MAX_SLOTS)
+        nslots = SHM_MAX_SLOTS;
+
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        printf("WARNING! Unable to create shared memory segment %s\n", name);
+        return NULL;
+    }
+
+    if (ftruncate(fd, sizeof(shmseg_t)) < 0)
+    {
+        printf("WARNING! Unable to size shared memory segment %s\n", name);
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    seg = (shmseg_t *)mmap(NULL, sizeof(shmseg_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED)
+    {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // ftruncate() has zeroed the segment.. all slots are FREE
+    seg->version = SHM_VERSION;
+    seg->nslots = nslots;
+    seg->jpid = getpid();
+    // Magic is written last.. C nodes don't touch the segment before it is set
+    __atomic_store_n(&seg->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+    return seg;
+}
+
+
+shmseg_t *shmseg_open(char *name)
+{
+    int fd;
+    struct stat st;
+    shmseg_t *seg;
+
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0 || st.st_size != sizeof(shmseg_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    seg = (shmseg_t *)mmap(NULL, sizeof(shmseg_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED)
+        return NULL;
+
+    if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+        seg->version != SHM_VERSION)
+    {
+        munmap(seg, sizeof(shmseg_t));
+        return NULL;
+    }
+
+    return seg;
+}
+
+
+void shmseg_close(shmseg_t *seg)
+{
+    if (seg != NULL)
+        munmap(seg, sizeof(shmseg_t));
+}
+
+
+void shmring_reset(shmring_t *r)
+{
+    r->head = 0;
+    r->tail = 0;
+    r->waiting = 0;
+}
+
+
+// Copy in and out of the ring.. pos is free running, so wrap it here
+//
+static void shmring_copyin(shmring_t *r, uint32_t pos, void *src, int len)
+{
+    uint32_t off = pos & SHM_RING_MASK;
+    uint32_t first = SHM_RING_SIZE - off;
+
+    if (first >= len)
+        memcpy(r->data + off, src, len);
+    else
+    {
+        memcpy(r->data + off, src, first);
+        memcpy(r->data, (unsigned char *)src + first, len - first);
+    }
+}
+
+static void shmring_copyout(shmring_t *r, uint32_t pos, void *dst, int len)
+{
+    uint32_t off = pos & SHM_RING_MASK;
+    uint32_t first = SHM_RING_SIZE - off;
+
+    if (first >= len)
+        memcpy(dst, r->data + off, len);
+    else
+    {
+        memcpy(dst, r->data + off, first);
+        memcpy((unsigned char *)dst + first, r->data, len - first);
+    }
+}
+
+
+// Single producer. Returns false if the frame does not fit - the caller
+// decides whether that is a drop or a retry.
+//
+bool shmring_write(shmring_t *r, char *topic, void *data, int len)
+{
+    uint16_t tlen = strlen(topic);
+    uint32_t flen = sizeof(uint16_t) + tlen + len;
+    uint32_t head, tail;
+
+    if (tlen > SHM_MAX_TOPIC || SHM_FRAME_HDR + tlen + len > SHM_RING_SIZE)
+        return false;
+
+    head = r->head;
+    tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if (SHM_RING_SIZE - (head - tail) < sizeof(uint32_t) + flen)
+        return false;
+
+    shmring_copyin(r, head, &flen, sizeof(uint32_t));
+    head += sizeof(uint32_t);
+    shmring_copyin(r, head, &tlen, sizeof(uint16_t));
+    head += sizeof(uint16_t);
+    shmring_copyin(r, head, topic, tlen);
+    head += tlen;
+    shmring_copyin(r, head, data, len);
+    head += len;
+
+    __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+// Single consumer. Returns the frame length copied into buf, 0 if the ring
+// is empty, and -1 if a frame was too large for buf (it is skipped).
+//
+int shmring_read(shmring_t *r, unsigned char *buf, int buflen)
+{
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = r->tail;
+    uint32_t flen;
+
+    if (head - tail < sizeof(uint32_t))
+        return 0;
+
+    shmring_copyout(r, tail, &flen, sizeof(uint32_t));
+    tail += sizeof(uint32_t);
+
+    if (flen > buflen)
+    {
+        __atomic_store_n(&r->tail, tail + flen, __ATOMIC_RELEASE);
+        return -1;
+    }
+
+    shmring_copyout(r, tail, buf, flen);
+    __atomic_store_n(&r->tail, tail + flen, __ATOMIC_RELEASE);
+
+    return flen;
+}
+
+
+// Split a frame read by shmring_read() into a NULL terminated topic and
+// the payload. Returns the payload length or -1 if the frame is bad.
+//
+int shmframe_split(unsigned char *buf, int len, char *topic, unsigned char **payload)
+{
+    uint16_t tlen;
+
+    if (len < sizeof(uint16_t))
+        return -1;
+
+    memcpy(&tlen, buf, sizeof(uint16_t));
+    if (tlen > SHM_MAX_TOPIC || sizeof(uint16_t) + tlen > len)
+        return -1;
+
+    memcpy(topic, buf + sizeof(uint16_t), tlen);
+    topic[tlen] = 0;
+    *payload = buf + sizeof(uint16_t) + tlen;
+
+    return len - sizeof(uint16_t) - tlen;
+}
+
+
+// The sequence number is bumped before looking at the waiting flag and the
+// waiter sets the flag before looking at the sequence number. Both are
+// sequentially consistent, so at least one of them sees the other.
+//
+void shmring_notify(volatile uint32_t *seq, volatile uint32_t *waiting)
+{
+    __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+    {
+    #ifdef linux
+        syscall(SYS_futex, seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    #endif
+    }
+}
+
+
+void shmring_wait(volatile uint32_t *seq, volatile uint32_t *waiting, uint32_t oldseq, int timeout)
+{
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(seq, __ATOMIC_SEQ_CST) == oldseq)
+    {
+    #ifdef linux
+        struct timespec ts;
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        // Not FUTEX_PRIVATE.. the word is shared with another process
+        syscall(SYS_futex, seq, FUTEX_WAIT, oldseq, &ts, NULL, 0);
+    #else
+        usleep(1000);
+    #endif
+    }
+
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+
+/*
+ * C node side of the link..
+ */
+
+// Returns NULL if there is no J node serving the link on this port.
+// The caller should go through the MQTT broker in that case.
+//
+shmlink_t *shmlink_open(int port, int serialnum)
+{
+    char name[64];
+    shmseg_t *seg;
+    shmslot_t *slot;
+
+    shmlink_name(name, port);
+    seg = shmseg_open(name);
+    if (seg == NULL)
+        return NULL;
+
+    // Stale segment.. the J node is gone
+    if (!shmlink_pid_alive(seg->jpid))
+    {
+        shmseg_close(seg);
+        return NULL;
+    }
+
+    if (serialnum < 1 || serialnum > seg->nslots)
+    {
+        printf("WARNING! No shared memory slot for C node %d (max %d)\n", serialnum, seg->nslots);
+        shmseg_close(seg);
+        return NULL;
+    }
+
+    slot = &(seg->slots[serialnum - 1]);
+    if (slot->state == SHM_SLOT_ACTIVE && slot->pid != getpid() && shmlink_pid_alive(slot->pid))
+    {
+        printf("WARNING! Shared memory slot %d is held by process %d\n", serialnum, slot->pid);
+        shmseg_close(seg);
+        return NULL;
+    }
+
+    // Take the slot.. the J node does not use the rings while the slot is FREE
+    __atomic_store_n(&slot->state, SHM_SLOT_FREE, __ATOMIC_SEQ_CST);
+    shmring_reset(&slot->up);
+    shmring_reset(&slot->down);
+    slot->pid = getpid();
+    __atomic_store_n(&slot->state, SHM_SLOT_ACTIVE, __ATOMIC_SEQ_CST);
+
+    shmlink_t *link = (shmlink_t *)calloc(1, sizeof(shmlink_t));
+    link->seg = seg;
+    link->slot = slot;
+    link->slotnum = serialnum - 1;
+    pthread_mutex_init(&(link->lock), NULL);
+
+    activelink = link;
+    return link;
+}
+
+
+static void *shmlink_reader(void *arg)
+{
+    shmlink_t *link = (shmlink_t *)arg;
+    shmring_t *r = &(link->slot->down);
+    unsigned char *buf = (unsigned char *)malloc(SHM_RING_SIZE);
+    unsigned char *payload;
+    char topic[SHM_MAX_TOPIC + 1];
+    int n, plen;
+
+    while (1)
+    {
+        uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_SEQ_CST);
+        bool got = false;
+
+        while ((n = shmring_read(r, buf, SHM_RING_SIZE)) != 0)
+        {
+            got = true;
+            if (n < 0)
+                continue;
+            plen = shmframe_split(buf, n, topic, &payload);
+            if (plen >= 0)
+                link->cback(link->ctx, topic, payload, plen);
+        }
+
+        if (got)
+            continue;
+
+        shmring_wait(&r->seq, &r->waiting, seq, SHM_WAIT_TIMEOUT);
+
+        // Same as losing the local MQTT broker
+        if (!shmlink_pid_alive(link->seg->jpid))
+        {
+            printf("ERROR! J node (process %d) on the shared memory link stopped. Exiting.\n", link->seg->jpid);
+            exit(1);
+        }
+    }
+
+    return NULL;
+}
+
+
+bool shmlink_start(shmlink_t *link, shmlink_recv_f cback, void *ctx)
+{
+    link->cback = cback;
+    link->ctx = ctx;
+
+    if (pthread_create(&(link->thread), NULL, shmlink_reader, link) != 0)
+    {
+        printf("ERROR! Unable to start the shared memory link reader\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+// Publish a frame to the J node. A full ring means the J node is not
+// keeping up.. wait a little for it to drain instead of dropping.
+//
+bool shmlink_publish(shmlink_t *link, char *topic, void *data, int len)
+{
+    bool rval;
+    int tries = 0;
+
+    pthread_mutex_lock(&(link->lock));
+    while (!(rval = shmring_write(&(link->slot->up), topic, data, len)))
+    {
+        if (SHM_FRAME_HDR + strlen(topic) + len > SHM_RING_SIZE || tries++ >= SHM_WAIT_TIMEOUT)
+            break;
+        usleep(1000);
+    }
+    pthread_mutex_unlock(&(link->lock));
+
+    if (rval)
+    {
+        __atomic_add_fetch(&(link->slot->up.seq), 1, __ATOMIC_SEQ_CST);
+        shmring_notify(&(link->seg->upseq), &(link->seg->jwaiting));
+    }
+    else
+        printf("WARNING!! Unable to publish message to shared memory link - topic: %s\n", topic);
+
+    return rval;
+}
+
+
+bool shmlink_ishandle(void *handle)
+{
+    return (handle != NULL && handle == (void *)activelink);
+}
+
+
+void shmlink_close(shmlink_t *link)
+{
+    if (link == NULL)
+        return;
+
+    __atomic_store_n(&(link->slot->state), SHM_SLOT_FREE, __ATOMIC_SEQ_CST);
+    link->slot->pid = 0;
+    if (activelink == link)
+        activelink = NULL;
+    shmseg_close(link->seg);
+    free(link);
+}
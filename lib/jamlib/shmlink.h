@@ -0,0 +1,148 @@
+/*
+The MIT License (MIT)
+Copyright (c) 2016 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __SHMLINK_H__
+#define __SHMLINK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/*
+ * Shared memory link between the C node and the J node on the same device.
+ * It replaces the hop through the localhost MQTT broker. The J node creates
+ * the segment (/jamshm-<port>) and each C node takes the slot given by its
+ * serial number. A slot has two byte rings: up (C to J) and down (J to C).
+ *
+ * A frame in the ring is [u32 len][u16 topic len][topic][payload] - the
+ * same topic and CBOR payload that would have gone through the broker.
+ * So REGISTER, PING, REXEC and the rest are unchanged.
+ *
+ * Waiting is done on futex words in the segment (Linux only). The J side
+ * waits on a single word (upseq) for all the slots.
+ *
+ * This file is also compiled into the J side addon (lib/jamserver/shmlink)
+ * so it should not depend on the rest of the JAM library.
+ */
+
+#define SHM_MAGIC                   0x4a414d53      // "JAMS"
+#define SHM_VERSION                 1
+#define SHM_MAX_SLOTS               16
+#define SHM_RING_SIZE               (128 * 1024)    // power of 2
+#define SHM_MAX_TOPIC               128
+#define SHM_FRAME_HDR               (sizeof(uint32_t) + sizeof(uint16_t))
+#define SHM_WAIT_TIMEOUT            1000            // milliseconds
+
+enum shmslot_state_t
+{
+    SHM_SLOT_FREE,
+    SHM_SLOT_ACTIVE
+};
+
+typedef struct _shmring_t
+{
+    volatile uint32_t head;                 // producer position (free running)
+    volatile uint32_t tail;                 // consumer position (free running)
+    volatile uint32_t seq;                  // futex word.. bumped on every write
+    volatile uint32_t waiting;              // consumer is sleeping on seq
+    unsigned char data[SHM_RING_SIZE];
+
+} shmring_t;
+
+
+typedef struct _shmslot_t
+{
+    volatile uint32_t state;
+    volatile int32_t pid;                   // C node holding the slot
+    shmring_t up;
+    shmring_t down;
+
+} shmslot_t;
+
+
+typedef struct _shmseg_t
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nslots;
+    volatile int32_t jpid;                  // J node that created the segment
+    volatile uint32_t upseq;                // futex word for the J side
+    volatile uint32_t jwaiting;
+    shmslot_t slots[SHM_MAX_SLOTS];
+
+} shmseg_t;
+
+
+typedef void (*shmlink_recv_f)(void *ctx, char *topic, void *payload, int len);
+
+// C node side of the link
+typedef struct _shmlink_t
+{
+    shmseg_t *seg;
+    shmslot_t *slot;
+    int slotnum;
+
+    pthread_mutex_t lock;                   // more than one thread publishes
+    pthread_t thread;
+    shmlink_recv_f cback;
+    void *ctx;
+
+} shmlink_t;
+
+
+/*
+ * Segment and ring functions (used by both sides)
+ */
+
+void shmlink_name(char *buf, int port);
+shmseg_t *shmseg_create(char *name, int nslots);
+shmseg_t *shmseg_open(char *name);
+void shmseg_close(shmseg_t *seg);
+
+void shmring_reset(shmring_t *r);
+bool shmring_write(shmring_t *r, char *topic, void *data, int len);
+int shmring_read(shmring_t *r, unsigned char *buf, int buflen);
+int shmframe_split(unsigned char *buf, int len, char *topic, unsigned char **payload);
+void shmring_notify(volatile uint32_t *seq, volatile uint32_t *waiting);
+void shmring_wait(volatile uint32_t *seq, volatile uint32_t *waiting, uint32_t oldseq, int timeout);
+bool shmlink_pid_alive(int32_t pid);
+
+/*
+ * C node side
+ */
+
+shmlink_t *shmlink_open(int port, int serialnum);
+bool shmlink_start(shmlink_t *link, shmlink_recv_f cback, void *ctx);
+bool shmlink_publish(shmlink_t *link, char *topic, void *data, int len);
+bool shmlink_ishandle(void *handle);
+void shmlink_close(shmlink_t *link);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -167,6 +167,27 @@ nvoid_t *queue_deq(simplequeue_t *sq)
 	}
 }
 
+// Dequeue without blocking.. returns NULL if nothing is sitting in the queue
+nvoid_t *queue_deq_nowait(simplequeue_t *sq)
+{
+	char *buf = NULL;
+	int bytes = nn_recv(sq->pullsock, &buf, NN_MSG, NN_DONTWAIT);
+
+	if (bytes < 0) return NULL;
+
+	if (bytes != sizeof(nvoid_t)) {
+		nn_freemsg(buf);
+		return NULL;
+	}
+	else
+	{
+		nvoid_t *data = (nvoid_t *)calloc(1, sizeof(nvoid_t));
+		memcpy(data, buf, sizeof(nvoid_t));
+		nn_freemsg(buf);
+		return data;
+	}
+}
+
 nvoid_t *queue_deq_timeout(simplequeue_t *sq, int timeout)
 {
 	struct nn_pollfd pfd[1];
@@ -0,0 +1,79 @@
+//===================================================================
+// Reads the output of blocktest.c:
+//      C name                  a test case
+//      S value timestamp       a sample (float as the bits)
+//      B hex                   a block with the samples since the last one
+//      E                       the end
+// and checks that JAMDatastream.expandBlock gives back the samples.
+//===================================================================
+
+'use strict';
+
+const path = require('path');
+const JAMDatastream = require(path.join(__dirname, '../../jamserver/jamdatastream'));
+
+var name = '';
+var expected = [];
+var blocks = {};
+var failed = 0;
+
+function floatBits(v) {
+    var b = Buffer.alloc(4);
+    b.writeFloatBE(v, 0);
+    return b.readUInt32BE(0);
+}
+
+function check(hex) {
+    var buf = Buffer.from(hex, 'hex');
+    var samples = JAMDatastream.expandBlock(buf);
+    var isint = (buf[0] === 1);
+    var err = null;
+
+    if (samples.length !== expected.length)
+        err = samples.length + ' samples, expected ' + expected.length;
+    for (var i = 0; err === null && i < samples.length; i++) {
+        var v = isint ? samples[i].value : floatBits(samples[i].value);
+        if (v !== expected[i][0] || samples[i].timestamp !== expected[i][1])
+            err = 'sample ' + i + ': ' + v + ' at ' + samples[i].timestamp +
+                  ', expected ' + expected[i][0] + ' at ' + expected[i][1];
+    }
+    if (err !== null) {
+        console.log(name + ': ' + err);
+        failed++;
+    }
+    blocks[name].push(expected.length);
+    expected = [];
+}
+
+var rl = require('readline').createInterface({input: process.stdin});
+
+rl.on('line', function(line) {
+    var f = line.split(' ');
+
+    switch (f[0]) {
+        case 'C':
+            name = f.slice(1).join(' ');
+            blocks[name] = [];
+            break;
+        case 'S':
+            expected.push([Number(f[1]), Number(f[2])]);
+            break;
+        case 'B':
+            check(f[1]);
+            break;
+        case 'E':
+            for (var n in blocks)
+                console.log(n + ': ' + blocks[n].length + ' blocks [' + blocks[n].join(', ') + ']');
+            if (expected.length > 0) {
+                console.log(expected.length + ' samples not in a block');
+                failed++;
+            }
+            console.log(failed === 0 ? 'PASSED' : 'FAILED');
+            process.exit(failed === 0 ? 0 : 1);
+    }
+});
+
+rl.on('close', function() {
+    console.log('FAILED (no end line)');
+    process.exit(1);
+});
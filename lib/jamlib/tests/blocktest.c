@@ -0,0 +1,171 @@
+/*
+ * Writes compact blocks with jamblock.c the way jamlogger does and prints
+ * each sample (S value timestamp) before the block it goes in (B hex).
+ * blockcheck.js decodes the blocks with JAMDatastream.expandBlock and
+ * compares them with the samples.
+ *
+ * cc -I.. -o blocktest blocktest.c ../jamblock.c
+ * ./blocktest | node blockcheck.js       (needs npm install in lib/jamserver)
+ */
+
+#include "../jamblock.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_T0                     1500000000000ULL
+
+
+static void send_block(jamblock_t *b)
+{
+    int i;
+
+    if (b->count == 0)
+        return;
+    printf("B ");
+    for (i = 0; i < b->len; i++)
+        printf("%02x", b->data[i]);
+    printf("\n");
+    jamblock_clear(b);
+}
+
+
+// Same as block_add() in jamdata.c.. the value is the int or the float bits
+static void add(jamblock_t *b, int type, unsigned int value, unsigned long long timestamp)
+{
+    if (jamblock_full(b, timestamp))
+        send_block(b);
+
+    if (type == LOGGER_BLOCK_INT)
+        printf("S %d %llu\n", (int)value, timestamp);
+    else
+        printf("S %u %llu\n", value, timestamp);
+
+    if (jamblock_add(b, type, value, timestamp))
+        send_block(b);
+}
+
+
+static void add_float(jamblock_t *b, float f, unsigned long long timestamp)
+{
+    unsigned int bits;
+
+    memcpy(&bits, &f, sizeof(float));
+    add(b, LOGGER_BLOCK_FLOAT, bits, timestamp);
+}
+
+
+static jamblock_t *new_block(char *name, int maxcount, int maxage)
+{
+    jamblock_t *b = (jamblock_t *)calloc(1, sizeof(jamblock_t));
+
+    b->maxcount = maxcount > 0 ? maxcount : LOGGER_BLOCK_SIZE;
+    b->maxage = maxage;
+    printf("C %s\n", name);
+    return b;
+}
+
+
+// Negative and repeated deltas of the values and the timestamps
+// (a timestamp can go back when the clock is set)
+//
+static void test_int()
+{
+    int values[] = {0, 5, 5, 5, -3, -3, 100000, -100000, 2147483647, -2147483648, 0, 1, 1, -1, 7};
+    long long gaps[] = {0, 10, 10, 10, 3, 250, 250, 1, 0, 0, -40, 5000, 10, 100000, 2};
+    unsigned long long ts = TEST_T0;
+    jamblock_t *b = new_block("int", 0, 0);
+    int i;
+
+    for (i = 0; i < sizeof(values) / sizeof(int); i++)
+    {
+        ts += gaps[i];
+        add(b, LOGGER_BLOCK_INT, (unsigned int)values[i], ts);
+    }
+    send_block(b);
+    free(b);
+}
+
+
+static void test_float()
+{
+    float values[] = {1.5f, 1.5f, 1.5f, -1.5f, 1.5f, 0.1f, 0.2f, 1.0f / 3, 0.0f, -0.0f, 0.0f,
+                      1e-40f, 3.4e38f, -2.25f, 1.0f / 0.0f, 42.0f, 42.0f, 42.5f};
+    unsigned long long ts = TEST_T0;
+    jamblock_t *b = new_block("float", 0, 0);
+    int i;
+
+    for (i = 0; i < sizeof(values) / sizeof(float); i++)
+    {
+        ts += (i % 3 == 0) ? 17 : 1;
+        add_float(b, values[i], ts);
+    }
+    send_block(b);
+    free(b);
+}
+
+
+// Blocks sent at maxcount (50, 50 and the 20 left)
+//
+static void test_maxcount()
+{
+    unsigned long long ts = TEST_T0;
+    jamblock_t *b = new_block("maxcount int", 50, 0);
+    int i;
+
+    for (i = 0; i < 120; i++)
+        add(b, LOGGER_BLOCK_INT, (unsigned int)(i % 7 - 3), ts += 1 + i % 4);
+    send_block(b);
+
+    b->maxcount = 50;
+    printf("C maxcount float\n");
+    for (i = 0; i < 120; i++)
+        add_float(b, (i % 5) * 0.25f - 0.5f, ts += 1 + i % 4);
+    send_block(b);
+    free(b);
+}
+
+
+// Large jumps fill the LOGGER_BLOCK_SIZE bytes before the count.. and a
+// gap of maxage starts a new block
+//
+static void test_full()
+{
+    unsigned long long ts = TEST_T0;
+    unsigned int x = 12345;
+    jamblock_t *b = new_block("full int", 0, 0);
+    int i;
+
+    for (i = 0; i < 1000; i++)
+    {
+        x = x * 1103515245 + 12345;
+        add(b, LOGGER_BLOCK_INT, x, ts += x % 100000);
+    }
+    send_block(b);
+
+    printf("C full float\n");
+    for (i = 0; i < 1000; i++)
+    {
+        x = x * 1103515245 + 12345;
+        add(b, LOGGER_BLOCK_FLOAT, x & 0x7f7fffff, ts += 1);
+    }
+    send_block(b);
+
+    b->maxage = 1000;
+    printf("C maxage\n");
+    for (i = 0; i < 20; i++)
+        add(b, LOGGER_BLOCK_INT, i, ts += (i % 10 == 9) ? 1000 : 100);
+    send_block(b);
+    free(b);
+}
+
+
+int main(int argc, char *argv[])
+{
+    test_int();
+    test_float();
+    test_maxcount();
+    test_full();
+    printf("E\n");
+    return 0;
+}
@@ -0,0 +1,53 @@
+//===================================================================
+// J side of streamtest.c. Lines on stdin:
+//      R length chunk actid    a request with a stream descriptor (argument 1)
+//      F hex                   a fragment from /level/func/stream
+//      E                       end of a round
+// At the end of a round the acks (A index count) and the result of the
+// request (D ok or D BAD) go out, followed by an E line.
+//===================================================================
+
+'use strict';
+
+const path = require('path');
+const jamserver = path.join(__dirname, '../../jamserver');
+const cbor = require(require.resolve('cbor', {paths: [jamserver]}));
+const StreamTable = require(path.join(jamserver, 'streamtable'));
+
+var out = [];
+var st = new StreamTable(function(msg) {
+    out.push('A ' + msg.args[0] + ' ' + msg.args[1]);
+});
+
+var rl = require('readline').createInterface({input: process.stdin});
+
+rl.on('line', function(line) {
+    var f = line.split(' ');
+
+    switch (f[0]) {
+        case 'R':
+            var len = parseInt(f[1]);
+            var msg = {actid: f[3], actarg: 'dev', actname: 'streamtest',
+                       args: [7, new cbor.Tagged(19027, [len, parseInt(f[2])])]};
+            st.hold(msg, function(m) {
+                var buf = m.args[1];
+                var ok = buf.length === len;
+                for (var i = 0; ok && i < len; i++)
+                    ok = buf[i] === ((i * 31 + 7) & 255);
+                out.push('D ' + (ok ? 'ok' : 'BAD'));
+            });
+            break;
+        case 'F':
+            st.chunk(Buffer.from(f[1], 'hex'));
+            break;
+        case 'E':
+            out.push('E');
+            process.stdout.write(out.join('\n') + '\n');
+            out = [];
+            break;
+    }
+});
+
+rl.on('close', function() {
+    process.exit(0);
+});
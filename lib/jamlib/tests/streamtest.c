@@ -0,0 +1,260 @@
+/*
+ * Runs jamstream.c against the J side StreamTable (streampeer.js) over pipes.
+ * The MQTT publish, the command hold and the clock are replaced here.
+ *
+ * cc -I.. -o streamtest streamtest.c ../jamstream.c ../actid.c -lcbor -lpthread
+ * ./streamtest            (from this directory.. needs npm install in lib/jamserver)
+ *
+ * Checks the reassembly of a 200K argument, that no more than JSTREAM_WINDOW
+ * fragments beyond the last ack are in flight, and that a stream without
+ * acks is dropped after JSTREAM_TIMEOUT.
+ */
+
+#include "../jamstream.h"
+#include "../activity.h"
+#include "../nvoid.h"
+#include "../mqtt.h"
+#include <cbor.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_LEN                    200000
+#define TEST_ACTID                  "@00112233445566778899aabbccddeeff"
+
+static long long now = 1000000;             // activity_getseconds() in us
+static int held = 0;
+static int published = 0;
+static FILE *tonode = NULL;
+
+
+long long activity_getseconds()
+{
+    return now;
+}
+
+void command_hold(command_t *cmd)
+{
+    held++;
+}
+
+void command_free(command_t *cmd)
+{
+    held--;
+}
+
+// The fragments go to the peer as hex lines
+void mqtt_publish_data(MQTTAsync mq, enum mqtt_topic_t topic, void *data, int len)
+{
+    int i;
+
+    published++;
+    if (tonode == NULL)
+        return;
+    fprintf(tonode, "F ");
+    for (i = 0; i < len; i++)
+        fprintf(tonode, "%02x", ((unsigned char *)data)[i]);
+    fprintf(tonode, "\n");
+}
+
+
+// Request map as command_new_using_arg lays it out: args (the 8th entry)
+// has an int and the stream descriptor of argument 1
+//
+static cbor_item_t *make_request(int len)
+{
+    char *keys[] = {"cmd", "opt", "cond", "condvec", "actname", "actid", "actarg", "args"};
+    cbor_item_t *map = cbor_new_definite_map(8);
+    cbor_item_t *arr, *desc;
+    int i;
+
+    for (i = 0; i < 7; i++)
+        cbor_map_add(map, (struct cbor_pair){.key = cbor_move(cbor_build_string(keys[i])),
+                                             .value = cbor_move(cbor_build_string("-"))});
+
+    desc = cbor_new_definite_array(2);
+    cbor_array_push(desc, cbor_move(cbor_build_uint32(len)));
+    cbor_array_push(desc, cbor_move(cbor_build_uint32(JSTREAM_CHUNK)));
+
+    arr = cbor_new_definite_array(2);
+    cbor_array_push(arr, cbor_move(cbor_build_uint32(7)));
+    cbor_array_push(arr, cbor_move(cbor_build_tag(CBOR_TAG_JAM_STREAM, cbor_move(desc))));
+
+    cbor_map_add(map, (struct cbor_pair){.key = cbor_move(cbor_build_string(keys[7])),
+                                         .value = cbor_move(arr)});
+    return map;
+}
+
+
+static void make_command(command_t *cmd, arg_t *args, nvoid_t *nv, unsigned char *buf, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        buf[i] = (i * 31 + 7) & 255;
+    nv->data = buf;
+    nv->len = len;
+
+    memset(args, 0, 2 * sizeof(arg_t));
+    args[0].type = INT_TYPE;
+    args[0].val.ival = 7;
+    args[1].type = NVOID_TYPE;
+    args[1].val.nval = nv;
+
+    memset(cmd, 0, sizeof(command_t));
+    cmd->actid = TEST_ACTID;
+    cmd->actname = "streamtest";
+    cmd->cdata = make_request(len);
+    cmd->args = args;
+    cmd->nargs = 2;
+}
+
+
+static void send_ack(corestate_t *cs, command_t *cmd, int index, int count)
+{
+    command_t ack;
+    arg_t args[2];
+
+    memset(&ack, 0, sizeof(ack));
+    memset(args, 0, sizeof(args));
+    args[0].type = args[1].type = INT_TYPE;
+    args[0].val.ival = index;
+    args[1].val.ival = count;
+    ack.args = args;
+    ack.nargs = 2;
+    ack.actid = cmd->actid;
+    jstream_ack(cs, 0, &ack);
+}
+
+
+// The peer answers each E line with the acks (A index count), the
+// reassembled argument (D ok or D BAD) and an E line
+//
+static bool test_reassembly()
+{
+    int tochild[2], fromchild[2];
+    int chunks = (TEST_LEN + JSTREAM_CHUNK - 1) / JSTREAM_CHUNK;
+    int acked = 0, rounds = 0;
+    bool ok = false, window = true;
+    unsigned char *buf = malloc(TEST_LEN);
+    char line[256];
+    command_t cmd;
+    corestate_t cs;
+    arg_t args[2];
+    nvoid_t nv;
+    FILE *fromnode;
+
+    if (pipe(tochild) < 0 || pipe(fromchild) < 0)
+        return false;
+    if (fork() == 0)
+    {
+        dup2(tochild[0], 0);
+        dup2(fromchild[1], 1);
+        close(tochild[1]);
+        close(fromchild[0]);
+        execlp("node", "node", "streampeer.js", NULL);
+        _exit(1);
+    }
+    close(tochild[0]);
+    close(fromchild[1]);
+    tonode = fdopen(tochild[1], "w");
+    fromnode = fdopen(fromchild[0], "r");
+
+    make_command(&cmd, args, &nv, buf, TEST_LEN);
+    memset(&cs, 0, sizeof(cs));
+    held = published = 0;
+
+    fprintf(tonode, "R %d %d %s\n", TEST_LEN, JSTREAM_CHUNK, cmd.actid);
+    jstream_start(&cs, &cmd, 1);
+    if (published != JSTREAM_WINDOW)
+    {
+        printf("Window: %d fragments sent before the first ack\n", published);
+        window = false;
+    }
+
+    while (jstream_busy(&cmd) && rounds++ < 2 * chunks)
+    {
+        fprintf(tonode, "E\n");
+        fflush(tonode);
+        while (fgets(line, sizeof(line), fromnode) != NULL && line[0] != 'E')
+        {
+            int index, count;
+            if (line[0] == 'D')
+                ok = (strncmp(line, "D ok", 4) == 0);
+            if (line[0] == 'A' && sscanf(line, "A %d %d", &index, &count) == 2)
+            {
+                if (count > acked)
+                    acked = count;
+                send_ack(&cs, &cmd, index, count);
+            }
+        }
+        if (published > acked + JSTREAM_WINDOW)
+        {
+            printf("Window: %d fragments sent with %d acked\n", published, acked);
+            window = false;
+        }
+        now += 500000;
+        jstream_sweep();
+    }
+
+    fclose(tonode);
+    fclose(fromnode);
+    tonode = NULL;
+    cbor_decref(&cmd.cdata);
+    free(buf);
+
+    printf("Reassembly: %d fragments (%d sent) in %d rounds.. %s\n", chunks, published, rounds,
+            ok ? "matched" : "not matched");
+    return ok && window && published == chunks && held == 0 && !jstream_busy(&cmd);
+}
+
+
+// Nothing acks.. the stream goes at the first sweep after JSTREAM_TIMEOUT
+//
+static bool test_timeout()
+{
+    unsigned char *buf = malloc(TEST_LEN);
+    bool ok = true;
+    command_t cmd;
+    corestate_t cs;
+    arg_t args[2];
+    nvoid_t nv;
+
+    make_command(&cmd, args, &nv, buf, TEST_LEN);
+    memset(&cs, 0, sizeof(cs));
+    held = published = 0;
+
+    jstream_start(&cs, &cmd, 1);
+    now += 2000000;
+    jstream_sweep();
+    if (!jstream_busy(&cmd) || held != 1)
+    {
+        printf("Timeout: stream dropped after 2s\n");
+        ok = false;
+    }
+
+    now += JSTREAM_TIMEOUT * 1000000LL;
+    jstream_sweep();
+    if (jstream_busy(&cmd) || held != 0)
+    {
+        printf("Timeout: stream still there after %ds\n", JSTREAM_TIMEOUT + 2);
+        ok = false;
+    }
+
+    cbor_decref(&cmd.cdata);
+    free(buf);
+    return ok && published == JSTREAM_WINDOW;
+}
+
+
+int main(int argc, char *argv[])
+{
+    bool r = test_reassembly();
+    printf("Reassembly and window: %s\n", r ? "PASSED" : "FAILED");
+
+    bool t = test_timeout();
+    printf("Timeout: %s\n", t ? "PASSED" : "FAILED");
+
+    return (r && t) ? 0 : 1;
+}
@@ -5,6 +5,7 @@ Copyright (c) 2016 Muthucumaru Maheswaran
 #include <assert.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <fcntl.h>
 
 #include "task.h"
 
@@ -17,6 +18,8 @@ threadsem_t *threadsem_new()
 
     int res = pipe(t->fildes);
     assert(res == 0);
+    // The waiters go through fdwait().. a read should never block the thread
+    fcntl(t->fildes[0], F_SETFL, fcntl(t->fildes[0], F_GETFL) | O_NONBLOCK);
 
     return t;
 }
@@ -30,6 +33,22 @@ void task_wait(threadsem_t *sem)
 }
 
 
+// Wait at most ms milliseconds for a signal. All signals posted so far
+// are consumed, so this is meant for waiting on a condition that is
+// checked again after the wakeup - not for counting.
+// Returns false on timeout.
+//
+bool task_timedwait(threadsem_t *sem, int ms)
+{
+    char buf[16];
+
+    if (fdtimedwait(sem->fildes[0], 'r', ms) == 0)
+        return false;
+
+    while (read(sem->fildes[0], buf, sizeof(buf)) > 0);
+    return true;
+}
+
 void thread_signal(threadsem_t *sem)
 {
     char *str = "1";
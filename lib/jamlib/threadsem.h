@@ -6,6 +6,8 @@ Copyright (c) 2016 Muthucumaru Maheswaran
 #ifndef __THREADSEM_H__
 #define __THREADSEM_H__
 
+#include <stdbool.h>
+
 typedef struct _threadsem_t
 {
     int fildes[2];
@@ -15,6 +17,7 @@ typedef struct _threadsem_t
 
 threadsem_t *threadsem_new();
 void task_wait(threadsem_t *sem);
+bool task_timedwait(threadsem_t *sem, int ms);
 void thread_signal(threadsem_t *sem);
 void threadsem_free(threadsem_t *sem);
 
@@ -0,0 +1,86 @@
+//===================================================================
+// Activity IDs. A new ID is 128 bits: a 64-bit node ID and a 64-bit
+// counter seeded from the clock (same layout as lib/jamlib/actid.h).
+// On the wire it is a CBOR byte string. Inside the J node it is the
+// string '@' + 32 hex digits so that it can key the Maps like the
+// older string IDs.. which are still accepted as they are.
+//
+//===================================================================
+
+'use strict';
+
+const crypto = require('crypto');
+const deviceParams = require('./deviceparams');
+
+const MARK = '@';
+const BYTES = 16;
+const STRLEN = 1 + 2 * BYTES;
+
+var nodehex;
+var hi, lo;
+
+class ActId {
+
+    static generate() {
+
+        if (nodehex === undefined)
+            seed();
+
+        // 64-bit counter as two 32-bit halves
+        lo = (lo + 1) >>> 0;
+        if (lo === 0)
+            hi = (hi + 1) >>> 0;
+
+        return MARK + nodehex + hex32(hi) + hex32(lo);
+    }
+
+    static isBinary(id) {
+        return typeof id === 'string' && id.length === STRLEN && id[0] === MARK;
+    }
+
+    static toWire(id) {
+        if (ActId.isBinary(id))
+            return Buffer.from(id.substr(1), 'hex');
+        return id;
+    }
+
+    static fromWire(v) {
+        if (Buffer.isBuffer(v) && v.length === BYTES)
+            return MARK + v.toString('hex');
+        return v;
+    }
+
+    // Message as it should be encoded (the message is not changed)
+    static wire(msg) {
+        if (msg === null || typeof msg !== 'object' || !ActId.isBinary(msg.actid))
+            return msg;
+        var omsg = Object.assign({}, msg);
+        omsg.actid = ActId.toWire(msg.actid);
+        return omsg;
+    }
+
+    // Decoded message.. the byte string ID is turned into the string form
+    static normalize(msg) {
+        if (msg !== null && typeof msg === 'object' && msg.actid !== undefined)
+            msg.actid = ActId.fromWire(msg.actid);
+        return msg;
+    }
+}
+
+function seed() {
+
+    // 'J' keeps the J node apart from a C node with the same device ID
+    var devid = deviceParams.getItem('deviceId');
+    nodehex = crypto.createHash('md5').update('J' + devid).digest('hex').substr(0, 16);
+
+    // microseconds << 12.. not reused after a restart
+    var us = Date.now() * 1000;
+    hi = Math.floor(us / 0x100000) >>> 0;
+    lo = ((us % 0x100000) * 4096) >>> 0;
+}
+
+function hex32(v) {
+    return ('0000000' + v.toString(16)).substr(-8);
+}
+
+module.exports = ActId;
@@ -6,6 +6,8 @@ const commandLineArgs = require('command-line-args');
 
 // jnode  --device(d) --fog(-f)  --cloud(-c) --debug(-d) --log(-l)=log.txt
 //  --registry(-r) --app(-a)=name --port(-p)=port_number [--num(-n)=serial_number]
+//  --shm(-s)   device only.. C nodes talk to the jnode through shared memory
+//  --workers(-w)=count   worker threads running the J functions (1 by default)
 //
 // serial_number is actually optional.. it starts with 1 and this value is assumed by default
 
@@ -23,6 +25,8 @@ module.exports = new function parseArgs() {
         { name: 'link', alias: 'l', type: String},
         { name: 'long', alias: 'x', type: Number},
         { name: 'lat', alias: 'y', type: Number},
+        { name: 'shm', alias: 's', type: Boolean},
+        { name: 'workers', alias: 'w', type: Number, defaultValue: 1},
         { name: 'port', alias: 'p', type: String, defaultValue: '1883'}
     ];
 
@@ -29,15 +29,30 @@ module.exports = Object.freeze({
             J2J_CLOUD:  301,       // Sometimes 300 milliseconds does NOT work - very weird!!
             RUN_TABLE: 51,
             RUN_TABLE_ACK: 151,
-            WAIT_TIMEOUT: 600
+            WAIT_TIMEOUT: 600,
+            RUN_TABLE_TICK: 25              // granularity of the RunTable timer wheel
         },
         Counts: {
             ACK_TIMEOUTS: 3,
-            WAIT_COUNT: 3
+            WAIT_COUNT: 3,
+            RUN_TABLE_SLOTS: 64             // slots in the RunTable timer wheel
         },
         Cache: {
             LIMIT: 32
         },
+        Datastream: {
+            CAPACITY: 4096,                 // entries kept per stream
+            NOTIFY: 'jamdata.zadd'          // channel with "<score> <key>" for every ZADD
+        },
+        Broadcaster: {
+            HISTORY: 1024                   // messages kept for clock lookups
+        },
+        Stream: {
+            TAG: 19027,                     // CBOR_TAG_JAM_STREAM in lib/jamlib/command.h
+            WINDOW: 4,                      // JSTREAM_WINDOW in lib/jamlib/jamstream.h
+            TIMEOUT: 10000,                 // milliseconds without a fragment
+            EARLY: 16                       // fragments kept per stream before the request
+        },
         DelayMode: {
             NoDelay: "None",
             Random: "Random",
@@ -0,0 +1,119 @@
+//===================================================================
+// Fixed capacity ring of entries kept in key order. The key is the
+// time_stamp of a datastream entry ({log, time_stamp}) unless keyOf
+// and compare are given (e.g., the (clock, subClock) of a broadcast).
+// The oldest entry is overwritten when the ring is full. Index 0 is
+// the oldest entry.
+//
+//===================================================================
+
+'use strict';
+
+class DataRing {
+
+    constructor(capacity, keyOf, compare) {
+        this.capacity = capacity;
+        this.buf = new Array(capacity);
+        this.start = 0;
+        this.length = 0;
+        this.keyOf = keyOf ? keyOf : (entry) => entry.time_stamp;
+        this.compare = compare ? compare : (a, b) => a - b;
+    }
+
+    at(i) {
+        if (i < 0 || i >= this.length)
+            return undefined;
+        return this.buf[(this.start + i) % this.capacity];
+    }
+
+    last() {
+        return this.at(this.length - 1);
+    }
+
+    push(entry) {
+        if (this.length === this.capacity) {
+            this.buf[this.start] = entry;
+            this.start = (this.start + 1) % this.capacity;
+        } else {
+            this.buf[(this.start + this.length) % this.capacity] = entry;
+            this.length++;
+        }
+    }
+
+    // Entry that arrived late (older than the newest one). It is dropped
+    // if the ring is full and it is older than everything in it.
+    insert(entry) {
+        var pos = this.upperBound(this.keyOf(entry));
+        if (pos === this.length) {
+            this.push(entry);
+            return true;
+        }
+        if (this.length === this.capacity) {
+            if (pos === 0)
+                return false;
+            // Make room by dropping the oldest
+            this.buf[this.start] = undefined;
+            this.start = (this.start + 1) % this.capacity;
+            this.length--;
+            pos--;
+        }
+        for (var i = this.length; i > pos; i--)
+            this.buf[(this.start + i) % this.capacity] = this.buf[(this.start + i - 1) % this.capacity];
+        this.buf[(this.start + pos) % this.capacity] = entry;
+        this.length++;
+        return true;
+    }
+
+    // Index of the first entry with a key > t
+    upperBound(t) {
+        var lo = 0, hi = this.length;
+        while (lo < hi) {
+            var mid = (lo + hi) >>> 1;
+            if (this.compare(this.keyOf(this.at(mid)), t) <= 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    // Index of the first entry with a key >= t
+    lowerBound(t) {
+        var lo = 0, hi = this.length;
+        while (lo < hi) {
+            var mid = (lo + hi) >>> 1;
+            if (this.compare(this.keyOf(this.at(mid)), t) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    slice(from, to) {
+        if (from === undefined || from < 0)
+            from = 0;
+        if (to === undefined || to > this.length)
+            to = this.length;
+        var out = [];
+        for (var i = from; i < to; i++)
+            out.push(this.at(i));
+        return out;
+    }
+
+    toArray() {
+        return this.slice(0, this.length);
+    }
+
+    // Same entries (the newest ones if they do not fit) in a ring of a new capacity
+    resize(capacity) {
+        var entries = this.slice(Math.max(0, this.length - capacity), this.length);
+        this.capacity = capacity;
+        this.buf = new Array(capacity);
+        this.start = 0;
+        this.length = 0;
+        entries.forEach((entry) => this.push(entry));
+    }
+}
+
+module.exports = DataRing;
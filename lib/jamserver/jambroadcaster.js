@@ -6,6 +6,19 @@
 
 var Redis = require('redis');
 var cbor  = require('cbor');
+var DataRing = require('./dataring');
+var globals = require('./constants').globals;
+
+// History is ordered by (clock, subClock)
+function counterKey(message) {
+    return message.counter;
+}
+
+function counterCompare(a, b) {
+    if (a.clock !== b.clock)
+        return a.clock - b.clock;
+    return a.subClock - b.subClock;
+}
 
 class JAMBroadcaster {
 
@@ -16,10 +29,11 @@ class JAMBroadcaster {
         this.jammanager = jammanager;
         this.hooks = [];
         this.lastValue = null;
-        this.messages = [];
+        this.messages = new DataRing(globals.Broadcaster.HISTORY, counterKey, counterCompare);
         this.clock = 0; //value at the cloud
         this.subClock = 0;  //change value at the fog
         this.transformer = (input) => input;
+        this.schema = null;
 
         if( jammanager.getParentConObject() !== null )
             this._subscribeForBroadcast(jammanager.getParentConObject(), jammanager.getParentRedis());
@@ -65,6 +79,24 @@ class JAMBroadcaster {
             this.transformer = func;
     }
 
+    //Struct broadcasters. The C nodes get [id, field 1, .., field n] in place of a map
+    setSchema(id, fields){
+        this.schema = {id: id, fields: fields};
+        return this;
+    }
+
+    _schemaRecord(obj){
+        var record = [this.schema.id];
+        this.schema.fields.forEach(function(field){
+            var v = obj;
+            field.split('.').forEach(function(name){
+                v = (v === undefined || v === null) ? undefined : v[name];
+            });
+            record.push(v);
+        });
+        return record;
+    }
+
     getLastValue(){
         return this.lastValue;
     }
@@ -73,29 +105,42 @@ class JAMBroadcaster {
         return this.clock + '.' + this.subClock;
     }
 
+    //Number of messages kept for getMessageAtClock (the oldest ones are dropped)
+    setRetention(count){
+        let n = parseInt(count);
+        if( n >= 1 )
+            this.messages.resize(n);
+        return this;
+    }
+
     getMessageAtClock(clockPack){
         let parts = clockPack.split(".");
         let clock = parseInt(parts[0]);
         let subClock = parts.length > 1 ? (parts[1] === "*" ? "*" : parseInt(parts[1])) : 0;
 
-        let messages = [];
-
-        for( let i = this.messages.length - 1; i >= 0; i--){    //start from the current position and go down the array
-            let message = this.messages[i];
-            if( message.counter.clock == clock ){
-                if( subClock === "*" || subClock == message.counter.subClock ) {
-                    messages.push(message.message);
-                    if( subClock !== "*" )
-                        break;
-                }
-            }
+        if( subClock !== "*" ){
+            //the newest message with this counter
+            let key = {clock: clock, subClock: subClock};
+            let i = this.messages.upperBound(key) - 1;
+            if( i < 0 || counterCompare(this.messages.at(i).counter, key) !== 0 )
+                return null;
+            return this.messages.at(i).message;
         }
 
-        if( messages.length === 0 )
+        //all messages of the clock, newest first
+        let from = this.messages.lowerBound({clock: clock, subClock: -Infinity});
+        let to = this.messages.upperBound({clock: clock, subClock: Infinity});
+        if( from >= to )
             return null;
-        if( subClock !== "*" )
-            return messages[0];
-        return messages;
+        return this.messages.slice(from, to).reverse().map((m) => m.message);
+    }
+
+    _saveMessage(message){
+        let last = this.messages.last();
+        if( last === undefined || counterCompare(last.counter, message.counter) <= 0 )
+            this.messages.push(message);
+        else
+            this.messages.insert(message);
     }
 
     broadcast(message, fromSelf){
@@ -126,7 +171,7 @@ class JAMBroadcaster {
                 },
                 message: message
             };
-            this.messages.push(message);    //save message
+            this._saveMessage(message);
 
             //console.log(message);
         }
@@ -143,8 +188,9 @@ class JAMBroadcaster {
 
             this.clock = message.counter.clock;
             this.subClock = message.counter.subClock;
-            this.messages.push(message);    //save message
+            this._saveMessage(message);
 
+            //an object sent as a JSON string is decoded once here and reused below
             if( typeof message.message === "string" && message.message.indexOf("{") === 0 )
                 this.lastValue = JSON.parse(message.message);
             else
@@ -157,11 +203,21 @@ class JAMBroadcaster {
         if( this.jammanager.isDevice || this.jammanager.isFog ){ //send unwrapped message for devices
             let rawMessage = message.message;
             if( (typeof rawMessage === "object" || (typeof rawMessage === "string" && rawMessage.indexOf("{") === 0)) ){
+                if( this.schema !== null ){
+                    //an inbound message was decoded into lastValue already
+                    if( typeof rawMessage === "string" )
+                        rawMessage = (this.lastValue !== null && typeof this.lastValue === "object") ? this.lastValue : JSON.parse(rawMessage);
+                    rawMessage = this._schemaRecord(rawMessage);
+                }
                 rawMessage = cbor.encode(rawMessage);
                 msgbuf = Buffer.from(rawMessage);
                 rawMessage = msgbuf.toString('base64');
                 this._sendCborMessage(rawMessage, fromSelf);
             }
+            else if( typeof rawMessage === "number" || typeof rawMessage === "string" || typeof rawMessage === "boolean" ){
+                //scalars as well.. the C nodes read them without parsing the JSON envelope
+                this._sendCborMessage(Buffer.from(cbor.encode(rawMessage)).toString('base64'), fromSelf);
+            }
         }
     }
 
@@ -13,6 +13,7 @@ const deviceParams = require('./deviceparams');
 const mqttconsts = require('./constants').mqtt;
 const cmdopts = require('./cmdparser');
 const JAMP = require('./jamprotocol');
+const shmtransport = require('./shmtransport');
 
 
 const JCoreAdmin = require('./jcoreadmin');
@@ -20,6 +21,10 @@ const JCoreDaemon = require('./jcoredaemon');
 const JCoreClient = require('./jcoreclient');
 const RunTable = require('./runtable');
 const NodeCache = require('./nodecache');
+const WorkerPool = require('./workerpool');
+const ActId = require('./actid');
+const TypedArgs = require('./typedargs');
+const StreamTable = require('./streamtable');
 
 class JAMCore {
 
@@ -41,8 +46,7 @@ class JAMCore {
         this.results = [];
         this.cNodeCount = 0;
 
-        this.jobQueue = new Array();
-        this.workerBusy = false;
+        this.pool = new WorkerPool();
 
         this.ncache = this.getNcache(jsys.link);
 
@@ -86,44 +90,46 @@ class JAMCore {
 
 
 
-    // TODO: Include a scheduler that would pick the next job
-    setWorker(worker) {
+    // The workers get their index and the configuration before anything
+    // else. Worker 0 runs the user program.
+    setWorkers(workers, conf) {
 
-        this.worker = worker;
         var that = this;
 
-        // Jobs already queued.. send one of them.
-        if (this.jobQueue.length > 0) {
-            this.worker.postMessage(this.jobQueue.shift());
-            this.workerBusy = true;
-        }
+        // Plain data only (jamsys has functions).. same as what the
+        // tiny-worker serialization used to give the worker
+        conf = conf.map((c) => JSON.parse(JSON.stringify(c)));
+
+        this.pool.onmessage = function(msg) {
+            that.processWorkerMsg(msg);
+        };
+
+        workers.forEach(function(w, i) {
+            that.pool.add(w);
+            that.pool.post(that.pool.workers[i], {cmd: 'CONF-DATA', opt: 'WORKER', data: {index: i, count: workers.length}});
+            conf.forEach(function(c) {
+                that.pool.post(that.pool.workers[i], c);
+            });
+        });
+        this.pool.dispatch();
 
-        this.worker.onmessage = function(val) {
-            that.processWorkerMsg(val.data);
-            if (that.jobQueue.length > 0) {
-                that.worker.postMessage(that.jobQueue.shift());
-                that.workerBusy = true;
-            } else
-                that.workerBusy = false;
-        }
-        
         // relay data store up/down messages to the worker side 
         this.ncache.onFogDataUp(function(info) {
-            that.worker.postMessage({cmd: 'NCACHE-MOD', opt: 'FOG-DATA-UP', data: info});
+            that.pool.broadcast({cmd: 'NCACHE-MOD', opt: 'FOG-DATA-UP', data: info});
         });
 
         this.ncache.onFogDataDown(function() {
-            that.worker.postMessage({cmd: 'NCACHE-MOD', opt: 'FOG-DATA-DOWN'});
+            that.pool.broadcast({cmd: 'NCACHE-MOD', opt: 'FOG-DATA-DOWN'});
         });
 
         this.ncache.onCloudDataUp(function(info) {
         //    console.log("---------- CLOUD DATA UP-----------");
-            that.worker.postMessage({cmd: 'NCACHE-MOD', opt: 'CLOUD-DATA-UP', data: info});
+            that.pool.broadcast({cmd: 'NCACHE-MOD', opt: 'CLOUD-DATA-UP', data: info});
         });
 
         this.ncache.onCloudDataDown(function() {
          //   console.log("---------- CLOUD DATA UP-----------");
-            that.worker.postMessage({cmd: 'NCACHE-MOD', opt: 'CLOUD-DATA-DOWN'});
+            that.pool.broadcast({cmd: 'NCACHE-MOD', opt: 'CLOUD-DATA-DOWN'});
         });
 
     }
@@ -170,16 +176,7 @@ class JAMCore {
     }
 
     enqueueJob(job) {
-
-        if (this.workerBusy)
-            this.jobQueue.push(job);
-        else {
-            if (this.worker !== undefined) {
-                this.worker.postMessage(job);
-                this.workerBusy = true;
-            } else
-                this.jobQueue.push(job);
-        }
+        this.pool.enqueue(job);
     }
 
     pushErrorToWorker(opt, cbid, msg) {
@@ -210,13 +207,22 @@ class JAMCore {
         // Changes
         var IDmap = new Map();
         this.mserv = mqtt.connect("tcp://localhost:" + cmdopts.port, this.copts);
+        // C nodes on this device can skip the broker
+        if (cmdopts.shm && this.machtype === globals.NodeType.DEVICE)
+            shmtransport.attach(this.mserv, cmdopts.port);
         var that = this;
         // Setup the runTable
         this.runTable = new RunTable(this);
+        // Large arguments of the requests come in fragments
+        this.streams = new StreamTable(function(amsg) {
+            var encode = cbor.encode(ActId.wire(amsg));
+            that.mserv.publish('/' + cmdopts.app + '/level/func/reply/' + amsg["actarg"], encode);
+        });
 
         this.mserv.on('connect', function() {
             that.mserv.subscribe('/' + cmdopts.app + '/admin/request/all');
             that.mserv.subscribe('/' + cmdopts.app + '/level/func/request');
+            that.mserv.subscribe('/' + cmdopts.app + '/level/func/stream');
             that.mserv.subscribe('/' + cmdopts.app + '/mach/func/reply');
             // Changes
             that.mserv.subscribe('/' + cmdopts.app + '/mach/func/syncrequest');
@@ -233,6 +239,7 @@ class JAMCore {
         this.mserv.on('reconnect', function() {
             that.mserv.subscribe('/' + cmdopts.app + '/admin/request/all');
             that.mserv.subscribe('/' + cmdopts.app + '/level/func/request');
+            that.mserv.subscribe('/' + cmdopts.app + '/level/func/stream');
             that.mserv.subscribe('/' + cmdopts.app + '/mach/func/reply');
             // Changes
             that.mserv.subscribe('/' + cmdopts.app +'/mach/func/syncrequest');
@@ -249,7 +256,14 @@ class JAMCore {
         });
 
         this.mserv.on('message', function(topic, buf) {
+            // Fragments are not commands.. they go straight to the stream table
+            if (topic === '/' + cmdopts.app + '/level/func/stream') {
+                that.streams.chunk(buf);
+                return;
+            }
             cbor.decodeFirst(buf, function(error, msg) {
+                ActId.normalize(msg);
+                TypedArgs.normalize(msg);
 
                 switch (topic) {
                     case '/' + cmdopts.app + '/admin/request/all':
@@ -267,11 +281,24 @@ class JAMCore {
                     case '/' + cmdopts.app + '/level/func/request':
                     // These are requests by the C nodes under this broker
                     // The requests are published from device and fog levels
+                    // A request with large arguments waits for their fragments
                         try {
-                            that.jdaemon.levelService(msg, function(rmsg) {
-                                var encode = cbor.encode(rmsg);
-                                that.mserv.publish('/' + cmdopts.app +'/level/func/reply/' + rmsg["actarg"], encode);
-                            });
+                            var service = function(smsg) {
+                                that.jdaemon.levelService(smsg, function(rmsg) {
+                                    var encode = cbor.encode(ActId.wire(TypedArgs.wire(rmsg)));
+                                    that.mserv.publish('/' + cmdopts.app +'/level/func/reply/' + rmsg["actarg"], encode);
+                                });
+                            };
+                            if (!that.streams.hold(msg, function(smsg) {
+                                try {
+                                    service(smsg);
+                                } catch (e) {
+                                    console.log("ERROR!: ", e);
+                                }
+                            })) {
+                                keepRaw(msg, buf);
+                                service(msg);
+                            }
                         } catch (e) {
                             console.log("ERROR!: ", e);
                         }
@@ -351,10 +378,13 @@ class JAMCore {
         lsock.on('message', function(topic, buf) {
 
             cbor.decodeFirst(buf, function(error, msg) {
+                ActId.normalize(msg);
+                TypedArgs.normalize(msg);
                 switch (topic) {
                     case '/' + cmdopts.app + '/mach/func/urequest':
                     // Request for this node from up..
                         try {
+                            keepRaw(msg, buf);
                             that.jdaemon.machRunner(lsock, msg);
                         } catch (e) {
                             console.log("ERROR!: ", e);
@@ -382,10 +412,13 @@ class JAMCore {
         sock.on('message', function(topic, buf) {
 
             cbor.decodeFirst(buf, function(error, msg) {
+                ActId.normalize(msg);
+                TypedArgs.normalize(msg);
                 switch (topic) {
                     case '/' + cmdopts.app + '/mach/func/request':
                     // Requests flowing downwards.
                         try {
+                            keepRaw(msg, buf);
                             that.jdaemon.machRunner(sock, msg);
                         } catch (e) {
                             console.log("ERROR!: ", e);
@@ -499,5 +532,13 @@ function doPing(serv) {
     serv.publish('/' + cmdopts.app +'/admin/announce/all', encode);
 }
 
+// The request as it came in.. the worker decodes the args from it.
+// Not enumerable so that the copies of msg (replies) do not carry it.
+function keepRaw(msg, buf) {
+
+    if (msg !== null && typeof msg === 'object' && Buffer.isBuffer(buf))
+        Object.defineProperty(msg, 'raw', {value: buf});
+}
+
 
 module.exports = JAMCore;
@@ -1,7 +1,13 @@
 var Redis = require('redis');
 var cbor  = require('cbor');
+var DataRing = require('./dataring');
+var globals = require('./constants').globals;
 var debug = false;
 
+// Struct layouts registered by the compiled program. C nodes send a struct
+// sample as [schema id, field 1, .., field n] instead of a map.
+var schemas = new Map();
+
 class JAMDatastream {
 
     constructor(dev_id, key, fresh, jammanager, data_prototype, refresh_rate, slots, redis) {
@@ -48,7 +54,12 @@ class JAMDatastream {
 
         this.fresh = fresh;
         this.index_of_last_value = 0; //So we can zrange without having to retrieve everything
-        this.data_values = []; //This is the data value for the set
+        // Last entries of the set in time order (bounded). New members are fetched by
+        // score: last_score is the newest score seen and edge_members holds the members
+        // with that score, so members added in the same millisecond are not lost.
+        this.data_values = new DataRing(this.space > 0 ? this.space : globals.Datastream.CAPACITY);
+        this.last_score = -1;
+        this.edge_members = new Set();
 
         this.data_rcv_callback = undefined; //If the user wants a specific action to occur at every event we receive for a specific datastream
         // this.request_set_size();
@@ -120,7 +131,7 @@ class JAMDatastream {
      */
     lastData() {
         if (!this.isEmpty()) {
-            var data = this.data_values[this.size() - 1], value;
+            var data = this.data_values.last(), value;
             // if the content of the string is a number
             if(Number(data.log) == data.log) value = Number(data.log);
             // if the string starts with '{' then it could have been a JSON object
@@ -151,7 +162,7 @@ class JAMDatastream {
     lastValue() {
 
         if (!this.isEmpty()) {
-            var data = this.data_values[this.size() - 1], value;
+            var data = this.data_values.last(), value;
             // if the content of the string is a number
             if(Number(data.log) == data.log) value = Number(data.log);
             // if the string starts with '{' then it could have been a JSON object
@@ -215,7 +226,7 @@ class JAMDatastream {
      */
     data() {
         if (this.isEmpty()) return null;
-        return this.data_values.map(function(d){
+        return this.data_values.toArray().map(function(d){
             var value;
             // if the content of the string is a number
             if(Number(d.log) == d.log) value = Number(d.log);
@@ -246,7 +257,7 @@ class JAMDatastream {
      */
     values() {
         if (this.isEmpty()) return null;
-        return this.data_values.map(function(d) {
+        return this.data_values.toArray().map(function(d) {
             var value;
             // if the content of the string is a number
             if(Number(d.log) == d.log) value = Number(d.log);
@@ -296,7 +307,7 @@ class JAMDatastream {
             N = this.size();
         }
 
-        return this.data_values.slice(this.size() - N).map(function(d) {
+        return this.data_values.slice(this.size() - N, this.size()).map(function(d) {
             var value;
             // if the content of the string is a number
             if(Number(d.log) == d.log) value = Number(d.log);
@@ -345,7 +356,7 @@ class JAMDatastream {
             N = this.size();
         }
 
-        return this.data_values.slice(this.size() - N).map(function(d) {
+        return this.data_values.slice(this.size() - N, this.size()).map(function(d) {
             var value;
             // if the content of the string is a number
             if(Number(d.log) == d.log) value = Number(d.log);
@@ -378,9 +389,8 @@ class JAMDatastream {
      2017-02-22T12:55:16.000Z
      */
     dataAfter(timestamp) {
-        return this.data_values.filter(function(d) {
-            return Math.floor(timestamp.getTime() / 1000) < d.time_stamp;
-        }).map(function(d) {
+        var from = this.data_values.upperBound(Math.floor(timestamp.getTime() / 1000));
+        return this.data_values.slice(from).map(function(d) {
             var value;
             // if the content of the string is a number
             if(Number(d.log) == d.log) value = Number(d.log);
@@ -413,9 +423,8 @@ class JAMDatastream {
      6
      */
     valuesAfter(timestamp) {
-        return this.data_values.filter(function(d) {
-            return Math.floor(timestamp.getTime() / 1000) < d.time_stamp;
-        }).map(function(d) {
+        var from = this.data_values.upperBound(Math.floor(timestamp.getTime() / 1000));
+        return this.data_values.slice(from).map(function(d) {
             var value;
             // if the content of the string is a number
             if(Number(d.log) == d.log) value = Number(d.log);
@@ -449,10 +458,9 @@ class JAMDatastream {
      2017-02-22T12:55:16.000Z
      */
     dataBetween(fromTimestamp, toTimestamp) {
-        return this.data_values.filter(function(d) {
-            return Math.floor(fromTimestamp.getTime() / 1000) < d.time_stamp &&
-                d.time_stamp < Math.floor(toTimestamp.getTime() / 1000);
-        }).map(function(d) {
+        var from = this.data_values.upperBound(Math.floor(fromTimestamp.getTime() / 1000));
+        var to = this.data_values.lowerBound(Math.floor(toTimestamp.getTime() / 1000));
+        return this.data_values.slice(from, Math.max(from, to)).map(function(d) {
             var value;
             // if the content of the string is a number
             if(Number(d.log) == d.log) value = Number(d.log);
@@ -486,10 +494,9 @@ class JAMDatastream {
      32.5
      */
     valuesBetween(fromTimestamp, toTimestamp) {
-        return this.data_values.filter(function(d) {
-            return Math.floor(fromTimestamp.getTime() / 1000) < d.time_stamp &&
-                d.time_stamp < Math.floor(toTimestamp.getTime() / 1000);
-        }).map(function(d) {
+        var from = this.data_values.upperBound(Math.floor(fromTimestamp.getTime() / 1000));
+        var to = this.data_values.lowerBound(Math.floor(toTimestamp.getTime() / 1000));
+        return this.data_values.slice(from, Math.max(from, to)).map(function(d) {
             var value;
             // if the content of the string is a number
             if(Number(d.log) == d.log) value = Number(d.log);
@@ -521,7 +528,7 @@ class JAMDatastream {
     }
 
     get_all_values() {
-        return this.data_values;
+        return this.data_values.toArray();
     }
 
     request_set_size() {
@@ -547,7 +554,7 @@ class JAMDatastream {
         if (this.set_size === 0) {
             throw "Empty Set";
         }
-        return this.data_values[this.data_values.length - 1];
+        return this.data_values.last();
     }
 
     get_value_at(index) {
@@ -557,7 +564,7 @@ class JAMDatastream {
         if (index < 0 || index > this.data_values.length - 1) {
             throw "Invalid Index";
         }
-        return this.data_values[index];
+        return this.data_values.at(index);
     }
 
     get_range_values(start, range) {
@@ -577,14 +584,6 @@ class JAMDatastream {
         var process = this.process_zrange_response;
         var datastream = this;
 
-        // if (force || this.index_of_last_value + 1 < this.set_size) {
-        //     this.zrange(this.key, this.index_of_last_value + 1, -1,
-        //         function(e, response) {
-        //             process(e, response, datastream);
-        //         });
-        // }
-        // else
-        //     console.log("FAILED TO ZRANGE IN LOGGER");
         if( this.isBusy ){
             this.hasData = true;
             return;
@@ -593,24 +592,49 @@ class JAMDatastream {
         this.isBusy = true;
         this.hasData = false;
 
-        this.zrange(this.key, this.index_of_last_value, -1,
-            function(e, response) {
-                process(e, response, datastream);
-            });
+        var callback = function(e, response) {
+            process(e, response, datastream, false);
+        };
+        if (this.last_score < 0) {
+            // First fetch.. only the newest members that fit in the ring
+            this.redis.zrange([this.key, -this.data_values.capacity, -1, 'WITHSCORES'], callback);
+        } else {
+            this.redis.zrangebyscore([this.key, this.last_score, '+inf', 'WITHSCORES', 'LIMIT', 0, this.data_values.capacity], callback);
+        }
         if (this.refresh_rate > 0) {
             setTimeout(this.request_value_refresh.bind(this), this.refresh_rate);
         }
     }
 
-    process_zrange_response(e, response, datastream) {
+    // A ZADD notification ("<score> <key>") for this stream. A score older
+    // than the newest one seen is a late member (e.g., replayed from a device
+    // spool) so only that score is fetched.
+    notify(score) {
+        var process = this.process_zrange_response;
+        var datastream = this;
+
+        if (score !== undefined && this.last_score >= 0 && score < this.last_score) {
+            this.redis.zrangebyscore([this.key, score, score, 'WITHSCORES'], function(e, response) {
+                process(e, response, datastream, true);
+            });
+        } else if (this.refresh_rate === 0) {
+            this.request_value_refresh();
+        }
+    }
+
+    // response is [member, score, ..]
+    process_zrange_response(e, response, datastream, late) {
         var entry;
         var dest = datastream.datasource.getDestination();
 
         if (e) {
-            datastream.isBusy = false;
+            if (!late)
+                datastream.isBusy = false;
             throw e;
         } else {
             if (response === undefined) {
+                if (late)
+                    return;
                 let hasData = datastream.hasData;
                 datastream.isBusy = false;
                 if( hasData )
@@ -618,60 +642,66 @@ class JAMDatastream {
                 return;
             }
 
-            for (var i = 0; i < response.length; i++) {
+            for (var i = 0; i + 1 < response.length; i += 2) {
+                var score = Number(response[i + 1].toString());
+
+                if (!late) {
+                    // Members with the last score were fetched before
+                    var member = response[i].toString('latin1');
+                    if (score === datastream.last_score && datastream.edge_members.has(member))
+                        continue;
+                    if (score > datastream.last_score) {
+                        datastream.last_score = score;
+                        datastream.edge_members.clear();
+                    }
+                    datastream.edge_members.add(member);
+                }
+
                 var dval = cbor.decodeFirstSync(response[i]);
-                var log = dval.value;
                 var timestamp = dval.timestamp;
+                var samples;
 
-                // try {
-                //     log = cbor.decodeFirstSync(log);
-                //     // if (debug) console.log(log);
-                // } catch(e) {
-                //     console.log("WARN! Error decoding data.. ", log)
-                // }
-                // }
-
-                //console.log("Before log transform:", log);
+                // A compact block is a single Redis member with many samples
+                if (dval.block !== undefined)
+                    samples = JAMDatastream.expandBlock(dval.block);
+                else
+                    samples = [{ value: JAMDatastream.expandRecord(dval.value), timestamp: timestamp }];
+
+                for (var k = 0; k < samples.length; k++) {
+                    entry = {
+                        log: datastream.transformer(samples[k].value, datastream),
+                        time_stamp: samples[k].timestamp
+                    };
+
+                    var newest = datastream.data_values.last();
+                    if (newest === undefined || newest.time_stamp <= entry.time_stamp) {
+                        datastream.data_values.push(entry);
+                    } else if (datastream.has_entry(entry) || !datastream.data_values.insert(entry)) {
+                        continue;
+                    }
+                    datastream.set_size++;
 
-                entry = {
-                    log: datastream.transformer(log, datastream),
-                    time_stamp: timestamp
-                };
+                    if (debug) {
+                        console.log("Received data: ", entry);
+                        console.log(datastream.index_of_last_value);
+                    }
 
-                datastream.data_values.push(entry);
-                datastream.index_of_last_value++;
-                datastream.set_size++;
+                    //Added by Richboy on Sat 3 June 2017
+                    //inform listeners about new data
+                    for( let listener of datastream.listeners ) {
 
-                if (debug) {
-                    console.log("Received data: ", entry);
-                    console.log(datastream.index_of_last_value);
+                        if( listener.notify && typeof listener.notify === 'function' )
+                            listener.notify.call(listener, datastream.key, entry, datastream);
+                        else if( typeof listener === 'function' )
+                            listener.call({}, datastream.key, entry, datastream);
+                    }
                 }
-
-                //console.log("After log transform:", entry.log);
-
-                /*
-                 if(refresh_size && i == response.length -1){
-                 //Attempt to update the size ... in case it did not update or misssed it
-                 var size = parseInt(response[i].slice(response[i].lastIndexOf(this.delimiter, time_stamp_index - 1) + 3, time_stamp_index));
-                 if(size > this.set_size)
-                 this.set_size = size;
-                 }*/
+                datastream.index_of_last_value++;
 
                 if (datastream.data_rcv_callback) {
                     datastream.data_rcv_callback(response[i]);
                 }
 
-                //Added by Richboy on Sat 3 June 2017
-                //inform listeners about new data
-                for( let listener of datastream.listeners ) {
-
-                    if( listener.notify && typeof listener.notify === 'function' )
-                        listener.notify.call(listener, datastream.key, entry, datastream);
-                    else if( typeof listener === 'function' )
-                        listener.call({}, datastream.key, entry, datastream);
-                }
-
-
                 //Check if this stream is to be sent to the parent
                 let forward = false;
                 if( datastream.jammanager.getParentRedisLogger() != null ) {//if the redis connection to parent is not null
@@ -692,21 +722,34 @@ class JAMDatastream {
 
                 if( forward ) {
                     //make copy and adapt the log to the transformed copy
-                    datastream.jammanager.simpleLog(datastream.key, response[i], null, datastream.jammanager.getParentRedisLogger(), timestamp);
+                    datastream.jammanager.simpleLog(datastream.key, response[i], null, datastream.jammanager.getParentRedisLogger(), score);
                 }
             }
 
-            // if (datastream.index_of_last_value + 1 > datastream.set_size) {
-            //     datastream.set_size = datastream.index_of_last_value;
-            // }
+            if (late)
+                return;
 
-            let hasData = datastream.hasData;
+            // A full batch.. there could be more
+            let hasData = datastream.hasData || response.length / 2 >= datastream.data_values.capacity;
             datastream.isBusy = false;
             if( hasData )
                 setTimeout(datastream.request_value_refresh.bind(datastream), 0);
         }
     }
 
+    // A late entry that is already in the ring (a record written twice)
+    has_entry(entry) {
+        var log = JSON.stringify(entry.log);
+        for (var i = this.data_values.lowerBound(entry.time_stamp); i < this.data_values.length; i++) {
+            var d = this.data_values.at(i);
+            if (d.time_stamp !== entry.time_stamp)
+                break;
+            if (JSON.stringify(d.log) === log)
+                return true;
+        }
+        return false;
+    }
+
     zrange(key, start, range, callback) {
         this.redis.zrange([key, start, range], callback);
     }
@@ -775,6 +818,8 @@ class JAMDatastream {
                 self.performDataRegularization();
             }
         });
+        // Same connection.. the ZADD is done before the readers hear about it
+        redis.publish(globals.Datastream.NOTIFY, curTime + ' ' + this.key);
     }
 
     getSeries(callback, fromMillis, toMillis) { // TODO needs to be revised cause of the data caching
@@ -899,6 +944,89 @@ class JAMDatastream {
         return this.key;
     }
 
+    // fields are the leaf paths in declaration order (e.g., 'pos.x')
+    static addSchema(id, fields){
+        schemas.set(id, fields);
+    }
+
+    // Samples [{value, timestamp}] in a compact block (see jamblock_t in
+    // lib/jamlib/jamdata.h). Timestamps go past 2^32 so the varints are
+    // decoded with arithmetic instead of bit operations.
+    static expandBlock(buf){
+        var pos = 1;
+        var samples = [];
+
+        function uvarint() {
+            var val = 0, mul = 1, b;
+            do {
+                b = buf[pos++];
+                val += (b & 0x7f) * mul;
+                mul *= 128;
+            } while (b & 0x80);
+            return val;
+        }
+        function svarint() {
+            var n = uvarint();
+            return (n % 2 === 1) ? -(n + 1) / 2 : n / 2;
+        }
+
+        var isint = (buf[0] === 1);
+        var timestamp = uvarint();
+        var delta = 0;
+        var value, bits;
+        if (isint) {
+            value = svarint();
+        } else {
+            bits = buf.readUInt32BE(pos);
+            pos += 4;
+        }
+
+        while (true) {
+            if (isint) {
+                samples.push({ value: value, timestamp: timestamp });
+            } else {
+                var f = Buffer.alloc(4);
+                f.writeUInt32BE(bits >>> 0, 0);
+                samples.push({ value: f.readFloatBE(0), timestamp: timestamp });
+            }
+            if (pos >= buf.length)
+                break;
+
+            delta += svarint();
+            timestamp += delta;
+            if (isint) {
+                value += svarint();
+            } else {
+                var ctl = buf[pos++];
+                if (ctl !== 0) {
+                    var lead = (ctl >> 2) & 3, trail = ctl & 3, x = 0;
+                    for (var i = lead; i < 4 - trail; i++)
+                        x = x * 256 + buf[pos++];
+                    bits = (bits ^ (x * Math.pow(256, trail))) >>> 0;
+                }
+            }
+        }
+        return samples;
+    }
+
+    static expandRecord(value){
+        if( !Array.isArray(value) || !schemas.has(value[0]) )
+            return value;
+
+        var fields = schemas.get(value[0]);
+        var obj = {};
+        for (var i = 0; i < fields.length; i++) {
+            var path = fields[i].split('.');
+            var o = obj;
+            for (var j = 0; j < path.length - 1; j++) {
+                if (o[path[j]] === undefined)
+                    o[path[j]] = {};
+                o = o[path[j]];
+            }
+            o[path[path.length - 1]] = value[i + 1];
+        }
+        return obj;
+    }
 }
 
 module.exports = JAMDatastream;
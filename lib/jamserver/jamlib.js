@@ -8,7 +8,9 @@
 const mqtt = require('mqtt'),
 	  os = require('os'),
       globals = require('./constants').globals;
-const Worker = require('tiny-worker');
+const WorkerPool = require('./workerpool');
+// worker_threads when the node has it.. it can transfer the request buffers
+const Worker = WorkerPool.threads !== undefined ? WorkerPool.threads.Worker : require('tiny-worker');
 
 // Do command line processing...
 var cmdopts = require('./cmdparser');
@@ -33,12 +35,13 @@ jamsys.init(reggie, machType, cmdopts.tags, cmdopts.iflow,
 								cmdopts.link, cmdopts.long, cmdopts.lat);
 jamsys.setMQTT(getMachineAddr(), cmdopts.port);
 var jnode = require('./jnode');
-var worker = new Worker('./jamout.js');
-worker.postMessage({cmd: 'CONF-DATA', opt:'CMDOPTS', data: cmdopts});
-worker.postMessage({cmd: 'CONF-DATA', opt:'JSYS', data: jamsys});
+var workers = [];
+for (var w = 0; w < Math.max(1, cmdopts.workers); w++)
+	workers.push(new Worker('./jamout.js'));
 jnode.init(reggie, machType);
 var jcore = jnode.getcore();
-jcore.setWorker(worker);
+jcore.setWorkers(workers, [{cmd: 'CONF-DATA', opt:'CMDOPTS', data: cmdopts},
+						   {cmd: 'CONF-DATA', opt:'JSYS', data: jamsys}]);
 
 
 
@@ -1,6 +1,7 @@
 'use strict';
 
 const JAMDatasource = require('./jamdatasource.js');
+const JAMDatastream = require('./jamdatastream.js');
 //const jamsys = require('./jamsys');
 
 class JAMLogger extends JAMDatasource {
@@ -10,6 +11,12 @@ class JAMLogger extends JAMDatasource {
     constructor(jammanager, name, destination) {
         super(jammanager, 'logger', name, jammanager.getLevelCode(), destination || 'cloud');
     }
+
+    // Struct loggers.. the C nodes send the values without the field names
+    setSchema(id, fields) {
+        JAMDatastream.addSchema(id, fields);
+        return this;
+    }
 }
 
 module.exports = JAMLogger;
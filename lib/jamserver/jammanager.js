@@ -137,34 +137,36 @@ module.exports = function(cmdopts, jsys) {
         parentConObj = null;
     }
 
-    //'__keyevent@*:*'
     function init() {
-        // Turn on notify events for:
-        // E: Keyspace events
-        // z: Sorted sets
-        listener.config(['set', 'notify-keyspace-events', 'KEA']);
+        // Writers publish "<score> <key>" on the notify channel with every ZADD..
+        // no keyspace notifications (they are sent for every command on every key)
 
         // // Allows other machine to access redis clients on this one.
     //    listener.rawCall(['config', 'set', 'protected-mode', 'no']);
     //    executor.rawCall(['config', 'set', 'protected-mode', 'no']);
 
-        //listen for all events for all keys and process them in the listenerEvent function
-        listener.psubscribe('__keyevent*');
-        listener.on('pmessage', listenerEvent);
+        listener.subscribe(globals.Datastream.NOTIFY);
+        listener.on('message', function(ch, bufferData) {
+            listenerEvent(null, ch, bufferData);
+        });
     }
 
     function listenerEvent(pat, ch, bufferData) {
         var data = bufferData.toString();
+        var score;
+
+        var sp = data.indexOf(' ');
+        if (sp > 0) {
+            score = Number(data.substring(0, sp));
+            data = data.substring(sp + 1);
+        }
 
         if (data !== undefined) {
 
             if (jamdatastream_callbacks[data] != undefined) {
                 // msg_receive_callback(data);
                 let jamdatastream = jamdatastream_callbacks[data];
-                jamdatastream.set_size++;
-                if (jamdatastream.refresh_rate === 0) {
-                    jamdatastream.request_value_refresh();
-                }
+                jamdatastream.notify(score);
             } else {
                 var idx = data.lastIndexOf('.');
                 if (idx !== -1) {
@@ -175,10 +177,7 @@ module.exports = function(cmdopts, jsys) {
                         var deviceId = data.substring(idx + 1, data.length - 1);
                         jamdatasource.addDatastream(deviceId);
                         let jamdatastream = jamdatastream_callbacks[data];
-                        jamdatastream.set_size++;
-                        if (jamdatastream.refresh_rate === 0) {
-                            jamdatastream.request_value_refresh();
-                        }
+                        jamdatastream.notify(score);
                     }
                 }
             }
@@ -306,6 +305,7 @@ module.exports = function(cmdopts, jsys) {
             };
 
             redis.zadd([key, timestamp, value], cb);
+            redis.publish(globals.Datastream.NOTIFY, timestamp + ' ' + key);
         },
 
         subscribe: function(key, listener){
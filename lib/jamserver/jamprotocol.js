@@ -1,7 +1,8 @@
 'use strict';
 
 var cbor = require('cbor'),
-    crypto = require('crypto'),
+    ActId = require('./actid'),
+    TypedArgs = require('./typedargs'),
     globals = require('./constants').globals;
 
 // =============================================================================
@@ -16,12 +17,12 @@ class JAMProtocol {
 
         msg['opt'] = mtype;
         msg['cmd'] = 'MEXEC-ACK';
-        mserv.publish('/' + app + '/mach/func/request', cbor.encode(msg));
+        mserv.publish('/' + app + '/mach/func/request', cbor.encode(ActId.wire(TypedArgs.wire(msg))));
 
         if (mtype === globals.NodeType.DEVICE && fserv !== null)
-            fserv.publish('/' + app + '/mach/func/urequest', cbor.encode(msg));
+            fserv.publish('/' + app + '/mach/func/urequest', cbor.encode(ActId.wire(TypedArgs.wire(msg))));
         if (mtype === globals.NodeType.FOG && cserv !== null)
-            cserv.publish('/' + app + '/mach/func/urequest', cbor.encode(msg));
+            cserv.publish('/' + app + '/mach/func/urequest', cbor.encode(ActId.wire(TypedArgs.wire(msg))));
     }
 
     // msg contains the request we received.. returning a reply!
@@ -29,12 +30,12 @@ class JAMProtocol {
                     
         msg['opt'] = mtype;
         msg['cmd'] = 'MEXEC-RES';
-        mserv.publish('/' + app + '/mach/func/request', cbor.encode(msg));
+        mserv.publish('/' + app + '/mach/func/request', cbor.encode(ActId.wire(TypedArgs.wire(msg))));
 
         if (mtype === globals.NodeType.DEVICE && fserv !== null)
-            fserv.publish('/' + app + '/mach/func/urequest', cbor.encode(msg));
+            fserv.publish('/' + app + '/mach/func/urequest', cbor.encode(ActId.wire(TypedArgs.wire(msg))));
         if (mtype === globals.NodeType.FOG && cserv !== null)
-            cserv.publish('/' + app + '/mach/func/urequest', cbor.encode(msg));
+            cserv.publish('/' + app + '/mach/func/urequest', cbor.encode(ActId.wire(TypedArgs.wire(msg))));
     }
 
     static createMachAsyncReq(name, params, oexpr, vec, machtype, bclock) {
@@ -48,7 +49,7 @@ class JAMProtocol {
                     "actarg": bclock,
                     "args": params};
 
-        tmsg.actid = crypto.createHash('md5').update(JSON.stringify(tmsg) + new Date()).digest('hex');
+        tmsg.actid = ActId.generate();
 
         return tmsg;
     }
@@ -63,7 +64,7 @@ class JAMProtocol {
                     "actid": "-",
                     "actarg": bclock,
                     "args": params};
-        tmsg.actid = crypto.createHash('md5').update(JSON.stringify(tmsg) + scount).digest('hex');
+        tmsg.actid = ActId.generate();
 
         return tmsg;
     }
@@ -78,7 +79,7 @@ class JAMProtocol {
                     "actid": "-",
                     "actarg": bclock,
                     "args": params};
-        tmsg.actid = crypto.createHash('md5').update(JSON.stringify(tmsg) + scount).digest('hex');
+        tmsg.actid = ActId.generate();
         tmsg.cmd = "REXEC-INQ";
 
         return tmsg;
@@ -95,7 +96,7 @@ class JAMProtocol {
                     "actarg": bclock,
                     "args": params};
 
-        tmsg.actid = crypto.createHash('md5').update(JSON.stringify(tmsg) + acount).digest('hex');
+        tmsg.actid = ActId.generate();
 
         return tmsg;
     }
@@ -111,7 +112,7 @@ class JAMProtocol {
                     "actarg": bclock,
                     "args": params};
 
-        tmsg.actid = crypto.createHash('md5').update(JSON.stringify(tmsg) + count + new Date()).digest('hex');
+        tmsg.actid = ActId.generate();
         return tmsg;
     }
 
@@ -81,7 +81,7 @@ class JCoreDaemon {
 
             case 'MEXEC-ASY':
                 JAMP.sendMachAcknowledge(sock, this.jcore.fserv, this.jcore.cserv, this.machtype, cmdopts.app, msg);
-                this.jcore.enqueueJob({cmd: 'MEXEC-ASY', cond: msg.cond, name: msg.actname, actid: msg.actid, args: msg.args});
+                this.jcore.enqueueJob({cmd: 'MEXEC-ASY', cond: msg.cond, name: msg.actname, actid: msg.actid, args: msg.args, raw: msg.raw});
 
 
             break;
@@ -97,7 +97,7 @@ class JCoreDaemon {
                     JAMP.sendMachReply(sock, that.jcore.fserv, that.jcore.cserv, that.machtype, cmdopts.app, omsg);
                 }});
                 // Queue the request for local execution..
-                this.jcore.enqueueJob({cmd: 'MEXEC-SYN', cond: msg.cond, name: msg.actname, actid: msg.actid, args: msg.args});
+                this.jcore.enqueueJob({cmd: 'MEXEC-SYN', cond: msg.cond, name: msg.actname, actid: msg.actid, args: msg.args, raw: msg.raw});
 
             break;
         }
@@ -123,6 +123,12 @@ class JCoreDaemon {
                     callback({code: 'ACK', res: ''});
                 }
             break;
+            case 'REXEC-NAK':
+                // The C node is overloaded.. it tells us when to try again
+                // [[ REXEC-NAK NAK ACTIVITY actid device_id OVERLOAD (arg0) retry-after (arg1) ]]
+                if (msg['args'][0] === 'OVERLOAD')
+                    this.jcore.runTable.processOverload(msg['actid'], msg['args'][1]);
+            break;
             case 'REXEC-RES':
                 var runid = msg['actid'];
                 var rentry = this.jcore.runTable.get(runid);
@@ -216,7 +222,7 @@ class JCoreDaemon {
    		this.activityTable.set(cmsg["actid"], {callback: callback, originmsg: cmsg, rescmd: 'REXEC-RES'});
         rmsg.cmd = "REXEC-ACK";
         callback(rmsg);
-        this.jcore.enqueueJob({cmd: 'REXEC-SYN', cond: cmsg.cond,  name: cmsg.actname, actid: cmsg.actid, args: cmsg.args});
+        this.jcore.enqueueJob({cmd: 'REXEC-SYN', cond: cmsg.cond,  name: cmsg.actname, actid: cmsg.actid, args: cmsg.args, raw: cmsg.raw});
     }
 
     runSyncCallbackNRT(cmsg, callback) {
@@ -251,7 +257,7 @@ class JCoreDaemon {
         callback(rmsg);
 
         // Run function at the worker thread
-        this.jcore.enqueueJob({cmd: cmsg.cmd, cond: cmsg.cond, name: cmsg.actname, args: cmsg.args});
+        this.jcore.enqueueJob({cmd: cmsg.cmd, cond: cmsg.cond, name: cmsg.actname, args: cmsg.args, raw: cmsg.raw});
         this.activityTable.set(cmsg["actid"],  "Completed");
     }
 
@@ -1,8 +1,13 @@
 // jworklib.js
 
 const deasync = require('deasync');
+const cbor = require('cbor');
 const globals = require('jamserver/constants').globals;
 const ebus = require('jamserver/ebus');
+const TypedArgs = require('jamserver/typedargs');
+const threads = loadThreads();
+// Running under worker_threads or under tiny-worker (postMessage/onmessage globals)
+const parentPort = (threads !== undefined && !threads.isMainThread) ? threads.parentPort : null;
 
 var funcRegistry = new Map();
 var runLevel = [];
@@ -18,6 +23,7 @@ var respondMatrix = new Map();
 
 var jsys;
 var cmdopts;
+var workerIndex = 0;            // 0 runs the user program.. the rest only serve activities
 
 module.exports = new function() {
 	this.registerFuncs = registerFuncs;
@@ -54,7 +60,7 @@ function setupJWorklib() {
     // Setup the ebus message handler so that we can react to events.
     ebus.on('data-up', function(x) {
         var msg = {cmd: 'DATA-UP', host: x.host, port: x.port};
-        postMessage(msg);
+        post(msg);
     });
 }
 
@@ -122,7 +128,7 @@ function remoteSyncExec(name, params, expr, vec, bcasters, callback) {
     waitMatrix.set(cbid, {wmap:wmap, result: res, callback:callback, count:0, timeout:null});
 
     var msg = {cmd: 'REXEC-SYN', cbid: cbid, level: mlevel, name: name, params: params, expr: expr, vec: vec, bclock: bclock, count: scount};
-    postMessage(msg);
+    post(msg);
 }
 
 // after deasync, machSyncExec is called without the callback 
@@ -149,7 +155,7 @@ function machSyncExec(name, params, oexpr, vec, bcasters, callback) {
     scount++;
     var cbid = "mach" + name + ":" + scount; 
     var msg = {cmd: 'MEXEC-SYN', cbid: cbid, level: mlevel, name: name, params: params, expr: oexpr, vec: vec, bclock: bclock, count: scount};
-    postMessage(msg);
+    post(msg);
 
     // compute the wait map. this includes only other nodes.
     var wmap = {};
@@ -187,7 +193,7 @@ function remoteAsyncExec(name, params, expr, vec, bcasters) {
     acount++;
 
     var msg = {cmd: 'REXEC-ASY', name: name, params: params, expr: expr, vec: vec, bclock: bclock, count: acount};
-    postMessage(msg);
+    post(msg);
 }
 
 // Returns true if it is able to launch the specified function
@@ -209,7 +215,7 @@ function machAsyncExec(name, params, oexpr, vec, bcasters) {
     var eres = jcondEval(oexpr);
 
     var msg = {cmd: 'MEXEC-ASY', name: name, params: params, expr: oexpr, vec: vec, bclock: bclock};
-    postMessage(msg);
+    post(msg);
 
     if (eres)
         fentry.func.apply(this, params);
@@ -240,10 +246,36 @@ function registerFuncs(machbox) {
 	}
 }
 
-function run(callback) {
+function post(msg) {
+
+    if (parentPort !== null)
+        parentPort.postMessage(msg);
+    else
+        postMessage(msg);
+}
+
+function listen(handler) {
+
+    if (parentPort !== null)
+        parentPort.on('message', handler);
+    else
+        onmessage = function(ev) { handler(ev.data); };
+}
+
+function loadThreads() {
+    try {
+        return require('worker_threads');
+    } catch (e) {
+        return undefined;
+    }
+}
+
+// The compiled program gives the user program (callback), the part of
+// it that only defines the activities (services) and the activities
+// that use the top-level state of the program (stateful).
+function run(callback, services, stateful) {
 
-    onmessage = function(ev) { 
-        var v = ev.data;
+    listen(function(v) {
         var msg;
         switch (v.cmd) {
             case 'REXEC-ASY':
@@ -264,12 +296,12 @@ function run(callback) {
 
             case 'REXEC-ERR':
                 processWait(v.cbid, v.data, true);
-                postMessage({cmd: 'DONE'});
+                post({cmd: 'DONE'});
             break;
             case 'REXEC-RES':
             case 'MEXEC-RES':
                 processWait(v.cbid, v.data);
-                postMessage({cmd: 'DONE'});
+                post({cmd: 'DONE'});
             break;
             case 'NCACHE-MOD':
                 switch (v.opt) {
@@ -288,10 +320,13 @@ function run(callback) {
                         ebus.cloudDataDown();
                     break;
                 }
-                postMessage({cmd: 'DONE'});
+                post({cmd: 'DONE'});
             break;
             case 'CONF-DATA':
                 switch (v.opt) {
+                    case 'WORKER':
+                        workerIndex = v.data.index;
+                    break;
                     case 'CMDOPTS':
                         cmdopts = v.data;
                     break;
@@ -301,28 +336,59 @@ function run(callback) {
                         jsys.setLong = setLong;
                         jsys.setLat = setLat;
                         setupJWorklib();
-                        // This is running the user program..                        
-                        if (callback !== undefined)
-                            callback();
+                        if (workerIndex === 0) {
+                            // This is running the user program..
+                            if (stateful !== undefined)
+                                post({cmd: 'SET-CONF', opt: 'STATEFUL', data: stateful});
+                            if (callback !== undefined)
+                                callback();
+                        } else if (services !== undefined) {
+                            // Just the activities.. then we can take jobs
+                            services();
+                            post({cmd: 'SET-CONF', opt: 'READY'});
+                        }
                     break;
                 }
-                postMessage({cmd: 'DONE'});
+                post({cmd: 'DONE'});
             default:
         }
-    }    
+    });
+}
+
+// The args come as the raw request when the core could transfer it
+function jobArgs(v) {
+
+    if (v.raw !== undefined && v.args === undefined)
+        v.args = TypedArgs.args(cbor.decodeFirstSync(Buffer.from(v.raw)).args);
+    return v.args;
+}
+
+// A helper worker does not have the top-level state of the program.
+// An activity that needs it is sent back to run on worker 0.
+function runActivity(v, fentry) {
+
+    try {
+        return {ok: true, res: fentry.func.apply(this, jobArgs(v))};
+    } catch (e) {
+        if (workerIndex !== 0 && e instanceof ReferenceError) {
+            post({cmd: 'PIN', name: v.name, job: {cmd: v.cmd, cond: v.cond, name: v.name, actid: v.actid, args: v.args}});
+            return {ok: false};
+        }
+        throw e;
+    }
 }
 
 function asyncExecute(v, doneMsg, errMsg) {
 
     if (checkCondition(v.cond) !== true)
-        postMessage({cmd: doneMsg, data: "", actid: v.actid});
+        post({cmd: doneMsg, data: "", actid: v.actid});
     else if (v.name !== undefined) {
         var fentry = funcRegistry.get(v.name);
         if (fentry !== undefined) {
-            fentry.func.apply(this, v.args);
-            postMessage({cmd: doneMsg});
+            if (runActivity(v, fentry).ok)
+                post({cmd: doneMsg});
         } else 
-            postMessage({cmd: errMsg, data: "", actid: v.actid});
+            post({cmd: errMsg, data: "", actid: v.actid});
     }   
 }
 
@@ -330,25 +396,27 @@ function syncExecute(v, doneMsg, errMsg) {
 
     if (checkCondition(v.cond) !== true) {
         msg = {cmd: errMsg, data: "", actid: v.actid};
-        postMessage(msg);
+        post(msg);
     } else if (v.name !== undefined) {
         var fentry = funcRegistry.get(v.name);
         if (fentry !== undefined) {
-            res = fentry.func.apply(this, v.args);
-            msg = {cmd: doneMsg, data: res, actid: v.actid}; // different from the async
-            postMessage(msg);
+            var r = runActivity(v, fentry);
+            if (r.ok) {
+                msg = {cmd: doneMsg, data: r.res, actid: v.actid}; // different from the async
+                post(msg);
+            }
         } else 
-            postMessage({cmd: errMsg, data: "", actid: v.actid});
+            post({cmd: errMsg, data: "", actid: v.actid});
     }  
 }
 
 
 function setLong(val) {
-    postMessage({cmd: 'SET-CONF', opt: 'SET-LONG', data: val});
+    post({cmd: 'SET-CONF', opt: 'SET-LONG', data: val});
 }
 
 function setLat(val) {
-    postMessage({cmd: 'SET-CONF', opt: 'SET-LAT', data: val});
+    post({cmd: 'SET-CONF', opt: 'SET-LAT', data: val});
 }
 
 function getMaxBcastClock(bstr) {
@@ -7,15 +7,29 @@
 
 var cbor = require('cbor');
 var globals = require('./constants').globals;
+var TimerWheel = require('./timerwheel');
+var ActId = require('./actid');
+var TypedArgs = require('./typedargs');
 
 var runTable;
 var jamcore;
+var templates;
+var wheel;
+
+// Request fields that stay the same across the calls of an activity and
+// the ones that change on every call. The CBOR of the first part is kept
+// in a template; only the second part is encoded per call.
+const FIXED_FIELDS = ['cmd', 'opt', 'cond', 'condvec', 'actname'];
+const CALL_FIELDS = ['actid', 'actarg', 'args'];    // actid first
+const ALL_FIELDS = FIXED_FIELDS.concat(CALL_FIELDS);
 
 class RunTable {
 
     constructor(jcore) {
         runTable = new Map();
         jamcore = jcore;
+        templates = new Map();
+        wheel = new TimerWheel(globals.Timeouts.RUN_TABLE_TICK, globals.Counts.RUN_TABLE_SLOTS);
     }
 
     get(runid) {
@@ -30,19 +44,14 @@ class RunTable {
         // form entry..
         var rentry = {msg:tmsg, type: tmsg.opt, targets: targets, results: {cloud:null, fog:null, device:null}, cbid: cbid, cback:callback, acks: {cloud:0, fog:0, device:0}, acktimer:undefined, waittimer: undefined, ackcount:0, waitcount:0, exception:true};
 
-        // prepare the message 
-        var cmsg = JSON.parse(JSON.stringify(tmsg));    // clone it
-        delete(cmsg.cbid);
-        var omsg = cbor.encode(cmsg);
-        rentry.outmsg = omsg; 
-        
+        // prepare the message.. cbid stays local
+        rentry.outmsg = encodeRequest(tmsg);
+
         var flag = sendRequest(rentry);
 
         if (flag) {
             // Set a timeout
-            var acktimer = setTimeout(processAckTimeout, globals.Timeouts.RUN_TABLE_ACK, runid);
-            // Insert the timeout handler into the entry
-            rentry.acktimer = acktimer;
+            rentry.acktimer = wheel.schedule(globals.Timeouts.RUN_TABLE_ACK, processAckTimeout, runid);
             runTable.set(runid, rentry);
         } else 
             callback({code:"ERR", res:rentry.results});
@@ -57,15 +66,42 @@ class RunTable {
 
         // delete acktimer if it is running.
         if (re.acktimer !== undefined) {
-            clearTimeout(re.acktimer);
+            wheel.cancel(re.acktimer);
             re.acktimer = undefined;
         }
 
         // increment ack count - used to determine how many results we will get
         re.acks[type] = re.acks[type] + 1;
 
-        // we start the wait timer.. 
-        setTimeout(processWaitTimeout, globals.Timeouts.WAIT_TIMEOUT, rid);
+        // (re)start the wait timer.. one per entry no matter how many ACKs come in
+        wheel.cancel(re.waittimer);
+        re.waittimer = wheel.schedule(globals.Timeouts.WAIT_TIMEOUT, processWaitTimeout, rid);
+    }
+
+    // The request was rejected because the node is overloaded. Resend it
+    // after the retry-after hint instead of letting the ack timer fire
+    // right away - that would make the overload worse.
+    processOverload(rid, retry) {
+
+        var re = runTable.get(rid);
+        if (re === undefined)
+            return;
+
+        if (re.acktimer !== undefined) {
+            wheel.cancel(re.acktimer);
+            re.acktimer = undefined;
+        }
+
+        if (re.ackcount >= globals.Counts.ACK_TIMEOUTS) {
+            re.cback({code: "ERR", res: re.results});
+            return;
+        }
+        re.ackcount++;
+
+        if (typeof retry !== 'number' || retry <= 0)
+            retry = globals.Timeouts.RUN_TABLE_ACK;
+
+        re.acktimer = wheel.schedule(retry, processOverloadRetry, rid);
     }
 
     processResults(rid, type, res) {
@@ -111,8 +147,8 @@ class RunTable {
 
         var re = runTable.get(runid);
         if (re !== undefined) {
-            if (re.acktimer !== undefined)            
-                clearTimeout(re.acktimer);
+            wheel.cancel(re.acktimer);
+            wheel.cancel(re.waittimer);
 
             runTable.delete(runid);
         }
@@ -130,6 +166,67 @@ class RunTable {
 }
 
 
+// Encode a request without cloning it. The map header and the fixed
+// fields come from the activity's template; actid, actarg and args are
+// appended. Anything that does not look like a regular request is
+// encoded the old way.
+function encodeRequest(tmsg) {
+
+    var nkeys = Object.keys(tmsg).length - (tmsg.hasOwnProperty('cbid') ? 1 : 0);
+    if (nkeys !== ALL_FIELDS.length || !ALL_FIELDS.every((f) => tmsg.hasOwnProperty(f)))
+        return encodePlain(tmsg);
+
+    var t = getTemplate(tmsg);
+    var cmsg = TypedArgs.wire(tmsg);
+    var parts = [t.prefix];
+    parts.push(t.keys[0]);
+    parts.push(cbor.encode(ActId.toWire(tmsg.actid)));
+    for (var j = 1; j < CALL_FIELDS.length; j++) {
+        parts.push(t.keys[j]);
+        parts.push(cbor.encode(cmsg[CALL_FIELDS[j]]));
+    }
+    return Buffer.concat(parts);
+}
+
+function encodePlain(tmsg) {
+
+    var cmsg = ActId.wire(TypedArgs.wire(Object.assign({}, tmsg)));
+    delete(cmsg.cbid);
+    return cbor.encode(cmsg);
+}
+
+function getTemplate(tmsg) {
+
+    var tkey = tmsg.cmd + '|' + tmsg.opt + '|' + tmsg.actname;
+    var t = templates.get(tkey);
+    if (t !== undefined && t.cond === tmsg.cond && sameCondvec(t, tmsg.condvec))
+        return t;
+
+    // Map header for all the fields (less than 24.. fits in one byte)
+    var parts = [Buffer.from([0xa0 | ALL_FIELDS.length])];
+    FIXED_FIELDS.forEach(function(f) {
+        parts.push(cbor.encode(f));
+        parts.push(cbor.encode(tmsg[f]));
+    });
+
+    t = {cond: tmsg.cond,
+         condvec: tmsg.condvec,
+         condstr: JSON.stringify(tmsg.condvec),
+         prefix: Buffer.concat(parts),
+         keys: CALL_FIELDS.map((f) => cbor.encode(f))};
+    templates.set(tkey, t);
+    return t;
+}
+
+function sameCondvec(t, vec) {
+
+    if (t.condvec === vec)
+        return true;
+    if (typeof vec !== 'object' || vec === null)
+        return false;
+    return t.condstr === JSON.stringify(vec);
+}
+
 function sendRequest(re) {
 
     var targets = re.targets;
@@ -168,7 +265,7 @@ function processWaitTimeout(rid) {
         if (re.waitcount < globals.Counts.WAIT_COUNT) {
             sendRequest(re);
             re.waitcount++;
-            setTimeout(processWaitTimeout, globals.Timeouts.WAIT_TIMEOUT, rid);
+            re.waittimer = wheel.schedule(globals.Timeouts.WAIT_TIMEOUT, processWaitTimeout, rid);
         } else 
             re.cback({code: 'ERR', res: re.results})
     }
@@ -183,13 +280,22 @@ function processAckTimeout(rid) {
         if (re.ackcount < globals.Counts.ACK_TIMEOUTS) {
             sendRequest(re);
             re.ackcount++;
-
-            var acktimer = setTimeout(processAckTimeout, globals.Timeouts.RUN_TABLE_ACK, rid);
-            re.acktimer = acktimer;
+            re.acktimer = wheel.schedule(globals.Timeouts.RUN_TABLE_ACK, processAckTimeout, rid);
         } else 
             re.cback({code: "ERR", res:re.results});
     }
 }
 
 
+// The retry-after hint of an overload reply has passed
+function processOverloadRetry(rid) {
+
+    var re = runTable.get(rid);
+    if (re !== undefined) {
+        sendRequest(re);
+        re.acktimer = wheel.schedule(globals.Timeouts.RUN_TABLE_ACK, processAckTimeout, rid);
+    }
+}
+
+
 module.exports = RunTable;
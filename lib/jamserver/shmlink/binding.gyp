@@ -0,0 +1,21 @@
+{
+  "targets": [
+    {
+      "target_name": "shmlink",
+      "sources": [
+        "shmaddon.c",
+        "../../jamlib/shmlink.c"
+      ],
+      "include_dirs": [
+        "../../jamlib"
+      ],
+      "cflags": [ "-std=gnu11" ],
+      "conditions": [
+        ["OS == 'linux'", {
+          "defines": [ "linux" ],
+          "libraries": [ "-lpthread", "-lrt" ]
+        }]
+      ]
+    }
+  ]
+}
@@ -0,0 +1 @@
+module.exports = require('./build/Release/shmlink.node');
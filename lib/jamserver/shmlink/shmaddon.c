@@ -0,0 +1,300 @@
+/*
+
+The MIT License (MIT)
+Copyright (c) 2016 Muthucumaru Maheswaran
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+// J node side of the shared memory link (lib/jamlib/shmlink.h).
+//
+// create(name, nslots)         -> handle
+// publish(handle, topic, buf)  -> number of C nodes the frame was written to
+// start(handle, callback)      -> callback(topic, buf) for every frame from a C node
+// close(handle)
+//
+// The reader runs in its own thread and hands the frames to the event loop
+// through a thread safe function.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <node_api.h>
+
+#include "shmlink.h"
+
+#define NAPI_CHECK(env, call)                                   \
+    if ((call) != napi_ok) {                                    \
+        napi_throw_error(env, NULL, "shmlink: " #call);         \
+        return NULL;                                            \
+    }
+
+typedef struct _shmhandle_t
+{
+    char name[64];
+    shmseg_t *seg;
+    pthread_t thread;
+    bool running;
+    napi_threadsafe_function tsfn;
+
+} shmhandle_t;
+
+typedef struct _shmframe_t
+{
+    char topic[SHM_MAX_TOPIC + 1];
+    int len;
+    unsigned char data[];
+
+} shmframe_t;
+
+
+static shmhandle_t *get_handle(napi_env env, napi_value val)
+{
+    void *ptr = NULL;
+
+    if (napi_get_value_external(env, val, &ptr) != napi_ok || ptr == NULL)
+    {
+        napi_throw_type_error(env, NULL, "shmlink: bad handle");
+        return NULL;
+    }
+    return (shmhandle_t *)ptr;
+}
+
+
+// A C node that went away without releasing its slot
+//
+static void release_dead_slots(shmseg_t *seg)
+{
+    for (int i = 0; i < seg->nslots; i++)
+    {
+        shmslot_t *slot = &(seg->slots[i]);
+        if (slot->state == SHM_SLOT_ACTIVE && !shmlink_pid_alive(slot->pid))
+            __atomic_store_n(&slot->state, SHM_SLOT_FREE, __ATOMIC_SEQ_CST);
+    }
+}
+
+
+static void *shm_reader(void *arg)
+{
+    shmhandle_t *h = (shmhandle_t *)arg;
+    shmseg_t *seg = h->seg;
+    unsigned char *buf = (unsigned char *)malloc(SHM_RING_SIZE);
+    unsigned char *payload;
+    char topic[SHM_MAX_TOPIC + 1];
+    int n, plen;
+
+    while (h->running)
+    {
+        uint32_t seq = __atomic_load_n(&seg->upseq, __ATOMIC_SEQ_CST);
+        bool got = false;
+
+        for (int i = 0; i < seg->nslots; i++)
+        {
+            shmslot_t *slot = &(seg->slots[i]);
+            if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SHM_SLOT_ACTIVE)
+                continue;
+
+            while ((n = shmring_read(&slot->up, buf, SHM_RING_SIZE)) != 0)
+            {
+                got = true;
+                if (n < 0)
+                    continue;
+                plen = shmframe_split(buf, n, topic, &payload);
+                if (plen < 0)
+                    continue;
+
+                shmframe_t *f = (shmframe_t *)malloc(sizeof(shmframe_t) + plen);
+                strcpy(f->topic, topic);
+                f->len = plen;
+                memcpy(f->data, payload, plen);
+                if (napi_call_threadsafe_function(h->tsfn, f, napi_tsfn_blocking) != napi_ok)
+                    free(f);
+            }
+        }
+
+        if (!got)
+        {
+            shmring_wait(&seg->upseq, &seg->jwaiting, seq, SHM_WAIT_TIMEOUT);
+            release_dead_slots(seg);
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+
+static void call_js(napi_env env, napi_value cback, void *context, void *data)
+{
+    shmframe_t *f = (shmframe_t *)data;
+    napi_value argv[2], undef;
+    void *copy;
+
+    if (env != NULL && cback != NULL)
+    {
+        napi_create_string_utf8(env, f->topic, NAPI_AUTO_LENGTH, &argv[0]);
+        napi_create_buffer_copy(env, f->len, f->data, &copy, &argv[1]);
+        napi_get_undefined(env, &undef);
+        napi_call_function(env, undef, cback, 2, argv, NULL);
+    }
+    free(f);
+}
+
+
+static napi_value shm_create(napi_env env, napi_callback_info info)
+{
+    size_t argc = 2;
+    napi_value argv[2], result;
+    int32_t nslots = SHM_MAX_SLOTS;
+    size_t len;
+
+    NAPI_CHECK(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, NULL, "shmlink: create(name, [nslots])");
+        return NULL;
+    }
+
+    shmhandle_t *h = (shmhandle_t *)calloc(1, sizeof(shmhandle_t));
+    NAPI_CHECK(env, napi_get_value_string_utf8(env, argv[0], h->name, sizeof(h->name), &len));
+    if (argc > 1)
+        napi_get_value_int32(env, argv[1], &nslots);
+
+    h->seg = shmseg_create(h->name, nslots);
+    if (h->seg == NULL)
+    {
+        free(h);
+        napi_get_null(env, &result);
+        return result;
+    }
+
+    NAPI_CHECK(env, napi_create_external(env, h, NULL, NULL, &result));
+    return result;
+}
+
+
+static napi_value shm_publish(napi_env env, napi_callback_info info)
+{
+    size_t argc = 3;
+    napi_value argv[3], result;
+    char topic[SHM_MAX_TOPIC + 1];
+    void *data;
+    size_t len, tlen;
+    int count = 0;
+
+    NAPI_CHECK(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+    shmhandle_t *h = get_handle(env, argv[0]);
+    if (h == NULL || h->seg == NULL)
+        return NULL;
+    NAPI_CHECK(env, napi_get_value_string_utf8(env, argv[1], topic, sizeof(topic), &tlen));
+    NAPI_CHECK(env, napi_get_buffer_info(env, argv[2], &data, &len));
+
+    // Same as the broker.. every C node gets every publication
+    for (int i = 0; i < h->seg->nslots; i++)
+    {
+        shmslot_t *slot = &(h->seg->slots[i]);
+        if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SHM_SLOT_ACTIVE)
+            continue;
+
+        if (shmring_write(&slot->down, topic, data, len))
+        {
+            shmring_notify(&slot->down.seq, &slot->down.waiting);
+            count++;
+        }
+        else if (!shmlink_pid_alive(slot->pid))
+            __atomic_store_n(&slot->state, SHM_SLOT_FREE, __ATOMIC_SEQ_CST);
+        else
+            printf("WARNING! Shared memory slot %d is full.. dropping message on %s\n", i + 1, topic);
+    }
+
+    NAPI_CHECK(env, napi_create_int32(env, count, &result));
+    return result;
+}
+
+
+static napi_value shm_start(napi_env env, napi_callback_info info)
+{
+    size_t argc = 2;
+    napi_value argv[2], name;
+
+    NAPI_CHECK(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+    shmhandle_t *h = get_handle(env, argv[0]);
+    if (h == NULL || h->seg == NULL || h->running)
+        return NULL;
+
+    NAPI_CHECK(env, napi_create_string_utf8(env, "shmlink", NAPI_AUTO_LENGTH, &name));
+    NAPI_CHECK(env, napi_create_threadsafe_function(env, argv[1], NULL, name, 0, 1,
+                                                    NULL, NULL, NULL, call_js, &h->tsfn));
+    // The reader thread should not keep the node process alive
+    napi_unref_threadsafe_function(env, h->tsfn);
+
+    h->running = true;
+    if (pthread_create(&h->thread, NULL, shm_reader, h) != 0)
+    {
+        h->running = false;
+        napi_throw_error(env, NULL, "shmlink: unable to start the reader");
+    }
+    return NULL;
+}
+
+
+static napi_value shm_close(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value argv[1];
+
+    NAPI_CHECK(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+    shmhandle_t *h = get_handle(env, argv[0]);
+    if (h == NULL || h->seg == NULL)
+        return NULL;
+
+    if (h->running)
+    {
+        h->running = false;
+        shmring_notify(&h->seg->upseq, &h->seg->jwaiting);
+        pthread_join(h->thread, NULL);
+        napi_release_threadsafe_function(h->tsfn, napi_tsfn_abort);
+    }
+
+    // The C nodes find the J node gone through jpid
+    shmseg_close(h->seg);
+    h->seg = NULL;
+    shm_unlink(h->name);
+    return NULL;
+}
+
+
+static napi_value init(napi_env env, napi_value exports)
+{
+    napi_property_descriptor desc[] = {
+        { "create", NULL, shm_create, NULL, NULL, NULL, napi_default, NULL },
+        { "publish", NULL, shm_publish, NULL, NULL, NULL, napi_default, NULL },
+        { "start", NULL, shm_start, NULL, NULL, NULL, napi_default, NULL },
+        { "close", NULL, shm_close, NULL, NULL, NULL, napi_default, NULL }
+    };
+
+    NAPI_CHECK(env, napi_define_properties(env, exports, sizeof(desc) / sizeof(desc[0]), desc));
+    return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
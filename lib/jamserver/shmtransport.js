@@ -0,0 +1,50 @@
+'use strict';
+
+// =============================================================================
+// Shared memory transport between the J node and the C nodes on the device.
+// It is attached to the local MQTT client, so the rest of the J node does not
+// change: every publication also goes down the shared memory link and the
+// frames coming up the link are delivered as 'message' events with the same
+// topic and CBOR payload. The C nodes use the link if it is there and go
+// through the broker otherwise (see lib/jamlib/shmlink.h).
+// =============================================================================
+
+var shmlink;
+try {
+    shmlink = require('./shmlink');
+} catch (e) {
+    shmlink = null;
+}
+
+// Must match SHM_MAX_SLOTS in shmlink.h
+const MAX_CNODES = 16;
+
+module.exports.attach = function(mserv, port) {
+
+    if (shmlink === null) {
+        console.log("WARNING! Shared memory link is not built.. using the MQTT broker");
+        return false;
+    }
+
+    var link = shmlink.create('/jamshm-' + port, MAX_CNODES);
+    if (link === null) {
+        console.log("WARNING! Unable to create the shared memory link.. using the MQTT broker");
+        return false;
+    }
+
+    var publish = mserv.publish.bind(mserv);
+    mserv.publish = function(topic, msg, opts, cb) {
+        shmlink.publish(link, topic, Buffer.isBuffer(msg) ? msg : Buffer.from(msg));
+        return publish(topic, msg, opts, cb);
+    };
+
+    shmlink.start(link, function(topic, buf) {
+        mserv.emit('message', topic, buf);
+    });
+
+    process.on('exit', function() {
+        shmlink.close(link);
+    });
+
+    return true;
+}
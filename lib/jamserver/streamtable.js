@@ -0,0 +1,166 @@
+//===================================================================
+// Chunked byte string arguments. A C node sends a large byte string
+// argument of a request as a descriptor (tag Stream.TAG over
+// [length, fragment size]) and the bytes as fragments on
+// /level/func/stream: [actid, argument index, seq, bytes].
+// The fragments are copied into one buffer of the given length and the
+// request is held until all its arguments are complete. The number of
+// fragments received in order is acked (CHUNK-ACK) every half window..
+// the sender keeps at most a window beyond the last ack in flight.
+// See lib/jamlib/jamstream.h for the C side.
+//
+//===================================================================
+
+'use strict';
+
+const cbor = require('cbor');
+const globals = require('./constants').globals;
+const ActId = require('./actid');
+
+class StreamTable {
+
+    // ack(msg) publishes a CHUNK-ACK to the C node
+    constructor(ack) {
+
+        this.ack = ack;
+        this.streams = new Map();           // actid/index -> stream
+        this.early = new Map();             // fragments that came ahead of the request
+
+        setInterval(this.sweep.bind(this), globals.Stream.TIMEOUT / 2);
+    }
+
+    static isDescriptor(v) {
+        return v instanceof cbor.Tagged && v.tag === globals.Stream.TAG &&
+            Array.isArray(v.value) && v.value.length === 2;
+    }
+
+    // Hold a request with stream descriptors.. done(msg) is called with
+    // the buffers in place of the descriptors. False if there is nothing
+    // to wait for.
+    hold(msg, done) {
+
+        if (msg === null || typeof msg !== 'object' || !Array.isArray(msg.args))
+            return false;
+
+        var pending = [];
+        msg.args.forEach(function(a, i) {
+            if (StreamTable.isDescriptor(a))
+                pending.push(i);
+        });
+        if (pending.length === 0)
+            return false;
+
+        // A resent request.. the first one is run
+        if (this.streams.has(msg.actid + '/' + pending[0]))
+            return true;
+
+        var req = {msg: msg, done: done, count: pending.length};
+        for (var i of pending) {
+            var key = msg.actid + '/' + i;
+            var length = msg.args[i].value[0];
+            var chunk = msg.args[i].value[1];
+            var nchunks = Math.ceil(length / chunk);
+
+            var s = {req: req, index: i, buf: Buffer.alloc(length), chunk: chunk, nchunks: nchunks,
+                     have: new Uint8Array(nchunks), next: 0, acked: 0, done: false, time: Date.now()};
+            this.streams.set(key, s);
+
+            var e = this.early.get(key);
+            if (e !== undefined) {
+                this.early.delete(key);
+                for (var f of e.frames)
+                    this.store(s, f[0], f[1]);
+            }
+        }
+        return true;
+    }
+
+    // A fragment from /level/func/stream
+    chunk(buf) {
+
+        var f;
+        try {
+            f = cbor.decodeFirstSync(buf);
+        } catch (e) {
+            return;
+        }
+        if (!Array.isArray(f) || f.length !== 4 || !Buffer.isBuffer(f[3]))
+            return;
+
+        var key = ActId.fromWire(f[0]) + '/' + f[1];
+        var s = this.streams.get(key);
+        if (s !== undefined) {
+            this.store(s, f[2], f[3]);
+            return;
+        }
+
+        // Ahead of its request.. or for another J node on this broker
+        var e = this.early.get(key);
+        if (e === undefined) {
+            e = {frames: [], time: Date.now()};
+            this.early.set(key, e);
+        }
+        if (e.frames.length < globals.Stream.EARLY)
+            e.frames.push([f[2], f[3]]);
+    }
+
+    store(s, seq, data) {
+
+        // Fragments sent again after the last ack was lost
+        if (s.done) {
+            this.sendAck(s);
+            return;
+        }
+        if (seq >= s.nchunks || s.have[seq])
+            return;
+
+        var offset = seq * s.chunk;
+        if (data.length !== Math.min(s.chunk, s.buf.length - offset))
+            return;
+
+        data.copy(s.buf, offset);
+        s.have[seq] = 1;
+        s.time = Date.now();
+        while (s.next < s.nchunks && s.have[s.next])
+            s.next++;
+
+        if (s.next === s.nchunks) {
+            s.done = true;
+            s.have = null;
+            this.sendAck(s);
+            s.req.msg.args[s.index] = s.buf;
+            if (--s.req.count === 0)
+                s.req.done(s.req.msg);
+        } else if (s.next - s.acked >= globals.Stream.WINDOW / 2)
+            this.sendAck(s);
+    }
+
+    sendAck(s) {
+
+        var msg = s.req.msg;
+        s.acked = s.next;
+        this.ack({"cmd": "CHUNK-ACK", "opt": "-", "cond": "-", "condvec": 0, "actname": "-",
+                  "actid": msg.actid, "actarg": msg.actarg, "args": [s.index, s.next]});
+    }
+
+    // Completed streams are kept for a while to answer the resent requests
+    sweep() {
+
+        var now = Date.now();
+        for (var [key, s] of this.streams) {
+            if (now - s.time < globals.Stream.TIMEOUT)
+                continue;
+            if (!s.done) {
+                console.log("WARNING! Stream " + key + " of " + s.req.msg.actname + " timed out");
+                s.req.count = -1;
+            }
+            this.streams.delete(key);
+        }
+        for (var [ekey, e] of this.early) {
+            if (now - e.time >= globals.Stream.TIMEOUT)
+                this.early.delete(ekey);
+        }
+    }
+}
+
+module.exports = StreamTable;
@@ -0,0 +1,112 @@
+//===================================================================
+// Coarse timer wheel. All the deadlines share one interval timer that
+// ticks every `tick` milliseconds; a deadline fires on the first tick
+// at or after it is due. Good enough for retry timers that are a few
+// hundred milliseconds long and much cheaper than a setTimeout each
+// when thousands of them are outstanding.
+//
+// schedule() returns a handle that is given to cancel(). Cancelling
+// only marks the handle.. it is dropped when its slot comes around.
+//
+//===================================================================
+
+'use strict';
+
+class TimerWheel {
+
+    constructor(tick, nslots) {
+        this.tick = tick;
+        this.nslots = nslots;
+        this.slots = new Array(nslots);
+        for (var i = 0; i < nslots; i++)
+            this.slots[i] = [];
+        this.current = 0;
+        this.count = 0;
+        this.timer = undefined;
+        this.base = 0;
+    }
+
+    schedule(delay, fn, arg) {
+        if (this.timer === undefined)
+            this._start();
+
+        // Round up so a deadline never fires early
+        var elapsed = Date.now() - this.base;
+        var due = Math.ceil((elapsed + delay) / this.tick);
+        if (due <= this.current)
+            due = this.current + 1;
+
+        var handle = {due: due, fn: fn, arg: arg, live: true};
+        this.slots[due % this.nslots].push(handle);
+        this.count++;
+        return handle;
+    }
+
+    cancel(handle) {
+        if (handle !== undefined && handle.live) {
+            handle.live = false;
+            this.count--;
+        }
+    }
+
+    _start() {
+        this.base = Date.now();
+        this.current = 0;
+        this.timer = setInterval(this._advance.bind(this), this.tick);
+        // The wheel should not keep the node process alive
+        if (this.timer.unref !== undefined)
+            this.timer.unref();
+    }
+
+    _stop() {
+        clearInterval(this.timer);
+        this.timer = undefined;
+        for (var i = 0; i < this.nslots; i++)
+            this.slots[i] = [];
+    }
+
+    // Catch up with the wall clock.. the interval can run late when the
+    // event loop is busy.
+    _advance() {
+        var target = Math.floor((Date.now() - this.base) / this.tick);
+        var expired = [];
+
+        while (this.current < target) {
+            this.current++;
+            var slot = this.slots[this.current % this.nslots];
+            if (slot.length === 0)
+                continue;
+
+            var keep = [];
+            for (var i = 0; i < slot.length; i++) {
+                var h = slot[i];
+                if (!h.live)
+                    continue;
+                if (h.due <= this.current)
+                    expired.push(h);
+                else
+                    keep.push(h);
+            }
+            this.slots[this.current % this.nslots] = keep;
+        }
+
+        // Fire after the wheel is consistent.. the handlers reschedule
+        for (var j = 0; j < expired.length; j++) {
+            var e = expired[j];
+            if (!e.live)
+                continue;
+            e.live = false;
+            this.count--;
+            try {
+                e.fn(e.arg);
+            } catch (err) {
+                console.log(err);
+            }
+        }
+
+        if (this.count === 0)
+            this._stop();
+    }
+}
+
+module.exports = TimerWheel;
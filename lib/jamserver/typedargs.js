@@ -0,0 +1,113 @@
+//===================================================================
+// Typed array arguments. The C side sends int32[], float32[] and
+// float64[] arguments as RFC 8746 tagged byte strings (tags 64-87).
+// They come out of the decoder as Tagged items and are turned into
+// TypedArrays over the received bytes.. no element is boxed. Going
+// out, a TypedArray is sent the same way in the byte order of this
+// host.
+//
+//===================================================================
+
+'use strict';
+
+const cbor = require('cbor');
+const os = require('os');
+
+const LITTLE = os.endianness() === 'LE';
+
+// tag = 64 + (float << 4) + (signed << 3) + (little endian << 2) + size
+const TYPES = {
+    64: Uint8Array,
+    65: Uint16Array,
+    66: Uint32Array,
+    68: Uint8ClampedArray,
+    69: Uint16Array,
+    70: Uint32Array,
+    72: Int8Array,
+    73: Int16Array,
+    74: Int32Array,
+    77: Int16Array,
+    78: Int32Array,
+    81: Float32Array,
+    82: Float64Array,
+    85: Float32Array,
+    86: Float64Array
+};
+
+const TAGS = new Map([
+    [Uint8Array, 64],
+    [Uint8ClampedArray, 68],
+    [Int8Array, 72],
+    [Uint16Array, LITTLE ? 69 : 65],
+    [Uint32Array, LITTLE ? 70 : 66],
+    [Int16Array, LITTLE ? 77 : 73],
+    [Int32Array, LITTLE ? 78 : 74],
+    [Float32Array, LITTLE ? 85 : 81],
+    [Float64Array, LITTLE ? 86 : 82]
+]);
+
+class TypedArgs {
+
+    static fromWire(v) {
+
+        if (v === null || typeof v !== 'object' || !Buffer.isBuffer(v.value))
+            return v;
+        var T = TYPES[v.tag];
+        if (T === undefined)
+            return v;
+
+        var buf = v.value;
+        var size = T.BYTES_PER_ELEMENT;
+        if (buf.length % size !== 0)
+            return v;
+
+        // A view when the bytes can be used as they are
+        var little = size === 1 || (v.tag & 4) !== 0;
+        if (little === LITTLE && buf.byteOffset % size === 0)
+            return new T(buf.buffer, buf.byteOffset, buf.length / size);
+
+        var bytes = new Uint8Array(buf.length);
+        bytes.set(buf);
+        if (little !== LITTLE) {
+            for (var i = 0; i < bytes.length; i += size)
+                bytes.subarray(i, i + size).reverse();
+        }
+        return new T(bytes.buffer);
+    }
+
+    static toWire(v) {
+
+        var tag = ArrayBuffer.isView(v) ? TAGS.get(v.constructor) : undefined;
+        if (tag === undefined || Buffer.isBuffer(v))
+            return v;
+        return new cbor.Tagged(tag, Buffer.from(v.buffer, v.byteOffset, v.byteLength));
+    }
+
+    // Message as it should be encoded (the message is not changed)
+    static wire(msg) {
+
+        if (msg === null || typeof msg !== 'object' || !Array.isArray(msg.args) ||
+            !msg.args.some((a) => TAGS.has(a !== null && a !== undefined ? a.constructor : a)))
+            return msg;
+        var omsg = Object.assign({}, msg);
+        omsg.args = msg.args.map(TypedArgs.toWire);
+        return omsg;
+    }
+
+    // Decoded message.. the typed arrays are turned into TypedArrays
+    static normalize(msg) {
+
+        if (msg !== null && typeof msg === 'object' && Array.isArray(msg.args))
+            msg.args = TypedArgs.args(msg.args);
+        return msg;
+    }
+
+    static args(args) {
+
+        for (var i = 0; i < args.length; i++)
+            args[i] = TypedArgs.fromWire(args[i]);
+        return args;
+    }
+}
+
+module.exports = TypedArgs;
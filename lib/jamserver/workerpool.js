@@ -0,0 +1,190 @@
+//===================================================================
+// Pool of workers running the J functions. Worker 0 (the primary)
+// runs the user program; the others only register the activities
+// (userServices in the compiled program) and say READY.
+//
+// Jobs for an activity that uses the program's top-level state are
+// pinned to the primary.. the rest go through a shared queue to the
+// first idle worker. Results of a remote call go back to the worker
+// that made the call - its waitMatrix is waiting for them.
+//
+// With worker_threads the raw CBOR of a request is handed over as a
+// transferred ArrayBuffer and decoded in the worker, instead of the
+// args being cloned on the way in.
+//
+//===================================================================
+
+'use strict';
+
+const threads = loadThreads();
+
+// Messages from a worker that end the job it was given
+const COMPLETIONS = new Set(['DONE', 'REXEC-RES', 'MEXEC-RES', 'REXEC-ERR', 'MEXEC-ERR', 'PIN']);
+
+// Jobs carrying the results of a remote call made by a worker
+const RESULTS = new Set(['REXEC-RES', 'REXEC-ERR', 'MEXEC-RES']);
+
+class WorkerPool {
+
+    constructor() {
+        this.workers = [];
+        this.shared = [];
+        this.stateful = new Set();
+        this.statefulKnown = false;     // helpers wait until the primary tells us
+        this.callers = new Map();
+        this.onmessage = undefined;
+    }
+
+    static get threads() {
+        return threads;
+    }
+
+    add(worker) {
+
+        var w = {worker: worker, index: this.workers.length, ready: this.workers.length === 0, inflight: 0, queue: []};
+        var that = this;
+
+        if (w.index === 0 && this.pending !== undefined) {
+            w.queue = this.pending;
+            this.pending = undefined;
+        }
+
+        this.workers.push(w);
+        if (threads !== undefined && worker instanceof threads.Worker)
+            worker.on('message', function(msg) { that.processMsg(w, msg); });
+        else
+            worker.onmessage = function(ev) { that.processMsg(w, ev.data); };
+
+        return w.index;
+    }
+
+    get size() {
+        return this.workers.length;
+    }
+
+    setStateful(names) {
+        names.forEach((n) => this.stateful.add(n));
+
+        // Queued before we knew.. move them over
+        var primary = this.primaryQueue();
+        this.shared = this.shared.filter((job) => {
+            if (job.name === undefined || !this.stateful.has(job.name))
+                return true;
+            primary.push(job);
+            return false;
+        });
+    }
+
+    enqueue(job) {
+
+        if (RESULTS.has(job.cmd) && job.cbid !== undefined) {
+            // The caller may be blocked inside the call.. do not queue
+            var idx = this.callers.get(job.cbid);
+            this.callers.delete(job.cbid);
+            var w = this.workers[idx !== undefined ? idx : 0];
+            if (w !== undefined) {
+                this.post(w, job);
+                return;
+            }
+        }
+
+        if (job.name !== undefined && this.stateful.has(job.name))
+            this.primaryQueue().push(job);
+        else
+            this.shared.push(job);
+
+        this.dispatch();
+    }
+
+    // Configuration and ncache updates go to every worker
+    broadcast(msg) {
+        this.workers.forEach((w) => this.post(w, msg));
+    }
+
+    processMsg(w, msg) {
+
+        if (COMPLETIONS.has(msg.cmd) && w.inflight > 0)
+            w.inflight--;
+
+        switch (msg.cmd) {
+            case 'REXEC-SYN':
+            case 'MEXEC-SYN':
+                this.callers.set(msg.cbid, w.index);
+            break;
+            case 'PIN':
+                // The activity needed state that only the primary has
+                this.primaryQueue().push(msg.job);
+                this.setStateful([msg.name]);
+                this.dispatch();
+            return;
+            case 'SET-CONF':
+                if (msg.opt === 'READY') {
+                    w.ready = true;
+                    this.dispatch();
+                    return;
+                } else if (msg.opt === 'STATEFUL') {
+                    this.setStateful(msg.data);
+                    this.statefulKnown = true;
+                    this.dispatch();
+                    return;
+                }
+            break;
+        }
+
+        if (this.onmessage !== undefined)
+            this.onmessage(msg);
+        this.dispatch();
+    }
+
+    dispatch() {
+
+        for (var i = 0; i < this.workers.length; i++) {
+            var w = this.workers[i];
+            if (w.inflight > 0)
+                continue;
+            if (w.queue.length > 0)
+                this.post(w, w.queue.shift());
+            else if (w.ready && (w.index === 0 || this.statefulKnown) && this.shared.length > 0)
+                this.post(w, this.shared.shift());
+        }
+    }
+
+    post(w, job) {
+
+        w.inflight++;
+        if (threads !== undefined && w.worker instanceof threads.Worker) {
+            if (job.raw !== undefined) {
+                // Own copy of the bytes.. a Buffer can be a slice of a shared pool
+                var ab = new ArrayBuffer(job.raw.length);
+                new Uint8Array(ab).set(job.raw);
+                job.raw = ab;
+                delete(job.args);
+                w.worker.postMessage(job, [ab]);
+            } else
+                w.worker.postMessage(job);
+        } else {
+            delete(job.raw);
+            w.worker.postMessage(job);
+        }
+    }
+
+    primaryQueue() {
+        // Jobs can come in before the workers are started
+        if (this.workers.length === 0) {
+            if (this.pending === undefined)
+                this.pending = [];
+            return this.pending;
+        }
+        return this.workers[0].queue;
+    }
+}
+
+function loadThreads() {
+    try {
+        return require('worker_threads');
+    } catch (e) {
+        return undefined;
+    }
+}
+
+module.exports = WorkerPool;
@@ -1,5 +1,43 @@
 var types = require('./types');
 
+// C declaration of a parameter.. an array has the brackets after the name
+function paramDecl(type, name) {
+    if (type.endsWith('[]')) {
+        return type.slice(0, -2) + ' ' + name + '[]';
+    }
+    return type + ' ' + name;
+}
+
+// Arguments for jam_rexec_*() and jam_lexec_async(). An array goes with its
+// element count: the declared size, or else the int parameter after it.
+function callArgs(fname, params) {
+    var args = [];
+    for (var i = 0; i < params.length; i++) {
+        args.push(params[i].name);
+        if (params[i].type.endsWith('[]')) {
+            if (params[i].size) {
+                args.push(params[i].size);
+            } else if (i + 1 < params.length && params[i + 1].type === 'int') {
+                args.push(params[i + 1].name);
+            } else {
+                throw "Array parameter " + params[i].name + " of " + fname + " needs a size or an int count after it";
+            }
+        }
+    }
+    return args;
+}
+
+// C side parameters of a J activity with the names of the J parameters
+function namedParams(cParams, jParams) {
+    return cParams.map(function(p, i) {
+        return {
+            type: typeof(p) === 'object' ? p.type : p,
+            name: jParams[i],
+            size: typeof(p) === 'object' ? p.size : undefined
+        };
+    });
+}
+
 module.exports = {
     CreateCASyncJSFunction: function(fname, jCond, params) {
         var ps = [];
@@ -26,10 +64,9 @@ module.exports = {
     CreateCASyncCFunction: function(fname, params, stmt) {
         var cout = "";
         var typed_params = [];
-        var untyped_params = [''];
+        var untyped_params = [''].concat(callArgs(fname, params));
         params.forEach(function(p) {
-            typed_params.push(p.type + ' ' + p.name);
-            untyped_params.push(p.name);
+            typed_params.push(paramDecl(p.type, p.name));
         });
 
         // Main function
@@ -78,7 +115,7 @@ module.exports = {
         var cout = "";
         var typed_params = [];
         params.forEach(function(p) {
-            typed_params.push(p.type + ' ' + p.name);
+            typed_params.push(paramDecl(p.type, p.name));
         });
 
         // Main function
@@ -92,7 +129,7 @@ module.exports = {
         for (var i = 0; i < params.length; i++) {
             funcCall += 'cmd->args[' + i + '].val.' + types.getJamlibCode(params[i].type);
             if (i < params.length - 1) {
-                cout += ', ';
+                funcCall += ', ';
             }
         }
         funcCall += ')';
@@ -135,18 +172,13 @@ module.exports = {
     },
     CreateJSASyncCFunction: function(fname, cParams, jParams, jCond) {
         var ps = [],
-            qs = [],
             c_codes = [];
+        var params = namedParams(cParams, jParams);
+        var qs = callArgs(fname, params);
 
-        for (var i = 0; i < cParams.length; i++) {
-            qs.push(jParams[i]);
-            if (typeof(cParams[i]) === 'object') {
-                c_codes.push(types.getCCode(cParams[i].type));
-                ps.push(cParams[i].type + ' ' + jParams[i]);
-            } else {
-                c_codes.push(types.getCCode(cParams[i]));
-                ps.push(cParams[i] + ' ' + jParams[i]);
-            }
+        for (var i = 0; i < params.length; i++) {
+            c_codes.push(types.getCCode(params[i].type));
+            ps.push(paramDecl(params[i].type, params[i].name));
         }
 
         var cout = "void " + fname + "(" + ps.join(', ') + ") {\n";
@@ -191,20 +223,14 @@ module.exports = {
         };
     },
     CreateJSSyncCFunction: function(dspec, fname, cParams, jParams, jCond) {
-        var ps = [],
-            qs = [];
+        var ps = [];
         var c_codes = [];
+        var params = namedParams(cParams, jParams);
+        var qs = callArgs(fname, params);
 
-        for (var i = 0; i < cParams.length; i++) {
-            var typeName;
-            if (typeof(cParams[i]) === 'object') {
-                typeName = cParams[i].type;
-            } else {
-                typeName = cParams[i];
-            }
-            ps.push(typeName + ' ' + jParams[i]);
-            qs.push(jParams[i]);
-            c_codes.push(types.getCCode(typeName));
+        for (var i = 0; i < params.length; i++) {
+            ps.push(paramDecl(params[i].type, params[i].name));
+            c_codes.push(types.getCCode(params[i].type));
         }
 
         var cout = dspec + " " + fname + "(" + ps.join(', ') + ") {\n";
@@ -13,12 +13,17 @@ function compile(cInput, jsInput, jsPort) {
     // annotated_JS = "/* @flow */\n" + struct_objects + annotated_JS + this.generate_js_signatures();
 
     var preamble = "\njsys = jworklib.getjsys();\n";
+    // The helper workers have no jdata (see statefulActivities)
+    var svcpreamble = preamble;
     if (jsResults.hasJdata)
         preamble += "jman = new JAMManager(jworklib.getcmdopts(), jsys);\n";
 
     return {
         'C': cResults.C,
-        'JS': jsResults.JS.requires + '\nfunction userProgram() {' + preamble + cResults.JS + jsResults.JS.jsout + '\n}\njworklib.run(function() { console.log("JAMLib 1.0beta Initialized."); userProgram(); } );\n',
+        'JS': jsResults.JS.requires + '\nfunction userProgram() {' + preamble + cResults.JS + jsResults.JS.jsout + '\n}\n' +
+              // Helper workers only define the activities (see jamserver/workerpool.js)
+              'function userServices() {' + svcpreamble + cResults.JS + jsResults.JS.svcout + '\n}\n' +
+              'jworklib.run(function() { console.log("JAMLib 1.0beta Initialized."); userProgram(); }, userServices, ' + JSON.stringify(jsResults.JS.stateful) + ');\n',
         'annotated_JS': jsResults.JS.jsout + cResults.JS,
         'maxLevel': jsResults.maxLevel,
         'hasJdata': jsResults.hasJdata,
@@ -23,7 +23,18 @@ var jamCTranslator = {
     Namespace_spec: function(_, namespace) {
         return namespace.sourceString;
     },
-    Sync_activity: function(_, specs, jCond_spec, declarator, namespace, stmt) {
+    // Stack size in bytes
+    Stack_spec: function(_, _1, size, unit, _2) {
+        var n = parseInt(size.sourceString);
+        var u = unit.sourceString.toUpperCase();
+        if (u === 'K') {
+            n *= 1024;
+        } else if (u === 'M') {
+            n *= 1024 * 1024;
+        }
+        return n;
+    },
+    Sync_activity: function(_, specs, jCond_spec, declarator, namespace, stack_spec, stmt) {
         var c_codes = [];
         var jCond = {
             source: "true",
@@ -51,7 +62,8 @@ var jamCTranslator = {
         symbolTable.addActivity(funcname, {
             activityType: "sync",
             language: "c",
-            codes: c_codes
+            codes: c_codes,
+            stack: stackSize(stack_spec)
         });
 
         var rtype = specs.cTranslator;
@@ -75,7 +87,7 @@ var jamCTranslator = {
             annotated_JS: js_output.annotated_JS
         };
     },
-    Async_activity: function(_, jCond_spec, decl, namespace, stmt) {
+    Async_activity: function(_, jCond_spec, decl, namespace, stack_spec, stmt) {
         var c_codes = [];
         var jCond = {
             source: "true",
@@ -98,7 +110,8 @@ var jamCTranslator = {
         symbolTable.addActivity(funcname, {
             activityType: "async",
             language: "c",
-            codes: c_codes
+            codes: c_codes,
+            stack: stackSize(stack_spec)
         });
         if (namespace.numChildren > 0) {
             // funcname = namespc + "_func_" + namespace_funcs[namespc].indexOf(funcname);
@@ -158,7 +171,10 @@ var jamCTranslator = {
         if (params.numChildren > 0) {
             var tempParams = params.jamCTranslator[0];
             for (var i = 0; i < tempParams.length; i++) {
-                if (tempParams[i].hasOwnProperty("type")) {
+                if (tempParams[i].hasOwnProperty("size")) {
+                    // arrays keep their size.. it goes with the call
+                    parameters.push(tempParams[i]);
+                } else if (tempParams[i].hasOwnProperty("type")) {
                     parameters.push(tempParams[i].type);
                 } else {
                     parameters.push(tempParams[i]);
@@ -234,7 +250,15 @@ var jamCTranslator = {
         return {
             pointer: pointer.cTranslator,
             name: dir_decl.name,
-            params: dir_decl.params
+            params: dir_decl.params,
+            size: dir_decl.size
+        };
+    },
+    // An array.. size is '' when there is nothing between the brackets
+    Dir_declarator_PMember: function(dir_declarator, member) {
+        return {
+            name: dir_declarator.jamCTranslator.name,
+            size: member.sourceString.slice(1, -1).trim()
         };
     },
     Dir_declarator_PCall: function(name, params) {
@@ -259,6 +283,13 @@ var jamCTranslator = {
         if (decl.jamCTranslator.pointer !== '') {
             varType += decl.jamCTranslator.pointer;
         }
+        if (decl.jamCTranslator.size !== undefined) {
+            return {
+                type: varType + '[]',
+                name: decl.jamCTranslator.name,
+                size: decl.jamCTranslator.size
+            };
+        }
         return {
             type: varType,
             name: decl.jamCTranslator.name
@@ -375,7 +406,7 @@ cTranslator.Primary_expr = function(node) {
             if (symbol.jdata_type === "logger" || symbol.jdata_type === "shuffler") {
                 throw 'Cannot read values from ' + symbol.jdata_type + ' ' + node.sourceString;
             } else if (symbol.jdata_type === "broadcaster") {
-                return `${types.getStringCast(symbol.type_spec)}(get_bcast_next_value(${node.sourceString}))`;
+                return `${types.getStringCast(symbol.type_spec)}(get_bcast_value(${node.sourceString}))`;
             }
         }
     }
@@ -396,6 +427,9 @@ cTranslator.Assign_stmt_Struct = function(id, _1, _2, members, _3, _4) {
                 var child = rest.child(i).jamCTranslator;
                 assignmentMap.set(child.name, child.value);
             }
+            if (symbol.jdata_type === "logger" || symbol.jdata_type === "shuffler") {
+                return jdata.createStructLog(id.sourceString, symbol.type_spec, assignmentMap);
+            }
             var structCall = jdata.createStructCallParams(symbol.type_spec.entries, '', assignmentMap);
             return `jamdata_log_to_server("global", "${id.sourceString}", "${structCall.formatString}", ${structCall.valueArray.join(", ")});`;
         }
@@ -412,8 +446,7 @@ cTranslator.Assign_stmt_Expr = function(id, _1, expr, _2) {
         var rhs = symbolTable.get(expr.sourceString);
         if (rhs !== undefined && rhs.type === "jdata") {
             if (rhs.type_spec instanceof Object) {
-                var res = jdata.createStructDecode(rhs.type_spec.name, rhs.type_spec.entries, '');
-                return `jamdata_decode("${res.formatString}", get_bcast_next_value(${expr.sourceString}), ${res.count}, &${id.sourceString}, ${res.offsetArray.join(', ')});\n`;
+                return jdata.createStructRead(id.sourceString, expr.sourceString, rhs.type_spec);
             }
         }
     }
@@ -477,6 +510,14 @@ function flattenIterNodes(nodes) {
     return result;
 }
 
+// Stack size given with the activity.. 0 runs it on the activity thread's stack
+function stackSize(stack_spec) {
+    if (stack_spec.numChildren > 0) {
+        return stack_spec.child(0).jamCTranslator;
+    }
+    return 0;
+}
+
 // Comparison function for sorting nodes based on their source's start index.
 function compareByInterval(node, otherNode) {
     return node.source.startIdx - otherNode.source.startIdx;
@@ -512,7 +553,7 @@ function parseArrayList(list, sep) {
 function generateCActivities() {
     var cout = '';
     for (const [name, values] of symbolTable.activities.c) {
-        cout += 'activity_regcallback(js->atable, "' + name + '", ' + values.activityType.toUpperCase() + ', "' + values.codes.join('') + '", call' + name + ');\n';
+        cout += 'activity_regcallback(js->atable, "' + name + '", ' + values.activityType.toUpperCase() + ', "' + values.codes.join('') + '", call' + name + ', ' + (values.stack || 0) + ');\n';
     }
     return cout;
 }
@@ -555,8 +596,8 @@ function generate_taskmain() {
 
     user_setup();
 
-    taskcreate(jam_event_loop, js, 50000);
-    taskcreate(jam_run_app, cptr, 50000);
+    taskcreate(jam_event_loop, js, JAM_TASK_STACK);
+    taskcreate(jam_run_app, cptr, JAM_TASK_STACK);
   }\n`;
     return cout;
 }
@@ -584,6 +625,7 @@ function translate(tree) {
     cout += 'char dev_tag[32] = { 0 };\n';
     cout += 'int ndevices;\n';
     cout += jdata.createCVariables(symbolTable.getGlobals());
+    cout += jdata.createStructCodecs(symbolTable.getGlobals());
     cout += results.C;
     cout += generate_c_activity_wrappers();
     cout += generate_setup();
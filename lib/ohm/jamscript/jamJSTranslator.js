@@ -25,36 +25,64 @@ var maxLevel = 1;
 var jamJSTranslator = {
     Program: function(directives, elements) {
         var jsout = "";
+        var svcout = "";            // what a helper worker runs: no top-level statements
         var annotated_JS = "";
         var hasJdata = false;
         var jviewOut = "";
+        var topVars = new Set();
+        var topFuncs = new Map();
+        var jconds = [];
 
         //    jsout += "var jcondition = new Map();\n";
         callGraph.addFunction('js', 'root');
         currentFunction = "root";
         for (var i = 0; i < elements.children.length; i++) {
-            if (elements.child(i).child(0).child(0).ctorName === "Activity_def") {
+            var elem = elements.child(i).child(0).child(0);
+            if (elem.ctorName === "Activity_def") {
                 // var output = elements.child(i).child(0).child(0).jamJSTranslator;
                 // cout += output.C + '\n';
                 // jsout += output.JS + '\n';
                 // annotated_JS += output.annotated_JS + '\n';
-                jsout += elements.child(i).child(0).child(0).jamJSTranslator;
-            } else if (elements.child(i).child(0).child(0).ctorName === "Jconditional") {
-                jsout += elements.child(i).child(0).child(0).jamJSTranslator;
-            } else if (elements.child(i).child(0).child(0).ctorName === "Jdata_decl") {
+                var aout = elem.jamJSTranslator;
+                jsout += aout;
+                svcout += aout;
+            } else if (elem.ctorName === "Jconditional") {
+                var cout = elem.jamJSTranslator;
+                jsout += cout;
+                jconds.push(cout);
+            } else if (elem.ctorName === "Jdata_decl") {
+                // Only the primary worker has the jdata objects (one clock and
+                // one set of redis connections).. like a top-level variable
                 hasJdata = true;
-                jsout += elements.child(i).child(0).child(0).jamJSTranslator;
-            } else if (elements.child(i).child(0).child(0).ctorName === "Jview_decl") {
-                var out = elements.child(i).child(0).child(0).jamJSTranslator;
+                var dout = elem.jamJSTranslator;
+                jsout += dout;
+                jdataNames(dout, topVars);
+            } else if (elem.ctorName === "Jview_decl") {
+                var out = elem.jamJSTranslator;
                 jviewOut = out.jview;
                 jsout += out.js;
                 annotated_JS += out.js;
             } else {
                 currentFunction = "root";
-                jsout += elements.child(i).child(0).child(0).es5Translator + '\n';
+                var sout = elem.es5Translator + '\n';
+                jsout += sout;
+                if (elem.ctorName === "FunctionDeclaration") {
+                    svcout += sout;
+                    topFuncs.set(elem.child(1).sourceString, elem.sourceString);
+                } else if (elem.ctorName === "VariableStatement")
+                    declaredNames(elem, topVars);
             }
         }
 
+        // Jconditionals on jdata stay with the primary worker and so do the
+        // activities guarded by them
+        jconds.forEach(function(cout) {
+            if (usesNames(cout, topVars))
+                jcondNames(cout, topVars);
+            else
+                svcout += cout;
+        });
+
         var requires = '';
         requires += "const Worker = require('tiny-worker');\n";
         requires += "const jworklib = require('jamserver/jworklib');\n";
@@ -70,7 +98,7 @@ var jamJSTranslator = {
         annotated_JS = requires + annotated_JS;
 
         return {
-            'JS': {requires: requires, jsout: jsout},
+            'JS': {requires: requires, jsout: jsout, svcout: svcout, stateful: statefulActivities(topVars, topFuncs)},
             'annotated_JS': annotated_JS,
             'jView': jviewOut,
             'maxLevel': maxLevel,
@@ -84,15 +112,20 @@ var jamJSTranslator = {
         return type.sourceString;
     },
     Jdata_spec_specified: function(type_spec, id, _1, jdata_type, _2, level, _3, _4) {
+        if (level.sourceString === 'last' && jdata_type.jamJSTranslator !== 'broadcaster') {
+            throw 'Only broadcasters can keep the last value: ' + id.sourceString;
+        }
         symbolTable.set(id.sourceString, {
             type: "jdata",
             type_spec: type_spec.jamJSTranslator,
-            jdata_type: jdata_type.jamJSTranslator
+            jdata_type: jdata_type.jamJSTranslator,
+            // C reads return the newest value instead of the next queued one
+            latest: level.sourceString === 'last'
         });
         if (jdata_type.jamJSTranslator === 'logger') {
-            return `var ${id.sourceString} = new JAMLogger(jman, "${id.sourceString}");\njworklib.addLogger("${id.sourceString}", ${id.sourceString}.getMyDataStream());`;
+            return `var ${id.sourceString} = new JAMLogger(jman, "${id.sourceString}");\njworklib.addLogger("${id.sourceString}", ${id.sourceString}.getMyDataStream());` + structSchema(id.sourceString, type_spec.jamJSTranslator);
         } else if (jdata_type.jamJSTranslator === 'broadcaster') {
-            return `var ${id.sourceString} = new JAMBroadcaster('${id.sourceString}', jman);\njworklib.addBroadcaster("${id.sourceString}", ${id.sourceString});`;
+            return `var ${id.sourceString} = new JAMBroadcaster('${id.sourceString}', jman);\njworklib.addBroadcaster("${id.sourceString}", ${id.sourceString});` + structSchema(id.sourceString, type_spec.jamJSTranslator);
         } else if (jdata_type.jamJSTranslator === 'shuffler') {
             return `var ${id.sourceString} = new JAMShuffler('${id.sourceString}', jman);\njworklib.addJAMShuffler("${id.sourceString}", ${id.sourceString});`;
         } else {
@@ -107,15 +140,77 @@ var jamJSTranslator = {
         });
 
         if (jdata_type.jamJSTranslator === 'logger') {
-            return `var ${id.sourceString} = new JAMLogger(jman, "${id.sourceString}");\njworklib.addLogger("${id.sourceString}", ${id.sourceString}.getMyDataStream());`;
+            return `var ${id.sourceString} = new JAMLogger(jman, "${id.sourceString}");\njworklib.addLogger("${id.sourceString}", ${id.sourceString}.getMyDataStream());` + structSchema(id.sourceString, type_spec.jamJSTranslator);
         } else if (jdata_type.jamJSTranslator === 'broadcaster') {
-            return `var ${id.sourceString} = new JAMBroadcaster('${id.sourceString}', jman);\njworklib.addBroadcaster("${id.sourceString}", ${id.sourceString});`;
+            return `var ${id.sourceString} = new JAMBroadcaster('${id.sourceString}', jman);\njworklib.addBroadcaster("${id.sourceString}", ${id.sourceString});` + structSchema(id.sourceString, type_spec.jamJSTranslator);
         } else if (jdata_type.jamJSTranslator === 'shuffler') {
             return `var ${id.sourceString} = new JAMShuffler('${id.sourceString}', jman);\njworklib.addShuffler("${id.sourceString}", ${id.sourceString});`;
         } else {
             return;
         }
     },
+    Jdata_spec_windowed: function(type_spec, id, _1, jdata_type, window, _2) {
+        if (jdata_type.jamJSTranslator !== 'logger' || (type_spec.jamJSTranslator !== 'int' && type_spec.jamJSTranslator !== 'float')) {
+            throw 'Only int and float loggers can be windowed: ' + id.sourceString;
+        }
+        symbolTable.set(id.sourceString, {
+            type: "jdata",
+            type_spec: type_spec.jamJSTranslator,
+            jdata_type: jdata_type.jamJSTranslator,
+            window: window.jamJSTranslator
+        });
+        // The C side sends one aggregate {count, min, max, mean, last, ..} per window
+        return `var ${id.sourceString} = new JAMLogger(jman, "${id.sourceString}");\njworklib.addLogger("${id.sourceString}", ${id.sourceString}.getMyDataStream());`;
+    },
+    Jdata_spec_compact: function(type_spec, id, _1, jdata_type, compact, _2) {
+        if (jdata_type.jamJSTranslator !== 'logger' || (type_spec.jamJSTranslator !== 'int' && type_spec.jamJSTranslator !== 'float')) {
+            throw 'Only int and float loggers can be compact: ' + id.sourceString;
+        }
+        symbolTable.set(id.sourceString, {
+            type: "jdata",
+            type_spec: type_spec.jamJSTranslator,
+            jdata_type: jdata_type.jamJSTranslator,
+            compact: compact.jamJSTranslator
+        });
+        // The datastream expands the blocks into samples
+        return `var ${id.sourceString} = new JAMLogger(jman, "${id.sourceString}");\njworklib.addLogger("${id.sourceString}", ${id.sourceString}.getMyDataStream());`;
+    },
+    Compact_spec: function(_1, _2, count, _3, age, _4) {
+        var spec = {
+            count: count.jamJSTranslator,
+            age: age.numChildren > 0 ? age.child(0).jamJSTranslator : 0
+        };
+        if (spec.count < 1 || !Number.isInteger(spec.count) || spec.age < 0) {
+            throw 'Invalid compact logger: ' + this.sourceString;
+        }
+        return spec;
+    },
+    Window_spec: function(_1, _2, size, _3, slide, _4, histogram) {
+        var spec = {
+            size: size.jamJSTranslator,
+            slide: slide.numChildren > 0 ? slide.child(0).jamJSTranslator : size.jamJSTranslator
+        };
+        if (spec.size <= 0 || spec.slide <= 0 || spec.slide > spec.size || spec.size % spec.slide !== 0) {
+            throw 'Window slide should divide the window size: ' + this.sourceString;
+        }
+        if (histogram.numChildren > 0) {
+            spec.histogram = histogram.child(0).jamJSTranslator;
+        }
+        return spec;
+    },
+    Histogram_spec: function(_1, _2, min, _3, max, _4, bins, _5) {
+        if (max.jamJSTranslator <= min.jamJSTranslator || bins.jamJSTranslator < 1 || !Number.isInteger(bins.jamJSTranslator)) {
+            throw 'Invalid histogram: ' + this.sourceString;
+        }
+        return {
+            min: min.jamJSTranslator,
+            max: max.jamJSTranslator,
+            bins: bins.jamJSTranslator
+        };
+    },
+    Window_num: function(sign, num) {
+        return Number(this.sourceString.replace(/\s/g, ''));
+    },
     Jdata_spec_flow: function(node, _) {
         return node.jamJSTranslator;
     },
@@ -718,6 +813,13 @@ es5Translator.FunctionExpression_anonymous = function(_1, _2, params, _3, _4, bo
     return `function (${params.es5Translator}) {\n${body.es5Translator}}`;
 };
 
+// Struct jdata: the C side sends and reads values by schema (see jdata.js)
+function structSchema(id, type_spec) {
+    if (!(type_spec instanceof Object))
+        return '';
+    return `\n${id}.setSchema(${jdata.schemaId(type_spec)}, ${JSON.stringify(jdata.schemaFields(type_spec))});`;
+}
+
 function isUndefined(x) {
     return x === void 0;
 }
@@ -837,6 +939,67 @@ function mergeElements(x, y) {
 
 // End Additional support functions
 
+// Names declared by a top-level var statement
+function declaredNames(node, names) {
+    var list = node.child(1).child(0);
+    names.add(list.child(0).child(0).sourceString);
+    var rest = list.child(2);
+    for (var i = 0; i < rest.numChildren; i++)
+        names.add(rest.child(i).child(0).sourceString);
+}
+
+// Names declared by a jdata section (jdata objects and flows)
+function jdataNames(src, names) {
+    var re = /var\s+([A-Za-z_$][\w$]*)\s*=/g;
+    var m;
+    while ((m = re.exec(src)) !== null)
+        names.add(m[1]);
+    names.add('jman');
+}
+
+// Names of the entries of a jconditional
+function jcondNames(src, names) {
+    var re = /jworklib\.setjcond\('(?:[\w$]+\.)?([\w$]+)'/g;
+    var m;
+    while ((m = re.exec(src)) !== null)
+        names.add(m[1]);
+}
+
+function usesNames(src, names) {
+    var ids = String(src).match(/[A-Za-z_$][\w$]*/g) || [];
+    return ids.some((id) => names.has(id));
+}
+
+// JS activities that (directly or through a top-level function) use a
+// variable of the program's top level, a jdata object or a jconditional
+// on jdata. Only the worker running the program has these.. so these
+// activities are pinned to it. Any identifier with a matching name counts
+// (err on the safe side).
+function statefulActivities(topVars, topFuncs) {
+    var tainted = new Set(topVars);
+    var uses = function(src) {
+        return usesNames(src, tainted);
+    };
+
+    var changed = true;
+    while (changed) {
+        changed = false;
+        topFuncs.forEach(function(src, name) {
+            if (!tainted.has(name) && uses(src)) {
+                tainted.add(name);
+                changed = true;
+            }
+        });
+    }
+
+    var stateful = [];
+    symbolTable.activities.js.forEach(function(data, name) {
+        if (uses(data.block) || (data.jCond !== undefined && uses(data.jCond.source)))
+            stateful.push(name);
+    });
+    return stateful;
+}
+
 module.exports = {
     compile: function(input, jsport) {
         port = jsport;
@@ -16,6 +16,115 @@ function createCStruct(struct) {
     return result;
 }
 
+// Loggers (and shufflers) of simple types get a jamlogger_t handle
+function loggerType(value) {
+    if (value.jdata_type !== 'logger' && value.jdata_type !== 'shuffler')
+        return undefined;
+    if (value.type_spec instanceof Object)
+        return 'LOGGER_STRUCT';
+    switch (value.type_spec) {
+        case 'char':
+        case 'char*':
+            return 'LOGGER_STRING';
+        case 'int':
+            return 'LOGGER_INT';
+        case 'float':
+            return 'LOGGER_FLOAT';
+    }
+    return undefined;
+}
+
+// Leaf fields of a struct in declaration order, with the path from the top
+function structLeaves(entries, parent) {
+    var leaves = [];
+    for (var i = 0; i < entries.length; i++) {
+        var path = parent + entries[i].name;
+        if (entries[i].type instanceof Object) {
+            leaves = leaves.concat(structLeaves(entries[i].type.entries, path + '.'));
+        } else {
+            leaves.push({path: path, code: types.getCCode(entries[i].type)});
+        }
+    }
+    return leaves;
+}
+
+// Schema id sent in place of the field names. Both the C and the J sides
+// derive it from the layout (FNV-1a), so they agree without a registry.
+function schemaId(struct) {
+    var desc = struct.name + '{' + structLeaves(struct.entries, '').map(function(leaf) {
+        return leaf.path + ':' + leaf.code;
+    }).join(',') + '}';
+    var hash = 0x811c9dc5;
+    for (var i = 0; i < desc.length; i++) {
+        hash ^= desc.charCodeAt(i);
+        hash = Math.imul(hash, 0x01000193) >>> 0;
+    }
+    return hash;
+}
+
+var ctypes = { i: 'int', f: 'float', s: 'char *' };
+var putfuncs = { i: 'jamrecord_put_int', f: 'jamrecord_put_float', s: 'jamrecord_put_string' };
+var getfuncs = { i: 'jamreader_get_int', f: 'jamreader_get_float', s: 'jamreader_get_string' };
+
+// Encoder for struct loggers: one argument per leaf field
+function createStructEncoder(struct) {
+    var leaves = structLeaves(struct.entries, '');
+    var params = leaves.map(function(leaf, i) {
+        return `${ctypes[leaf.code]} f${i}`;
+    });
+    var maxlen = `${9 * leaves.length}`;
+    leaves.forEach(function(leaf, i) {
+        if (leaf.code === 's')
+            maxlen += ` + strlen(f${i})`;
+    });
+
+    var cout = `void jamenc_${struct.name}(jamlogger_t *jl, ${params.join(', ')}) {
+`;
+    cout += `jamrecord_t r;
+`;
+    cout += `jamrecord_begin(&r, jl, ${schemaId(struct)}u, ${leaves.length}, ${maxlen});
+`;
+    leaves.forEach(function(leaf, i) {
+        cout += `${putfuncs[leaf.code]}(&r, f${i});
+`;
+    });
+    cout += `jamrecord_end(&r);
+`;
+    cout += `}
+`;
+    return cout;
+}
+
+// Decoder for struct broadcasters.. falls back to jamdata_decode() if the
+// value is not in the schema format (e.g., a map from an older J node)
+function createStructDecoder(struct) {
+    var leaves = structLeaves(struct.entries, '');
+    var fmt = leaves.map(function(leaf) { return leaf.code; }).join('');
+    var offsets = leaves.map(function(leaf) {
+        return `offsetof(struct ${struct.name}, ${leaf.path})`;
+    });
+
+    var cout = `void *jamdec_${struct.name}(char *data, struct ${struct.name} *out) {
+`;
+    cout += `jamreader_t r;
+`;
+    cout += `if (!jamreader_open(&r, data, ${schemaId(struct)}u, ${leaves.length}))
+`;
+    cout += `return jamdata_decode("${fmt}", data, ${leaves.length}, out, ${offsets.join(', ')});
+`;
+    leaves.forEach(function(leaf) {
+        cout += `out->${leaf.path} = ${getfuncs[leaf.code]}(&r);
+`;
+    });
+    cout += `jamreader_close(&r);
+`;
+    cout += `return out;
+`;
+    cout += `}
+`;
+    return cout;
+}
+
 module.exports = {
     createCVariables: function(globals) {
         var cout = '';
@@ -26,21 +135,61 @@ module.exports = {
                 }
                 if (value.jdata_type === 'broadcaster') {
                     cout += `jambroadcaster_t *${key};\n`;
+                } else if (loggerType(value) !== undefined) {
+                    cout += `jamlogger_t *${key};\n`;
+                }
+            }
+        });
+        return cout;
+    },
+    createStructCodecs: function(globals) {
+        var cout = '';
+        var done = new Set();
+        globals.forEach(function(value, key, map) {
+            if (value.type === 'jdata' && value.type_spec instanceof Object) {
+                if (!done.has(value.type_spec.name)) {
+                    done.add(value.type_spec.name);
+                    cout += createStructEncoder(value.type_spec);
+                    cout += createStructDecoder(value.type_spec);
                 }
             }
         });
         return cout;
     },
+    createStructLog: function(id, struct, assignmentMap) {
+        var args = structLeaves(struct.entries, '').map(function(leaf) {
+            if (!assignmentMap.has(leaf.path))
+                throw 'Field ' + leaf.path + ' is not set';
+            return assignmentMap.get(leaf.path);
+        });
+        return `jamenc_${struct.name}(${id}, ${args.join(', ')});`;
+    },
+    createStructRead: function(id, bcast, struct) {
+        return `jamdec_${struct.name}(get_bcast_value(${bcast}), &${id});\n`;
+    },
+    schemaFields: function(struct) {
+        return structLeaves(struct.entries, '').map(function(leaf) { return leaf.path; });
+    },
+    schemaId: schemaId,
     linkCVariables: function(globals) {
         var cout = '';
         globals.forEach(function(value, key, map) {
             if (value.type === 'jdata') {
                 if (value.jdata_type === 'broadcaster') {
-                    // Check for struct
-                    if (value.type_spec instanceof Object) {
-                        cout += `${key} = jambroadcaster_init(BCAST_RETURNS_NEXT, "global.cbor", "${key}");\n`;
-                    } else {
-                        cout += `${key} = jambroadcaster_init(BCAST_RETURNS_NEXT, "global", "${key}");\n`;
+                    // Structs and scalars both use the compact CBOR values
+                    var mode = value.latest ? 'BCAST_RETURNS_LAST' : 'BCAST_RETURNS_NEXT';
+                    cout += `${key} = jambroadcaster_init(${mode}, "global.cbor", "${key}");\n`;
+                } else if (loggerType(value) !== undefined) {
+                    cout += `${key} = jamlogger_init("global", "${key}", ${loggerType(value)});\n`;
+                    if (value.window !== undefined) {
+                        cout += `jamlogger_set_window(${key}, ${value.window.size}, ${value.window.slide});\n`;
+                        if (value.window.histogram !== undefined) {
+                            var h = value.window.histogram;
+                            cout += `jamlogger_set_histogram(${key}, ${h.min}, ${h.max}, ${h.bins});\n`;
+                        }
+                    }
+                    if (value.compact !== undefined) {
+                        cout += `jamlogger_set_block(${key}, ${value.compact.count}, ${value.compact.age});\n`;
                     }
                 }
             }
@@ -51,12 +200,13 @@ module.exports = {
         if (type === "broadcaster") {
             throw 'Cannot declare broadcaster ' + id;
         } else if (type === "logger" || type === "shuffler" ) {
+            // The handle is set up in user_setup() (see linkCVariables)
             if (spec === "char" || spec === "char*") {
-                return `jamdata_log_to_server_string("${namespace}", "${id}", ${value});`;
+                return `jamlogger_log_string(${id}, ${value});`;
             } else if(spec === "int") {
-                return `jamdata_log_to_server_int("${namespace}", "${id}", ${value});`;
+                return `jamlogger_log_int(${id}, ${value});`;
             } else if(spec === "float") {
-                return `jamdata_log_to_server_float("${namespace}", "${id}", ${value});`;
+                return `jamlogger_log_float(${id}, ${value});`;
             } else {
                 throw "Unable to use " + type + " with type " + spec;
             }
@@ -84,27 +234,5 @@ module.exports = {
             }
         }
         return result;
-    },
-    createStructDecode: function(structName, elements, parent) {
-        var result = {
-            count: 0,
-            offsetArray: [],
-            formatString: ""
-        };
-
-        for (var i = 0; i < elements.length; i++) {
-            var currentElement = parent + elements[i].name;
-            if (elements[i].type instanceof Object) {
-                var recurseResult = this.createStructDecode(structName, elements[i].type.entries, currentElement + '.');
-                result.count += recurseResult.count;
-                result.offsetArray = result.offsetArray.concat(recurseResult.offsetArray);
-                result.formatString += recurseResult.formatString;
-            } else {
-                result.count++;
-                result.offsetArray.push(`offsetof(struct ${structName}, ${currentElement})`);
-                result.formatString += types.getCCode(elements[i].type);
-            }
-        }
-        return result;
     }
 };